@@ -323,7 +323,8 @@ set(TRY_GTKSPELL ON)
         ${GTKSPELL3_LIBRARIES}
     )
 
-find_package(Boost 1.19.0 REQUIRED)
+# 1.54 for boost::geometry::index::rtree
+find_package(Boost 1.54.0 REQUIRED)
 list(APPEND INKSCAPE_INCS_SYS ${Boost_INCLUDE_DIRS})
 # list(APPEND INKSCAPE_LIBS ${Boost_LIBRARIES})
 
@@ -33,6 +33,8 @@ import os
 import random
 import re
 import sys
+import traceback
+from cStringIO import StringIO
 from math import *
 
 # a dictionary of all of the xmlns prefixes in a standard inkscape doc
@@ -80,6 +82,29 @@ def localize():
     trans.install()
 
 
+# the version of the protocol Effect.serve() speaks
+WORKER_PROTOCOL = 1
+
+
+class WorkerOutput:
+    """Collects what an effect writes to stdout or stderr while it
+    handles a request as a worker"""
+
+    def __init__(self):
+        self.chunks = []
+
+    def write(self, data):
+        if isinstance(data, unicode):
+            data = data.encode("utf-8")
+        self.chunks.append(data)
+
+    def flush(self):
+        pass
+
+    def getvalue(self):
+        return ''.join(self.chunks)
+
+
 def debug(what):
     sys.stderr.write(str(what) + "\n")
     return what
@@ -147,6 +172,7 @@ class Effect:
 
     def __init__(self, *args, **kwargs):
         self.document = None
+        self.svg_stream = None
         self.original_document = None
         self.ctx = None
         self.selected = {}
@@ -184,6 +210,10 @@ class Effect:
                 errormsg(_("Unable to open specified file: %s") % filename)
                 sys.exit()
 
+        # Then the document a worker received
+        elif self.svg_stream is not None:
+            stream = self.svg_stream
+
         # If it wasn't specified, try to open the file specified as
         # an object member
         elif self.svg_file is not None:
@@ -273,7 +303,12 @@ class Effect:
 
     def affect(self, args=sys.argv[1:], output=True):
         """Affect an SVG document with a callback effect"""
-        self.svg_file = args[-1]
+        for arg in args:
+            if arg.startswith('--inkscape-worker='):
+                self.serve(arg[len('--inkscape-worker='):])
+                return
+        if self.svg_stream is None:
+            self.svg_file = args[-1]
         localize()
         self.getoptions(args)
         self.parse()
@@ -284,6 +319,67 @@ class Effect:
         if output:
             self.output()
 
+    def serve(self, version):
+        """Run as a worker for an extension which declares
+        <worker protocol="1"/> in its .inx: affect the documents Inkscape
+        sends on stdin, each with a new instance of the class, until
+        Inkscape closes the pipe.
+
+        A request is a line "A D" followed by A bytes of NUL terminated
+        arguments and D bytes of document; without a document the
+        arguments are those of the command line, file name included.  The
+        answer is a line "STATUS O E" followed by the O bytes the effect
+        wrote to stdout and the E bytes it wrote to stderr."""
+        if version != str(WORKER_PROTOCOL):
+            errormsg("Worker protocol %s is not supported" % version)
+            sys.exit(1)
+
+        stdin, stdout = sys.stdin, sys.stdout
+        if sys.platform.startswith('win'):
+            import msvcrt
+            msvcrt.setmode(stdin.fileno(), os.O_BINARY)
+            msvcrt.setmode(stdout.fileno(), os.O_BINARY)
+
+        while True:
+            header = stdin.readline()
+            if not header:
+                break
+            args_length, document_length = [int(size) for size in header.split()]
+            args = stdin.read(args_length).split('\0')[:-1]
+            document = stdin.read(document_length)
+
+            status, out, err = self.serve_request(args, document)
+            stdout.write('%d %d %d\n' % (status, len(out), len(err)))
+            stdout.write(out)
+            stdout.write(err)
+            stdout.flush()
+
+    def serve_request(self, args, document):
+        """Affect one document as a worker, returning the exit status and
+        what the effect wrote to stdout and stderr"""
+        effect = self.__class__()
+        if document:
+            effect.svg_stream = StringIO(document)
+
+        out, err = WorkerOutput(), WorkerOutput()
+        real_stdout, real_stderr = sys.stdout, sys.stderr
+        sys.stdout, sys.stderr = out, err
+        status = 0
+        try:
+            effect.affect(args)
+        except SystemExit as e:
+            if isinstance(e.code, int):
+                status = e.code
+            elif e.code is not None:
+                err.write(str(e.code) + "\n")
+                status = 1
+        except Exception:
+            traceback.print_exc()
+            status = 1
+        finally:
+            sys.stdout, sys.stderr = real_stdout, real_stderr
+        return status, out.getvalue(), err.getvalue()
+
     def uniqueId(self, old_id, make_new_id=True):
         new_id = old_id
         if make_new_id:
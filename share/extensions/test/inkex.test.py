@@ -14,7 +14,8 @@ import sys
 sys.path.append('..') # this line allows to import the extension code
 
 import unittest
-from inkex import errormsg
+from cStringIO import StringIO
+from inkex import errormsg, Effect
 
 class InkexBasicTest(unittest.TestCase):
 
@@ -32,7 +33,72 @@ class InkexBasicTest(unittest.TestCase):
         #Parse Àûïàèé (unicode)
         errormsg(u'Àûïàèé')
 
+class TitleEffect(Effect):
+    def __init__(self):
+        Effect.__init__(self)
+        self.OptionParser.add_option("--title",
+                        action="store", type="string", dest="title", default="")
+
+    def effect(self):
+        if not self.options.title:
+            raise ValueError("no title")
+        self.document.getroot().set('title', self.options.title)
+
+class InkexWorkerTest(unittest.TestCase):
+
+    def request(self, args, document):
+        arguments = ''.join(arg + '\0' for arg in args)
+        return '%d %d\n%s%s' % (len(arguments), len(document), arguments, document)
+
+    def serve(self, requests):
+        stdin, stdout = sys.stdin, sys.stdout
+        sys.stdin, sys.stdout = StringIO(''.join(requests)), StringIO()
+        try:
+            TitleEffect().serve('1')
+            return sys.stdout.getvalue()
+        finally:
+            sys.stdin, sys.stdout = stdin, stdout
+
+    def replies(self, output):
+        replies = []
+        while output:
+            header, output = output.split('\n', 1)
+            status, out_length, err_length = [int(size) for size in header.split()]
+            out = output[:out_length]
+            err = output[out_length:out_length + err_length]
+            output = output[out_length + err_length:]
+            replies.append((status, out, err))
+        return replies
+
+    def test_document(self):
+        document = open('minimal-blank.svg').read()
+        replies = self.replies(self.serve([self.request(['--title=one'], document)]))
+        self.assertEqual(len(replies), 1)
+        status, out, err = replies[0]
+        self.assertEqual(status, 0)
+        self.assertTrue('title="one"' in out)
+        self.assertEqual(err, '')
+
+    def test_file_argument(self):
+        replies = self.replies(self.serve([self.request(['--title=two', 'minimal-blank.svg'], '')]))
+        self.assertEqual(replies[0][0], 0)
+        self.assertTrue('title="two"' in replies[0][1])
+
+    def test_failure_keeps_serving(self):
+        document = open('minimal-blank.svg').read()
+        replies = self.replies(self.serve([self.request([], document),
+                                           self.request(['--title=three'], document)]))
+        self.assertEqual(len(replies), 2)
+        status, out, err = replies[0]
+        self.assertEqual(status, 1)
+        self.assertEqual(out, '')
+        self.assertTrue('no title' in err)
+        status, out, err = replies[1]
+        self.assertEqual(status, 0)
+        self.assertTrue('title="three"' in out)
+
 if __name__ == '__main__':
     #unittest.main()
-    suite = unittest.TestLoader().loadTestsFromTestCase(InkexBasicTest)
-    unittest.TextTestRunner(verbosity=2).run(suite)
+    for case in (InkexBasicTest, InkexWorkerTest):
+        suite = unittest.TestLoader().loadTestsFromTestCase(case)
+        unittest.TextTestRunner(verbosity=2).run(suite)
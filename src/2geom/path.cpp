@@ -575,6 +575,18 @@ std::vector<PathIntersection> Path::intersect(Path const &other, Coord precision
     return result;
 }
 
+std::vector<PathIntersection> Path::intersectSelf(Coord precision) const
+{
+    std::vector<PVIntersection> pvx = PathVector(*this).intersectSelf(precision);
+    std::vector<PathIntersection> result;
+    result.reserve(pvx.size());
+    for (std::size_t i = 0; i < pvx.size(); ++i) {
+        result.push_back(PathIntersection(pvx[i].first.asPathTime(), pvx[i].second.asPathTime(),
+                                          pvx[i].point()));
+    }
+    return result;
+}
+
 int Path::winding(Point const &p) const {
     int wind = 0;
 
@@ -135,94 +135,179 @@ void PathVector::snapEnds(Coord precision)
 }
 
 // sweepline optimization
-// this is very similar to CurveIntersectionSweepSet in path.cpp
-// should probably be merged
-class PathIntersectionSweepSet {
+// Sweeps over the curves of all paths at once, so that the cost depends on the number
+// of curves with overlapping bounds rather than on the number of overlapping paths.
+// This is very similar to CurveIntersectionSweepSet in path.cpp.
+class PathVectorSweepSet {
 public:
-    struct PathRecord {
+    struct CurveRecord {
         boost::intrusive::list_member_hook<> _hook;
+        Curve const *curve;
         Path const *path;
-        std::size_t index;
+        Rect bounds;
+        std::size_t path_index;
+        std::size_t curve_index;
         unsigned which;
 
-        PathRecord(Path const &p, std::size_t i, unsigned w)
-            : path(&p)
-            , index(i)
+        CurveRecord(Path const &p, std::size_t pi, std::size_t ci, unsigned w)
+            : curve(&p[ci])
+            , path(&p)
+            , bounds(curve->boundsFast())
+            , path_index(pi)
+            , curve_index(ci)
             , which(w)
         {}
+
+        PathVectorTime time(Coord t) const {
+            PathVectorTime ret(path_index, curve_index, t);
+            // only closed paths wrap around to the first curve
+            if (t >= 1 && (curve_index + 1 < path->size() || path->closed())) {
+                ret.normalizeForward(path->size());
+            }
+            return ret;
+        }
+        /// Check whether the final point of this curve is the initial point of other.
+        bool precedes(CurveRecord const &other) const {
+            if (path != other.path) return false;
+            return other.curve_index == curve_index + 1
+                || (path->closed() && curve_index + 1 == path->size() && other.curve_index == 0);
+        }
     };
 
-    typedef std::vector<PathRecord>::iterator ItemIterator;
+    typedef std::vector<CurveRecord>::const_iterator ItemIterator;
 
-    PathIntersectionSweepSet(std::vector<PVIntersection> &result,
-                             PathVector const &a, PathVector const &b, Coord precision)
+    /// Intersections between the curves of a and b.
+    PathVectorSweepSet(std::vector<PVIntersection> &result,
+                       PathVector const &a, PathVector const &b, Coord precision)
         : _result(result)
         , _precision(precision)
+        , _self(false)
     {
-        _records.reserve(a.size() + b.size());
-        for (std::size_t i = 0; i < a.size(); ++i) {
-            _records.push_back(PathRecord(a[i], i, 0));
-        }
-        for (std::size_t i = 0; i < b.size(); ++i) {
-            _records.push_back(PathRecord(b[i], i, 1));
-        }
+        _records.reserve(a.curveCount() + b.curveCount());
+        _addRecords(a, 0);
+        _addRecords(b, 1);
+        _setSweepDirection(a.boundsFast() | b.boundsFast());
     }
 
-    std::vector<PathRecord> &items() { return _records; }
+    /// Intersections among all curves of pv, including self-intersections of single curves.
+    PathVectorSweepSet(std::vector<PVIntersection> &result, PathVector const &pv, Coord precision)
+        : _result(result)
+        , _precision(precision)
+        , _self(true)
+    {
+        _records.reserve(pv.curveCount());
+        _addRecords(pv, 0);
+        _setSweepDirection(pv.boundsFast());
+    }
 
+    std::vector<CurveRecord> const &items() { return _records; }
     Interval itemBounds(ItemIterator ii) {
-        OptRect r = ii->path->boundsFast();
-        return (*r)[X];
+        return ii->bounds[_sweep_dir];
     }
 
     void addActiveItem(ItemIterator ii) {
-        unsigned w = ii->which;
-        unsigned ow = (ii->which + 1) % 2;
-
-        for (ActivePathList::iterator i = _active[ow].begin(); i != _active[ow].end(); ++i) {
-            if (!ii->path->boundsFast().intersects(i->path->boundsFast())) continue;
-            std::vector<PathIntersection> px = ii->path->intersect(*i->path, _precision);
-            for (std::size_t k = 0; k < px.size(); ++k) {
-                PathVectorTime tw(ii->index, px[k].first), tow(i->index, px[k].second);
+        CurveRecord &rec = const_cast<CurveRecord&>(*ii);
+        unsigned w = rec.which;
+        unsigned ow = _self ? w : (w+1) % 2;
+
+        if (_self && !rec.curve->isLineSegment()) {
+            std::vector<CurveIntersection> cx = rec.curve->intersectSelf(_precision);
+            for (std::size_t k = 0; k < cx.size(); ++k) {
+                _result.push_back(PVIntersection(rec.time(cx[k].first), rec.time(cx[k].second),
+                                                 cx[k].point()));
+            }
+        }
+
+        for (ActiveCurveList::iterator i = _active[ow].begin(); i != _active[ow].end(); ++i) {
+            if (!rec.bounds.intersects(i->bounds)) continue;
+            std::vector<CurveIntersection> cx = rec.curve->intersect(*i->curve, _precision);
+            // neighbouring curves of a path always meet at their common node; the two
+            // curves of a closed path with two segments share both of their nodes
+            bool before = _self && rec.precedes(*i);
+            bool after = _self && i->precedes(rec);
+            for (std::size_t k = 0; k < cx.size(); ++k) {
+                if (before && are_near(cx[k].point(), rec.curve->finalPoint(), _precision)) continue;
+                if (after && are_near(cx[k].point(), rec.curve->initialPoint(), _precision)) continue;
+                PathVectorTime tw = rec.time(cx[k].first), tow = i->time(cx[k].second);
                 _result.push_back(PVIntersection(
                     w == 0 ? tw : tow,
                     w == 0 ? tow : tw,
-                    px[k].point()));
+                    cx[k].point()));
             }
         }
-        _active[w].push_back(*ii);
+        _active[w].push_back(rec);
     }
 
     void removeActiveItem(ItemIterator ii) {
-        ActivePathList &apl = _active[ii->which];
-        apl.erase(apl.iterator_to(*ii));
+        ActiveCurveList &acl = _active[ii->which];
+        acl.erase(acl.iterator_to(*ii));
     }
 
 private:
+    void _addRecords(PathVector const &pv, unsigned w) {
+        for (std::size_t i = 0; i < pv.size(); ++i) {
+            for (std::size_t j = 0; j < pv[i].size(); ++j) {
+                _records.push_back(CurveRecord(pv[i], i, j, w));
+            }
+        }
+    }
+    void _setSweepDirection(OptRect const &bounds) {
+        _sweep_dir = X;
+        if (bounds && bounds->height() > bounds->width()) {
+            _sweep_dir = Y;
+        }
+    }
+
     typedef boost::intrusive::list
-        < PathRecord
+        < CurveRecord
         , boost::intrusive::member_hook
-            < PathRecord
+            < CurveRecord
             , boost::intrusive::list_member_hook<>
-            , &PathRecord::_hook
+            , &CurveRecord::_hook
             >
-        > ActivePathList;
+        > ActiveCurveList;
 
     std::vector<PVIntersection> &_result;
-    std::vector<PathRecord> _records;
-    ActivePathList _active[2];
+    std::vector<CurveRecord> _records;
+    ActiveCurveList _active[2];
     Coord _precision;
+    Dim2 _sweep_dir;
+    bool _self;
 };
 
 std::vector<PVIntersection> PathVector::intersect(PathVector const &other, Coord precision) const
 {
     std::vector<PVIntersection> result;
 
-    PathIntersectionSweepSet pisset(result, *this, other, precision);
-    Sweeper<PathIntersectionSweepSet> sweeper(pisset);
+    PathVectorSweepSet pvsset(result, *this, other, precision);
+    Sweeper<PathVectorSweepSet> sweeper(pvsset);
     sweeper.process();
 
+    // intersections at nodes are found on both adjoining curves
+    std::sort(result.begin(), result.end());
+    result.erase(std::unique(result.begin(), result.end()), result.end());
+
+    return result;
+}
+
+/** @brief Compute the intersections of the paths with each other and with themselves.
+ * Intersections at the common node of two neighbouring curves of a path are not reported.
+ * In each of the returned intersections, the first time is smaller than the second. */
+std::vector<PVIntersection> PathVector::intersectSelf(Coord precision) const
+{
+    std::vector<PVIntersection> result;
+
+    PathVectorSweepSet pvsset(result, *this, precision);
+    Sweeper<PathVectorSweepSet> sweeper(pvsset);
+    sweeper.process();
+
+    for (std::size_t i = 0; i < result.size(); ++i) {
+        if (result[i].second < result[i].first) {
+            std::swap(result[i].first, result[i].second);
+        }
+    }
     std::sort(result.begin(), result.end());
+    result.erase(std::unique(result.begin(), result.end()), result.end());
 
     return result;
 }
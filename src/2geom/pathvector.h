@@ -264,6 +264,7 @@ public:
     void snapEnds(Coord precision = EPSILON);
 
     std::vector<PVIntersection> intersect(PathVector const &other, Coord precision = EPSILON) const;
+    std::vector<PVIntersection> intersectSelf(Coord precision = EPSILON) const;
 
     /** @brief Determine the winding number at the specified point.
      * This is simply the sum of winding numbers for constituent paths. */
@@ -31,6 +31,34 @@ static const int OPENMP_THRESHOLD = 2048;
 #include "display/nr-3dutils.h"
 #include "display/cairo-utils.h"
 
+// number of pixels passed to a span function at once by the contiguous loops below
+static const int INK_CAIRO_SPAN_LENGTH = 1024;
+
+/**
+ * Blend a run of ARGB32 pixels using the supplied functor.
+ * Functors with vectorised kernels provide an overload of this function for their own
+ * type, which is found by argument dependent lookup.
+ */
+template <typename Blend>
+inline void ink_cairo_blend_span(Blend &blend, guint32 const *in1, guint32 const *in2, guint32 *out, int n)
+{
+    for (int i = 0; i < n; ++i) {
+        out[i] = blend(in1[i], in2[i]);
+    }
+}
+
+/**
+ * Filter a run of ARGB32 pixels using the supplied functor. See ink_cairo_blend_span().
+ * The input and output may be the same buffer.
+ */
+template <typename Filter>
+inline void ink_cairo_filter_span(Filter &filter, guint32 const *in, guint32 *out, int n)
+{
+    for (int i = 0; i < n; ++i) {
+        out[i] = filter(in[i]);
+    }
+}
+
 /**
  * Blend two surfaces using the supplied functor.
  * This template blends two Cairo image surfaces using a blending functor that takes
@@ -84,24 +112,22 @@ void ink_cairo_surface_blend(cairo_surface_t *in1, cairo_surface_t *in2, cairo_s
     if (bpp1 == 4) {
         if (bpp2 == 4) {
             if (fast_path) {
+                int spans = (limit + INK_CAIRO_SPAN_LENGTH - 1) / INK_CAIRO_SPAN_LENGTH;
                 #if HAVE_OPENMP
                 #pragma omp parallel for if(limit > OPENMP_THRESHOLD) num_threads(numOfThreads)
                 #endif
-                for (int i = 0; i < limit; ++i) {
-                    *(out_data + i) = blend(*(in1_data + i), *(in2_data + i));
+                for (int i = 0; i < spans; ++i) {
+                    int start = i * INK_CAIRO_SPAN_LENGTH;
+                    ink_cairo_blend_span(blend, in1_data + start, in2_data + start, out_data + start,
+                                         std::min(INK_CAIRO_SPAN_LENGTH, limit - start));
                 }
             } else {
                 #if HAVE_OPENMP
                 #pragma omp parallel for if(limit > OPENMP_THRESHOLD) num_threads(numOfThreads)
                 #endif
                 for (int i = 0; i < h; ++i) {
-                    guint32 *in1_p = in1_data + i * stride1/4;
-                    guint32 *in2_p = in2_data + i * stride2/4;
-                    guint32 *out_p = out_data + i * strideout/4;
-                    for (int j = 0; j < w; ++j) {
-                        *out_p = blend(*in1_p, *in2_p);
-                        ++in1_p; ++in2_p; ++out_p;
-                    }
+                    ink_cairo_blend_span(blend, in1_data + i * stride1/4, in2_data + i * stride2/4,
+                                         out_data + i * strideout/4, w);
                 }
             }
         } else {
@@ -212,11 +238,14 @@ void ink_cairo_surface_filter(cairo_surface_t *in, cairo_surface_t *out, Filter
     // this is provided just in case, to avoid problems with strict aliasing rules
     if (in == out) {
         if (bppin == 4) {
+            int spans = (limit + INK_CAIRO_SPAN_LENGTH - 1) / INK_CAIRO_SPAN_LENGTH;
             #if HAVE_OPENMP
             #pragma omp parallel for if(limit > OPENMP_THRESHOLD) num_threads(numOfThreads)
             #endif
-            for (int i = 0; i < limit; ++i) {
-                *(in_data + i) = filter(*(in_data + i));
+            for (int i = 0; i < spans; ++i) {
+                int start = i * INK_CAIRO_SPAN_LENGTH;
+                ink_cairo_filter_span(filter, in_data + start, in_data + start,
+                                      std::min(INK_CAIRO_SPAN_LENGTH, limit - start));
             }
         } else {
             #if HAVE_OPENMP
@@ -237,23 +266,21 @@ void ink_cairo_surface_filter(cairo_surface_t *in, cairo_surface_t *out, Filter
         if (bppout == 4) {
             // bppin == 4, bppout == 4
             if (fast_path) {
+                int spans = (limit + INK_CAIRO_SPAN_LENGTH - 1) / INK_CAIRO_SPAN_LENGTH;
                 #if HAVE_OPENMP
                 #pragma omp parallel for if(limit > OPENMP_THRESHOLD) num_threads(numOfThreads)
                 #endif
-                for (int i = 0; i < limit; ++i) {
-                    *(out_data + i) = filter(*(in_data + i));
+                for (int i = 0; i < spans; ++i) {
+                    int start = i * INK_CAIRO_SPAN_LENGTH;
+                    ink_cairo_filter_span(filter, in_data + start, out_data + start,
+                                          std::min(INK_CAIRO_SPAN_LENGTH, limit - start));
                 }
             } else {
                 #if HAVE_OPENMP
                 #pragma omp parallel for if(limit > OPENMP_THRESHOLD) num_threads(numOfThreads)
                 #endif
                 for (int i = 0; i < h; ++i) {
-                    guint32 *in_p = in_data + i * stridein/4;
-                    guint32 *out_p = out_data + i * strideout/4;
-                    for (int j = 0; j < w; ++j) {
-                        *out_p = filter(*in_p);
-                        ++in_p; ++out_p;
-                    }
+                    ink_cairo_filter_span(filter, in_data + i * stridein/4, out_data + i * strideout/4, w);
                 }
             }
         } else {
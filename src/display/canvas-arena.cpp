@@ -11,12 +11,16 @@
  * Released under GNU GPL, read the file 'COPYING' for more information
  */
 
+#include <algorithm>
+#include <deque>
+#include <vector>
 #include <gtkmm.h>
 
 #include "display/sp-canvas-util.h"
 #include "helper/sp-marshal.h"
 #include "display/canvas-arena.h"
 #include "display/cairo-utils.h"
+#include "display/canvas-tile-cache.h"
 #include "display/drawing-context.h"
 #include "display/drawing-item.h"
 #include "display/drawing-group.h"
@@ -43,6 +47,8 @@ static gint sp_canvas_arena_send_event (SPCanvasArena *arena, GdkEvent *event);
 
 static void sp_canvas_arena_request_update (SPCanvasArena *ca, DrawingItem *item);
 static void sp_canvas_arena_request_render (SPCanvasArena *ca, Geom::IntRect const &area);
+static void sp_canvas_arena_appearance_changed (SPCanvasArena *ca, Geom::IntRect const &area, bool scales);
+static unsigned sp_canvas_arena_render_key (SPCanvasArena *arena);
 
 static guint signals[LAST_SIGNAL] = {0};
 
@@ -62,6 +68,401 @@ struct CachePrefObserver : public Inkscape::Preferences::Observer {
         Glib::ustring name = v.getEntryName();
         if (name == "size") {
             _arena->drawing.setCacheBudget((1 << 20) * v.getIntLimited(64, 0, 4096));
+        } else if (name == "filtersize") {
+            _arena->drawing.setFilterCacheBudget((1 << 20) * v.getIntLimited(32, 0, 4096));
+        } else if (name == "glyphs") {
+            _arena->drawing.setGlyphCacheBudget((1 << 20) * v.getIntLimited(4, 0, 4096));
+        } else if (name == "tiles") {
+            _arena->tiles->setBudget((1 << 20) * v.getIntLimited(32, 0, 4096));
+        }
+    }
+    SPCanvasArena *_arena;
+};
+
+/**
+ * Renders the drawing of a canvas arena on a background thread.
+ *
+ * A Drawing cannot be rendered by several threads at once, so there is a single
+ * worker per arena, and it is stopped through Drawing::signal_before_change
+ * whenever the drawing is about to be modified. The worker renders dirty tiles
+ * of the tile cache grid into separate surfaces, which are stored in the tile cache
+ * and copied into a frame covering the visible area on the main thread. Until a tile arrives, the canvas shows the previous
+ * contents of the frame, transformed to the current zoom.
+ *
+ * The worker never reads the document, which the main thread modifies in place:
+ * the parts of rendering which do, like creating the patterns of paint servers,
+ * are done before a tile is queued, and tiles showing items which read the
+ * document whenever they are rendered (filters with feImage) are rendered on
+ * the main thread while the worker is held. Neither does it read the preferences;
+ * the drawing reads the ones it renders with in Drawing::update().
+ */
+class ArenaRenderer {
+public:
+    ArenaRenderer(SPCanvasArena *arena);
+    ~ArenaRenderer();
+
+    void render(SPCanvasBuf *buf);
+    void stop();
+    void setArea(Geom::IntRect const &area);
+    void transform(Geom::Affine const &old_ctm, Geom::Affine const &new_ctm);
+    void invalidate(Geom::IntRect const &area);
+
+private:
+    struct Tile {
+        Geom::IntRect area;
+        cairo_surface_t *surface;
+    };
+    void _run();
+    void _collect();
+    void _paintTile(Geom::IntRect const &area, cairo_surface_t *tile);
+    void _clipValid();
+    static gboolean _deliver(gpointer data);
+
+    SPCanvasArena *_arena;
+    Glib::Threads::Thread *_thread;
+    sigc::connection _before_change;
+
+    // shared with the worker, guarded by _mutex
+    Glib::Threads::Mutex _mutex;
+    Glib::Threads::Cond _cond;
+    std::deque<Geom::IntRect> _queue;
+    std::vector<Tile> _finished;
+    bool _busy;
+    bool _held; ///< the main thread is rendering; the worker must not start a tile
+    bool _quit;
+    guint _idle_id;
+
+    // main thread only
+    cairo_surface_t *_frame;
+    Geom::IntRect _frame_area;
+    cairo_region_t *_valid;   ///< areas of the frame which show the current drawing
+    cairo_region_t *_pending; ///< areas queued for the worker
+};
+
+ArenaRenderer::ArenaRenderer(SPCanvasArena *arena)
+    : _arena(arena)
+    , _thread(NULL)
+    , _busy(false)
+    , _held(false)
+    , _quit(false)
+    , _idle_id(0)
+    , _frame(NULL)
+    , _valid(cairo_region_create())
+    , _pending(cairo_region_create())
+{
+    _before_change = arena->drawing.signal_before_change.connect(
+        sigc::mem_fun(*this, &ArenaRenderer::stop));
+    try {
+        _thread = Glib::Threads::Thread::create(sigc::mem_fun(*this, &ArenaRenderer::_run));
+    } catch (Glib::Threads::ThreadError const &e) {
+        g_warning("Could not start the canvas render thread: %s", e.what().c_str());
+        _thread = NULL;
+    }
+}
+
+ArenaRenderer::~ArenaRenderer()
+{
+    _before_change.disconnect();
+    if (_thread) {
+        {
+            Glib::Threads::Mutex::Lock lock(_mutex);
+            _quit = true;
+            _queue.clear();
+            _cond.broadcast();
+        }
+        _thread->join();
+    }
+    if (_idle_id) {
+        g_source_remove(_idle_id);
+    }
+    for (unsigned i = 0; i < _finished.size(); ++i) {
+        cairo_surface_destroy(_finished[i].surface);
+    }
+    if (_frame) {
+        cairo_surface_destroy(_frame);
+    }
+    cairo_region_destroy(_valid);
+    cairo_region_destroy(_pending);
+}
+
+/**
+ * Paints the current frame into the buffer and queues the parts of it
+ * which are out of date. Called on the main thread.
+ */
+void ArenaRenderer::render(SPCanvasBuf *buf)
+{
+    Geom::IntRect r = buf->rect;
+
+    _arena->drawing.update(Geom::IntRect::infinite(), _arena->ctx);
+
+    if (!_frame) {
+        setArea(buf->canvas_rect);
+    }
+    if (!_thread || !_frame_area.contains(r)) {
+        stop();
+        Inkscape::DrawingContext dc(buf->ct, r.min());
+        _arena->drawing.render(dc, r);
+        return;
+    }
+
+    cairo_rectangle_int_t crect = { r.left(), r.top(), r.width(), r.height() };
+    cairo_region_t *missing = cairo_region_create_rectangle(&crect);
+    cairo_region_subtract(missing, _valid);
+    cairo_region_subtract(missing, _pending);
+
+    if (!cairo_region_is_empty(missing)) {
+        // take the tiles which were rendered before from the cache, queue the rest
+        std::vector<Geom::IntRect> main_thread_tiles;
+        cairo_rectangle_int_t ext;
+        cairo_region_get_extents(missing, &ext);
+        Glib::Threads::Mutex::Lock lock(_mutex);
+        for (int ty = CanvasTileCache::tileIndex(ext.y); ty <= CanvasTileCache::tileIndex(ext.y + ext.height - 1); ++ty) {
+            for (int tx = CanvasTileCache::tileIndex(ext.x); tx <= CanvasTileCache::tileIndex(ext.x + ext.width - 1); ++tx) {
+                Geom::IntRect area = CanvasTileCache::tileArea(tx, ty);
+                cairo_rectangle_int_t trect = { area.left(), area.top(), area.width(), area.height() };
+                if (cairo_region_contains_rectangle(missing, &trect) == CAIRO_REGION_OVERLAP_OUT) continue;
+
+                cairo_surface_t *tile = _arena->tiles->lookup(tx, ty);
+                if (tile) {
+                    _paintTile(area, tile);
+                    cairo_region_union_rectangle(_valid, &trect);
+                } else if (_arena->drawing.prepareRender(area)) {
+                    _queue.push_back(area);
+                    cairo_region_union_rectangle(_pending, &trect);
+                } else {
+                    main_thread_tiles.push_back(area);
+                }
+            }
+        }
+
+        if (!main_thread_tiles.empty()) {
+            _held = true;
+            while (_busy) {
+                _cond.wait(_mutex);
+            }
+            // rendering may update the document, which stops the worker and so takes the lock
+            lock.release();
+            for (unsigned i = 0; i < main_thread_tiles.size(); ++i) {
+                Geom::IntRect const &area = main_thread_tiles[i];
+                cairo_surface_t *tile = cairo_image_surface_create(CAIRO_FORMAT_ARGB32, area.width(), area.height());
+                Inkscape::DrawingContext dc(tile, area.min());
+                _arena->drawing.render(dc, area);
+                _paintTile(area, tile);
+                _arena->tiles->insert(CanvasTileCache::tileIndex(area.left()), CanvasTileCache::tileIndex(area.top()),
+                                      tile);
+                cairo_surface_destroy(tile);
+
+                cairo_rectangle_int_t trect = { area.left(), area.top(), area.width(), area.height() };
+                cairo_region_union_rectangle(_valid, &trect);
+            }
+            lock.acquire();
+            _held = false;
+        }
+        _cond.broadcast();
+        _clipValid();
+    }
+    cairo_region_destroy(missing);
+
+    cairo_save(buf->ct);
+    cairo_rectangle(buf->ct, 0, 0, r.width(), r.height());
+    cairo_clip(buf->ct);
+    cairo_set_source_surface(buf->ct, _frame, _frame_area.left() - r.left(), _frame_area.top() - r.top());
+    cairo_paint(buf->ct);
+    cairo_restore(buf->ct);
+}
+
+/**
+ * Cancels the queued tiles and waits until the worker is idle.
+ * Does nothing when called from the worker itself, which cannot wait for itself.
+ */
+void ArenaRenderer::stop()
+{
+    if (!_thread || Glib::Threads::Thread::self() == _thread) return;
+
+    {
+        Glib::Threads::Mutex::Lock lock(_mutex);
+        _queue.clear();
+        while (_busy) {
+            _cond.wait(_mutex);
+        }
+    }
+    _collect();
+
+    // the canvas believes the cancelled areas are up to date; ask it to paint them again
+    SPCanvas *canvas = SP_CANVAS_ITEM(_arena)->canvas;
+    int n = cairo_region_num_rectangles(_pending);
+    for (int i = 0; i < n; ++i) {
+        cairo_rectangle_int_t m;
+        cairo_region_get_rectangle(_pending, i, &m);
+        canvas->requestRedraw(m.x, m.y, m.x + m.width, m.y + m.height);
+    }
+    cairo_region_destroy(_pending);
+    _pending = cairo_region_create();
+}
+
+/**
+ * Moves the frame to a new visible area, keeping the contents of the overlap.
+ */
+void ArenaRenderer::setArea(Geom::IntRect const &area)
+{
+    if (_frame && area == _frame_area) return;
+    stop();
+
+    cairo_surface_t *frame = cairo_image_surface_create(CAIRO_FORMAT_ARGB32, area.width(), area.height());
+    if (_frame) {
+        cairo_t *ct = cairo_create(frame);
+        cairo_set_source_surface(ct, _frame, _frame_area.left() - area.left(), _frame_area.top() - area.top());
+        cairo_paint(ct);
+        cairo_destroy(ct);
+        cairo_surface_destroy(_frame);
+    }
+    _frame = frame;
+    _frame_area = area;
+    _clipValid();
+}
+
+/**
+ * Transforms the frame after the canvas transform has changed. The result is
+ * only a preview, so all of it is marked as out of date.
+ */
+void ArenaRenderer::transform(Geom::Affine const &old_ctm, Geom::Affine const &new_ctm)
+{
+    if (!_frame || old_ctm.isSingular()) return;
+    stop();
+
+    cairo_surface_t *frame = ink_cairo_surface_create_identical(_frame);
+    cairo_t *ct = cairo_create(frame);
+    cairo_translate(ct, -_frame_area.left(), -_frame_area.top());
+    ink_cairo_transform(ct, old_ctm.inverse() * new_ctm);
+    cairo_set_source_surface(ct, _frame, _frame_area.left(), _frame_area.top());
+    cairo_paint(ct);
+    cairo_destroy(ct);
+    cairo_surface_destroy(_frame);
+    _frame = frame;
+
+    cairo_region_destroy(_valid);
+    _valid = cairo_region_create();
+}
+
+/// Marks an area of the frame as out of date.
+void ArenaRenderer::invalidate(Geom::IntRect const &area)
+{
+    cairo_rectangle_int_t crect = { area.left(), area.top(), area.width(), area.height() };
+    cairo_region_t *reg = cairo_region_create_rectangle(&crect);
+    cairo_region_subtract(_valid, reg);
+    cairo_region_destroy(reg);
+}
+
+/// Worker thread main loop.
+void ArenaRenderer::_run()
+{
+    Glib::Threads::Mutex::Lock lock(_mutex);
+    while (true) {
+        while (!_quit && (_queue.empty() || _held)) {
+            _cond.wait(_mutex);
+        }
+        if (_quit) break;
+
+        Geom::IntRect area = _queue.front();
+        _queue.pop_front();
+        _busy = true;
+        lock.release();
+
+        cairo_surface_t *s = cairo_image_surface_create(CAIRO_FORMAT_ARGB32, area.width(), area.height());
+        Inkscape::DrawingContext dc(s, area.min());
+        _arena->drawing.render(dc, area);
+
+        lock.acquire();
+        Tile tile = { area, s };
+        _finished.push_back(tile);
+        _busy = false;
+        if (!_idle_id) {
+            _idle_id = g_idle_add(&ArenaRenderer::_deliver, this);
+        }
+        _cond.broadcast();
+    }
+}
+
+/// Copies the finished tiles into the frame and asks the canvas to show them.
+void ArenaRenderer::_collect()
+{
+    std::vector<Tile> finished;
+    {
+        Glib::Threads::Mutex::Lock lock(_mutex);
+        finished.swap(_finished);
+    }
+
+    SPCanvas *canvas = SP_CANVAS_ITEM(_arena)->canvas;
+    for (unsigned i = 0; i < finished.size(); ++i) {
+        Geom::IntRect const &area = finished[i].area;
+        _paintTile(area, finished[i].surface);
+        _arena->tiles->insert(CanvasTileCache::tileIndex(area.left()), CanvasTileCache::tileIndex(area.top()),
+                              finished[i].surface);
+        cairo_surface_destroy(finished[i].surface);
+
+        cairo_rectangle_int_t crect = { area.left(), area.top(), area.width(), area.height() };
+        cairo_region_union_rectangle(_valid, &crect);
+        cairo_region_t *reg = cairo_region_create_rectangle(&crect);
+        cairo_region_subtract(_pending, reg);
+        cairo_region_destroy(reg);
+        canvas->requestRedraw(area.left(), area.top(), area.right(), area.bottom());
+    }
+    _clipValid();
+}
+
+/// Tiles may extend past the frame; only the part inside of it is valid.
+void ArenaRenderer::_clipValid()
+{
+    cairo_rectangle_int_t crect = { _frame_area.left(), _frame_area.top(),
+                                    _frame_area.width(), _frame_area.height() };
+    cairo_region_intersect_rectangle(_valid, &crect);
+}
+
+/// Copies a rendered tile into the frame.
+void ArenaRenderer::_paintTile(Geom::IntRect const &area, cairo_surface_t *tile)
+{
+    if (!_frame) return;
+    cairo_t *ct = cairo_create(_frame);
+    cairo_translate(ct, -_frame_area.left(), -_frame_area.top());
+    cairo_rectangle(ct, area.left(), area.top(), area.width(), area.height());
+    cairo_set_source_surface(ct, tile, area.left(), area.top());
+    cairo_set_operator(ct, CAIRO_OPERATOR_SOURCE);
+    cairo_fill(ct);
+    cairo_destroy(ct);
+}
+
+gboolean ArenaRenderer::_deliver(gpointer data)
+{
+    ArenaRenderer *renderer = reinterpret_cast<ArenaRenderer *>(data);
+    {
+        Glib::Threads::Mutex::Lock lock(renderer->_mutex);
+        renderer->_idle_id = 0;
+    }
+    renderer->_collect();
+    return FALSE;
+}
+
+struct RenderPrefObserver : public Inkscape::Preferences::Observer {
+    RenderPrefObserver(SPCanvasArena *arena)
+        : Inkscape::Preferences::Observer("/options/rendering/background")
+        , _arena(arena)
+    {
+        Inkscape::Preferences *prefs = Inkscape::Preferences::get();
+        notify(prefs->getEntry(observed_path));
+        prefs->addObserver(*this);
+    }
+    void notify(Preferences::Entry const &v) {
+        if (v.getBool(false) && !_arena->renderer) {
+            _arena->renderer = new ArenaRenderer(_arena);
+        } else if (!v.getBool(false) && _arena->renderer) {
+            delete _arena->renderer;
+            _arena->renderer = NULL;
+            // parts of the canvas may still show an out of date frame
+            SPCanvas *canvas = SP_CANVAS_ITEM(_arena)->canvas;
+            if (canvas) {
+                Geom::IntRect area = canvas->getViewboxIntegers();
+                canvas->requestRedraw(area.left(), area.top(), area.right(), area.bottom());
+            }
         }
     }
     SPCanvasArena *_arena;
@@ -101,7 +502,11 @@ sp_canvas_arena_init (SPCanvasArena *arena)
     root->setPickChildren(true);
     arena->drawing.setRoot(root);
 
+    arena->tiles = new CanvasTileCache();
+    arena->changed = cairo_region_create();
     arena->observer = new CachePrefObserver(arena);
+    arena->renderer = NULL;
+    arena->render_observer = new RenderPrefObserver(arena);
 
     arena->drawing.signal_request_update.connect(
         sigc::bind<0>(
@@ -111,6 +516,10 @@ sp_canvas_arena_init (SPCanvasArena *arena)
         sigc::bind<0>(
             sigc::ptr_fun(&sp_canvas_arena_request_render),
             arena));
+    arena->drawing.signal_appearance_changed.connect(
+        sigc::bind<0>(
+            sigc::ptr_fun(&sp_canvas_arena_appearance_changed),
+            arena));
     arena->drawing.signal_item_deleted.connect(
         sigc::bind<0>(
             sigc::ptr_fun(&sp_canvas_arena_item_deleted),
@@ -124,6 +533,10 @@ static void sp_canvas_arena_destroy(SPCanvasItem *object)
     SPCanvasArena *arena = SP_CANVAS_ARENA(object);
 
     delete arena->observer;
+    delete arena->render_observer;
+    delete arena->renderer;
+    delete arena->tiles;
+    cairo_region_destroy(arena->changed);
     arena->drawing.~Drawing();
 
     if (SP_CANVAS_ITEM_CLASS(sp_canvas_arena_parent_class)->destroy)
@@ -138,7 +551,17 @@ sp_canvas_arena_update (SPCanvasItem *item, Geom::Affine const &affine, unsigned
     if (SP_CANVAS_ITEM_CLASS(sp_canvas_arena_parent_class)->update)
         SP_CANVAS_ITEM_CLASS(sp_canvas_arena_parent_class)->update(item, affine, flags);
 
+    if (arena->renderer && (flags & SP_CANVAS_UPDATE_AFFINE) && affine != arena->ctx.ctm) {
+        arena->renderer->transform(arena->ctx.ctm, affine);
+    }
+    if ((flags & SP_CANVAS_UPDATE_AFFINE) && affine != arena->ctx.ctm) {
+        // the whole canvas is painted again, which is what the tiles are for
+        cairo_region_destroy(arena->changed);
+        arena->changed = cairo_region_create();
+    }
     arena->ctx.ctm = affine;
+    arena->tiles->setTransform(affine);
+    arena->tiles->setRenderKey(sp_canvas_arena_render_key(arena));
 
     unsigned reset = flags & SP_CANVAS_UPDATE_AFFINE ? DrawingItem::STATE_ALL : 0;
     arena->drawing.update(Geom::IntRect::infinite(), arena->ctx, DrawingItem::STATE_ALL, reset);
@@ -193,10 +616,43 @@ sp_canvas_arena_render (SPCanvasItem *item, SPCanvasBuf *buf)
     Geom::OptIntRect r = buf->rect;
     if (!r || r->hasZeroArea()) return;
 
-    Inkscape::DrawingContext dc(buf->ct, r->min());
+    cairo_rectangle_int_t crect = { r->left(), r->top(), r->width(), r->height() };
+    bool changed = cairo_region_contains_rectangle(arena->changed, &crect) != CAIRO_REGION_OVERLAP_OUT;
+    cairo_region_subtract_rectangle(arena->changed, &crect);
+
+    if (arena->renderer) {
+        arena->renderer->render(buf);
+        return;
+    }
 
     arena->drawing.update(Geom::IntRect::infinite(), arena->ctx);
-    arena->drawing.render(dc, *r);
+
+    if (arena->tiles->budget() == 0 || changed) {
+        // Areas painted again after an edit are small and rarely shown again as they
+        // are, so rendering whole tiles for them would be wasted.
+        Inkscape::DrawingContext dc(buf->ct, r->min());
+        arena->drawing.render(dc, *r);
+        return;
+    }
+
+    // render whole tiles and keep them for later
+    for (int ty = CanvasTileCache::tileIndex(r->top()); ty <= CanvasTileCache::tileIndex(r->bottom() - 1); ++ty) {
+        for (int tx = CanvasTileCache::tileIndex(r->left()); tx <= CanvasTileCache::tileIndex(r->right() - 1); ++tx) {
+            Geom::IntRect area = CanvasTileCache::tileArea(tx, ty);
+            cairo_surface_t *tile = arena->tiles->lookup(tx, ty);
+            if (tile) {
+                cairo_surface_reference(tile);
+            } else {
+                tile = cairo_image_surface_create(CAIRO_FORMAT_ARGB32, area.width(), area.height());
+                Inkscape::DrawingContext dc(tile, area.min());
+                arena->drawing.render(dc, area);
+                arena->tiles->insert(tx, ty, tile);
+            }
+            cairo_set_source_surface(buf->ct, tile, area.left() - r->left(), area.top() - r->top());
+            cairo_paint(buf->ct);
+            cairo_surface_destroy(tile);
+        }
+    }
 }
 
 static double
@@ -226,6 +682,9 @@ sp_canvas_arena_viewbox_changed (SPCanvasItem *item, Geom::IntRect const &new_ar
     Geom::IntPoint expansion(new_area.width()/2, new_area.height()/2);
     expanded.expandBy(expansion);
     arena->drawing.setCacheLimit(expanded);
+    if (arena->renderer) {
+        arena->renderer->setArea(new_area);
+    }
 }
 
 static gint
@@ -336,9 +795,37 @@ sp_canvas_arena_request_update (SPCanvasArena *ca, DrawingItem */*item*/)
 static void sp_canvas_arena_request_render(SPCanvasArena *ca, Geom::IntRect const &area)
 {
     SPCanvas *canvas = SP_CANVAS_ITEM(ca)->canvas;
+    if (ca->renderer) {
+        ca->renderer->invalidate(area);
+    }
     canvas->requestRedraw(area.left(), area.top(), area.right(), area.bottom());
 }
 
+/**
+ * Discards the cached tiles showing an area whose appearance changed. Areas which are only
+ * rendered again because the canvas was zoomed keep their tiles at the other zoom levels.
+ */
+static void sp_canvas_arena_appearance_changed(SPCanvasArena *ca, Geom::IntRect const &area, bool scales)
+{
+    ca->tiles->invalidate(area, scales);
+    cairo_rectangle_int_t crect = { area.left(), area.top(), area.width(), area.height() };
+    cairo_region_union_rectangle(ca->changed, &crect);
+}
+
+/**
+ * Combines the settings which affect rendered pixels without marking the drawing
+ * for rendering, so that cached tiles rendered with other settings can be discarded.
+ */
+static unsigned sp_canvas_arena_render_key(SPCanvasArena *arena)
+{
+    Inkscape::Preferences *prefs = Inkscape::Preferences::get();
+    unsigned key = arena->drawing.renderMode();
+    key = key * 16 + arena->drawing.colorMode();
+    key = key * 16 + prefs->getInt("/options/blurquality/value", 0) + 8;
+    key = key * 16 + prefs->getInt("/options/filterquality/value", 0) + 8;
+    return key;
+}
+
 void
 sp_canvas_arena_set_pick_delta (SPCanvasArena *ca, gdouble delta)
 {
@@ -365,6 +852,9 @@ sp_canvas_arena_render_surface (SPCanvasArena *ca, cairo_surface_t *surface, Geo
     g_return_if_fail (ca != NULL);
     g_return_if_fail (SP_IS_CANVAS_ARENA (ca));
 
+    if (ca->renderer) {
+        ca->renderer->stop();
+    }
     Inkscape::DrawingContext dc(surface, r.min());
     ca->drawing.update(Geom::IntRect::infinite(), ca->ctx);
     ca->drawing.render(dc, r);
@@ -29,10 +29,14 @@
 typedef struct _SPCanvasArena      SPCanvasArena;
 typedef struct _SPCanvasArenaClass SPCanvasArenaClass;
 typedef struct _cairo_surface      cairo_surface_t;
+typedef struct _cairo_region       cairo_region_t;
 struct CachePrefObserver;
+struct RenderPrefObserver;
+class ArenaRenderer;
 
 namespace Inkscape {
 
+class CanvasTileCache;
 class Drawing;
 class DrawingItem;
 
@@ -52,6 +56,10 @@ struct _SPCanvasArena {
     /* fixme: */
     Inkscape::DrawingItem *picked;
     CachePrefObserver *observer;
+    RenderPrefObserver *render_observer;
+    ArenaRenderer *renderer; ///< background renderer, NULL unless enabled in preferences
+    Inkscape::CanvasTileCache *tiles;
+    cairo_region_t *changed; ///< areas whose appearance changed since they were last painted
     double delta;
 };
 
@@ -0,0 +1,207 @@
+/*
+ * Cache of rendered canvas tiles for several zoom levels
+ *
+ * Copyright (C) 2018 Authors
+ *
+ * Released under GNU GPL, read the file 'COPYING' for more information
+ */
+
+#include <cairo.h>
+
+#include "display/canvas-tile-cache.h"
+
+namespace Inkscape {
+
+CanvasTileCache::CanvasTileCache()
+    : _current(0)
+    , _next_id(0)
+    , _render_key(0)
+    , _budget(0)
+    , _size(0)
+{
+    setTransform(Geom::identity());
+}
+
+CanvasTileCache::~CanvasTileCache()
+{
+    clear();
+}
+
+void CanvasTileCache::setBudget(size_t bytes)
+{
+    _budget = bytes;
+    _evict(_budget);
+}
+
+/**
+ * Selects the zoom level of the given canvas transform, creating it if necessary.
+ */
+void CanvasTileCache::setTransform(Geom::Affine const &ctm)
+{
+    std::vector<Level>::iterator found = _levels.end();
+    for (std::vector<Level>::iterator i = _levels.begin(); i != _levels.end(); ++i) {
+        if (Geom::are_near(i->ctm, ctm, 1e-9)) {
+            found = i;
+            break;
+        }
+    }
+    if (found != _levels.end()) {
+        _current = found->id;
+    } else {
+        Level level;
+        level.id = _next_id++;
+        level.ctm = ctm;
+        level.tiles = 0;
+        _levels.push_back(level);
+        _current = level.id;
+    }
+
+    // forget levels which no longer have any tiles
+    for (std::vector<Level>::iterator i = _levels.begin(); i != _levels.end();) {
+        if (i->tiles == 0 && i->id != _current) {
+            i = _levels.erase(i);
+        } else {
+            ++i;
+        }
+    }
+}
+
+/**
+ * Sets a value describing the render settings, such as the display mode.
+ * Tiles rendered with a different value are discarded.
+ */
+void CanvasTileCache::setRenderKey(unsigned key)
+{
+    if (key != _render_key) {
+        clear();
+        _render_key = key;
+    }
+}
+
+cairo_surface_t *CanvasTileCache::lookup(int tx, int ty)
+{
+    std::map<Key, EntryList::iterator>::iterator found = _index.find(Key(_current, tx, ty));
+    if (found == _index.end()) {
+        return NULL;
+    }
+    // move to the front of the LRU list
+    _entries.splice(_entries.begin(), _entries, found->second);
+    return found->second->surface;
+}
+
+void CanvasTileCache::insert(int tx, int ty, cairo_surface_t *tile)
+{
+    size_t size = cairo_image_surface_get_stride(tile) * cairo_image_surface_get_height(tile);
+    if (size > _budget) return;
+
+    Key key(_current, tx, ty);
+    std::map<Key, EntryList::iterator>::iterator found = _index.find(key);
+    if (found != _index.end()) {
+        _remove(found->second);
+    }
+
+    _evict(_budget - size);
+
+    Entry e(key);
+    e.surface = cairo_surface_reference(tile);
+    e.size = size;
+    _entries.push_front(e);
+    _index.insert(std::make_pair(key, _entries.begin()));
+    _size += size;
+    _findLevel(_current)->tiles += 1;
+}
+
+/**
+ * Discards the tiles which intersect an area given in the coordinates of the current level.
+ * The area is transformed to every other level, so those are invalidated as well. When the
+ * contents of the area do not scale with the zoom (e.g. non-scaling strokes), the transformed
+ * area would not cover them, and the other levels are discarded entirely.
+ */
+void CanvasTileCache::invalidate(Geom::IntRect const &area, bool scales)
+{
+    Level *current = _findLevel(_current);
+    if (current->ctm.isSingular()) {
+        clear();
+        return;
+    }
+    Geom::Affine to_doc = current->ctm.inverse();
+
+    std::map<unsigned, Geom::IntRect> level_areas;
+    for (std::vector<Level>::iterator i = _levels.begin(); i != _levels.end(); ++i) {
+        if (i->id == _current) {
+            level_areas.insert(std::make_pair(i->id, area));
+        } else if (scales) {
+            Geom::Rect r = Geom::Rect(area) * (to_doc * i->ctm);
+            // antialiasing reaches a pixel past the item at any zoom
+            r.expandBy(1);
+            level_areas.insert(std::make_pair(i->id, r.roundOutwards()));
+        }
+    }
+
+    for (EntryList::iterator i = _entries.begin(); i != _entries.end();) {
+        EntryList::iterator e = i++;
+        std::map<unsigned, Geom::IntRect>::iterator level_area = level_areas.find(e->key.level);
+        if (level_area == level_areas.end() ||
+            tileArea(e->key.tx, e->key.ty).intersects(level_area->second)) {
+            _remove(e);
+        }
+    }
+}
+
+void CanvasTileCache::clear()
+{
+    _evict(0);
+}
+
+/// Returns the canvas area covered by a tile.
+Geom::IntRect CanvasTileCache::tileArea(int tx, int ty)
+{
+    return Geom::IntRect::from_xywh(tx * TILE_SIZE, ty * TILE_SIZE, TILE_SIZE, TILE_SIZE);
+}
+
+/// Returns the index of the tile row or column containing a canvas coordinate.
+int CanvasTileCache::tileIndex(int coord)
+{
+    // round towards negative infinity
+    return coord >= 0 ? coord / TILE_SIZE : -((-coord - 1) / TILE_SIZE) - 1;
+}
+
+CanvasTileCache::Level *CanvasTileCache::_findLevel(unsigned id)
+{
+    for (std::vector<Level>::iterator i = _levels.begin(); i != _levels.end(); ++i) {
+        if (i->id == id) return &*i;
+    }
+    return NULL;
+}
+
+void CanvasTileCache::_remove(EntryList::iterator e)
+{
+    Level *level = _findLevel(e->key.level);
+    if (level) {
+        level->tiles -= 1;
+    }
+    _size -= e->size;
+    cairo_surface_destroy(e->surface);
+    _index.erase(e->key);
+    _entries.erase(e);
+}
+
+void CanvasTileCache::_evict(size_t limit)
+{
+    while (_size > limit && !_entries.empty()) {
+        _remove(--_entries.end());
+    }
+}
+
+} // end namespace Inkscape
+
+/*
+  Local Variables:
+  mode:c++
+  c-file-style:"stroustrup"
+  c-file-offsets:((innamespace . 0)(inline-open . 0)(case-label . +))
+  indent-tabs-mode:nil
+  fill-column:99
+  End:
+*/
+// vim: filetype=cpp:expandtab:shiftwidth=4:tabstop=8:softtabstop=4:fileencoding=utf-8:textwidth=99 :
@@ -0,0 +1,115 @@
+#ifndef SEEN_INKSCAPE_DISPLAY_CANVAS_TILE_CACHE_H
+#define SEEN_INKSCAPE_DISPLAY_CANVAS_TILE_CACHE_H
+
+/*
+ * Cache of rendered canvas tiles for several zoom levels
+ *
+ * Copyright (C) 2018 Authors
+ *
+ * Released under GNU GPL, read the file 'COPYING' for more information
+ */
+
+#include <cstddef>
+#include <list>
+#include <map>
+#include <vector>
+#include <2geom/affine.h>
+#include <2geom/rect.h>
+#include <boost/utility.hpp>
+
+extern "C" {
+typedef struct _cairo_surface cairo_surface_t;
+}
+
+namespace Inkscape {
+
+/**
+ * Rendered tiles of a canvas drawing, kept for every recently used canvas transform.
+ *
+ * The canvas is divided into a grid of TILE_SIZE pixel tiles. A tile is identified by
+ * its zoom level, i.e. the canvas transform it was rendered with, and its position in
+ * the grid. Zooming back to a level or scrolling over an area which was already rendered
+ * can then be served from memory. When the appearance of the drawing changes, the
+ * changed area is invalidated at all levels. Tiles are evicted in least recently used order once the
+ * byte budget is exceeded; a budget of zero disables the cache.
+ */
+class CanvasTileCache
+    : boost::noncopyable
+{
+public:
+    static int const TILE_SIZE = 256;
+
+    CanvasTileCache();
+    ~CanvasTileCache();
+
+    size_t budget() const { return _budget; }
+    void setBudget(size_t bytes);
+    /// Bytes held by the cached tiles
+    size_t size() const { return _size; }
+
+    void setTransform(Geom::Affine const &ctm);
+    void setRenderKey(unsigned key);
+
+    /// Returns the cached tile at the current level, or NULL. The cache keeps the reference.
+    cairo_surface_t *lookup(int tx, int ty);
+    /// Stores a reference to the surface as the tile at the current level.
+    void insert(int tx, int ty, cairo_surface_t *tile);
+    void invalidate(Geom::IntRect const &area, bool scales = true);
+    void clear();
+
+    static Geom::IntRect tileArea(int tx, int ty);
+    static int tileIndex(int coord);
+
+private:
+    struct Key {
+        Key(unsigned l, int x, int y) : level(l), tx(x), ty(y) {}
+        bool operator<(Key const &other) const {
+            if (level != other.level) return level < other.level;
+            if (ty != other.ty) return ty < other.ty;
+            return tx < other.tx;
+        }
+        unsigned level;
+        int tx;
+        int ty;
+    };
+    struct Entry {
+        Entry(Key const &k) : key(k), surface(NULL), size(0) {}
+        Key key;
+        cairo_surface_t *surface;
+        size_t size;
+    };
+    struct Level {
+        unsigned id;
+        Geom::Affine ctm;
+        unsigned tiles;
+    };
+    typedef std::list<Entry> EntryList;
+
+    Level *_findLevel(unsigned id);
+    void _remove(EntryList::iterator e);
+    void _evict(size_t limit);
+
+    EntryList _entries; ///< most recently used first
+    std::map<Key, EntryList::iterator> _index;
+    std::vector<Level> _levels;
+    unsigned _current; ///< id of the level of the current transform
+    unsigned _next_id;
+    unsigned _render_key;
+    size_t _budget;
+    size_t _size;
+};
+
+} // end namespace Inkscape
+
+#endif // !SEEN_INKSCAPE_DISPLAY_CANVAS_TILE_CACHE_H
+
+/*
+  Local Variables:
+  mode:c++
+  c-file-style:"stroustrup"
+  c-file-offsets:((innamespace . 0)(inline-open . 0)(case-label . +))
+  indent-tabs-mode:nil
+  fill-column:99
+  End:
+*/
+// vim: filetype=cpp:expandtab:shiftwidth=4:tabstop=8:softtabstop=4:fileencoding=utf-8:textwidth=99 :
@@ -47,6 +47,7 @@ DrawingGroup::setPickChildren(bool p)
 void
 DrawingGroup::setChildTransform(Geom::Affine const &new_trans)
 {
+    _beforeChange();
     Geom::Affine current;
     if (_child_transform) {
         current = *_child_transform;
@@ -23,6 +23,8 @@ public:
     DrawingGroup(Drawing &drawing);
     ~DrawingGroup();
 
+    virtual char const *typeName() const { return "DrawingGroup"; }
+
     bool pickChildren() { return _pick_children; }
     void setPickChildren(bool p);
 
@@ -14,7 +14,6 @@
 #include "display/drawing.h"
 #include "display/drawing-context.h"
 #include "display/drawing-image.h"
-#include "preferences.h"
 #include "style.h"
 
 #include "display/cairo-utils.h"
@@ -24,6 +23,7 @@ namespace Inkscape {
 DrawingImage::DrawingImage(Drawing &drawing)
     : DrawingItem(drawing)
     , _pixbuf(NULL)
+    , _scale_filter(CAIRO_FILTER_GOOD)
 {}
 
 DrawingImage::~DrawingImage()
@@ -34,6 +34,8 @@ DrawingImage::~DrawingImage()
 void
 DrawingImage::setPixbuf(Inkscape::Pixbuf *pb)
 {
+    _beforeChange();
+    _markForRendering();
     _pixbuf = pb;
 
     _markForUpdate(STATE_ALL, false);
@@ -42,6 +44,8 @@ DrawingImage::setPixbuf(Inkscape::Pixbuf *pb)
 void
 DrawingImage::setScale(double sx, double sy)
 {
+    _beforeChange();
+    _markForRendering();
     _scale = Geom::Scale(sx, sy);
     _markForUpdate(STATE_ALL, false);
 }
@@ -49,6 +53,8 @@ DrawingImage::setScale(double sx, double sy)
 void
 DrawingImage::setOrigin(Geom::Point const &o)
 {
+    _beforeChange();
+    _markForRendering();
     _origin = o;
     _markForUpdate(STATE_ALL, false);
 }
@@ -56,10 +62,45 @@ DrawingImage::setOrigin(Geom::Point const &o)
 void
 DrawingImage::setClipbox(Geom::Rect const &box)
 {
+    _beforeChange();
+    _markForRendering();
     _clipbox = box;
     _markForUpdate(STATE_ALL, false);
 }
 
+/**
+ * Keeps the image-rendering of the style, which is read on the main thread only,
+ * for rendering.
+ */
+void
+DrawingImage::setStyle(SPStyle *style, SPStyle *context_style)
+{
+    DrawingItem::setStyle(style, context_style); // Must be first
+
+    // See: http://www.w3.org/TR/SVG/painting.html#ImageRenderingProperty
+    //      http://www.w3.org/TR/css4-images/#the-image-rendering
+    //      It's back in CSS Images 3 now. 
+    //      style.h/style.cpp
+    switch (style ? style->image_rendering.computed : SP_CSS_IMAGE_RENDERING_AUTO) {
+        case SP_CSS_IMAGE_RENDERING_AUTO:
+        case SP_CSS_IMAGE_RENDERING_OPTIMIZEQUALITY:
+        case SP_CSS_IMAGE_RENDERING_CRISPEDGES:
+            // CSS 3 defines:
+            //   'auto' to use smoothing
+            //   'optimize-quality' as alias for auto
+            //   We don't have special rendering for 'crisp-edges' yet
+            //   so follow what browsers do.
+            // In recent Cairo, BEST used Lanczos3, which is prohibitively slow
+            _scale_filter = CAIRO_FILTER_GOOD;
+            break;
+        case SP_CSS_IMAGE_RENDERING_OPTIMIZESPEED:
+        case SP_CSS_IMAGE_RENDERING_PIXELATED:
+        default:
+            _scale_filter = CAIRO_FILTER_NEAREST;
+            break;
+    }
+}
+
 Geom::Rect
 DrawingImage::bounds() const
 {
@@ -80,8 +121,6 @@ DrawingImage::bounds() const
 unsigned
 DrawingImage::_updateItem(Geom::IntRect const &, UpdateContext const &, unsigned, unsigned)
 {
-    _markForRendering();
-
     // Calculate bbox
     if (_pixbuf) {
         Geom::Rect r = bounds() * _ctm;
@@ -96,9 +135,7 @@ DrawingImage::_updateItem(Geom::IntRect const &, UpdateContext const &, unsigned
 unsigned DrawingImage::_renderItem(DrawingContext &dc, Geom::IntRect const &/*area*/, unsigned /*flags*/, DrawingItem * /*stop_at*/)
 {
     bool outline = _drawing.outline();
-
-    Inkscape::Preferences *prefs = Inkscape::Preferences::get();
-    bool imgoutline = prefs->getBool("/options/rendering/imageinoutlinemode", false);
+    bool imgoutline = _drawing.imageOutline();
 
     if (!outline || imgoutline) {
         if (!_pixbuf) return RENDER_OK;
@@ -114,35 +151,14 @@ unsigned DrawingImage::_renderItem(DrawingContext &dc, Geom::IntRect const &/*ar
         dc.setSource(_pixbuf->getSurfaceRaw(), 0, 0);
 
         if (_style) {
-            // See: http://www.w3.org/TR/SVG/painting.html#ImageRenderingProperty
-            //      http://www.w3.org/TR/css4-images/#the-image-rendering
-            //      It's back in CSS Images 3 now. 
-            //      style.h/style.cpp
-            switch (_style->image_rendering.computed) {
-                case SP_CSS_IMAGE_RENDERING_AUTO:
-                case SP_CSS_IMAGE_RENDERING_OPTIMIZEQUALITY:
-                case SP_CSS_IMAGE_RENDERING_CRISPEDGES:
-                    // CSS 3 defines:
-                    //   'auto' to use smoothing
-                    //   'optimize-quality' as alias for auto
-                    //   We don't have special rendering for 'crisp-edges' yet
-                    //   so follow what browsers do.
-                    // In recent Cairo, BEST used Lanczos3, which is prohibitively slow
-                    dc.patternSetFilter( CAIRO_FILTER_GOOD );
-                    break;
-                case SP_CSS_IMAGE_RENDERING_OPTIMIZESPEED:
-                case SP_CSS_IMAGE_RENDERING_PIXELATED:
-                default:
-                    dc.patternSetFilter( CAIRO_FILTER_NEAREST );
-                    break;
-            }
+            dc.patternSetFilter(_scale_filter);
         }
 
         dc.paint(1);
 
     } else { // outline; draw a rect instead
 
-        guint32 rgba = prefs->getInt("/options/wireframecolors/images", 0xff0000ff);
+        guint32 rgba = _drawing.colors().images;
 
         {   Inkscape::DrawingContext::Save save(dc);
             dc.transform(_ctm);
@@ -173,6 +189,14 @@ unsigned DrawingImage::_renderItem(DrawingContext &dc, Geom::IntRect const &/*ar
     return RENDER_OK;
 }
 
+void DrawingImage::_prepareItem(DrawingContext &/*dc*/)
+{
+    // the pixbuf is shared with other drawings, so convert it before rendering on other threads
+    if (_pixbuf) {
+        _pixbuf->ensurePixelFormat(Inkscape::Pixbuf::PF_CAIRO);
+    }
+}
+
 /** Calculates the closest distance from p to the segment a1-a2*/
 static double
 distance_to_segment (Geom::Point const &p, Geom::Point const &a1, Geom::Point const &a2)
@@ -28,17 +28,22 @@ public:
     DrawingImage(Drawing &drawing);
     ~DrawingImage();
 
+    virtual char const *typeName() const { return "DrawingImage"; }
+
     void setPixbuf(Inkscape::Pixbuf *pb);
     void setScale(double sx, double sy);
     void setOrigin(Geom::Point const &o);
     void setClipbox(Geom::Rect const &box);
     Geom::Rect bounds() const;
 
+    virtual void setStyle(SPStyle *style, SPStyle *context_style = NULL);
+
 protected:
     virtual unsigned _updateItem(Geom::IntRect const &area, UpdateContext const &ctx,
                                  unsigned flags, unsigned reset);
     virtual unsigned _renderItem(DrawingContext &dc, Geom::IntRect const &area, unsigned flags,
                                  DrawingItem *stop_at);
+    virtual void _prepareItem(DrawingContext &dc);
     virtual DrawingItem *_pickItem(Geom::Point const &p, double delta, unsigned flags);
 
     Inkscape::Pixbuf *_pixbuf;
@@ -47,6 +52,7 @@ protected:
     Geom::Rect _clipbox; ///< for preserveAspectRatio
     Geom::Point _origin;
     Geom::Scale _scale;
+    cairo_filter_t _scale_filter; ///< from image-rendering
 };
 
 } // end namespace Inkscape
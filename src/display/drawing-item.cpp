@@ -18,7 +18,6 @@
 #include "display/drawing-pattern.h"
 #include "display/drawing-surface.h"
 #include "nr-filter.h"
-#include "preferences.h"
 #include "style.h"
 
 #include "display/cairo-utils.h"
@@ -120,6 +119,7 @@ DrawingItem::DrawingItem(Drawing &drawing)
     , _filter(NULL)
     , _user_data(NULL)
     , _cache(NULL)
+    , _content_version(++drawing._content_version)
     , _state(0)
     , _child_type(CHILD_ORPHAN)
     , _background_new(0)
@@ -139,6 +139,7 @@ DrawingItem::DrawingItem(Drawing &drawing)
 
 DrawingItem::~DrawingItem()
 {
+    _beforeChange();
     _drawing.signal_item_deleted.emit(this);
     //if (!_children.empty()) {
     //    g_warning("Removing item with children");
@@ -215,6 +216,7 @@ DrawingItem::isAncestorOf(DrawingItem *item) const
 void
 DrawingItem::appendChild(DrawingItem *item)
 {
+    _beforeChange();
     item->_parent = this;
     assert(item->_child_type == CHILD_ORPHAN);
     item->_child_type = CHILD_NORMAL;
@@ -232,6 +234,7 @@ DrawingItem::appendChild(DrawingItem *item)
 void
 DrawingItem::prependChild(DrawingItem *item)
 {
+    _beforeChange();
     item->_parent = this;
     assert(item->_child_type == CHILD_ORPHAN);
     item->_child_type = CHILD_NORMAL;
@@ -245,6 +248,7 @@ DrawingItem::prependChild(DrawingItem *item)
 void
 DrawingItem::clearChildren()
 {
+    _beforeChange();
     if (_children.empty()) return;
 
     _markForRendering();
@@ -263,6 +267,7 @@ DrawingItem::clearChildren()
 void
 DrawingItem::setTransform(Geom::Affine const &new_trans)
 {
+    _beforeChange();
     Geom::Affine current;
     if (_transform) {
         current = *_transform;
@@ -284,6 +289,7 @@ DrawingItem::setTransform(Geom::Affine const &new_trans)
 void
 DrawingItem::setOpacity(float opacity)
 {
+    _beforeChange();
     if (_opacity != opacity) {
         _opacity = opacity;
         _markForRendering();
@@ -302,6 +308,7 @@ DrawingItem::setAntialiasing(unsigned a)
 void
 DrawingItem::setIsolation(unsigned isolation)
 {
+    _beforeChange();
     _isolation = isolation;
     //if( isolation != 0 ) std::cout << "isolation: " << isolation << std::endl;
     _markForRendering();
@@ -310,6 +317,7 @@ DrawingItem::setIsolation(unsigned isolation)
 void
 DrawingItem::setBlendMode(unsigned mix_blend_mode)
 {
+    _beforeChange();
     _mix_blend_mode = mix_blend_mode;
     //if( mix_blend_mode != 0 ) std::cout << "setBlendMode: " << mix_blend_mode << std::endl;
     _markForRendering();
@@ -318,6 +326,7 @@ DrawingItem::setBlendMode(unsigned mix_blend_mode)
 void
 DrawingItem::setVisible(bool v)
 {
+    _beforeChange();
     if (_visible != v) {
         _visible = v;
         _markForRendering();
@@ -344,12 +353,15 @@ DrawingItem::setCached(bool cached, bool persistent)
     if (_cached_persistent && !persistent)
         return;
 
+    _beforeChange();
     _cached = cached;
     _cached_persistent = persistent ? cached : false;
     if (cached) {
         _drawing._cached_items.insert(this);
     } else {
-        _drawing._cached_items.erase(this);
+        if (_drawing._cached_items.erase(this) && _drawing.statistics()) {
+            _drawing.statistics()->cacheEviction();
+        }
         delete _cache;
         _cache = NULL;
     }
@@ -363,6 +375,7 @@ DrawingItem::setCached(bool cached, bool persistent)
 void
 DrawingItem::setStyle(SPStyle *style, SPStyle *context_style)
 {
+    _beforeChange();
     // std::cout << "DrawingItem::setStyle: " << name() << " " << style
     //           << " " << context_style << std::endl;
 
@@ -414,6 +427,7 @@ DrawingItem::setStyle(SPStyle *style, SPStyle *context_style)
 void
 DrawingItem::setChildrenStyle(SPStyle* context_style)
 {
+    _beforeChange();
     _context_style = context_style;
     for (ChildrenList::iterator i = _children.begin(); i != _children.end(); ++i) {
         i->setChildrenStyle( context_style );
@@ -424,6 +438,7 @@ DrawingItem::setChildrenStyle(SPStyle* context_style)
 void
 DrawingItem::setClip(DrawingItem *item)
 {
+    _beforeChange();
     _markForRendering();
     delete _clip;
     _clip = item;
@@ -438,6 +453,7 @@ DrawingItem::setClip(DrawingItem *item)
 void
 DrawingItem::setMask(DrawingItem *item)
 {
+    _beforeChange();
     _markForRendering();
     delete _mask;
     _mask = item;
@@ -452,6 +468,7 @@ DrawingItem::setMask(DrawingItem *item)
 void
 DrawingItem::setFillPattern(DrawingPattern *pattern)
 {
+    _beforeChange();
     _markForRendering();
     delete _fill_pattern;
     _fill_pattern = pattern;
@@ -466,6 +483,7 @@ DrawingItem::setFillPattern(DrawingPattern *pattern)
 void
 DrawingItem::setStrokePattern(DrawingPattern *pattern)
 {
+    _beforeChange();
     _markForRendering();
     delete _stroke_pattern;
     _stroke_pattern = pattern;
@@ -482,6 +500,7 @@ DrawingItem::setStrokePattern(DrawingPattern *pattern)
 void
 DrawingItem::setZOrder(unsigned z)
 {
+    _beforeChange();
     if (!_parent) return;
 
     ChildrenList::iterator it = _parent->_children.iterator_to(*this);
@@ -496,6 +515,7 @@ DrawingItem::setZOrder(unsigned z)
 void
 DrawingItem::setItemBounds(Geom::OptRect const &bounds)
 {
+    _beforeChange();
     _item_bbox = bounds;
 }
 
@@ -527,6 +547,11 @@ DrawingItem::update(Geom::IntRect const &area, UpdateContext const &ctx, unsigne
     bool render_filters = _drawing.renderFilters();
     bool outline = _drawing.outline();
 
+    // An item which was up to date and is only reset, e.g. because the canvas was zoomed,
+    // did not change; its render request merely repaints it
+    bool changed = ctx.changed || _propagate_state || (~_state & flags & STATE_RENDER);
+    bool propagated = ctx.changed || _propagate_state;
+
     // Set reset flags according to propagation status
     reset |= _propagate_state;
     _propagate_state = 0;
@@ -552,6 +577,7 @@ DrawingItem::update(Geom::IntRect const &area, UpdateContext const &ctx, unsigne
     }
 
     UpdateContext child_ctx(ctx);
+    child_ctx.changed = propagated;
     if (_transform) {
         child_ctx.ctm = *_transform * ctx.ctm;
     }
@@ -632,6 +658,7 @@ DrawingItem::update(Geom::IntRect const &area, UpdateContext const &ctx, unsigne
                 // Destroy cache for this item - outside of canvas or invisible.
                 // The opposite transition (invisible -> visible or object
                 // entering the canvas) is handled during the render phase
+                if (_drawing.statistics()) _drawing.statistics()->cacheEviction();
                 delete _cache;
                 _cache = NULL;
             }
@@ -648,7 +675,7 @@ DrawingItem::update(Geom::IntRect const &area, UpdateContext const &ctx, unsigne
             _stroke_pattern->update(area, child_ctx, flags, reset);
         }
         if (!is_drawing_group(this) || (_filter && render_filters)) {
-            _markForRendering();
+            _markForRendering(!changed);
         }
     }
 }
@@ -677,6 +704,49 @@ struct MaskLuminanceToAlpha {
  */
 unsigned
 DrawingItem::render(DrawingContext &dc, Geom::IntRect const &area, unsigned flags, DrawingItem *stop_at)
+{
+    DrawingStatistics *stats = _drawing.statistics();
+    if (stats) {
+        DrawingStatistics::Timer timer(stats, stats->itemTimes(), typeName());
+        return _render(dc, area, flags, stop_at);
+    }
+    return _render(dc, area, flags, stop_at);
+}
+
+/**
+ * Prepares the item and its descendants for rendering an area without reading the document.
+ * Returns false if one of them reads the document whenever it is rendered.
+ * @see Drawing::prepareRender()
+ */
+bool
+DrawingItem::prepareRender(DrawingContext &dc, Geom::IntRect const &area)
+{
+    // outlines do not use paint servers or filters
+    if (!_visible || _drawing.outline()) return true;
+    // patterns render their whole tile
+    bool pattern = _child_type == CHILD_FILL_PATTERN || _child_type == CHILD_STROKE_PATTERN;
+    if (!pattern && !area.intersects(_drawbox)) return true;
+
+    Geom::IntRect child_area = area;
+    if (_filter && _drawing.renderFilters()) {
+        // the background is rendered from other items, which may lie outside of the area
+        if (_filter->reads_document() || _filter->uses_background()) return false;
+        // the filter renders its input beyond the area
+        child_area = Geom::IntRect::infinite();
+    }
+
+    _prepareItem(dc);
+    for (ChildrenList::iterator i = _children.begin(); i != _children.end(); ++i) {
+        if (!i->prepareRender(dc, child_area)) return false;
+    }
+    if (_mask && !_mask->prepareRender(dc, child_area)) return false;
+    if (_fill_pattern && !_fill_pattern->prepareRender(dc, Geom::IntRect::infinite())) return false;
+    if (_stroke_pattern && !_stroke_pattern->prepareRender(dc, Geom::IntRect::infinite())) return false;
+    return true;
+}
+
+unsigned
+DrawingItem::_render(DrawingContext &dc, Geom::IntRect const &area, unsigned flags, DrawingItem *stop_at)
 {
     bool outline = _drawing.outline();
     bool render_filters = _drawing.renderFilters();
@@ -723,11 +793,16 @@ DrawingItem::render(DrawingContext &dc, Geom::IntRect const &area, unsigned flag
             set_cairo_blend_operator( dc, _mix_blend_mode );
 
             _cache->paintFromCache(dc, carea);
-            if (!carea) return RENDER_OK;
+            if (!carea) {
+                if (_drawing.statistics()) _drawing.statistics()->cacheHit();
+                return RENDER_OK;
+            }
+            if (_drawing.statistics()) _drawing.statistics()->cacheMiss();
         } else {
             // There is no cache. This could be because caching of this item
             // was just turned on after the last update phase, or because
             // we were previously outside of the canvas.
+            if (_drawing.statistics()) _drawing.statistics()->cacheMiss();
             Geom::OptIntRect cl = _drawing.cacheLimit();
             cl.intersectWith(_drawbox);
             if (cl) {
@@ -779,10 +854,20 @@ DrawingItem::render(DrawingContext &dc, Geom::IntRect const &area, unsigned flag
     // Note 2: We only need to render carea of clip and mask, but
     //         iarea of the object.
     Geom::OptIntRect iarea = carea;
-    // expand carea to contain the dependent area of filters.
+    cairo_surface_t *filter_result = NULL;
+    Geom::IntRect filter_result_area;
     if (_filter && render_filters) {
-        _filter->area_enlarge(*iarea, this);
-        iarea.intersectWith(_drawbox);
+        if (_filter->caches_result(this)) {
+            // the result is cached for the whole filter region, so render all of it if not cached yet
+            filter_result = _filter->cached_result(this, *carea, filter_result_area);
+            if (!filter_result) {
+                iarea = _drawbox;
+            }
+        } else {
+            // expand carea to contain the dependent area of filters.
+            _filter->area_enlarge(*iarea, this);
+            iarea.intersectWith(_drawbox);
+        }
     }
 
     DrawingSurface intermediate(*iarea);
@@ -821,10 +906,20 @@ DrawingItem::render(DrawingContext &dc, Geom::IntRect const &area, unsigned flag
 
     // 3. Render object itself
     ict.pushGroup();
-    render_result = _renderItem(ict, *iarea, flags, stop_at);
+    bool const filter_cached = filter_result != NULL;
+    if (filter_cached) {
+        // 3-4. Take the filtered object from the filter cache.
+        ict.setSource(filter_result, filter_result_area.left(), filter_result_area.top());
+        ict.setOperator(CAIRO_OPERATOR_SOURCE);
+        ict.paint();
+        ict.setOperator(CAIRO_OPERATOR_OVER);
+        cairo_surface_destroy(filter_result);
+    } else {
+        render_result = _renderItem(ict, *iarea, flags, stop_at);
+    }
 
     // 4. Apply filter.
-    if (_filter && render_filters) {
+    if (_filter && render_filters && !filter_cached) {
         bool rendered = false;
         if (_filter->uses_background() && _background_accumulate) {
             DrawingItem *bg_root = this;
@@ -883,20 +978,30 @@ DrawingItem::_renderOutline(DrawingContext &dc, Geom::IntRect const &area, unsig
     // First, render the object itself
     _renderItem(dc, *carea, flags, NULL);
 
-    // render clip and mask, if any
-    guint32 saved_rgba = _drawing.outlinecolor; // save current outline color
-    // render clippath as an object, using a different color
-    Inkscape::Preferences *prefs = Inkscape::Preferences::get();
+    // render clip and mask, if any, in the colors chosen by _outlineColor()
     if (_clip) {
-        _drawing.outlinecolor = prefs->getInt("/options/wireframecolors/clips", 0x00ff00ff); // green clips
         _clip->render(dc, *carea, flags);
     }
-    // render mask as an object, using a different color
     if (_mask) {
-        _drawing.outlinecolor = prefs->getInt("/options/wireframecolors/masks", 0x0000ffff); // blue masks
         _mask->render(dc, *carea, flags);
     }
-    _drawing.outlinecolor = saved_rgba; // restore outline color
+}
+
+/**
+ * Color of the outline of this item in outline mode. Items of clipping paths
+ * and masks use their own colors; the innermost clipping path or mask wins.
+ */
+guint32
+DrawingItem::_outlineColor() const
+{
+    for (DrawingItem const *i = this; i; i = i->_parent) {
+        if (i->_child_type == CHILD_CLIP) {
+            return _drawing.colors().clippaths; // green clips
+        } else if (i->_child_type == CHILD_MASK) {
+            return _drawing.colors().masks; // blue masks
+        }
+    }
+    return _drawing.outlinecolor;
 }
 
 /**
@@ -1027,24 +1132,42 @@ DrawingItem::recursivePrintTree( unsigned level )
  * This is called whenever the object changes its visible appearance.
  * For some cases (such as setting opacity) this is enough, but for others
  * _markForUpdate() also needs to be called.
+ *
+ * When reset_only is true the appearance did not change, the item is only
+ * rendered again, e.g. at a new canvas transform; renderings of the drawing
+ * kept for other transforms remain valid.
  */
 void
-DrawingItem::_markForRendering()
+DrawingItem::_markForRendering(bool reset_only)
 {
     // TODO: this function does too much work when a large subtree
     // is invalidated - fix
-    
+
+    if (!reset_only) {
+        guint64 version = ++_drawing._content_version;
+        for (DrawingItem *i = this; i; i = i->_parent) {
+            i->_content_version = version;
+        }
+    }
+
     bool outline = _drawing.outline();
     Geom::OptIntRect dirty = outline ? _bbox : _drawbox;
     if (!dirty) return;
 
     // dirty the caches of all parents
     DrawingItem *bkg_root = NULL;
+    // outlines, non-scaling strokes and filters do not grow with the zoom, so the area
+    // does not map to the item at other canvas transforms
+    bool scales = !outline &&
+        !(_style && _style->vector_effect.computed == SP_VECTOR_EFFECT_NON_SCALING_STROKE);
 
     for (DrawingItem *i = this; i; i = i->_parent) {
         if (i != this && i->_filter) {
             i->_filter->area_enlarge(*dirty, i);
         }
+        if (i->_filter && _drawing.renderFilters()) {
+            scales = false;
+        }
         if (i->_cache) {
             i->_cache->markDirty(*dirty);
         }
@@ -1057,6 +1180,9 @@ DrawingItem::_markForRendering()
         bkg_root->_invalidateFilterBackground(*dirty);
     }
     _drawing.signal_request_render.emit(*dirty);
+    if (!reset_only) {
+        _drawing.signal_appearance_changed.emit(*dirty, scales);
+    }
 }
 
 void
@@ -1073,6 +1199,16 @@ DrawingItem::_invalidateFilterBackground(Geom::IntRect const &area)
     }
 }
 
+/**
+ * Must be called before modifying the item, so that a background renderer
+ * of the drawing stops before it sees the item in an inconsistent state.
+ */
+void
+DrawingItem::_beforeChange()
+{
+    _drawing.signal_before_change.emit();
+}
+
 /**
  * Marks the item as needing a recomputation of internal data.
  *
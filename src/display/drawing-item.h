@@ -43,7 +43,11 @@ class Filter;
 
 
 struct UpdateContext {
+    UpdateContext() : changed(false) {}
     Geom::Affine ctm;
+    /// Set when an ancestor changed in a way which affects its descendants, as opposed
+    /// to an update which only resets the items, e.g. for a new canvas transform
+    bool changed;
 };
 
 struct CacheRecord
@@ -98,6 +102,8 @@ public:
     Geom::Affine ctm() const { return _ctm; }
     Geom::Affine transform() const { return _transform ? *_transform : Geom::identity(); }
     Drawing &drawing() const { return _drawing; }
+    /// Changes whenever the appearance of the item or one of its descendants changes
+    guint64 contentVersion() const { return _content_version; }
     DrawingItem *parent() const;
     bool isAncestorOf(DrawingItem *item) const;
 
@@ -134,10 +140,12 @@ public:
 
     void update(Geom::IntRect const &area = Geom::IntRect::infinite(), UpdateContext const &ctx = UpdateContext(), unsigned flags = STATE_ALL, unsigned reset = 0);
     unsigned render(DrawingContext &dc, Geom::IntRect const &area, unsigned flags = 0, DrawingItem *stop_at = NULL);
+    bool prepareRender(DrawingContext &dc, Geom::IntRect const &area);
     void clip(DrawingContext &dc, Geom::IntRect const &area);
     DrawingItem *pick(Geom::Point const &p, double delta, unsigned flags = 0);
 
     virtual Glib::ustring name(); // For debugging
+    virtual char const *typeName() const { return "DrawingItem"; } // For render statistics
     void recursivePrintTree(unsigned level = 0);  // For debugging
 
 protected:
@@ -154,9 +162,12 @@ protected:
         RENDER_OK = 0,
         RENDER_STOP = 1
     };
+    unsigned _render(DrawingContext &dc, Geom::IntRect const &area, unsigned flags, DrawingItem *stop_at);
     void _renderOutline(DrawingContext &dc, Geom::IntRect const &area, unsigned flags);
+    guint32 _outlineColor() const;
     void _markForUpdate(unsigned state, bool propagate);
-    void _markForRendering();
+    void _markForRendering(bool reset_only = false);
+    void _beforeChange();
     void _invalidateFilterBackground(Geom::IntRect const &area);
     double _cacheScore();
     Geom::OptIntRect _cacheRect();
@@ -165,6 +176,7 @@ protected:
     virtual unsigned _renderItem(DrawingContext &/*dc*/, Geom::IntRect const &/*area*/, unsigned /*flags*/,
                                  DrawingItem * /*stop_at*/) { return RENDER_OK; }
     virtual void _clipItem(DrawingContext &/*dc*/, Geom::IntRect const &/*area*/) {}
+    virtual void _prepareItem(DrawingContext &/*dc*/) {}
     virtual DrawingItem *_pickItem(Geom::Point const &/*p*/, double /*delta*/, unsigned /*flags*/) { return NULL; }
     virtual bool _canClip() { return false; }
 
@@ -204,6 +216,7 @@ protected:
     Inkscape::Filters::Filter *_filter;
     void *_user_data; ///< Used to associate DrawingItems with SPItems that created them
     DrawingCache *_cache;
+    guint64 _content_version; ///< see contentVersion()
 
     CacheList::iterator _cache_iterator;
 
@@ -31,6 +31,7 @@ DrawingPattern::~DrawingPattern()
 
 void
 DrawingPattern::setPatternToUserTransform(Geom::Affine const &new_trans) {
+    _beforeChange();
     Geom::Affine current;
     if (_pattern_to_user) {
         current = *_pattern_to_user;
@@ -51,11 +52,13 @@ DrawingPattern::setPatternToUserTransform(Geom::Affine const &new_trans) {
 
 void
 DrawingPattern::setTileRect(Geom::Rect const &tile_rect) {
+    _beforeChange();
     _tile_rect = tile_rect;
 }
 
 void
 DrawingPattern::setOverflow(Geom::Affine initial_transform, int steps, Geom::Affine step_transform) {
+    _beforeChange();
     _overflow_initial_transform = initial_transform;
     _overflow_steps = steps;
     _overflow_step_transform = step_transform;
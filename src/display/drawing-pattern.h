@@ -33,6 +33,8 @@ public:
     DrawingPattern(Drawing &drawing, bool debug = false);
     ~DrawingPattern();
 
+    virtual char const *typeName() const { return "DrawingPattern"; }
+
     /**
      * Set the transformation from pattern to user coordinate systems.
      * @see SPPattern description for explanation of coordinate systems.
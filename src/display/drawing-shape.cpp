@@ -47,6 +47,7 @@ DrawingShape::~DrawingShape()
 void
 DrawingShape::setPath(SPCurve *curve)
 {
+    _beforeChange();
     _markForRendering();
 
     if (_curve) {
@@ -180,7 +181,7 @@ DrawingShape::_renderStroke(DrawingContext &dc)
     if( has_stroke ) {
         // TODO: remove segments outside of bbox when no dashes present
         dc.path(_curve->get_pathvector());
-        if (_style && _style->vector_effect.computed == SP_VECTOR_EFFECT_NON_SCALING_STROKE) {
+        if (_nrstyle.non_scaling_stroke) {
             dc.restore();
             dc.save();
         }
@@ -208,7 +209,7 @@ DrawingShape::_renderItem(DrawingContext &dc, Geom::IntRect const &area, unsigne
     bool outline = _drawing.outline();
 
     if (outline) {
-        guint32 rgba = _drawing.outlinecolor;
+        guint32 rgba = _outlineColor();
 
         // paint-order doesn't matter
         {   Inkscape::DrawingContext::Save save(dc);
@@ -249,7 +250,7 @@ DrawingShape::_renderItem(DrawingContext &dc, Geom::IntRect const &area, unsigne
                     _nrstyle.applyFill(dc);
                     dc.fillPreserve();
                 }
-                if (_style && _style->vector_effect.computed == SP_VECTOR_EFFECT_NON_SCALING_STROKE) {
+                if (_nrstyle.non_scaling_stroke) {
                     dc.restore();
                     dc.save();
                 }
@@ -285,6 +286,15 @@ DrawingShape::_renderItem(DrawingContext &dc, Geom::IntRect const &area, unsigne
     return RENDER_OK;
 }
 
+/// Creates the fill and stroke patterns, which reads the paint servers.
+void DrawingShape::_prepareItem(DrawingContext &dc)
+{
+    Inkscape::DrawingContext::Save save(dc);
+    dc.transform(_ctm);
+    _nrstyle.prepareFill(dc, _item_bbox, _fill_pattern);
+    _nrstyle.prepareStroke(dc, _item_bbox, _stroke_pattern);
+}
+
 void DrawingShape::_clipItem(DrawingContext &dc, Geom::IntRect const & /*area*/)
 {
     if (!_curve) return;
@@ -292,11 +302,7 @@ void DrawingShape::_clipItem(DrawingContext &dc, Geom::IntRect const & /*area*/)
     Inkscape::DrawingContext::Save save(dc);
     // handle clip-rule
     if (_style) {
-        if (_style->clip_rule.computed == SP_WIND_RULE_EVENODD) {
-            dc.setFillRule(CAIRO_FILL_RULE_EVEN_ODD);
-        } else {
-            dc.setFillRule(CAIRO_FILL_RULE_WINDING);
-        }
+        dc.setFillRule(_nrstyle.clip_rule);
     }
     dc.transform(_ctm);
     dc.path(_curve->get_pathvector());
@@ -318,7 +324,7 @@ DrawingShape::_pickItem(Geom::Point const &p, double delta, unsigned flags)
     bool outline = _drawing.outline();
     bool pick_as_clip = flags & PICK_AS_CLIP;
 
-    if (SP_SCALE24_TO_FLOAT(_style->opacity.value) == 0 && !outline && !pick_as_clip) 
+    if (_opacity == 0 && !outline && !pick_as_clip) 
         // fully transparent, no pick unless outline mode
         return NULL;
 
@@ -344,8 +350,7 @@ DrawingShape::_pickItem(Geom::Point const &p, double delta, unsigned flags)
     int wind = 0;
     bool needfill = pick_as_clip || (_nrstyle.fill.type != NRStyle::PAINT_NONE &&
         _nrstyle.fill.opacity > 1e-3 && !outline);
-    bool wind_evenodd = pick_as_clip ? (_style->clip_rule.computed == SP_WIND_RULE_EVENODD) :
-        (_style->fill_rule.computed == SP_WIND_RULE_EVENODD);
+    bool wind_evenodd = (pick_as_clip ? _nrstyle.clip_rule : _nrstyle.fill_rule) == CAIRO_FILL_RULE_EVEN_ODD;
 
     // actual shape picking
     if (_drawing.arena()) {
@@ -27,6 +27,8 @@ public:
     DrawingShape(Drawing &drawing);
     ~DrawingShape();
 
+    virtual char const *typeName() const { return "DrawingShape"; }
+
     void setPath(SPCurve *curve);
     virtual void setStyle(SPStyle *style, SPStyle *context_style = NULL);
     virtual void setChildrenStyle(SPStyle *context_style);
@@ -37,6 +39,7 @@ protected:
     virtual unsigned _renderItem(DrawingContext &dc, Geom::IntRect const &area, unsigned flags,
                                  DrawingItem *stop_at);
     virtual void _clipItem(DrawingContext &dc, Geom::IntRect const &area);
+    virtual void _prepareItem(DrawingContext &dc);
     virtual DrawingItem *_pickItem(Geom::Point const &p, double delta, unsigned flags);
     virtual bool _canClip();
 
@@ -0,0 +1,169 @@
+/*
+ * Render performance statistics of a Drawing
+ *
+ * Copyright (C) 2018 Authors
+ *
+ * Released under GNU GPL, read the file 'COPYING' for more information
+ */
+
+#include <sstream>
+
+#include "display/drawing-statistics.h"
+
+namespace Inkscape {
+
+DrawingStatistics::Timer::Timer(DrawingStatistics *stats, TimingMap &map, char const *key)
+    : _stats(stats)
+    , _timing(map[key])
+    , _start(g_get_monotonic_time())
+    , _saved_nested(stats->_nested)
+{
+    _stats->_nested = 0;
+}
+
+DrawingStatistics::Timer::~Timer()
+{
+    gint64 elapsed = g_get_monotonic_time() - _start;
+    _timing.calls += 1;
+    _timing.total += elapsed;
+    _timing.self += elapsed - _stats->_nested;
+    // report our total time as nested time to the enclosing timer
+    _stats->_nested = _saved_nested + elapsed;
+}
+
+DrawingStatistics::DrawingStatistics()
+{
+    reset();
+}
+
+void DrawingStatistics::reset()
+{
+    _item_times.clear();
+    _primitive_times.clear();
+    _nested = 0;
+    _cache_hits = 0;
+    _cache_misses = 0;
+    _cache_evictions = 0;
+    _candidates_accepted = 0;
+    _candidates_rejected = 0;
+    _cache_bytes = 0;
+    _cache_bytes_peak = 0;
+}
+
+static void merge_timings(DrawingStatistics::TimingMap &to, DrawingStatistics::TimingMap const &from)
+{
+    for (DrawingStatistics::TimingMap::const_iterator i = from.begin(); i != from.end(); ++i) {
+        DrawingStatistics::Timing &t = to[i->first];
+        t.calls += i->second.calls;
+        t.total += i->second.total;
+        t.self += i->second.self;
+    }
+}
+
+/**
+ * Adds the counters of another instance to this one.
+ * Cache sizes are summed as well, since the caches of separate drawings coexist.
+ */
+void DrawingStatistics::merge(DrawingStatistics const &other)
+{
+    merge_timings(_item_times, other._item_times);
+    merge_timings(_primitive_times, other._primitive_times);
+    _cache_hits += other._cache_hits;
+    _cache_misses += other._cache_misses;
+    _cache_evictions += other._cache_evictions;
+    _candidates_accepted += other._candidates_accepted;
+    _candidates_rejected += other._candidates_rejected;
+    _cache_bytes += other._cache_bytes;
+    _cache_bytes_peak += other._cache_bytes_peak;
+}
+
+void DrawingStatistics::addTime(TimingMap &map, char const *key, gint64 usec)
+{
+    Timing &t = map[key];
+    t.calls += 1;
+    t.total += usec;
+    t.self += usec;
+}
+
+void DrawingStatistics::setCacheBytes(size_t bytes)
+{
+    _cache_bytes = bytes;
+    if (bytes > _cache_bytes_peak) {
+        _cache_bytes_peak = bytes;
+    }
+}
+
+static void write_json_string(std::ostream &os, std::string const &s)
+{
+    os << '"';
+    for (std::string::const_iterator i = s.begin(); i != s.end(); ++i) {
+        if (*i == '"' || *i == '\\') {
+            os << '\\';
+        }
+        os << *i;
+    }
+    os << '"';
+}
+
+static void write_json_timings(std::ostream &os, DrawingStatistics::TimingMap const &map)
+{
+    os << "{";
+    for (DrawingStatistics::TimingMap::const_iterator i = map.begin(); i != map.end(); ++i) {
+        os << (i == map.begin() ? "\n    " : ",\n    ");
+        write_json_string(os, i->first);
+        os << ": {\"calls\": " << i->second.calls
+           << ", \"total_us\": " << i->second.total
+           << ", \"self_us\": " << i->second.self << "}";
+    }
+    os << (map.empty() ? "}" : "\n  }");
+}
+
+/**
+ * Returns the statistics as a JSON object.
+ */
+std::string DrawingStatistics::toJSON() const
+{
+    std::ostringstream os;
+    os << "{\n  \"items\": ";
+    write_json_timings(os, _item_times);
+    os << ",\n  \"filter_primitives\": ";
+    write_json_timings(os, _primitive_times);
+    os << ",\n  \"cache\": {"
+       << "\n    \"hits\": " << _cache_hits
+       << ",\n    \"misses\": " << _cache_misses
+       << ",\n    \"evictions\": " << _cache_evictions
+       << ",\n    \"candidates_accepted\": " << _candidates_accepted
+       << ",\n    \"candidates_rejected\": " << _candidates_rejected
+       << ",\n    \"bytes\": " << _cache_bytes
+       << ",\n    \"peak_bytes\": " << _cache_bytes_peak
+       << "\n  }\n}\n";
+    return os.str();
+}
+
+/**
+ * Writes the JSON report to a file. Returns false if the file could not be written.
+ */
+bool DrawingStatistics::writeJSON(gchar const *filename) const
+{
+    std::string json = toJSON();
+    GError *error = NULL;
+    if (!g_file_set_contents(filename, json.data(), json.size(), &error)) {
+        g_warning("Could not write render statistics to %s: %s", filename, error->message);
+        g_error_free(error);
+        return false;
+    }
+    return true;
+}
+
+} // end namespace Inkscape
+
+/*
+  Local Variables:
+  mode:c++
+  c-file-style:"stroustrup"
+  c-file-offsets:((innamespace . 0)(inline-open . 0)(case-label . +))
+  indent-tabs-mode:nil
+  fill-column:99
+  End:
+*/
+// vim: filetype=cpp:expandtab:shiftwidth=4:tabstop=8:softtabstop=4:fileencoding=utf-8:textwidth=99 :
@@ -0,0 +1,119 @@
+#ifndef SEEN_INKSCAPE_DISPLAY_DRAWING_STATISTICS_H
+#define SEEN_INKSCAPE_DISPLAY_DRAWING_STATISTICS_H
+
+/*
+ * Render performance statistics of a Drawing
+ *
+ * Copyright (C) 2018 Authors
+ *
+ * Released under GNU GPL, read the file 'COPYING' for more information
+ */
+
+#include <cstddef>
+#include <map>
+#include <string>
+#include <boost/utility.hpp>
+#include <glib.h>
+
+namespace Inkscape {
+
+/**
+ * Counters describing where the rendering time of a Drawing goes.
+ *
+ * Collection is disabled by default; see Drawing::setStatisticsEnabled().
+ * Timings are wall-clock microseconds. The total time of an item includes the time
+ * of its children and filters, while its self time does not.
+ *
+ * The object is not thread-safe. Every Drawing has its own instance, so drawings
+ * rendered in parallel are accumulated separately and combined with merge().
+ */
+class DrawingStatistics
+    : boost::noncopyable
+{
+public:
+    struct Timing {
+        Timing() : calls(0), total(0), self(0) {}
+        guint64 calls;
+        gint64 total;
+        gint64 self;
+    };
+    typedef std::map<std::string, Timing> TimingMap;
+
+    /// Measures the scope it lives in and adds it to one entry of a timing map.
+    class Timer
+        : boost::noncopyable
+    {
+    public:
+        Timer(DrawingStatistics *stats, TimingMap &map, char const *key);
+        ~Timer();
+    private:
+        DrawingStatistics *_stats;
+        Timing &_timing;
+        gint64 _start;
+        gint64 _saved_nested;
+    };
+
+    DrawingStatistics();
+
+    void reset();
+    void merge(DrawingStatistics const &other);
+
+    TimingMap &itemTimes() { return _item_times; }
+    TimingMap const &itemTimes() const { return _item_times; }
+    TimingMap &primitiveTimes() { return _primitive_times; }
+    TimingMap const &primitiveTimes() const { return _primitive_times; }
+
+    /// Adds a measurement taken without a Timer, e.g. on another thread.
+    void addTime(TimingMap &map, char const *key, gint64 usec);
+    /// Counts usec as nested time of the running Timer, e.g. the wall-clock time of
+    /// work measured with addTime() on several threads at once.
+    void addNestedTime(gint64 usec) { _nested += usec; }
+
+    void cacheHit() { ++_cache_hits; }
+    void cacheMiss() { ++_cache_misses; }
+    void cacheEviction() { ++_cache_evictions; }
+    void candidatesPicked(size_t accepted, size_t rejected) {
+        _candidates_accepted += accepted;
+        _candidates_rejected += rejected;
+    }
+    void setCacheBytes(size_t bytes);
+
+    guint64 cacheHits() const { return _cache_hits; }
+    guint64 cacheMisses() const { return _cache_misses; }
+    guint64 cacheEvictions() const { return _cache_evictions; }
+    guint64 candidatesAccepted() const { return _candidates_accepted; }
+    guint64 candidatesRejected() const { return _candidates_rejected; }
+    size_t cacheBytes() const { return _cache_bytes; }
+    size_t cacheBytesPeak() const { return _cache_bytes_peak; }
+
+    std::string toJSON() const;
+    bool writeJSON(gchar const *filename) const;
+
+private:
+    TimingMap _item_times;
+    TimingMap _primitive_times;
+    gint64 _nested; ///< time spent in nested timers of the innermost running timer
+
+    guint64 _cache_hits;
+    guint64 _cache_misses;
+    guint64 _cache_evictions;
+    guint64 _candidates_accepted;
+    guint64 _candidates_rejected;
+    size_t _cache_bytes;
+    size_t _cache_bytes_peak;
+};
+
+} // end namespace Inkscape
+
+#endif // !SEEN_INKSCAPE_DISPLAY_DRAWING_STATISTICS_H
+
+/*
+  Local Variables:
+  mode:c++
+  c-file-style:"stroustrup"
+  c-file-offsets:((innamespace . 0)(inline-open . 0)(case-label . +))
+  indent-tabs-mode:nil
+  fill-column:99
+  End:
+*/
+// vim: filetype=cpp:expandtab:shiftwidth=4:tabstop=8:softtabstop=4:fileencoding=utf-8:textwidth=99 :
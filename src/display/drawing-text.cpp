@@ -15,6 +15,7 @@
 #include "display/drawing-context.h"
 #include "display/drawing-surface.h"
 #include "display/drawing-text.h"
+#include "display/glyph-cache.h"
 #include "helper/geom.h"
 #include "libnrtype/font-instance.h"
 #include "style.h"
@@ -43,6 +44,7 @@ DrawingGlyphs::~DrawingGlyphs()
 void
 DrawingGlyphs::setGlyph(font_instance *font, int glyph, Geom::Affine const &trans)
 {
+    _beforeChange();
     _markForRendering();
 
     setTransform(trans);
@@ -210,6 +212,7 @@ DrawingText::~DrawingText()
 void
 DrawingText::clear()
 {
+    _beforeChange();
     _markForRendering();
     _children.clear_and_dispose(DeleteDisposer());
 }
@@ -218,6 +221,7 @@ bool
 DrawingText::addComponent(font_instance *font, int glyph, Geom::Affine const &trans,
     float width, float ascent, float descent, float phase_length)
 {
+    _beforeChange();
 /* original, did not save a glyph for white space characters, causes problems for text-decoration
     if (!font || !font->PathVector(glyph)) {
         return(false);
@@ -440,7 +444,7 @@ void DrawingText::decorateItem(DrawingContext &dc, double phase_length, bool und
 unsigned DrawingText::_renderItem(DrawingContext &dc, Geom::IntRect const &/*area*/, unsigned /*flags*/, DrawingItem * /*stop_at*/)
 {
     if (_drawing.outline()) {
-        guint32 rgba = _drawing.outlinecolor;
+        guint32 rgba = _outlineColor();
         Inkscape::DrawingContext::Save save(dc);
         dc.setSource(rgba);
         dc.setTolerance(0.5); // low quality, but good enough for outline mode
@@ -574,8 +578,15 @@ unsigned DrawingText::_renderItem(DrawingContext &dc, Geom::IntRect const &/*are
             dc.newPath(); // Clear text-decoration path
         }
 
+        // Small glyphs filled without a stroke are composited from cached masks.
+        GlyphCache *glyph_cache = _drawing.glyphCache();
+        bool filled = false;
+        if (glyph_cache && has_fill && !has_stroke && _nrstyle.fill_rule == CAIRO_FILL_RULE_WINDING) {
+            filled = _fillFromGlyphCache(dc, *glyph_cache);
+        }
+
         // accumulate the path that represents the glyphs
-        for (ChildrenList::iterator i = _children.begin(); i != _children.end(); ++i) {
+        for (ChildrenList::iterator i = _children.begin(); !filled && i != _children.end(); ++i) {
             DrawingGlyphs *g = dynamic_cast<DrawingGlyphs *>(&*i);
             if (!g) throw InvalidItemException();
 
@@ -588,7 +599,7 @@ unsigned DrawingText::_renderItem(DrawingContext &dc, Geom::IntRect const &/*are
         }
 
         // Draw the glyphs.
-        {
+        if (!filled) {
             Inkscape::DrawingContext::Save save(dc);
             dc.transform(_ctm);
             if (has_fill && fill_first) {
@@ -598,7 +609,7 @@ unsigned DrawingText::_renderItem(DrawingContext &dc, Geom::IntRect const &/*are
         }
         {
             Inkscape::DrawingContext::Save save(dc);
-            if (!_style || !(_style->vector_effect.computed == SP_VECTOR_EFFECT_NON_SCALING_STROKE)) {
+            if (!_style || !_nrstyle.non_scaling_stroke) {
                 dc.transform(_ctm);
             }
             if (has_stroke) {
@@ -606,7 +617,7 @@ unsigned DrawingText::_renderItem(DrawingContext &dc, Geom::IntRect const &/*are
                 dc.strokePreserve();
             }
         }
-        {
+        if (!filled) {
             Inkscape::DrawingContext::Save save(dc);
             dc.transform(_ctm);
             if (has_fill && !fill_first) {
@@ -653,17 +664,124 @@ unsigned DrawingText::_renderItem(DrawingContext &dc, Geom::IntRect const &/*are
     return RENDER_OK;
 }
 
+/**
+ * Fills the glyphs by compositing their cached coverage masks into a single mask, which is
+ * painted with the fill. Glyphs which are too large or transformed to be cached are filled
+ * into the same mask from their outlines. Returns false if no glyph can use the cache.
+ */
+bool DrawingText::_fillFromGlyphCache(DrawingContext &dc, GlyphCache &cache)
+{
+    cairo_t *ct = dc.raw();
+    Geom::Affine to_device;
+    cairo_matrix_t m;
+    cairo_get_matrix(ct, &m);
+    ink_matrix_to_2geom(to_device, m);
+
+    struct GlyphMask {
+        cairo_surface_t *mask;
+        Geom::IntPoint origin;
+    };
+    std::vector<GlyphMask> masks;
+    std::vector<DrawingGlyphs *> outlines;
+    Geom::OptIntRect extents;
+    cairo_antialias_t antialias = cairo_get_antialias(ct);
+
+    for (ChildrenList::iterator i = _children.begin(); i != _children.end(); ++i) {
+        DrawingGlyphs *g = dynamic_cast<DrawingGlyphs *>(&*i);
+        if (!g) throw InvalidItemException();
+        if (g->_ctm.isSingular() || !g->_drawable) continue;
+
+        Geom::Affine glyph_to_device = g->_ctm * to_device;
+        if (!GlyphCache::canCache(glyph_to_device)) {
+            outlines.push_back(g);
+            Geom::OptRect b = bounds_exact_transformed(*g->_font->PathVector(g->_glyph), glyph_to_device);
+            if (b) {
+                extents.unionWith(b->roundOutwards());
+            }
+            continue;
+        }
+        GlyphMask gm;
+        gm.mask = cache.lookup(g->_font, g->_glyph, glyph_to_device, antialias, gm.origin);
+        if (gm.mask) {
+            masks.push_back(gm);
+            extents.unionWith(Geom::IntRect::from_xywh(gm.origin,
+                Geom::IntPoint(cairo_image_surface_get_width(gm.mask), cairo_image_surface_get_height(gm.mask))));
+        }
+    }
+
+    if (masks.empty() && !outlines.empty()) {
+        // nothing to gain from the cache
+        return false;
+    }
+
+    // limit the mask to the clip extents in device space
+    if (extents) {
+        Inkscape::DrawingContext::Save save(dc);
+        cairo_identity_matrix(ct);
+        double x0, y0, x1, y1;
+        cairo_clip_extents(ct, &x0, &y0, &x1, &y1);
+        extents.intersectWith(Geom::Rect(x0, y0, x1, y1).roundOutwards());
+    }
+
+    if (extents) {
+        cairo_surface_t *coverage = cairo_image_surface_create(CAIRO_FORMAT_A8,
+            extents->width(), extents->height());
+        cairo_t *cov = cairo_create(coverage);
+        cairo_set_operator(cov, CAIRO_OPERATOR_ADD);
+        for (std::vector<GlyphMask>::iterator i = masks.begin(); i != masks.end(); ++i) {
+            cairo_set_source_surface(cov, i->mask,
+                i->origin[Geom::X] - extents->left(), i->origin[Geom::Y] - extents->top());
+            cairo_paint(cov);
+        }
+        cairo_set_antialias(cov, antialias);
+        cairo_set_source_rgba(cov, 0, 0, 0, 1);
+        cairo_translate(cov, -extents->left(), -extents->top());
+        ink_cairo_transform(cov, to_device);
+        for (std::vector<DrawingGlyphs *>::iterator i = outlines.begin(); i != outlines.end(); ++i) {
+            cairo_save(cov);
+            ink_cairo_transform(cov, (*i)->_ctm);
+            feed_pathvector_to_cairo(cov, *(*i)->_font->PathVector((*i)->_glyph));
+            cairo_fill(cov);
+            cairo_restore(cov);
+        }
+        cairo_destroy(cov);
+        cairo_surface_mark_dirty(coverage);
+
+        Inkscape::DrawingContext::Save save(dc);
+        dc.transform(_ctm);
+        _nrstyle.applyFill(dc);
+        // the fill pattern stays locked to the user space it was set in
+        cairo_identity_matrix(ct);
+        cairo_mask_surface(ct, coverage, extents->left(), extents->top());
+        cairo_surface_destroy(coverage);
+    }
+
+    for (std::vector<GlyphMask>::iterator i = masks.begin(); i != masks.end(); ++i) {
+        cairo_surface_destroy(i->mask);
+    }
+    return true;
+}
+
+/// Creates the patterns of the fill, stroke and text decorations, which reads the paint servers.
+void DrawingText::_prepareItem(DrawingContext &dc)
+{
+    Inkscape::DrawingContext::Save save(dc);
+    dc.transform(_ctm);
+    _nrstyle.prepareFill(dc, _item_bbox, _fill_pattern);
+    _nrstyle.prepareStroke(dc, _item_bbox, _stroke_pattern);
+    if (_nrstyle.text_decoration_line != TEXT_DECORATION_LINE_CLEAR) {
+        _nrstyle.prepareTextDecorationFill(dc, _item_bbox, _fill_pattern);
+        _nrstyle.prepareTextDecorationStroke(dc, _item_bbox, _stroke_pattern);
+    }
+}
+
 void DrawingText::_clipItem(DrawingContext &dc, Geom::IntRect const &/*area*/)
 {
     Inkscape::DrawingContext::Save save(dc);
 
     // handle clip-rule
     if (_style) {
-        if (_style->clip_rule.computed == SP_WIND_RULE_EVENODD) {
-            dc.setFillRule(CAIRO_FILL_RULE_EVEN_ODD);
-        } else {
-            dc.setFillRule(CAIRO_FILL_RULE_WINDING);
-        }
+        dc.setFillRule(_nrstyle.clip_rule);
     }
 
     for (ChildrenList::iterator i = _children.begin(); i != _children.end(); ++i) {
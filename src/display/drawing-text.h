@@ -20,6 +20,8 @@ class font_instance;
 
 namespace Inkscape {
 
+class GlyphCache;
+
 class DrawingGlyphs
     : public DrawingItem
 {
@@ -27,6 +29,8 @@ public:
     DrawingGlyphs(Drawing &drawing);
     ~DrawingGlyphs();
 
+    virtual char const *typeName() const { return "DrawingGlyphs"; }
+
     void setGlyph(font_instance *font, int glyph, Geom::Affine const &trans);
     virtual void setStyle(SPStyle *style, SPStyle *context_style = NULL); // Not to be used
 
@@ -54,6 +58,8 @@ public:
     DrawingText(Drawing &drawing);
     ~DrawingText();
 
+    virtual char const *typeName() const { return "DrawingText"; }
+
     void clear();
     bool addComponent(font_instance *font, int glyph, Geom::Affine const &trans, 
         float width, float ascent, float descent, float phase_length);
@@ -66,9 +72,11 @@ protected:
     virtual unsigned _renderItem(DrawingContext &dc, Geom::IntRect const &area, unsigned flags,
                                  DrawingItem *stop_at);
     virtual void _clipItem(DrawingContext &dc, Geom::IntRect const &area);
+    virtual void _prepareItem(DrawingContext &dc);
     virtual DrawingItem *_pickItem(Geom::Point const &p, double delta, unsigned flags);
     virtual bool _canClip();
 
+    bool _fillFromGlyphCache(DrawingContext &dc, GlyphCache &cache);
     void decorateItem(DrawingContext &dc, double phase_length, bool under);
     void decorateStyle(DrawingContext &dc, double vextent, double xphase, Geom::Point const &p1, Geom::Point const &p2, double thickness);
     NRStyle _nrstyle;
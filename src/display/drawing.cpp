@@ -10,7 +10,13 @@
  * Released under GNU GPL, read the file 'COPYING' for more information
  */
 
+#include "config.h" // Needed for HAVE_OPENMP
+
 #include <algorithm>
+#if HAVE_OPENMP
+#include <omp.h>
+#endif //HAVE_OPENMP
+
 #include "display/drawing.h"
 #include "nr-filter-gaussian.h"
 #include "nr-filter-types.h"
@@ -18,6 +24,8 @@
 //grayscale colormode:
 #include "cairo-templates.h"
 #include "drawing-context.h"
+#include "drawing-surface.h"
+#include "preferences.h"
 
 
 namespace Inkscape {
@@ -39,22 +47,31 @@ Drawing::Drawing(SPCanvasArena *arena)
     , _colormode(COLORMODE_NORMAL)
     , _blur_quality(BLUR_QUALITY_BEST)
     , _filter_quality(Filters::FILTER_QUALITY_BEST)
+    , _num_threads(1)
+    , _image_outline(false)
     , _cache_score_threshold(50000.0)
     , _cache_budget(0)
     , _grayscale_colormatrix(std::vector<gdouble> (grayscale_value_matrix, grayscale_value_matrix + 20 ))
+    , _content_version(0)
+    , _statistics(NULL)
     , _canvasarena(arena)
 {
-
+    _colors.paths = 0x000000ff;
+    _colors.clippaths = 0x00ff00ff;
+    _colors.masks = 0x0000ffff;
+    _colors.images = 0xff0000ff;
 }
 
 Drawing::~Drawing()
 {
     delete _root;
+    delete _statistics;
 }
 
 void
 Drawing::setRoot(DrawingItem *item)
 {
+    signal_before_change.emit();
     delete _root;
     _root = item;
     if (item) {
@@ -105,26 +122,31 @@ Drawing::filterQuality() const
 void
 Drawing::setRenderMode(RenderMode mode)
 {
+    signal_before_change.emit();
     _rendermode = mode;
 }
 void
 Drawing::setColorMode(ColorMode mode)
 {
+    signal_before_change.emit();
     _colormode = mode;
 }
 void
 Drawing::setBlurQuality(int q)
 {
+    signal_before_change.emit();
     _blur_quality = q;
 }
 void
 Drawing::setFilterQuality(int q)
 {
+    signal_before_change.emit();
     _filter_quality = q;
 }
 void
 Drawing::setExact(bool e)
 {
+    signal_before_change.emit();
     _exact = e;
 }
 
@@ -136,6 +158,7 @@ Drawing::cacheLimit() const
 void
 Drawing::setCacheLimit(Geom::OptIntRect const &r)
 {
+    signal_before_change.emit();
     _cache_limit = r;
     for (std::set<DrawingItem *>::iterator i = _cached_items.begin();
          i != _cached_items.end(); ++i)
@@ -146,12 +169,57 @@ Drawing::setCacheLimit(Geom::OptIntRect const &r)
 void
 Drawing::setCacheBudget(size_t bytes)
 {
+    signal_before_change.emit();
     _cache_budget = bytes;
     _pickItemsForCaching();
 }
 
+void
+Drawing::setFilterCacheBudget(size_t bytes)
+{
+    signal_before_change.emit();
+    _filter_cache.setBudget(bytes);
+}
+
+void
+Drawing::setGlyphCacheBudget(size_t bytes)
+{
+    signal_before_change.emit();
+    _glyph_cache.setBudget(bytes);
+}
+
+/**
+ * Enable or disable collection of render statistics.
+ * Disabling discards the counters collected so far.
+ */
+void
+Drawing::setStatisticsEnabled(bool enabled)
+{
+    if (enabled && !_statistics) {
+        _statistics = new DrawingStatistics();
+    } else if (!enabled) {
+        delete _statistics;
+        _statistics = NULL;
+    }
+}
+
+/// Number of bytes currently held by the render caches of items.
+size_t
+Drawing::cacheBytes() const
+{
+    size_t bytes = 0;
+    for (std::set<DrawingItem *>::const_iterator i = _cached_items.begin(); i != _cached_items.end(); ++i) {
+        if ((*i)->_cache) {
+            Geom::IntPoint px = (*i)->_cache->pixels();
+            bytes += static_cast<size_t>(px[Geom::X]) * px[Geom::Y] * 4;
+        }
+    }
+    return bytes;
+}
+
 void
 Drawing::setGrayscaleMatrix(gdouble value_matrix[20]) {
+    signal_before_change.emit();
     _grayscale_colormatrix = Filters::FilterColorMatrix::ColorMatrixMatrix( 
         std::vector<gdouble> (value_matrix, value_matrix + 20) );
 }
@@ -159,6 +227,12 @@ Drawing::setGrayscaleMatrix(gdouble value_matrix[20]) {
 void
 Drawing::update(Geom::IntRect const &area, UpdateContext const &ctx, unsigned flags, unsigned reset)
 {
+    _loadPreferences();
+    if (_root && !reset && !_root->_propagate_state && (~_root->_state & flags) == 0) {
+        // everything is up to date; do not disturb background renderers
+        return;
+    }
+    signal_before_change.emit();
     if (_root) {
         _root->update(area, ctx, flags, reset);
     }
@@ -176,6 +250,9 @@ Drawing::render(DrawingContext &dc, Geom::IntRect const &area, unsigned flags, i
         _root->render(dc, area, flags);
         _root->setAntialiasing(prev_a);
     }
+    if (_statistics) {
+        _statistics->setCacheBytes(cacheBytes());
+    }
 
     if (colorMode() == COLORMODE_GRAYSCALE) {
         // apply grayscale filter on top of everything
@@ -192,6 +269,62 @@ Drawing::render(DrawingContext &dc, Geom::IntRect const &area, unsigned flags, i
     }
 }
 
+/**
+ * Does the part of rendering an area which reads the document, such as creating the
+ * patterns of paint servers, so that the area can then be rendered on another thread.
+ * Returns false if the area shows items which read the document whenever they are
+ * rendered, like filters with feImage; such areas must be rendered on the main thread.
+ */
+bool
+Drawing::prepareRender(Geom::IntRect const &area)
+{
+    if (!_root) return true;
+
+    cairo_surface_t *scratch = cairo_image_surface_create(CAIRO_FORMAT_ARGB32, 1, 1);
+    bool prepared;
+    {
+        DrawingContext dc(scratch, area.min());
+        prepared = _root->prepareRender(dc, area);
+    }
+    cairo_surface_destroy(scratch);
+    return prepared;
+}
+
+/**
+ * Reads the preferences which affect rendering. Called on the main thread, so that
+ * rendering, which may run on other threads, never reads the preferences.
+ */
+void
+Drawing::_loadPreferences()
+{
+    Inkscape::Preferences *prefs = Inkscape::Preferences::get();
+    int blur_quality = prefs->getInt("/options/blurquality/value", 0);
+    int filter_quality = prefs->getInt("/options/filterquality/value", 0);
+    int num_threads = 1;
+#if HAVE_OPENMP
+    num_threads = prefs->getIntLimited("/options/threading/numthreads", omp_get_num_procs(), 1, 256);
+#endif //HAVE_OPENMP
+    bool image_outline = prefs->getBool("/options/rendering/imageinoutlinemode", false);
+    OutlineColors colors = _colors;
+    colors.clippaths = prefs->getInt("/options/wireframecolors/clips", 0x00ff00ff);
+    colors.masks = prefs->getInt("/options/wireframecolors/masks", 0x0000ffff);
+    colors.images = prefs->getInt("/options/wireframecolors/images", 0xff0000ff);
+
+    if (blur_quality == _blur_quality && filter_quality == _filter_quality &&
+        num_threads == _num_threads && image_outline == _image_outline &&
+        colors.clippaths == _colors.clippaths && colors.masks == _colors.masks &&
+        colors.images == _colors.images)
+    {
+        return;
+    }
+    signal_before_change.emit();
+    _blur_quality = blur_quality;
+    _filter_quality = filter_quality;
+    _num_threads = num_threads;
+    _image_outline = image_outline;
+    _colors = colors;
+}
+
 DrawingItem *
 Drawing::pick(Geom::Point const &p, double delta, unsigned flags)
 {
@@ -218,6 +351,9 @@ Drawing::_pickItemsForCaching()
         j->item->setCached(true);
         to_cache.insert(j->item);
     }
+    if (_statistics) {
+        _statistics->candidatesPicked(to_cache.size(), _candidate_items.size() - to_cache.size());
+    }
     // Everything which is now in _cached_items but not in to_cache must be uncached
     // Note that calling setCached on an item modifies _cached_items
     // TODO: find a way to avoid the set copy
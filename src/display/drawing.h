@@ -19,7 +19,10 @@
 #include <sigc++/sigc++.h>
 
 #include "display/drawing-item.h"
+#include "display/drawing-statistics.h"
+#include "display/glyph-cache.h"
 #include "display/rendermode.h"
+#include "nr-filter-cache.h"
 #include "nr-filter-colormatrix.h"
 
 typedef struct _SPCanvasArena SPCanvasArena;
@@ -53,6 +56,10 @@ public:
     bool renderFilters() const;
     int blurQuality() const;
     int filterQuality() const;
+    /// Number of threads over which filters may spread their work.
+    int numThreads() const { return _num_threads; }
+    /// Whether images are shown rather than outlined in outline mode.
+    bool imageOutline() const { return _image_outline; }
     void setRenderMode(RenderMode mode);
     void setColorMode(ColorMode mode);
     void setBlurQuality(int q);
@@ -62,6 +69,18 @@ public:
     Geom::OptIntRect const &cacheLimit() const;
     void setCacheLimit(Geom::OptIntRect const &r);
     void setCacheBudget(size_t bytes);
+    void setFilterCacheBudget(size_t bytes);
+    Filters::FilterCache &filterCache() { return _filter_cache; }
+    /// Changes whenever the appearance of any item of the drawing changes
+    guint64 contentVersion() const { return _content_version; }
+    void setGlyphCacheBudget(size_t bytes);
+    /// Returns the cache of rasterized glyphs, or NULL if text must be filled from outlines.
+    GlyphCache *glyphCache() { return (_exact || _glyph_cache.budget() == 0) ? NULL : &_glyph_cache; }
+    size_t cacheBytes() const;
+
+    void setStatisticsEnabled(bool enabled);
+    /// Returns the collected render statistics, or NULL when collection is disabled.
+    DrawingStatistics *statistics() { return _statistics; }
 
     OutlineColors const &colors() const { return _colors; }
 
@@ -69,13 +88,22 @@ public:
 
     void update(Geom::IntRect const &area = Geom::IntRect::infinite(), UpdateContext const &ctx = UpdateContext(), unsigned flags = DrawingItem::STATE_ALL, unsigned reset = 0);
     void render(DrawingContext &dc, Geom::IntRect const &area, unsigned flags = 0, int antialiasing = -1);
+    bool prepareRender(Geom::IntRect const &area);
     DrawingItem *pick(Geom::Point const &p, double delta, unsigned flags);
 
     sigc::signal<void, DrawingItem *> signal_request_update;
     sigc::signal<void, Geom::IntRect const &> signal_request_render;
+    /// Emitted with the area of an item whose appearance changed, unlike the areas which are
+    /// only rendered again for a new canvas transform. The flag is false when the area does
+    /// not scale with the zoom, e.g. for non-scaling strokes or filters.
+    sigc::signal<void, Geom::IntRect const &, bool> signal_appearance_changed;
     sigc::signal<void, DrawingItem *> signal_item_deleted;
+    /// Emitted before the drawing or any of its items is modified, so that
+    /// renderers running on other threads can finish first.
+    sigc::signal<void> signal_before_change;
 
 private:
+    void _loadPreferences();
     void _pickItemsForCaching();
 
     typedef std::list<CacheRecord> CandidateList;
@@ -93,6 +121,8 @@ private:
     ColorMode _colormode;
     int _blur_quality;
     int _filter_quality;
+    int _num_threads;
+    bool _image_outline;
     Geom::OptIntRect _cache_limit;
 
     double _cache_score_threshold; ///< do not consider objects for caching below this score
@@ -100,6 +130,10 @@ private:
 
     OutlineColors _colors;
     Filters::FilterColorMatrix::ColorMatrixMatrix _grayscale_colormatrix;
+    Filters::FilterCache _filter_cache; ///< final results of filters, disabled by default
+    guint64 _content_version; ///< see contentVersion(), also numbers the versions of items
+    GlyphCache _glyph_cache; ///< coverage masks of small glyphs, disabled by default
+    DrawingStatistics *_statistics; ///< NULL unless statistics collection is enabled
     SPCanvasArena *_canvasarena; // may be NULL if this arena is not the screen
                                  // but used for export etc.
 
@@ -0,0 +1,187 @@
+/*
+ * Cache of rasterized glyph coverage masks
+ *
+ * Copyright (C) 2018 Authors
+ *
+ * Released under GNU GPL, read the file 'COPYING' for more information
+ */
+
+#include <cmath>
+#include <2geom/pathvector.h>
+
+#include "display/cairo-utils.h"
+#include "display/glyph-cache.h"
+#include "helper/geom.h"
+#include "libnrtype/font-instance.h"
+
+namespace Inkscape {
+
+bool GlyphCache::Key::operator<(Key const &other) const
+{
+    if (font != other.font) return font < other.font;
+    if (glyph != other.glyph) return glyph < other.glyph;
+    if (scale_x != other.scale_x) return scale_x < other.scale_x;
+    if (scale_y != other.scale_y) return scale_y < other.scale_y;
+    if (subpixel_x != other.subpixel_x) return subpixel_x < other.subpixel_x;
+    if (subpixel_y != other.subpixel_y) return subpixel_y < other.subpixel_y;
+    return antialias < other.antialias;
+}
+
+GlyphCache::GlyphCache()
+    : _budget(0)
+    , _size(0)
+{}
+
+GlyphCache::~GlyphCache()
+{
+    clear();
+}
+
+void GlyphCache::setBudget(size_t bytes)
+{
+    _budget = bytes;
+    _evict(_budget);
+}
+
+/**
+ * Returns true if glyphs drawn with the given transform from glyph (em) space to device
+ * space can be served from the cache, i.e. the transform only scales and translates,
+ * and the glyphs are small.
+ */
+bool GlyphCache::canCache(Geom::Affine const &glyph_to_device)
+{
+    double sx = fabs(glyph_to_device[0]);
+    double sy = fabs(glyph_to_device[3]);
+    if (sx > MAX_EM_SIZE || sy > MAX_EM_SIZE || sx < 1e-3 || sy < 1e-3) {
+        return false;
+    }
+    // rotation or skew must not move any point of the em box by more than 1/1000 pixel
+    return fabs(glyph_to_device[1]) < 1e-3 && fabs(glyph_to_device[2]) < 1e-3;
+}
+
+/**
+ * Returns a new reference to the coverage mask of a glyph, or NULL if the glyph has no
+ * outline. The glyph is rasterized if it is not cached yet. The transform must satisfy
+ * canCache(). The device position of the top left pixel of the mask is stored in origin.
+ */
+cairo_surface_t *GlyphCache::lookup(font_instance *font, int glyph, Geom::Affine const &glyph_to_device,
+                                    cairo_antialias_t antialias, Geom::IntPoint &origin)
+{
+    Geom::Point t = glyph_to_device.translation();
+    Geom::IntPoint pixel(floor(t[Geom::X]), floor(t[Geom::Y]));
+
+    Key key;
+    key.font = font;
+    key.glyph = glyph;
+    key.scale_x = glyph_to_device[0];
+    key.scale_y = glyph_to_device[3];
+    key.subpixel_x = round((t[Geom::X] - pixel[Geom::X]) * SUBPIXEL_STEPS);
+    key.subpixel_y = round((t[Geom::Y] - pixel[Geom::Y]) * SUBPIXEL_STEPS);
+    key.antialias = antialias;
+    if (key.subpixel_x == SUBPIXEL_STEPS) {
+        key.subpixel_x = 0;
+        pixel[Geom::X] += 1;
+    }
+    if (key.subpixel_y == SUBPIXEL_STEPS) {
+        key.subpixel_y = 0;
+        pixel[Geom::Y] += 1;
+    }
+
+    std::map<Key, EntryList::iterator>::iterator found = _index.find(key);
+    if (found != _index.end()) {
+        // move to the front of the LRU list
+        _entries.splice(_entries.begin(), _entries, found->second);
+        Entry &e = *found->second;
+        origin = pixel + e.offset;
+        return e.mask ? cairo_surface_reference(e.mask) : NULL;
+    }
+
+    Geom::IntPoint offset;
+    cairo_surface_t *mask = _rasterize(key, offset);
+    origin = pixel + offset;
+
+    size_t size = sizeof(Entry);
+    if (mask) {
+        size += cairo_image_surface_get_stride(mask) * cairo_image_surface_get_height(mask);
+    }
+    if (size <= _budget) {
+        _evict(_budget - size);
+        Entry e;
+        e.key = key;
+        e.mask = mask ? cairo_surface_reference(mask) : NULL;
+        e.offset = offset;
+        e.size = size;
+        font->Ref();
+        _entries.push_front(e);
+        _index.insert(std::make_pair(key, _entries.begin()));
+        _size += size;
+    }
+    return mask;
+}
+
+void GlyphCache::clear()
+{
+    _evict(0);
+}
+
+cairo_surface_t *GlyphCache::_rasterize(Key const &key, Geom::IntPoint &offset)
+{
+    offset = Geom::IntPoint(0, 0);
+    Geom::PathVector *pathv = key.font->PathVector(key.glyph);
+    if (!pathv) {
+        return NULL;
+    }
+
+    Geom::Affine m(key.scale_x, 0, 0, key.scale_y,
+                   double(key.subpixel_x) / SUBPIXEL_STEPS, double(key.subpixel_y) / SUBPIXEL_STEPS);
+    Geom::OptRect bounds = bounds_exact_transformed(*pathv, m);
+    if (!bounds || bounds->hasZeroArea()) {
+        return NULL;
+    }
+    // one pixel of padding for antialiasing
+    Geom::IntRect area = bounds->roundOutwards();
+    area.expandBy(1);
+
+    cairo_surface_t *mask = cairo_image_surface_create(CAIRO_FORMAT_A8, area.width(), area.height());
+    cairo_t *ct = cairo_create(mask);
+    cairo_set_antialias(ct, static_cast<cairo_antialias_t>(key.antialias));
+    cairo_translate(ct, -area.left(), -area.top());
+    ink_cairo_transform(ct, m);
+    feed_pathvector_to_cairo(ct, *pathv);
+    cairo_fill(ct);
+    cairo_destroy(ct);
+
+    offset = area.min();
+    return mask;
+}
+
+void GlyphCache::_remove(EntryList::iterator e)
+{
+    _size -= e->size;
+    if (e->mask) {
+        cairo_surface_destroy(e->mask);
+    }
+    e->key.font->Unref();
+    _index.erase(e->key);
+    _entries.erase(e);
+}
+
+void GlyphCache::_evict(size_t limit)
+{
+    while (_size > limit && !_entries.empty()) {
+        _remove(--_entries.end());
+    }
+}
+
+} // end namespace Inkscape
+
+/*
+  Local Variables:
+  mode:c++
+  c-file-style:"stroustrup"
+  c-file-offsets:((innamespace . 0)(inline-open . 0)(case-label . +))
+  indent-tabs-mode:nil
+  fill-column:99
+  End:
+*/
+// vim: filetype=cpp:expandtab:shiftwidth=4:tabstop=8:softtabstop=4:fileencoding=utf-8:textwidth=99 :
@@ -0,0 +1,96 @@
+#ifndef SEEN_INKSCAPE_DISPLAY_GLYPH_CACHE_H
+#define SEEN_INKSCAPE_DISPLAY_GLYPH_CACHE_H
+
+/*
+ * Cache of rasterized glyph coverage masks
+ *
+ * Copyright (C) 2018 Authors
+ *
+ * Released under GNU GPL, read the file 'COPYING' for more information
+ */
+
+#include <cstddef>
+#include <list>
+#include <map>
+#include <2geom/affine.h>
+#include <2geom/int-point.h>
+#include <boost/utility.hpp>
+#include <cairo.h>
+
+class font_instance;
+
+namespace Inkscape {
+
+/**
+ * Rasterized glyphs of small, unrotated text, shared by all text items of a Drawing.
+ *
+ * A glyph is stored as an A8 coverage mask, like an entry of a glyph atlas. Masks are
+ * keyed by font, glyph ID, scale, antialiasing mode and the subpixel offset of the glyph
+ * origin, quantized to 1/SUBPIXEL_STEPS of a pixel. Only transforms without rotation or
+ * skew and with an em size of at most MAX_EM_SIZE pixels can be cached; larger or
+ * transformed glyphs are filled from their outlines. Entries hold a reference to their
+ * font and are evicted in least recently used order once the byte budget is exceeded.
+ */
+class GlyphCache
+    : boost::noncopyable
+{
+public:
+    static int const SUBPIXEL_STEPS = 4;
+    static int const MAX_EM_SIZE = 48;
+
+    GlyphCache();
+    ~GlyphCache();
+
+    size_t budget() const { return _budget; }
+    void setBudget(size_t bytes);
+    /// Bytes held by the cached masks
+    size_t size() const { return _size; }
+
+    static bool canCache(Geom::Affine const &glyph_to_device);
+    cairo_surface_t *lookup(font_instance *font, int glyph, Geom::Affine const &glyph_to_device,
+                            cairo_antialias_t antialias, Geom::IntPoint &origin);
+    void clear();
+
+private:
+    struct Key {
+        font_instance *font;
+        int glyph;
+        double scale_x;
+        double scale_y;
+        int subpixel_x;
+        int subpixel_y;
+        int antialias;
+        bool operator<(Key const &other) const;
+    };
+    struct Entry {
+        Key key;
+        cairo_surface_t *mask; ///< NULL for glyphs without outline
+        Geom::IntPoint offset; ///< position of the mask relative to the glyph origin pixel
+        size_t size;
+    };
+    typedef std::list<Entry> EntryList;
+
+    static cairo_surface_t *_rasterize(Key const &key, Geom::IntPoint &offset);
+    void _remove(EntryList::iterator e);
+    void _evict(size_t limit);
+
+    EntryList _entries; ///< most recently used first
+    std::map<Key, EntryList::iterator> _index;
+    size_t _budget;
+    size_t _size;
+};
+
+} // end namespace Inkscape
+
+#endif // !SEEN_INKSCAPE_DISPLAY_GLYPH_CACHE_H
+
+/*
+  Local Variables:
+  mode:c++
+  c-file-style:"stroustrup"
+  c-file-offsets:((innamespace . 0)(inline-open . 0)(case-label . +))
+  indent-tabs-mode:nil
+  fill-column:99
+  End:
+*/
+// vim: filetype=cpp:expandtab:shiftwidth=4:tabstop=8:softtabstop=4:fileencoding=utf-8:textwidth=99 :
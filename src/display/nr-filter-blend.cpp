@@ -106,7 +106,7 @@ void FilterBlend::render_cairo(FilterSlot &slot)
     // filter use the same color interpolation space so we don't copy the input before converting.
     SPColorInterpolation ci_fp  = SP_CSS_COLOR_INTERPOLATION_AUTO;
     if( _style ) {
-        ci_fp = (SPColorInterpolation)_style->color_interpolation_filters.computed;
+        ci_fp = (SPColorInterpolation)_color_interpolation;
     }
     set_cairo_surface_ci( input1, ci_fp );
     set_cairo_surface_ci( input2, ci_fp );
@@ -149,6 +149,12 @@ bool FilterBlend::uses_background()
             _input2 == NR_FILTER_BACKGROUNDIMAGE || _input2 == NR_FILTER_BACKGROUNDALPHA);
 }
 
+void FilterBlend::get_inputs(std::vector<int> &inputs)
+{
+    inputs.push_back(_input);
+    inputs.push_back(_input2);
+}
+
 void FilterBlend::set_input(int slot) {
     _input = slot;
 }
@@ -54,6 +54,7 @@ public:
     virtual bool can_handle_affine(Geom::Affine const &);
     virtual double complexity(Geom::Affine const &ctm);
     virtual bool uses_background();
+    virtual void get_inputs(std::vector<int> &inputs);
 
     virtual void set_input(int slot);
     virtual void set_input(int input, int slot);
@@ -0,0 +1,172 @@
+/*
+ * Cache of rendered filter results
+ *
+ * Copyright (C) 2018 Authors
+ *
+ * Released under GNU GPL, read the file 'COPYING' for more information
+ */
+
+#include <cstring>
+#include <cairo.h>
+
+#include "display/nr-filter-cache.h"
+
+namespace Inkscape {
+namespace Filters {
+
+namespace {
+
+/// Mixes a value into a running hash, like boost::hash_combine.
+void hash_combine(size_t &seed, guint64 value)
+{
+    value *= G_GUINT64_CONSTANT(0x87c37b91114253d5);
+    value ^= value >> 31;
+    seed ^= static_cast<size_t>(value) + 0x9e3779b9 + (seed << 6) + (seed >> 2);
+}
+
+void hash_coord(size_t &seed, Geom::Coord value)
+{
+    guint64 bits;
+    memcpy(&bits, &value, sizeof(bits));
+    hash_combine(seed, bits);
+}
+
+void hash_rect(size_t &seed, Geom::OptRect const &rect)
+{
+    if (!rect) {
+        hash_combine(seed, 0);
+        return;
+    }
+    hash_coord(seed, rect->left());
+    hash_coord(seed, rect->top());
+    hash_coord(seed, rect->right());
+    hash_coord(seed, rect->bottom());
+}
+
+} // namespace
+
+FilterCacheKey::FilterCacheKey()
+    : item(NULL)
+    , item_version(0)
+    , filter_version(0)
+    , background_version(0)
+    , filter_quality(0)
+    , blur_quality(0)
+{
+}
+
+bool FilterCacheKey::operator==(FilterCacheKey const &other) const
+{
+    // the item and versions differ most often, so they are compared first
+    return item == other.item
+        && item_version == other.item_version
+        && filter_version == other.filter_version
+        && background_version == other.background_version
+        && ctm == other.ctm
+        && bbox == other.bbox
+        && filter_area == other.filter_area
+        && filter_quality == other.filter_quality
+        && blur_quality == other.blur_quality;
+}
+
+size_t FilterCacheKey::Hash::operator()(FilterCacheKey const &key) const
+{
+    size_t seed = 0;
+    hash_combine(seed, reinterpret_cast<guintptr>(key.item));
+    hash_combine(seed, key.item_version);
+    hash_combine(seed, key.filter_version);
+    hash_combine(seed, key.background_version);
+    for (unsigned i = 0; i < 6; ++i) {
+        hash_coord(seed, key.ctm[i]);
+    }
+    hash_rect(seed, key.bbox);
+    hash_rect(seed, key.filter_area);
+    hash_combine(seed, key.filter_quality);
+    hash_combine(seed, key.blur_quality);
+    return seed;
+}
+
+FilterCache::FilterCache()
+    : _budget(0)
+    , _size(0)
+{
+}
+
+FilterCache::~FilterCache()
+{
+    clear();
+}
+
+void FilterCache::setBudget(size_t bytes)
+{
+    _budget = bytes;
+    _evict(_budget);
+}
+
+cairo_surface_t *FilterCache::lookup(FilterCacheKey const &key, Geom::IntRect const &area, Geom::IntRect &covered)
+{
+    EntryIndex::iterator found = _index.find(key);
+    if (found == _index.end() || !found->second->area.contains(area)) {
+        return NULL;
+    }
+    // move to the front of the LRU list
+    _entries.splice(_entries.begin(), _entries, found->second);
+    covered = found->second->area;
+    return cairo_surface_reference(found->second->surface);
+}
+
+void FilterCache::insert(FilterCacheKey const &key, cairo_surface_t *result, Geom::IntRect const &area)
+{
+    size_t size = cairo_image_surface_get_stride(result) * cairo_image_surface_get_height(result);
+    // results larger than the whole budget would only flush the cache
+    if (size > _budget) return;
+
+    EntryIndex::iterator found = _index.find(key);
+    if (found != _index.end()) {
+        _size -= found->second->size;
+        cairo_surface_destroy(found->second->surface);
+        _entries.erase(found->second);
+        _index.erase(found);
+    }
+
+    _evict(_budget - size);
+
+    Entry e;
+    e.key = key;
+    e.surface = cairo_surface_reference(result);
+    e.area = area;
+    e.size = size;
+    _entries.push_front(e);
+    _index[key] = _entries.begin();
+    _size += size;
+}
+
+void FilterCache::clear()
+{
+    _evict(0);
+}
+
+void FilterCache::_evict(size_t limit)
+{
+    while (_size > limit && !_entries.empty()) {
+        Entry &e = _entries.back();
+        _size -= e.size;
+        cairo_surface_destroy(e.surface);
+        _index.erase(e.key);
+        _entries.pop_back();
+    }
+}
+
+} /* namespace Filters */
+} /* namespace Inkscape */
+
+/*
+  Local Variables:
+  mode:c++
+  c-file-style:"stroustrup"
+  c-file-offsets:((innamespace . 0)(inline-open . 0)(case-label . +))
+  indent-tabs-mode:nil
+  fill-column:99
+  End:
+*/
+// vim: filetype=cpp:expandtab:shiftwidth=4:tabstop=8:softtabstop=4:fileencoding=utf-8:textwidth=99 :
@@ -0,0 +1,110 @@
+#ifndef SEEN_NR_FILTER_CACHE_H
+#define SEEN_NR_FILTER_CACHE_H
+
+/*
+ * Cache of rendered filter results
+ *
+ * Copyright (C) 2018 Authors
+ *
+ * Released under GNU GPL, read the file 'COPYING' for more information
+ */
+
+#include <cstddef>
+#include <list>
+#include <boost/utility.hpp>
+#include <glib.h>
+#include <2geom/affine.h>
+#include <2geom/rect.h>
+#include "util/unordered-containers.h"
+
+extern "C" {
+typedef struct _cairo_surface cairo_surface_t;
+}
+
+namespace Inkscape {
+namespace Filters {
+
+/**
+ * Everything the result of a filter depends on. The pixels of the source and background
+ * images are not compared; content versions stand for them, which change whenever what
+ * is drawn there changes. Results cover the whole filter region, so the area being
+ * rendered is not part of the key.
+ */
+struct FilterCacheKey {
+    FilterCacheKey();
+
+    void const *item;           ///< the filtered DrawingItem
+    guint64 item_version;       ///< content version of the item
+    guint64 filter_version;     ///< version of the filter parameters
+    guint64 background_version; ///< content version of the drawing when the background is read
+    Geom::Affine ctm;
+    Geom::OptRect bbox;         ///< bounding box of the item
+    Geom::OptRect filter_area;  ///< filter region in the user space of the item
+    int filter_quality;
+    int blur_quality;
+
+    bool operator==(FilterCacheKey const &other) const;
+
+    struct Hash {
+        size_t operator()(FilterCacheKey const &key) const;
+    };
+};
+
+/**
+ * Cache of final filter outputs, shared by all filtered items of a Drawing.
+ *
+ * A lookup only succeeds when all inputs of the filter are equal to those of the stored
+ * result, so stale entries never need to be invalidated; they are evicted in least
+ * recently used order once the byte budget is exceeded.
+ */
+class FilterCache
+    : boost::noncopyable
+{
+public:
+    FilterCache();
+    ~FilterCache();
+
+    size_t budget() const { return _budget; }
+    void setBudget(size_t bytes);
+    /// Bytes held by the cached surfaces
+    size_t size() const { return _size; }
+
+    /// Returns a new reference to the cached result for the key if it covers area, or NULL.
+    /// The area covered by the result is stored in covered.
+    cairo_surface_t *lookup(FilterCacheKey const &key, Geom::IntRect const &area, Geom::IntRect &covered);
+    /// Stores a reference to the surface as the result for the key, covering area.
+    void insert(FilterCacheKey const &key, cairo_surface_t *result, Geom::IntRect const &area);
+    void clear();
+
+private:
+    struct Entry {
+        FilterCacheKey key;
+        cairo_surface_t *surface;
+        Geom::IntRect area;
+        size_t size;
+    };
+    typedef std::list<Entry> EntryList;
+    typedef INK_UNORDERED_MAP<FilterCacheKey, EntryList::iterator, FilterCacheKey::Hash> EntryIndex;
+
+    void _evict(size_t limit);
+
+    EntryList _entries; ///< most recently used first
+    EntryIndex _index;
+    size_t _budget;
+    size_t _size;
+};
+
+} /* namespace Filters */
+} /* namespace Inkscape */
+
+#endif /* SEEN_NR_FILTER_CACHE_H */
+/*
+  Local Variables:
+  mode:c++
+  c-file-style:"stroustrup"
+  c-file-offsets:((innamespace . 0)(inline-open . 0)(case-label . +))
+  indent-tabs-mode:nil
+  fill-column:99
+  End:
+*/
+// vim: filetype=cpp:expandtab:shiftwidth=4:tabstop=8:softtabstop=4:fileencoding=utf-8:textwidth=99 :
@@ -15,6 +15,7 @@
 #include "display/cairo-templates.h"
 #include "display/cairo-utils.h"
 #include "display/nr-filter-colormatrix.h"
+#include "display/nr-filter-simd.h"
 #include "display/nr-filter-slot.h"
 #include <2geom/math-utils.h>
 
@@ -32,7 +33,9 @@ FilterPrimitive * FilterColorMatrix::create() {
 FilterColorMatrix::~FilterColorMatrix()
 {}
 
-FilterColorMatrix::ColorMatrixMatrix::ColorMatrixMatrix(std::vector<double> const &values) {
+FilterColorMatrix::ColorMatrixMatrix::ColorMatrixMatrix(std::vector<double> const &values)
+    : _simd(pixel_simd_supported())
+{
     unsigned limit = std::min(static_cast<size_t>(20), values.size());
     for (unsigned i = 0; i < limit; ++i) {
         if (i % 5 == 4) {
@@ -47,32 +50,13 @@ FilterColorMatrix::ColorMatrixMatrix::ColorMatrixMatrix(std::vector<double> cons
 }
 
 guint32 FilterColorMatrix::ColorMatrixMatrix::operator()(guint32 in) {
-    EXTRACT_ARGB32(in, a, r, g, b)
-    // we need to un-premultiply alpha values for this type of matrix
-    // TODO: unpremul can be ignored if there is an identity mapping on the alpha channel
-    if (a != 0) {
-        r = unpremul_alpha(r, a);
-        g = unpremul_alpha(g, a);
-        b = unpremul_alpha(b, a);
-    }
-
-    gint32 ro = r*_v[0]  + g*_v[1]  + b*_v[2]  + a*_v[3]  + _v[4];
-    gint32 go = r*_v[5]  + g*_v[6]  + b*_v[7]  + a*_v[8]  + _v[9];
-    gint32 bo = r*_v[10] + g*_v[11] + b*_v[12] + a*_v[13] + _v[14];
-    gint32 ao = r*_v[15] + g*_v[16] + b*_v[17] + a*_v[18] + _v[19];
-    ro = (pxclamp(ro, 0, 255*255) + 127) / 255;
-    go = (pxclamp(go, 0, 255*255) + 127) / 255;
-    bo = (pxclamp(bo, 0, 255*255) + 127) / 255;
-    ao = (pxclamp(ao, 0, 255*255) + 127) / 255;
-
-    ro = premul_alpha(ro, ao);
-    go = premul_alpha(go, ao);
-    bo = premul_alpha(bo, ao);
-
-    ASSEMBLE_ARGB32(pxout, ao, ro, go, bo)
-    return pxout;
+    return color_matrix_pixel(in, _v);
 }
 
+void ink_cairo_filter_span(FilterColorMatrix::ColorMatrixMatrix &filter, guint32 const *in, guint32 *out, int n)
+{
+    color_matrix_span(in, out, n, filter._v, filter._simd);
+}
 
 struct ColorMatrixSaturate {
     ColorMatrixSaturate(double v_in) {
@@ -100,7 +84,9 @@ private:
 };
 
 struct ColorMatrixHueRotate {
-    ColorMatrixHueRotate(double v) {
+    ColorMatrixHueRotate(double v)
+        : _simd(pixel_simd_supported())
+    {
         double sinhue, coshue;
         Geom::sincos(v * M_PI/180.0, sinhue, coshue);
 
@@ -117,20 +103,15 @@ struct ColorMatrixHueRotate {
         _v[8] = round((0.072 +0.928*coshue +0.072*sinhue)*255);
     }
     guint32 operator()(guint32 in) {
-        EXTRACT_ARGB32(in, a, r, g, b)
-        gint32 maxpx = a*255;
-        gint32 ro = r*_v[0] + g*_v[1] + b*_v[2];
-        gint32 go = r*_v[3] + g*_v[4] + b*_v[5];
-        gint32 bo = r*_v[6] + g*_v[7] + b*_v[8];
-        ro = (pxclamp(ro, 0, maxpx) + 127) / 255;
-        go = (pxclamp(go, 0, maxpx) + 127) / 255;
-        bo = (pxclamp(bo, 0, maxpx) + 127) / 255;
-
-        ASSEMBLE_ARGB32(pxout, a, ro, go, bo)
-        return pxout;
+        return hue_rotate_pixel(in, _v);
+    }
+    friend void ink_cairo_filter_span(ColorMatrixHueRotate &filter, guint32 const *in, guint32 *out, int n)
+    {
+        hue_rotate_span(in, out, n, filter._v, filter._simd);
     }
 private:
     gint32 _v[9];
+    int _simd;
 };
 
 struct ColorMatrixLuminanceToAlpha {
@@ -158,7 +139,7 @@ void FilterColorMatrix::render_cairo(FilterSlot &slot)
     // filter use the same color interpolation space so we don't copy the input before converting.
     SPColorInterpolation ci_fp = SP_CSS_COLOR_INTERPOLATION_AUTO;
     if( _style ) {
-        ci_fp = (SPColorInterpolation)_style->color_interpolation_filters.computed;
+        ci_fp = (SPColorInterpolation)_color_interpolation;
     }
     set_cairo_surface_ci( input, ci_fp );
 
@@ -50,8 +50,10 @@ public:
     struct ColorMatrixMatrix {
         ColorMatrixMatrix(std::vector<double> const &values);
         guint32 operator()(guint32 in);
+        friend void ink_cairo_filter_span(ColorMatrixMatrix &filter, guint32 const *in, guint32 *out, int n);
     private:
         gint32 _v[20];
+        int _simd;
     };
 
 private:
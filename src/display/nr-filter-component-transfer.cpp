@@ -156,7 +156,7 @@ void FilterComponentTransfer::render_cairo(FilterSlot &slot)
     // filter use the same color interpolation space so we don't copy the input before converting.
     SPColorInterpolation ci_fp = SP_CSS_COLOR_INTERPOLATION_AUTO;
     if( _style ) {
-        ci_fp = (SPColorInterpolation)_style->color_interpolation_filters.computed;
+        ci_fp = (SPColorInterpolation)_color_interpolation;
         set_cairo_surface_ci(out, ci_fp );
     }
     set_cairo_surface_ci( input, ci_fp );
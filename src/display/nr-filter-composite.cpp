@@ -14,6 +14,7 @@
 #include "display/cairo-templates.h"
 #include "display/cairo-utils.h"
 #include "display/nr-filter-composite.h"
+#include "display/nr-filter-simd.h"
 #include "display/nr-filter-slot.h"
 #include "display/nr-filter-units.h"
 
@@ -34,31 +35,24 @@ FilterComposite::~FilterComposite()
 
 struct ComposeArithmetic {
     ComposeArithmetic(double k1, double k2, double k3, double k4)
-        : _k1(round(k1 * 255))
-        , _k2(round(k2 * 255*255))
-        , _k3(round(k3 * 255*255))
-        , _k4(round(k4 * 255*255*255))
-    {}
+        : _simd(pixel_simd_supported())
+    {
+        _k[0] = round(k1 * 255);
+        _k[1] = round(k2 * 255*255);
+        _k[2] = round(k3 * 255*255);
+        _k[3] = round(k4 * 255*255*255);
+    }
     guint32 operator()(guint32 in1, guint32 in2) {
-        EXTRACT_ARGB32(in1, aa, ra, ga, ba)
-        EXTRACT_ARGB32(in2, ab, rb, gb, bb)
-
-        gint32 ao = _k1*aa*ab + _k2*aa + _k3*ab + _k4;
-        gint32 ro = _k1*ra*rb + _k2*ra + _k3*rb + _k4;
-        gint32 go = _k1*ga*gb + _k2*ga + _k3*gb + _k4;
-        gint32 bo = _k1*ba*bb + _k2*ba + _k3*bb + _k4;
-
-        ao = pxclamp(ao, 0, 255*255*255); // r, g and b are premultiplied, so should be clamped to the alpha channel
-        ro = (pxclamp(ro, 0, ao) + (255*255/2)) / (255*255);
-        go = (pxclamp(go, 0, ao) + (255*255/2)) / (255*255);
-        bo = (pxclamp(bo, 0, ao) + (255*255/2)) / (255*255);
-        ao = (ao + (255*255/2)) / (255*255);
-
-        ASSEMBLE_ARGB32(pxout, ao, ro, go, bo)
-        return pxout;
+        return composite_arithmetic_pixel(in1, in2, _k);
+    }
+    friend void ink_cairo_blend_span(ComposeArithmetic &blend, guint32 const *in1, guint32 const *in2,
+                                     guint32 *out, int n)
+    {
+        composite_arithmetic_span(in1, in2, out, n, blend._k, blend._simd);
     }
 private:
-    gint32 _k1, _k2, _k3, _k4;
+    gint32 _k[4];
+    int _simd;
 };
 
 void FilterComposite::render_cairo(FilterSlot &slot)
@@ -71,7 +65,7 @@ void FilterComposite::render_cairo(FilterSlot &slot)
     // filter use the same color interpolation space so we don't copy the input before converting.
     SPColorInterpolation ci_fp  = SP_CSS_COLOR_INTERPOLATION_AUTO;
     if( _style ) {
-        ci_fp = (SPColorInterpolation)_style->color_interpolation_filters.computed;
+        ci_fp = (SPColorInterpolation)_color_interpolation;
     }
     set_cairo_surface_ci( input1, ci_fp );
     set_cairo_surface_ci( input2, ci_fp );
@@ -177,6 +171,12 @@ double FilterComposite::complexity(Geom::Affine const &)
     return 1.1;
 }
 
+void FilterComposite::get_inputs(std::vector<int> &inputs)
+{
+    inputs.push_back(_input);
+    inputs.push_back(_input2);
+}
+
 } /* namespace Filters */
 } /* namespace Inkscape */
 
@@ -146,7 +146,7 @@ void FilterDiffuseLighting::render_cairo(FilterSlot &slot)
     // Only alpha channel of input is used, no need to check input color_interpolation_filter value.
     SPColorInterpolation ci_fp  = SP_CSS_COLOR_INTERPOLATION_AUTO;
     if( _style ) {
-        ci_fp = (SPColorInterpolation)_style->color_interpolation_filters.computed;
+        ci_fp = (SPColorInterpolation)_color_interpolation;
 
         // Lighting color is always defined in terms of sRGB, preconvert to linearRGB
         // if color_interpolation_filters set to linearRGB (for efficiency assuming
@@ -82,7 +82,7 @@ void FilterDisplacementMap::render_cairo(FilterSlot &slot)
     // filter use the same color interpolation space so we don't copy the map before converting.
     SPColorInterpolation ci_fp = SP_CSS_COLOR_INTERPOLATION_AUTO;
     if( _style ) {
-        ci_fp = (SPColorInterpolation)_style->color_interpolation_filters.computed;
+        ci_fp = (SPColorInterpolation)_color_interpolation;
     }
     set_cairo_surface_ci( map, ci_fp );
 
@@ -154,6 +154,12 @@ double FilterDisplacementMap::complexity(Geom::Affine const &)
     return 3.0;
 }
 
+void FilterDisplacementMap::get_inputs(std::vector<int> &inputs)
+{
+    inputs.push_back(_input);
+    inputs.push_back(_input2);
+}
+
 } /* namespace Filters */
 } /* namespace Inkscape */
 
@@ -29,6 +29,7 @@ public:
     virtual void render_cairo(FilterSlot &slot);
     virtual void area_enlarge(Geom::IntRect &area, Geom::Affine const &trans);
     virtual double complexity(Geom::Affine const &ctm);
+    virtual void get_inputs(std::vector<int> &inputs);
 
     virtual void set_input(int slot);
     virtual void set_input(int input, int slot);
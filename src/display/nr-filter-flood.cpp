@@ -58,7 +58,7 @@ void FilterFlood::render_cairo(FilterSlot &slot)
 
     SPColorInterpolation ci_fp  = SP_CSS_COLOR_INTERPOLATION_AUTO;
     if( _style ) {
-        ci_fp = (SPColorInterpolation)_style->color_interpolation_filters.computed;
+        ci_fp = (SPColorInterpolation)_color_interpolation;
 
         // Flood color is always defined in terms of sRGB, preconvert to linearRGB
         // if color_interpolation_filters set to linearRGB (for efficiency assuming
@@ -17,12 +17,20 @@
 #include <cmath>
 #include <complex>
 #include <cstdlib>
+#include <cstring>
 #include <glib.h>
 #include <limits>
+#include <vector>
 #if HAVE_OPENMP
 #include <omp.h>
 #endif //HAVE_OPENMP
 
+// Vectorised ARGB32 kernels, selected at runtime depending on the CPU
+#if defined(__GNUC__) && (defined(__i386__) || defined(__x86_64__))
+#define HAVE_GAUSSIAN_X86_SIMD 1
+#include <immintrin.h>
+#endif
+
 #include "display/cairo-utils.h"
 #include "display/nr-filter-primitive.h"
 #include "display/nr-filter-gaussian.h"
@@ -468,9 +476,303 @@ INK_UNUSED(num_threads); // suppresses unused argument compiler warning
     }
 }
 
+#if HAVE_GAUSSIAN_X86_SIMD
+// Vectorised kernels for premultiplied ARGB32 surfaces. All four channels of a pixel
+// are filtered at once. They perform exactly the same arithmetic as the scalar templates
+// above (which remain the reference implementation), so the results are identical:
+//  - IIR: the same double precision operations in the same order (FMA is not enabled),
+//  - FIR: the 16.16 fixed point kernel is applied in single precision floats on raw
+//    kernel values; every product and partial sum is an integer below 2^24, so it is exact.
+// On little endian x86 the alpha channel of a pixel is the last byte.
+
+__attribute__((target("sse2")))
+static inline __m128i
+simd_load_pixel_epi32(unsigned char const *p)
+{
+    int px;
+    memcpy(&px, p, 4);
+    __m128i const zero = _mm_setzero_si128();
+    return _mm_unpacklo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128(px), zero), zero);
+}
+
+// Converts four rounded channel values to bytes, clamping colour channels to alpha
+__attribute__((target("sse2")))
+static inline void
+simd_store_premultiplied(unsigned char *p, __m128i v)
+{
+    __m128i v16 = _mm_packs_epi32(v, v);
+    v16 = _mm_min_epi16(v16, _mm_shufflelo_epi16(v16, _MM_SHUFFLE(3,3,3,3)));
+    int px = _mm_cvtsi128_si32(_mm_packus_epi16(v16, v16));
+    memcpy(p, &px, 4);
+}
+
+__attribute__((target("sse2")))
+static inline __m128i
+simd_round_pd_sse2(__m128d lo, __m128d hi)
+{
+    __m128d const half = _mm_set1_pd(0.5);
+    __m128d const zero = _mm_setzero_pd();
+    __m128d const maxval = _mm_set1_pd(255.0);
+    lo = _mm_min_pd(_mm_max_pd(_mm_add_pd(lo, half), zero), maxval);
+    hi = _mm_min_pd(_mm_max_pd(_mm_add_pd(hi, half), zero), maxval);
+    return _mm_unpacklo_epi64(_mm_cvttpd_epi32(lo), _mm_cvttpd_epi32(hi));
+}
+
+__attribute__((target("sse2")))
+static void
+filter2D_IIR_ARGB32_sse2(unsigned char *const dest, int const dstr1, int const dstr2,
+                         unsigned char const *const src, int const sstr1, int const sstr2,
+                         int const n1, int const n2, IIRValue const b[N+1], double const M[N*N],
+                         IIRValue *const tmpdata[], int const num_threads)
+{
+INK_UNUSED(num_threads);
+#if HAVE_OPENMP
+#pragma omp parallel for num_threads(num_threads)
+#endif // HAVE_OPENMP
+    for ( int c2 = 0 ; c2 < n2 ; c2++ ) {
+#if HAVE_OPENMP
+        unsigned int tid = omp_get_thread_num();
+#else
+        unsigned int tid = 0;
+#endif // HAVE_OPENMP
+        unsigned char const *srcimg = src  + c2*sstr2;
+        unsigned char       *dstimg = dest + c2*dstr2 + n1*dstr1;
+        IIRValue *const tmp = tmpdata[tid];
+        __m128d bv[N+1];
+        for(unsigned int i=0; i<N+1; i++) bv[i] = _mm_set1_pd(b[i]);
+
+        // Forward pass
+        __m128i const imin = simd_load_pixel_epi32(srcimg);
+        __m128d ulo[N+1], uhi[N+1];
+        ulo[0] = _mm_cvtepi32_pd(imin);
+        uhi[0] = _mm_cvtepi32_pd(_mm_shuffle_epi32(imin, _MM_SHUFFLE(1,0,3,2)));
+        for(unsigned int i=1; i<N; i++) { ulo[i] = ulo[0]; uhi[i] = uhi[0]; }
+        for ( int c1 = 0 ; c1 < n1 ; c1++ ) {
+            for(unsigned int i=N; i>0; i--) { ulo[i] = ulo[i-1]; uhi[i] = uhi[i-1]; }
+            __m128i const px = simd_load_pixel_epi32(srcimg);
+            srcimg += sstr1;
+            ulo[0] = _mm_mul_pd(_mm_cvtepi32_pd(px), bv[0]);
+            uhi[0] = _mm_mul_pd(_mm_cvtepi32_pd(_mm_shuffle_epi32(px, _MM_SHUFFLE(1,0,3,2))), bv[0]);
+            for(unsigned int i=1; i<N+1; i++) {
+                ulo[0] = _mm_add_pd(ulo[0], _mm_mul_pd(ulo[i], bv[i]));
+                uhi[0] = _mm_add_pd(uhi[0], _mm_mul_pd(uhi[i], bv[i]));
+            }
+            _mm_storeu_pd(tmp + c1*4,     ulo[0]);
+            _mm_storeu_pd(tmp + c1*4 + 2, uhi[0]);
+        }
+
+        // Backward pass, initialized exactly like the scalar version
+        IIRValue u[N][4], iplus[4], v[N][4];
+        for(unsigned int i=0; i<N; i++) {
+            _mm_storeu_pd(u[i],     ulo[i]);
+            _mm_storeu_pd(u[i] + 2, uhi[i]);
+        }
+        for(unsigned int c=0; c<4; c++) iplus[c] = src[c2*sstr2 + (n1-1)*sstr1 + c];
+        calcTriggsSdikaInitialization<4>(M, u, iplus, iplus, b[0], v);
+        __m128d vlo[N+1], vhi[N+1];
+        for(unsigned int i=0; i<N; i++) {
+            vlo[i] = _mm_loadu_pd(v[i]);
+            vhi[i] = _mm_loadu_pd(v[i] + 2);
+        }
+        dstimg -= dstr1;
+        simd_store_premultiplied(dstimg, simd_round_pd_sse2(vlo[0], vhi[0]));
+        int c1=n1-1;
+        while(c1-->0) {
+            for(unsigned int i=N; i>0; i--) { vlo[i] = vlo[i-1]; vhi[i] = vhi[i-1]; }
+            vlo[0] = _mm_mul_pd(_mm_loadu_pd(tmp + c1*4),     bv[0]);
+            vhi[0] = _mm_mul_pd(_mm_loadu_pd(tmp + c1*4 + 2), bv[0]);
+            for(unsigned int i=1; i<N+1; i++) {
+                vlo[0] = _mm_add_pd(vlo[0], _mm_mul_pd(vlo[i], bv[i]));
+                vhi[0] = _mm_add_pd(vhi[0], _mm_mul_pd(vhi[i], bv[i]));
+            }
+            dstimg -= dstr1;
+            simd_store_premultiplied(dstimg, simd_round_pd_sse2(vlo[0], vhi[0]));
+        }
+    }
+}
+
+__attribute__((target("avx2")))
+static inline __m128i
+simd_round_pd_avx2(__m256d v)
+{
+    v = _mm256_add_pd(v, _mm256_set1_pd(0.5));
+    v = _mm256_min_pd(_mm256_max_pd(v, _mm256_setzero_pd()), _mm256_set1_pd(255.0));
+    return _mm256_cvttpd_epi32(v);
+}
+
+__attribute__((target("avx2")))
+static void
+filter2D_IIR_ARGB32_avx2(unsigned char *const dest, int const dstr1, int const dstr2,
+                         unsigned char const *const src, int const sstr1, int const sstr2,
+                         int const n1, int const n2, IIRValue const b[N+1], double const M[N*N],
+                         IIRValue *const tmpdata[], int const num_threads)
+{
+INK_UNUSED(num_threads);
+#if HAVE_OPENMP
+#pragma omp parallel for num_threads(num_threads)
+#endif // HAVE_OPENMP
+    for ( int c2 = 0 ; c2 < n2 ; c2++ ) {
+#if HAVE_OPENMP
+        unsigned int tid = omp_get_thread_num();
+#else
+        unsigned int tid = 0;
+#endif // HAVE_OPENMP
+        unsigned char const *srcimg = src  + c2*sstr2;
+        unsigned char       *dstimg = dest + c2*dstr2 + n1*dstr1;
+        IIRValue *const tmp = tmpdata[tid];
+        __m256d bv[N+1];
+        for(unsigned int i=0; i<N+1; i++) bv[i] = _mm256_set1_pd(b[i]);
+
+        // Forward pass
+        __m256d u[N+1];
+        u[0] = _mm256_cvtepi32_pd(simd_load_pixel_epi32(srcimg));
+        for(unsigned int i=1; i<N; i++) u[i] = u[0];
+        for ( int c1 = 0 ; c1 < n1 ; c1++ ) {
+            for(unsigned int i=N; i>0; i--) u[i] = u[i-1];
+            u[0] = _mm256_mul_pd(_mm256_cvtepi32_pd(simd_load_pixel_epi32(srcimg)), bv[0]);
+            srcimg += sstr1;
+            for(unsigned int i=1; i<N+1; i++) {
+                u[0] = _mm256_add_pd(u[0], _mm256_mul_pd(u[i], bv[i]));
+            }
+            _mm256_storeu_pd(tmp + c1*4, u[0]);
+        }
+
+        // Backward pass, initialized exactly like the scalar version
+        IIRValue uold[N][4], iplus[4], vold[N][4];
+        for(unsigned int i=0; i<N; i++) _mm256_storeu_pd(uold[i], u[i]);
+        for(unsigned int c=0; c<4; c++) iplus[c] = src[c2*sstr2 + (n1-1)*sstr1 + c];
+        calcTriggsSdikaInitialization<4>(M, uold, iplus, iplus, b[0], vold);
+        __m256d v[N+1];
+        for(unsigned int i=0; i<N; i++) v[i] = _mm256_loadu_pd(vold[i]);
+        dstimg -= dstr1;
+        simd_store_premultiplied(dstimg, simd_round_pd_avx2(v[0]));
+        int c1=n1-1;
+        while(c1-->0) {
+            for(unsigned int i=N; i>0; i--) v[i] = v[i-1];
+            v[0] = _mm256_mul_pd(_mm256_loadu_pd(tmp + c1*4), bv[0]);
+            for(unsigned int i=1; i<N+1; i++) {
+                v[0] = _mm256_add_pd(v[0], _mm256_mul_pd(v[i], bv[i]));
+            }
+            dstimg -= dstr1;
+            simd_store_premultiplied(dstimg, simd_round_pd_avx2(v[0]));
+        }
+    }
+}
+
+// Copies a line into a float buffer with scr_len pixels of edge padding on both sides,
+// so that the kernel can be applied without bounds checks and in place.
+static inline void
+simd_fill_line(float *line, unsigned char const *src, int const sstr1, int const n1, int const scr_len)
+{
+    for ( int c1 = -scr_len ; c1 < n1 + scr_len ; c1++ ) {
+        unsigned char const *px = src + clip(c1, 0, n1-1)*sstr1;
+        float *out = line + (c1 + scr_len)*4;
+        for(unsigned int c=0; c<4; c++) out[c] = px[c];
+    }
+}
+
+__attribute__((target("sse2")))
+static void
+filter2D_FIR_ARGB32_sse2(unsigned char *const dst, int const dstr1, int const dstr2,
+                         unsigned char const *const src, int const sstr1, int const sstr2,
+                         int const n1, int const n2, float const *const kernel, int const scr_len, int const num_threads)
+{
+INK_UNUSED(num_threads);
+#if HAVE_OPENMP
+#pragma omp parallel num_threads(num_threads)
+#endif // HAVE_OPENMP
+    {
+    std::vector<float> line((n1 + 2*scr_len) * 4);
+    __m128i const rnd = _mm_set1_epi32(1 << 15); // FIRValue(.5)
+#if HAVE_OPENMP
+#pragma omp for
+#endif // HAVE_OPENMP
+    for ( int c2 = 0 ; c2 < n2 ; c2++ ) {
+        simd_fill_line(&line[0], src + c2*sstr2, sstr1, n1, scr_len);
+        float const *center = &line[scr_len*4];
+        unsigned char *dstimg = dst + c2*dstr2;
+        for ( int c1 = 0 ; c1 < n1 ; c1++ ) {
+            float const *p = center + c1*4;
+            __m128 sum = _mm_mul_ps(_mm_loadu_ps(p), _mm_set1_ps(kernel[0]));
+            for ( int i = 1 ; i <= scr_len ; i++ ) {
+                __m128 const k = _mm_set1_ps(kernel[i]);
+                sum = _mm_add_ps(sum, _mm_mul_ps(_mm_add_ps(_mm_loadu_ps(p - i*4), _mm_loadu_ps(p + i*4)), k));
+            }
+            __m128i v = _mm_srli_epi32(_mm_add_epi32(_mm_cvttps_epi32(sum), rnd), 16);
+            v = _mm_packs_epi32(v, v);
+            int px = _mm_cvtsi128_si32(_mm_packus_epi16(v, v));
+            memcpy(dstimg + c1*dstr1, &px, 4);
+        }
+    }
+    }
+}
+
+__attribute__((target("avx2")))
+static void
+filter2D_FIR_ARGB32_avx2(unsigned char *const dst, int const dstr1, int const dstr2,
+                         unsigned char const *const src, int const sstr1, int const sstr2,
+                         int const n1, int const n2, float const *const kernel, int const scr_len, int const num_threads)
+{
+INK_UNUSED(num_threads);
+#if HAVE_OPENMP
+#pragma omp parallel num_threads(num_threads)
+#endif // HAVE_OPENMP
+    {
+    // one extra pixel of padding so that two pixels can always be loaded at once
+    std::vector<float> line((n1 + 2*scr_len + 1) * 4);
+    __m256i const rnd = _mm256_set1_epi32(1 << 15); // FIRValue(.5)
+#if HAVE_OPENMP
+#pragma omp for
+#endif // HAVE_OPENMP
+    for ( int c2 = 0 ; c2 < n2 ; c2++ ) {
+        simd_fill_line(&line[0], src + c2*sstr2, sstr1, n1, scr_len);
+        float const *center = &line[scr_len*4];
+        unsigned char *dstimg = dst + c2*dstr2;
+        // two adjacent pixels per iteration
+        for ( int c1 = 0 ; c1 < n1 ; c1 += 2 ) {
+            float const *p = center + c1*4;
+            __m256 sum = _mm256_mul_ps(_mm256_loadu_ps(p), _mm256_set1_ps(kernel[0]));
+            for ( int i = 1 ; i <= scr_len ; i++ ) {
+                __m256 const k = _mm256_set1_ps(kernel[i]);
+                sum = _mm256_add_ps(sum, _mm256_mul_ps(_mm256_add_ps(_mm256_loadu_ps(p - i*4), _mm256_loadu_ps(p + i*4)), k));
+            }
+            __m256i v = _mm256_srli_epi32(_mm256_add_epi32(_mm256_cvttps_epi32(sum), rnd), 16);
+            __m128i v16 = _mm_packs_epi32(_mm256_castsi256_si128(v), _mm256_extracti128_si256(v, 1));
+            __m128i v8 = _mm_packus_epi16(v16, v16);
+            int px = _mm_cvtsi128_si32(v8);
+            memcpy(dstimg + c1*dstr1, &px, 4);
+            if (c1 + 1 < n1) {
+                px = _mm_cvtsi128_si32(_mm_srli_si128(v8, 4));
+                memcpy(dstimg + (c1+1)*dstr1, &px, 4);
+            }
+        }
+    }
+    }
+}
+
+static int
+_blur_simd_detect()
+{
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) return BLUR_SIMD_AVX2;
+    if (__builtin_cpu_supports("sse2")) return BLUR_SIMD_SSE2;
+    return BLUR_SIMD_NONE;
+}
+#endif // HAVE_GAUSSIAN_X86_SIMD
+
+int blur_simd_supported()
+{
+#if HAVE_GAUSSIAN_X86_SIMD
+    static int const level = _blur_simd_detect();
+    return level;
+#else
+    return BLUR_SIMD_NONE;
+#endif
+}
+
 static void
 gaussian_pass_IIR(Geom::Dim2 d, double deviation, cairo_surface_t *src, cairo_surface_t *dest,
-    IIRValue **tmpdata, int num_threads)
+    IIRValue **tmpdata, int num_threads, int simd)
 {
     // Filter variables
     IIRValue b[N+1];  // scaling coefficient + filter coefficients (can be 10.21 fixed point)
@@ -503,6 +805,21 @@ gaussian_pass_IIR(Geom::Dim2 d, double deviation, cairo_surface_t *src, cairo_su
             w, h, b, M, tmpdata, num_threads);
         break;
     case CAIRO_FORMAT_ARGB32: ///< Premultiplied 8 bit RGBA
+#if HAVE_GAUSSIAN_X86_SIMD
+        if (simd >= BLUR_SIMD_AVX2) {
+            filter2D_IIR_ARGB32_avx2(
+                cairo_image_surface_get_data(dest), d == Geom::X ? 4 : stride, d == Geom::X ? stride : 4,
+                cairo_image_surface_get_data(src),  d == Geom::X ? 4 : stride, d == Geom::X ? stride : 4,
+                w, h, b, M, tmpdata, num_threads);
+            break;
+        } else if (simd >= BLUR_SIMD_SSE2) {
+            filter2D_IIR_ARGB32_sse2(
+                cairo_image_surface_get_data(dest), d == Geom::X ? 4 : stride, d == Geom::X ? stride : 4,
+                cairo_image_surface_get_data(src),  d == Geom::X ? 4 : stride, d == Geom::X ? stride : 4,
+                w, h, b, M, tmpdata, num_threads);
+            break;
+        }
+#endif
         filter2D_IIR<unsigned char,4,true>(
             cairo_image_surface_get_data(dest), d == Geom::X ? 4 : stride, d == Geom::X ? stride : 4,
             cairo_image_surface_get_data(src),  d == Geom::X ? 4 : stride, d == Geom::X ? stride : 4,
@@ -515,7 +832,7 @@ gaussian_pass_IIR(Geom::Dim2 d, double deviation, cairo_surface_t *src, cairo_su
 
 static void
 gaussian_pass_FIR(Geom::Dim2 d, double deviation, cairo_surface_t *src, cairo_surface_t *dest,
-    int num_threads)
+    int num_threads, int simd)
 {
     int scr_len = _effect_area_scr(deviation);
     // Filter kernel for x direction
@@ -536,6 +853,27 @@ gaussian_pass_FIR(Geom::Dim2 d, double deviation, cairo_surface_t *src, cairo_su
             w, h, &kernel[0], scr_len, num_threads);
         break;
     case CAIRO_FORMAT_ARGB32: ///< Premultiplied 8 bit RGBA
+#if HAVE_GAUSSIAN_X86_SIMD
+        if (simd >= BLUR_SIMD_SSE2) {
+            // The vector kernels work on the raw 16.16 kernel values
+            std::vector<float> kernel_raw(scr_len + 1);
+            for (int i = 0; i <= scr_len; ++i) {
+                kernel_raw[i] = static_cast<double>(kernel[i]) * 65536.0;
+            }
+            if (simd >= BLUR_SIMD_AVX2) {
+                filter2D_FIR_ARGB32_avx2(
+                    cairo_image_surface_get_data(dest), d == Geom::X ? 4 : stride, d == Geom::X ? stride : 4,
+                    cairo_image_surface_get_data(src),  d == Geom::X ? 4 : stride, d == Geom::X ? stride : 4,
+                    w, h, &kernel_raw[0], scr_len, num_threads);
+            } else {
+                filter2D_FIR_ARGB32_sse2(
+                    cairo_image_surface_get_data(dest), d == Geom::X ? 4 : stride, d == Geom::X ? stride : 4,
+                    cairo_image_surface_get_data(src),  d == Geom::X ? 4 : stride, d == Geom::X ? stride : 4,
+                    w, h, &kernel_raw[0], scr_len, num_threads);
+            }
+            break;
+        }
+#endif
         filter2D_FIR<unsigned char,4>(
             cairo_image_surface_get_data(dest), d == Geom::X ? 4 : stride, d == Geom::X ? stride : 4,
             cairo_image_surface_get_data(src),  d == Geom::X ? 4 : stride, d == Geom::X ? stride : 4,
@@ -546,6 +884,27 @@ gaussian_pass_FIR(Geom::Dim2 d, double deviation, cairo_surface_t *src, cairo_su
     };
 }
 
+void blur_surface_axis(cairo_surface_t *surface, Geom::Dim2 d, double deviation, bool iir, int simd, int num_threads)
+{
+    simd = std::min(simd, blur_simd_supported());
+    cairo_surface_flush(surface);
+    if (iir) {
+        int w = cairo_image_surface_get_width(surface);
+        int h = cairo_image_surface_get_height(surface);
+        std::vector<IIRValue *> tmpdata(num_threads);
+        for (int i = 0; i < num_threads; ++i) {
+            tmpdata[i] = new IIRValue[std::max(w, h) * 4];
+        }
+        gaussian_pass_IIR(d, deviation, surface, surface, &tmpdata[0], num_threads, simd);
+        for (int i = 0; i < num_threads; ++i) {
+            delete[] tmpdata[i];
+        }
+    } else {
+        gaussian_pass_FIR(d, deviation, surface, surface, num_threads, simd);
+    }
+    cairo_surface_mark_dirty(surface);
+}
+
 void FilterGaussian::render_cairo(FilterSlot &slot)
 {
     cairo_surface_t *in = slot.getcairo(_input);
@@ -556,7 +915,7 @@ void FilterGaussian::render_cairo(FilterSlot &slot)
     // filter use the same color interpolation space so we don't copy the input before converting.
     SPColorInterpolation ci_fp = SP_CSS_COLOR_INTERPOLATION_AUTO;
     if( _style ) {
-        ci_fp = (SPColorInterpolation)_style->color_interpolation_filters.computed;
+        ci_fp = (SPColorInterpolation)_color_interpolation;
     }
     set_cairo_surface_ci( in, ci_fp );
 
@@ -593,12 +952,8 @@ void FilterGaussian::render_cairo(FilterSlot &slot)
             bytes_per_pixel = 4; break;
     }
 
-#if HAVE_OPENMP
-    Inkscape::Preferences *prefs = Inkscape::Preferences::get();
-    int threads = prefs->getIntLimited("/options/threading/numthreads", omp_get_num_procs(), 1, 256);
-#else
-    int threads = 1;
-#endif
+    int threads = slot.get_num_threads();
+    int simd = blur_simd_supported();
 
     int quality = slot.get_blurquality();
     int x_step = 1 << _effect_subsample_step_log2(deviation_x_orig, quality);
@@ -647,17 +1002,17 @@ void FilterGaussian::render_cairo(FilterSlot &slot)
 
     if (scr_len_x > 0) {
         if (use_IIR_x) {
-            gaussian_pass_IIR(Geom::X, deviation_x, downsampled, downsampled, tmpdata, threads);
+            gaussian_pass_IIR(Geom::X, deviation_x, downsampled, downsampled, tmpdata, threads, simd);
         } else {
-            gaussian_pass_FIR(Geom::X, deviation_x, downsampled, downsampled, threads);
+            gaussian_pass_FIR(Geom::X, deviation_x, downsampled, downsampled, threads, simd);
         }
     }
 
     if (scr_len_y > 0) {
         if (use_IIR_y) {
-            gaussian_pass_IIR(Geom::Y, deviation_y, downsampled, downsampled, tmpdata, threads);
+            gaussian_pass_IIR(Geom::Y, deviation_y, downsampled, downsampled, tmpdata, threads, simd);
         } else {
-            gaussian_pass_FIR(Geom::Y, deviation_y, downsampled, downsampled, threads);
+            gaussian_pass_FIR(Geom::Y, deviation_y, downsampled, downsampled, threads, simd);
         }
     }
 
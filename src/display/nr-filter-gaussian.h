@@ -25,6 +25,14 @@ enum {
     BLUR_QUALITY_WORST = -2
 };
 
+enum {
+    BLUR_SIMD_NONE = 0,
+    BLUR_SIMD_SSE2 = 1,
+    BLUR_SIMD_AVX2 = 2
+};
+
+typedef struct _cairo_surface cairo_surface_t;
+
 namespace Inkscape {
 namespace Filters {
 
@@ -61,6 +69,20 @@ private:
     double _deviation_y;
 };
 
+/**
+ * Returns the best vector instruction set (BLUR_SIMD_*) the blur kernels can use on
+ * this CPU. Detected once at runtime.
+ */
+int blur_simd_supported();
+
+/**
+ * Blur an image surface in place along one axis, with either the IIR or the FIR filter.
+ * The vector kernels up to the given BLUR_SIMD_* level are used for ARGB32 surfaces if
+ * the CPU supports them; BLUR_SIMD_NONE selects the scalar reference implementation.
+ */
+void blur_surface_axis(cairo_surface_t *surface, Geom::Dim2 d, double deviation, bool iir,
+                       int simd, int num_threads = 1);
+
 
 } /* namespace Filters */
 } /* namespace Inkscape */
@@ -32,6 +32,11 @@ public:
     virtual void render_cairo(FilterSlot &slot);
     virtual bool can_handle_affine(Geom::Affine const &);
     virtual double complexity(Geom::Affine const &ctm);
+    // the referenced image or element can change without the filter changing
+    virtual bool can_cache_result() { return false; }
+    // rendering shows document items, which must happen on one thread
+    virtual bool can_render_concurrently() { return false; }
+    virtual bool reads_document() { return true; }
 
     void set_document( SPDocument *document );
     void set_href(char const *href);
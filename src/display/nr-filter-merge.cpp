@@ -35,7 +35,7 @@ void FilterMerge::render_cairo(FilterSlot &slot)
 
     SPColorInterpolation ci_fp  = SP_CSS_COLOR_INTERPOLATION_AUTO;
     if( _style ) {
-        ci_fp = (SPColorInterpolation)_style->color_interpolation_filters.computed;
+        ci_fp = (SPColorInterpolation)_color_interpolation;
     }
 
     // output is RGBA if at least one input is RGBA
@@ -91,6 +91,11 @@ bool FilterMerge::uses_background()
     return false;
 }
 
+void FilterMerge::get_inputs(std::vector<int> &inputs)
+{
+    inputs.insert(inputs.end(), _input_image.begin(), _input_image.end());
+}
+
 void FilterMerge::set_input(int slot) {
     _input_image[0] = slot;
 }
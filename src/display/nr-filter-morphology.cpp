@@ -49,7 +49,7 @@ namespace {
  *       One problem with the 2D algorithm is that it is harder to parallelize.
  */
 template <typename Comparison, Geom::Dim2 axis, int BPP>
-void morphologicalFilter1D(cairo_surface_t * const input, cairo_surface_t * const out, double radius) {
+void morphologicalFilter1D(cairo_surface_t * const input, cairo_surface_t * const out, double radius, int numOfThreads) {
     Comparison comp;
 
     int w = cairo_image_surface_get_width(out);
@@ -65,11 +65,9 @@ void morphologicalFilter1D(cairo_surface_t * const input, cairo_surface_t * cons
     int ri = round(radius); // TODO: Support fractional radii?
     int wi = 2*ri+1;
 
+    (void) numOfThreads; // suppress unused argument warning without OpenMP
     #if HAVE_OPENMP
     int limit = w * h;
-    Inkscape::Preferences *prefs = Inkscape::Preferences::get();
-    int numOfThreads = prefs->getIntLimited("/options/threading/numthreads", omp_get_num_procs(), 1, 256);
-    (void) numOfThreads; // suppress unused variable warning
     #pragma omp parallel for if(limit > OPENMP_THRESHOLD) num_threads(numOfThreads)
     #endif // HAVE_OPENMP
     for (int i = 0; i < h; ++i) {
@@ -175,20 +173,21 @@ void FilterMorphology::render_cairo(FilterSlot &slot)
     double xr = fabs(xradius * p2pb.expansionX());
     double yr = fabs(yradius * p2pb.expansionY());
     int bpp = cairo_image_surface_get_format(input) == CAIRO_FORMAT_A8 ? 1 : 4;
+    int threads = slot.get_num_threads();
 
     cairo_surface_t *interm = ink_cairo_surface_create_identical(input);
 
     if (Operator == MORPHOLOGY_OPERATOR_DILATE) {
         if (bpp == 1) {
-            morphologicalFilter1D< std::greater<unsigned char>, Geom::X, 1 >(input, interm, xr);
+            morphologicalFilter1D< std::greater<unsigned char>, Geom::X, 1 >(input, interm, xr, threads);
         } else {
-            morphologicalFilter1D< std::greater<unsigned char>, Geom::X, 4 >(input, interm, xr);
+            morphologicalFilter1D< std::greater<unsigned char>, Geom::X, 4 >(input, interm, xr, threads);
         }
     } else {
         if (bpp == 1) {
-            morphologicalFilter1D< std::less<unsigned char>, Geom::X, 1 >(input, interm, xr);
+            morphologicalFilter1D< std::less<unsigned char>, Geom::X, 1 >(input, interm, xr, threads);
         } else {
-            morphologicalFilter1D< std::less<unsigned char>, Geom::X, 4 >(input, interm, xr);
+            morphologicalFilter1D< std::less<unsigned char>, Geom::X, 4 >(input, interm, xr, threads);
         }
     }
 
@@ -199,15 +198,15 @@ void FilterMorphology::render_cairo(FilterSlot &slot)
 
     if (Operator == MORPHOLOGY_OPERATOR_DILATE) {
         if (bpp == 1) {
-            morphologicalFilter1D< std::greater<unsigned char>, Geom::Y, 1 >(interm, out, yr);
+            morphologicalFilter1D< std::greater<unsigned char>, Geom::Y, 1 >(interm, out, yr, threads);
         } else {
-            morphologicalFilter1D< std::greater<unsigned char>, Geom::Y, 4 >(interm, out, yr);
+            morphologicalFilter1D< std::greater<unsigned char>, Geom::Y, 4 >(interm, out, yr, threads);
         }
     } else {
         if (bpp == 1) {
-            morphologicalFilter1D< std::less<unsigned char>, Geom::Y, 1 >(interm, out, yr);
+            morphologicalFilter1D< std::less<unsigned char>, Geom::Y, 1 >(interm, out, yr, threads);
         } else {
-            morphologicalFilter1D< std::less<unsigned char>, Geom::Y, 4 >(interm, out, yr);
+            morphologicalFilter1D< std::less<unsigned char>, Geom::Y, 4 >(interm, out, yr, threads);
         }
     }
 
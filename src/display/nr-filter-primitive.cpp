@@ -48,6 +48,7 @@ FilterPrimitive::FilterPrimitive()
     _subregion_height.unset(SVGLength::PERCENT, 1, 0);
 
     _style = NULL;
+    _color_interpolation = SP_CSS_COLOR_INTERPOLATION_AUTO;
 }
 
 FilterPrimitive::~FilterPrimitive()
@@ -179,6 +180,7 @@ void FilterPrimitive::setStyle(SPStyle *style)
         if (_style) sp_style_unref(_style);
         _style = style;
     }
+    _color_interpolation = style ? style->color_interpolation_filters.computed : SP_CSS_COLOR_INTERPOLATION_AUTO;
 }
 
 
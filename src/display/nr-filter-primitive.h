@@ -13,6 +13,7 @@
 
 #include <2geom/forward.h>
 #include <2geom/rect.h>
+#include <vector>
 
 #include "display/nr-filter-types.h"
 #include "svg/svg-length.h"
@@ -70,6 +71,22 @@ public:
     // this should return how many times slower this primitive is that normal rendering
     virtual double complexity(Geom::Affine const &/*ctm*/) { return 1.0; }
 
+    // says whether the result depends only on the filter inputs and parameters,
+    // and can therefore be stored in the filter result cache
+    virtual bool can_cache_result() { return true; }
+
+    // appends the slots read by this primitive to inputs;
+    // NR_FILTER_SLOT_NOT_SET stands for the result of the previous primitive
+    virtual void get_inputs(std::vector<int> &inputs) { inputs.push_back(_input); }
+    int get_output() const { return _output; }
+
+    // says whether render_cairo() may run at the same time as other primitives of the filter,
+    // each working on its own FilterSlot
+    virtual bool can_render_concurrently() { return true; }
+
+    // says whether render_cairo() reads the document, which only the main thread may do
+    virtual bool reads_document() { return false; }
+
     virtual bool uses_background() {
         if (_input == NR_FILTER_BACKGROUNDIMAGE || _input == NR_FILTER_BACKGROUNDALPHA) {
             return true;
@@ -118,6 +135,8 @@ public:
 
     /**
      * Sets style for access to properties used by filter primitives.
+     * The properties used while rendering are copied, since the style
+     * may change while a filter is rendered on another thread.
      */
     void setStyle(SPStyle *style);
 
@@ -132,6 +151,7 @@ protected:
     SVGLength _subregion_height;
 
     SPStyle *_style;
+    unsigned _color_interpolation; ///< computed color-interpolation-filters of _style
 };
 
 
@@ -0,0 +1,488 @@
+/*
+ * Per-pixel kernels of filter primitives, with vectorised variants
+ *
+ * Copyright (C) 2018 Authors
+ *
+ * Released under GNU GPL, read the file 'COPYING' for more information
+ */
+
+#include "display/nr-filter-simd.h"
+
+// Vectorised ARGB32 kernels, selected at runtime depending on the CPU
+#if defined(__GNUC__) && (defined(__i386__) || defined(__x86_64__))
+#define HAVE_PIXEL_X86_SIMD 1
+#include <immintrin.h>
+#endif
+
+#ifndef INK_UNUSED
+#define INK_UNUSED(x) ((void)(x))
+#endif
+
+namespace Inkscape {
+namespace Filters {
+
+#if HAVE_PIXEL_X86_SIMD
+// The kernels below process 4 (SSE2) or 8 (AVX2) pixels per iteration, with every channel
+// in its own vector of 32 bit lanes. They perform the same integer arithmetic as the
+// *_pixel() functions, including the wrap-around of 32 bit products, so the results are
+// identical. Divisions are done in single precision: the dividends are integers below 2^24,
+// and every quotient that is not an integer is at least 1/divisor away from the next one,
+// which is more than the rounding error of the division. Truncation gives the exact result.
+
+__attribute__((target("sse2")))
+static inline __m128i
+mullo_epi32_sse2(__m128i a, __m128i b)
+{
+    __m128i even = _mm_mul_epu32(a, b);
+    __m128i odd = _mm_mul_epu32(_mm_srli_epi64(a, 32), _mm_srli_epi64(b, 32));
+    return _mm_unpacklo_epi32(_mm_shuffle_epi32(even, _MM_SHUFFLE(0,0,2,0)),
+                              _mm_shuffle_epi32(odd, _MM_SHUFFLE(0,0,2,0)));
+}
+
+// Signed clamp; the bounds are vectors, so the upper bound may differ per lane
+__attribute__((target("sse2")))
+static inline __m128i
+clamp_epi32_sse2(__m128i v, __m128i low, __m128i high)
+{
+    __m128i m = _mm_cmpgt_epi32(low, v);
+    v = _mm_or_si128(_mm_and_si128(m, low), _mm_andnot_si128(m, v));
+    m = _mm_cmpgt_epi32(v, high);
+    return _mm_or_si128(_mm_and_si128(m, high), _mm_andnot_si128(m, v));
+}
+
+__attribute__((target("sse2")))
+static inline __m128i
+div_epi32_sse2(__m128i n, __m128 d)
+{
+    return _mm_cvttps_epi32(_mm_div_ps(_mm_cvtepi32_ps(n), d));
+}
+
+__attribute__((target("sse2")))
+static inline __m128i
+assemble_argb32_sse2(__m128i a, __m128i r, __m128i g, __m128i b)
+{
+    return _mm_or_si128(_mm_or_si128(_mm_slli_epi32(a, 24), _mm_slli_epi32(r, 16)),
+                        _mm_or_si128(_mm_slli_epi32(g, 8), b));
+}
+
+__attribute__((target("avx2")))
+static inline __m256i
+clamp_epi32_avx2(__m256i v, __m256i low, __m256i high)
+{
+    return _mm256_min_epi32(_mm256_max_epi32(v, low), high);
+}
+
+__attribute__((target("avx2")))
+static inline __m256i
+div_epi32_avx2(__m256i n, __m256 d)
+{
+    return _mm256_cvttps_epi32(_mm256_div_ps(_mm256_cvtepi32_ps(n), d));
+}
+
+__attribute__((target("avx2")))
+static inline __m256i
+assemble_argb32_avx2(__m256i a, __m256i r, __m256i g, __m256i b)
+{
+    return _mm256_or_si256(_mm256_or_si256(_mm256_slli_epi32(a, 24), _mm256_slli_epi32(r, 16)),
+                           _mm256_or_si256(_mm256_slli_epi32(g, 8), b));
+}
+
+#define EXTRACT_ARGB32_SSE2(px, a, r, g, b) \
+    __m128i a = _mm_srli_epi32(px, 24); \
+    __m128i r = _mm_and_si128(_mm_srli_epi32(px, 16), mask); \
+    __m128i g = _mm_and_si128(_mm_srli_epi32(px, 8), mask); \
+    __m128i b = _mm_and_si128(px, mask);
+
+#define EXTRACT_ARGB32_AVX2(px, a, r, g, b) \
+    __m256i a = _mm256_srli_epi32(px, 24); \
+    __m256i r = _mm256_and_si256(_mm256_srli_epi32(px, 16), mask); \
+    __m256i g = _mm256_and_si256(_mm256_srli_epi32(px, 8), mask); \
+    __m256i b = _mm256_and_si256(px, mask);
+
+/* feComposite arithmetic */
+
+__attribute__((target("sse2")))
+static inline __m128i
+composite_arithmetic_channel_sse2(__m128i c1, __m128i c2, __m128i const k[4])
+{
+    // both channels are below 256, so their product fits in the low 16 bits of the lane
+    __m128i v = mullo_epi32_sse2(k[0], _mm_mullo_epi16(c1, c2));
+    v = _mm_add_epi32(v, mullo_epi32_sse2(k[1], c1));
+    v = _mm_add_epi32(v, mullo_epi32_sse2(k[2], c2));
+    return _mm_add_epi32(v, k[3]);
+}
+
+__attribute__((target("sse2")))
+static int
+composite_arithmetic_sse2(guint32 const *in1, guint32 const *in2, guint32 *out, int n,
+                          gint32 const kv[4])
+{
+    __m128i const mask = _mm_set1_epi32(0xff);
+    __m128i const zero = _mm_setzero_si128();
+    __m128i const maxa = _mm_set1_epi32(255*255*255);
+    __m128i const half = _mm_set1_epi32(255*255/2);
+    __m128 const divisor = _mm_set1_ps(255*255);
+    __m128i k[4];
+    for (int i = 0; i < 4; ++i) {
+        k[i] = _mm_set1_epi32(kv[i]);
+    }
+
+    int const end = n & ~3;
+    for (int i = 0; i < end; i += 4) {
+        __m128i px1 = _mm_loadu_si128(reinterpret_cast<__m128i const *>(in1 + i));
+        __m128i px2 = _mm_loadu_si128(reinterpret_cast<__m128i const *>(in2 + i));
+        EXTRACT_ARGB32_SSE2(px1, aa, ra, ga, ba)
+        EXTRACT_ARGB32_SSE2(px2, ab, rb, gb, bb)
+
+        __m128i ao = clamp_epi32_sse2(composite_arithmetic_channel_sse2(aa, ab, k), zero, maxa);
+        __m128i ro = clamp_epi32_sse2(composite_arithmetic_channel_sse2(ra, rb, k), zero, ao);
+        __m128i go = clamp_epi32_sse2(composite_arithmetic_channel_sse2(ga, gb, k), zero, ao);
+        __m128i bo = clamp_epi32_sse2(composite_arithmetic_channel_sse2(ba, bb, k), zero, ao);
+        ao = div_epi32_sse2(_mm_add_epi32(ao, half), divisor);
+        ro = div_epi32_sse2(_mm_add_epi32(ro, half), divisor);
+        go = div_epi32_sse2(_mm_add_epi32(go, half), divisor);
+        bo = div_epi32_sse2(_mm_add_epi32(bo, half), divisor);
+
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(out + i), assemble_argb32_sse2(ao, ro, go, bo));
+    }
+    return end;
+}
+
+__attribute__((target("avx2")))
+static inline __m256i
+composite_arithmetic_channel_avx2(__m256i c1, __m256i c2, __m256i const k[4])
+{
+    __m256i v = _mm256_mullo_epi32(k[0], _mm256_mullo_epi16(c1, c2));
+    v = _mm256_add_epi32(v, _mm256_mullo_epi32(k[1], c1));
+    v = _mm256_add_epi32(v, _mm256_mullo_epi32(k[2], c2));
+    return _mm256_add_epi32(v, k[3]);
+}
+
+__attribute__((target("avx2")))
+static int
+composite_arithmetic_avx2(guint32 const *in1, guint32 const *in2, guint32 *out, int n,
+                          gint32 const kv[4])
+{
+    __m256i const mask = _mm256_set1_epi32(0xff);
+    __m256i const zero = _mm256_setzero_si256();
+    __m256i const maxa = _mm256_set1_epi32(255*255*255);
+    __m256i const half = _mm256_set1_epi32(255*255/2);
+    __m256 const divisor = _mm256_set1_ps(255*255);
+    __m256i k[4];
+    for (int i = 0; i < 4; ++i) {
+        k[i] = _mm256_set1_epi32(kv[i]);
+    }
+
+    int const end = n & ~7;
+    for (int i = 0; i < end; i += 8) {
+        __m256i px1 = _mm256_loadu_si256(reinterpret_cast<__m256i const *>(in1 + i));
+        __m256i px2 = _mm256_loadu_si256(reinterpret_cast<__m256i const *>(in2 + i));
+        EXTRACT_ARGB32_AVX2(px1, aa, ra, ga, ba)
+        EXTRACT_ARGB32_AVX2(px2, ab, rb, gb, bb)
+
+        __m256i ao = clamp_epi32_avx2(composite_arithmetic_channel_avx2(aa, ab, k), zero, maxa);
+        __m256i ro = clamp_epi32_avx2(composite_arithmetic_channel_avx2(ra, rb, k), zero, ao);
+        __m256i go = clamp_epi32_avx2(composite_arithmetic_channel_avx2(ga, gb, k), zero, ao);
+        __m256i bo = clamp_epi32_avx2(composite_arithmetic_channel_avx2(ba, bb, k), zero, ao);
+        ao = div_epi32_avx2(_mm256_add_epi32(ao, half), divisor);
+        ro = div_epi32_avx2(_mm256_add_epi32(ro, half), divisor);
+        go = div_epi32_avx2(_mm256_add_epi32(go, half), divisor);
+        bo = div_epi32_avx2(_mm256_add_epi32(bo, half), divisor);
+
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(out + i), assemble_argb32_avx2(ao, ro, go, bo));
+    }
+    return end;
+}
+
+/* feColorMatrix type="matrix" */
+
+__attribute__((target("sse2")))
+static inline __m128i
+color_matrix_row_sse2(__m128i r, __m128i g, __m128i b, __m128i a, __m128i const *v)
+{
+    __m128i o = _mm_add_epi32(mullo_epi32_sse2(r, v[0]), mullo_epi32_sse2(g, v[1]));
+    o = _mm_add_epi32(o, mullo_epi32_sse2(b, v[2]));
+    o = _mm_add_epi32(o, mullo_epi32_sse2(a, v[3]));
+    return _mm_add_epi32(o, v[4]);
+}
+
+// premul_alpha() for channels below 256: the product and rounding term fit in 16 bits
+__attribute__((target("sse2")))
+static inline __m128i
+premul_alpha_sse2(__m128i c, __m128i a)
+{
+    __m128i t = _mm_add_epi32(_mm_mullo_epi16(c, a), _mm_set1_epi32(128));
+    return _mm_srli_epi32(_mm_add_epi32(t, _mm_srli_epi32(t, 8)), 8);
+}
+
+__attribute__((target("sse2")))
+static int
+color_matrix_sse2(guint32 const *in, guint32 *out, int n, gint32 const vv[20])
+{
+    __m128i const mask = _mm_set1_epi32(0xff);
+    __m128i const zero = _mm_setzero_si128();
+    __m128i const maxc = _mm_set1_epi32(255*255);
+    __m128i const c255 = _mm_set1_epi32(255);
+    __m128i const c127 = _mm_set1_epi32(127);
+    __m128 const divisor = _mm_set1_ps(255);
+    __m128i v[20];
+    for (int i = 0; i < 20; ++i) {
+        v[i] = _mm_set1_epi32(vv[i]);
+    }
+
+    int const end = n & ~3;
+    for (int i = 0; i < end; i += 4) {
+        __m128i px = _mm_loadu_si128(reinterpret_cast<__m128i const *>(in + i));
+        EXTRACT_ARGB32_SSE2(px, a, r, g, b)
+
+        // un-premultiply where alpha is not zero
+        __m128i nonzero = _mm_cmpgt_epi32(a, zero);
+        __m128 af = _mm_cvtepi32_ps(a);
+        __m128i ahalf = _mm_srli_epi32(a, 1);
+        __m128i ur = div_epi32_sse2(_mm_add_epi32(_mm_mullo_epi16(r, c255), ahalf), af);
+        __m128i ug = div_epi32_sse2(_mm_add_epi32(_mm_mullo_epi16(g, c255), ahalf), af);
+        __m128i ub = div_epi32_sse2(_mm_add_epi32(_mm_mullo_epi16(b, c255), ahalf), af);
+        r = _mm_or_si128(_mm_and_si128(nonzero, ur), _mm_andnot_si128(nonzero, r));
+        g = _mm_or_si128(_mm_and_si128(nonzero, ug), _mm_andnot_si128(nonzero, g));
+        b = _mm_or_si128(_mm_and_si128(nonzero, ub), _mm_andnot_si128(nonzero, b));
+
+        __m128i ro = clamp_epi32_sse2(color_matrix_row_sse2(r, g, b, a, v), zero, maxc);
+        __m128i go = clamp_epi32_sse2(color_matrix_row_sse2(r, g, b, a, v + 5), zero, maxc);
+        __m128i bo = clamp_epi32_sse2(color_matrix_row_sse2(r, g, b, a, v + 10), zero, maxc);
+        __m128i ao = clamp_epi32_sse2(color_matrix_row_sse2(r, g, b, a, v + 15), zero, maxc);
+        ro = div_epi32_sse2(_mm_add_epi32(ro, c127), divisor);
+        go = div_epi32_sse2(_mm_add_epi32(go, c127), divisor);
+        bo = div_epi32_sse2(_mm_add_epi32(bo, c127), divisor);
+        ao = div_epi32_sse2(_mm_add_epi32(ao, c127), divisor);
+
+        ro = premul_alpha_sse2(ro, ao);
+        go = premul_alpha_sse2(go, ao);
+        bo = premul_alpha_sse2(bo, ao);
+
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(out + i), assemble_argb32_sse2(ao, ro, go, bo));
+    }
+    return end;
+}
+
+__attribute__((target("avx2")))
+static inline __m256i
+color_matrix_row_avx2(__m256i r, __m256i g, __m256i b, __m256i a, __m256i const *v)
+{
+    __m256i o = _mm256_add_epi32(_mm256_mullo_epi32(r, v[0]), _mm256_mullo_epi32(g, v[1]));
+    o = _mm256_add_epi32(o, _mm256_mullo_epi32(b, v[2]));
+    o = _mm256_add_epi32(o, _mm256_mullo_epi32(a, v[3]));
+    return _mm256_add_epi32(o, v[4]);
+}
+
+__attribute__((target("avx2")))
+static inline __m256i
+premul_alpha_avx2(__m256i c, __m256i a)
+{
+    __m256i t = _mm256_add_epi32(_mm256_mullo_epi16(c, a), _mm256_set1_epi32(128));
+    return _mm256_srli_epi32(_mm256_add_epi32(t, _mm256_srli_epi32(t, 8)), 8);
+}
+
+__attribute__((target("avx2")))
+static int
+color_matrix_avx2(guint32 const *in, guint32 *out, int n, gint32 const vv[20])
+{
+    __m256i const mask = _mm256_set1_epi32(0xff);
+    __m256i const zero = _mm256_setzero_si256();
+    __m256i const maxc = _mm256_set1_epi32(255*255);
+    __m256i const c255 = _mm256_set1_epi32(255);
+    __m256i const c127 = _mm256_set1_epi32(127);
+    __m256 const divisor = _mm256_set1_ps(255);
+    __m256i v[20];
+    for (int i = 0; i < 20; ++i) {
+        v[i] = _mm256_set1_epi32(vv[i]);
+    }
+
+    int const end = n & ~7;
+    for (int i = 0; i < end; i += 8) {
+        __m256i px = _mm256_loadu_si256(reinterpret_cast<__m256i const *>(in + i));
+        EXTRACT_ARGB32_AVX2(px, a, r, g, b)
+
+        __m256i nonzero = _mm256_cmpgt_epi32(a, zero);
+        __m256 af = _mm256_cvtepi32_ps(a);
+        __m256i ahalf = _mm256_srli_epi32(a, 1);
+        __m256i ur = div_epi32_avx2(_mm256_add_epi32(_mm256_mullo_epi16(r, c255), ahalf), af);
+        __m256i ug = div_epi32_avx2(_mm256_add_epi32(_mm256_mullo_epi16(g, c255), ahalf), af);
+        __m256i ub = div_epi32_avx2(_mm256_add_epi32(_mm256_mullo_epi16(b, c255), ahalf), af);
+        r = _mm256_blendv_epi8(r, ur, nonzero);
+        g = _mm256_blendv_epi8(g, ug, nonzero);
+        b = _mm256_blendv_epi8(b, ub, nonzero);
+
+        __m256i ro = clamp_epi32_avx2(color_matrix_row_avx2(r, g, b, a, v), zero, maxc);
+        __m256i go = clamp_epi32_avx2(color_matrix_row_avx2(r, g, b, a, v + 5), zero, maxc);
+        __m256i bo = clamp_epi32_avx2(color_matrix_row_avx2(r, g, b, a, v + 10), zero, maxc);
+        __m256i ao = clamp_epi32_avx2(color_matrix_row_avx2(r, g, b, a, v + 15), zero, maxc);
+        ro = div_epi32_avx2(_mm256_add_epi32(ro, c127), divisor);
+        go = div_epi32_avx2(_mm256_add_epi32(go, c127), divisor);
+        bo = div_epi32_avx2(_mm256_add_epi32(bo, c127), divisor);
+        ao = div_epi32_avx2(_mm256_add_epi32(ao, c127), divisor);
+
+        ro = premul_alpha_avx2(ro, ao);
+        go = premul_alpha_avx2(go, ao);
+        bo = premul_alpha_avx2(bo, ao);
+
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(out + i), assemble_argb32_avx2(ao, ro, go, bo));
+    }
+    return end;
+}
+
+/* feColorMatrix type="hueRotate" */
+
+__attribute__((target("sse2")))
+static int
+hue_rotate_sse2(guint32 const *in, guint32 *out, int n, gint32 const vv[9])
+{
+    __m128i const mask = _mm_set1_epi32(0xff);
+    __m128i const zero = _mm_setzero_si128();
+    __m128i const c255 = _mm_set1_epi32(255);
+    __m128i const c127 = _mm_set1_epi32(127);
+    __m128 const divisor = _mm_set1_ps(255);
+    __m128i v[9];
+    for (int i = 0; i < 9; ++i) {
+        v[i] = _mm_set1_epi32(vv[i]);
+    }
+
+    int const end = n & ~3;
+    for (int i = 0; i < end; i += 4) {
+        __m128i px = _mm_loadu_si128(reinterpret_cast<__m128i const *>(in + i));
+        EXTRACT_ARGB32_SSE2(px, a, r, g, b)
+        __m128i maxpx = _mm_mullo_epi16(a, c255);
+
+        __m128i o[3];
+        for (int j = 0; j < 3; ++j) {
+            __m128i c = _mm_add_epi32(mullo_epi32_sse2(r, v[3*j]), mullo_epi32_sse2(g, v[3*j+1]));
+            c = _mm_add_epi32(c, mullo_epi32_sse2(b, v[3*j+2]));
+            c = clamp_epi32_sse2(c, zero, maxpx);
+            o[j] = div_epi32_sse2(_mm_add_epi32(c, c127), divisor);
+        }
+
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(out + i), assemble_argb32_sse2(a, o[0], o[1], o[2]));
+    }
+    return end;
+}
+
+__attribute__((target("avx2")))
+static int
+hue_rotate_avx2(guint32 const *in, guint32 *out, int n, gint32 const vv[9])
+{
+    __m256i const mask = _mm256_set1_epi32(0xff);
+    __m256i const zero = _mm256_setzero_si256();
+    __m256i const c255 = _mm256_set1_epi32(255);
+    __m256i const c127 = _mm256_set1_epi32(127);
+    __m256 const divisor = _mm256_set1_ps(255);
+    __m256i v[9];
+    for (int i = 0; i < 9; ++i) {
+        v[i] = _mm256_set1_epi32(vv[i]);
+    }
+
+    int const end = n & ~7;
+    for (int i = 0; i < end; i += 8) {
+        __m256i px = _mm256_loadu_si256(reinterpret_cast<__m256i const *>(in + i));
+        EXTRACT_ARGB32_AVX2(px, a, r, g, b)
+        __m256i maxpx = _mm256_mullo_epi16(a, c255);
+
+        __m256i o[3];
+        for (int j = 0; j < 3; ++j) {
+            __m256i c = _mm256_add_epi32(_mm256_mullo_epi32(r, v[3*j]), _mm256_mullo_epi32(g, v[3*j+1]));
+            c = _mm256_add_epi32(c, _mm256_mullo_epi32(b, v[3*j+2]));
+            c = clamp_epi32_avx2(c, zero, maxpx);
+            o[j] = div_epi32_avx2(_mm256_add_epi32(c, c127), divisor);
+        }
+
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(out + i), assemble_argb32_avx2(a, o[0], o[1], o[2]));
+    }
+    return end;
+}
+
+#undef EXTRACT_ARGB32_SSE2
+#undef EXTRACT_ARGB32_AVX2
+
+static int
+_pixel_simd_detect()
+{
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) return PIXEL_SIMD_AVX2;
+    if (__builtin_cpu_supports("sse2")) return PIXEL_SIMD_SSE2;
+    return PIXEL_SIMD_NONE;
+}
+#endif // HAVE_PIXEL_X86_SIMD
+
+int pixel_simd_supported()
+{
+#if HAVE_PIXEL_X86_SIMD
+    static int const level = _pixel_simd_detect();
+    return level;
+#else
+    return PIXEL_SIMD_NONE;
+#endif
+}
+
+void composite_arithmetic_span(guint32 const *in1, guint32 const *in2, guint32 *out, int n,
+                               gint32 const k[4], int simd)
+{
+    int i = 0;
+#if HAVE_PIXEL_X86_SIMD
+    if (simd >= PIXEL_SIMD_AVX2) {
+        i = composite_arithmetic_avx2(in1, in2, out, n, k);
+    } else if (simd >= PIXEL_SIMD_SSE2) {
+        i = composite_arithmetic_sse2(in1, in2, out, n, k);
+    }
+#else
+    INK_UNUSED(simd);
+#endif
+    for (; i < n; ++i) {
+        out[i] = composite_arithmetic_pixel(in1[i], in2[i], k);
+    }
+}
+
+void color_matrix_span(guint32 const *in, guint32 *out, int n, gint32 const v[20], int simd)
+{
+    int i = 0;
+#if HAVE_PIXEL_X86_SIMD
+    if (simd >= PIXEL_SIMD_AVX2) {
+        i = color_matrix_avx2(in, out, n, v);
+    } else if (simd >= PIXEL_SIMD_SSE2) {
+        i = color_matrix_sse2(in, out, n, v);
+    }
+#else
+    INK_UNUSED(simd);
+#endif
+    for (; i < n; ++i) {
+        out[i] = color_matrix_pixel(in[i], v);
+    }
+}
+
+void hue_rotate_span(guint32 const *in, guint32 *out, int n, gint32 const v[9], int simd)
+{
+    int i = 0;
+#if HAVE_PIXEL_X86_SIMD
+    if (simd >= PIXEL_SIMD_AVX2) {
+        i = hue_rotate_avx2(in, out, n, v);
+    } else if (simd >= PIXEL_SIMD_SSE2) {
+        i = hue_rotate_sse2(in, out, n, v);
+    }
+#else
+    INK_UNUSED(simd);
+#endif
+    for (; i < n; ++i) {
+        out[i] = hue_rotate_pixel(in[i], v);
+    }
+}
+
+} /* namespace Filters */
+} /* namespace Inkscape */
+
+/*
+  Local Variables:
+  mode:c++
+  c-file-style:"stroustrup"
+  c-file-offsets:((innamespace . 0)(inline-open . 0)(case-label . +))
+  indent-tabs-mode:nil
+  fill-column:99
+  End:
+*/
+// vim: filetype=cpp:expandtab:shiftwidth=4:tabstop=8:softtabstop=4:fileencoding=utf-8:textwidth=99 :
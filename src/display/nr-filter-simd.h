@@ -0,0 +1,132 @@
+#ifndef SEEN_NR_FILTER_SIMD_H
+#define SEEN_NR_FILTER_SIMD_H
+
+/*
+ * Per-pixel kernels of filter primitives, with vectorised variants
+ *
+ * Copyright (C) 2018 Authors
+ *
+ * Released under GNU GPL, read the file 'COPYING' for more information
+ */
+
+#include <glib.h>
+#include "display/cairo-templates.h"
+#include "display/cairo-utils.h"
+
+enum {
+    PIXEL_SIMD_NONE = 0,
+    PIXEL_SIMD_SSE2 = 1,
+    PIXEL_SIMD_AVX2 = 2
+};
+
+namespace Inkscape {
+namespace Filters {
+
+/**
+ * Returns the best vector instruction set (PIXEL_SIMD_*) the pixel kernels can use on
+ * this CPU. Detected once at runtime.
+ */
+int pixel_simd_supported();
+
+/*
+ * The *_pixel() functions are the reference implementations operating on one premultiplied
+ * ARGB32 pixel. The *_span() functions apply them to a run of pixels, using the vector
+ * kernels up to the given PIXEL_SIMD_* level. The results are identical for every level.
+ * The input and output of a span may be the same buffer, but must not otherwise overlap.
+ */
+
+/**
+ * feComposite operator="arithmetic". The coefficients are k1*255, k2*255^2, k3*255^2
+ * and k4*255^3, rounded to integers.
+ */
+inline guint32 composite_arithmetic_pixel(guint32 in1, guint32 in2, gint32 const k[4])
+{
+    EXTRACT_ARGB32(in1, aa, ra, ga, ba)
+    EXTRACT_ARGB32(in2, ab, rb, gb, bb)
+
+    gint32 ao = k[0]*aa*ab + k[1]*aa + k[2]*ab + k[3];
+    gint32 ro = k[0]*ra*rb + k[1]*ra + k[2]*rb + k[3];
+    gint32 go = k[0]*ga*gb + k[1]*ga + k[2]*gb + k[3];
+    gint32 bo = k[0]*ba*bb + k[1]*ba + k[2]*bb + k[3];
+
+    ao = pxclamp(ao, 0, 255*255*255); // r, g and b are premultiplied, so should be clamped to the alpha channel
+    ro = (pxclamp(ro, 0, ao) + (255*255/2)) / (255*255);
+    go = (pxclamp(go, 0, ao) + (255*255/2)) / (255*255);
+    bo = (pxclamp(bo, 0, ao) + (255*255/2)) / (255*255);
+    ao = (ao + (255*255/2)) / (255*255);
+
+    ASSEMBLE_ARGB32(pxout, ao, ro, go, bo)
+    return pxout;
+}
+
+void composite_arithmetic_span(guint32 const *in1, guint32 const *in2, guint32 *out, int n,
+                               gint32 const k[4], int simd);
+
+/**
+ * feColorMatrix type="matrix". The offsets (every fifth value) are scaled by 255^2,
+ * the other values by 255.
+ */
+inline guint32 color_matrix_pixel(guint32 in, gint32 const v[20])
+{
+    EXTRACT_ARGB32(in, a, r, g, b)
+    // we need to un-premultiply alpha values for this type of matrix
+    // TODO: unpremul can be ignored if there is an identity mapping on the alpha channel
+    if (a != 0) {
+        r = unpremul_alpha(r, a);
+        g = unpremul_alpha(g, a);
+        b = unpremul_alpha(b, a);
+    }
+
+    gint32 ro = r*v[0]  + g*v[1]  + b*v[2]  + a*v[3]  + v[4];
+    gint32 go = r*v[5]  + g*v[6]  + b*v[7]  + a*v[8]  + v[9];
+    gint32 bo = r*v[10] + g*v[11] + b*v[12] + a*v[13] + v[14];
+    gint32 ao = r*v[15] + g*v[16] + b*v[17] + a*v[18] + v[19];
+    ro = (pxclamp(ro, 0, 255*255) + 127) / 255;
+    go = (pxclamp(go, 0, 255*255) + 127) / 255;
+    bo = (pxclamp(bo, 0, 255*255) + 127) / 255;
+    ao = (pxclamp(ao, 0, 255*255) + 127) / 255;
+
+    ro = premul_alpha(ro, ao);
+    go = premul_alpha(go, ao);
+    bo = premul_alpha(bo, ao);
+
+    ASSEMBLE_ARGB32(pxout, ao, ro, go, bo)
+    return pxout;
+}
+
+void color_matrix_span(guint32 const *in, guint32 *out, int n, gint32 const v[20], int simd);
+
+/**
+ * feColorMatrix type="hueRotate", with the 3x3 colour matrix scaled by 255.
+ */
+inline guint32 hue_rotate_pixel(guint32 in, gint32 const v[9])
+{
+    EXTRACT_ARGB32(in, a, r, g, b)
+    gint32 maxpx = a*255;
+    gint32 ro = r*v[0] + g*v[1] + b*v[2];
+    gint32 go = r*v[3] + g*v[4] + b*v[5];
+    gint32 bo = r*v[6] + g*v[7] + b*v[8];
+    ro = (pxclamp(ro, 0, maxpx) + 127) / 255;
+    go = (pxclamp(go, 0, maxpx) + 127) / 255;
+    bo = (pxclamp(bo, 0, maxpx) + 127) / 255;
+
+    ASSEMBLE_ARGB32(pxout, a, ro, go, bo)
+    return pxout;
+}
+
+void hue_rotate_span(guint32 const *in, guint32 *out, int n, gint32 const v[9], int simd);
+
+} /* namespace Filters */
+} /* namespace Inkscape */
+
+#endif // SEEN_NR_FILTER_SIMD_H
+/*
+  Local Variables:
+  mode:c++
+  c-file-style:"stroustrup"
+  c-file-offsets:((innamespace . 0)(inline-open . 0)(case-label . +))
+  indent-tabs-mode:nil
+  fill-column:99
+  End:
+*/
+// vim: filetype=cpp:expandtab:shiftwidth=4:tabstop=8:softtabstop=4:fileencoding=utf-8:textwidth=99 :
@@ -36,6 +36,7 @@ FilterSlot::FilterSlot(DrawingItem *item, DrawingContext *bgdc,
     , _last_out(NR_FILTER_SOURCEGRAPHIC)
     , filterquality(FILTER_QUALITY_BEST)
     , blurquality(BLUR_QUALITY_BEST)
+    , num_threads(1)
 {
     using Geom::X;
     using Geom::Y;
@@ -56,6 +57,29 @@ FilterSlot::FilterSlot(DrawingItem *item, DrawingContext *bgdc,
     }
 }
 
+FilterSlot::FilterSlot(FilterSlot const &other, int last_out)
+    : _slots(other._slots)
+    , _primitiveAreas(other._primitiveAreas)
+    , _item(other._item)
+    , _slot_w(other._slot_w)
+    , _slot_h(other._slot_h)
+    , _slot_x(other._slot_x)
+    , _slot_y(other._slot_y)
+    , _source_graphic(other._source_graphic)
+    , _background_ct(other._background_ct)
+    , _source_graphic_area(other._source_graphic_area)
+    , _background_area(other._background_area)
+    , _units(other._units)
+    , _last_out(last_out)
+    , filterquality(other.filterquality)
+    , blurquality(other.blurquality)
+    , num_threads(other.num_threads)
+{
+    for (SlotMap::iterator i = _slots.begin(); i != _slots.end(); ++i) {
+        cairo_surface_reference(i->second);
+    }
+}
+
 FilterSlot::~FilterSlot()
 {
     for (SlotMap::iterator i = _slots.begin(); i != _slots.end(); ++i) {
@@ -207,6 +231,31 @@ cairo_surface_t *FilterSlot::get_result(int res)
     return r;
 }
 
+void FilterSlot::detach(int slot_nr)
+{
+    SlotMap::iterator s = _slots.find(slot_nr);
+    if (s == _slots.end()) return;
+
+    cairo_surface_t *copy = ink_cairo_surface_copy(s->second);
+    copy_cairo_surface_ci(s->second, copy);
+    _set_internal(slot_nr, copy);
+    cairo_surface_destroy(copy);
+}
+
+void FilterSlot::take_result(FilterSlot &other)
+{
+    int slot_nr = other._last_out;
+    SlotMap::iterator s = other._slots.find(slot_nr);
+    if (s == other._slots.end()) return;
+
+    _set_internal(slot_nr, s->second);
+    PrimitiveAreaMap::iterator a = other._primitiveAreas.find(slot_nr);
+    if (a != other._primitiveAreas.end()) {
+        _primitiveAreas[slot_nr] = a->second;
+    }
+    _last_out = slot_nr;
+}
+
 void FilterSlot::_set_internal(int slot_nr, cairo_surface_t *surface)
 {
     // destroy after referencing
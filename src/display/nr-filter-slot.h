@@ -34,6 +34,9 @@ public:
     /** Creates a new FilterSlot object. */
     FilterSlot(DrawingItem *item, DrawingContext *bgdc,
         DrawingContext &graphic, FilterUnits const &u);
+    /** Creates a FilterSlot for rendering one primitive concurrently with
+     * others. It shares the images of 'other'; unset inputs read 'last_out'. */
+    FilterSlot(FilterSlot const &other, int last_out);
     /** Destroys the FilterSlot object and all its contents */
     virtual ~FilterSlot();
 
@@ -54,6 +57,18 @@ public:
 
     cairo_surface_t *get_result(int slot_nr);
 
+    /** Replaces the image in given slot with a private copy, so that
+     * in-place colour space conversion does not affect other FilterSlots
+     * sharing the image. */
+    void detach(int slot);
+
+    /** Stores the last output of 'other' and its primitive area in this
+     * FilterSlot, as if the primitive had been rendered here. */
+    void take_result(FilterSlot &other);
+
+    /** Returns the slot written last, which is read by unset inputs. */
+    int get_last_out() const { return _last_out; }
+
     void set_primitive_area(int slot, Geom::Rect &area);
     Geom::Rect get_primitive_area(int slot);
     
@@ -72,6 +87,12 @@ public:
     /** Gets the gaussian filtering quality. Affects used interpolation methods */
     int get_blurquality(void);
 
+    /** Sets the number of threads primitives may spread their work over. */
+    void set_num_threads(int const n) { num_threads = n; }
+
+    /** Gets the number of threads primitives may spread their work over. */
+    int get_num_threads() const { return num_threads; }
+
     FilterUnits const &get_units() const { return _units; }
     Geom::Rect get_slot_area() const;
 
@@ -98,6 +119,7 @@ private:
     int _last_out;
     FilterQuality filterquality;
     int blurquality;
+    int num_threads;
 
     cairo_surface_t *_get_transformed_source_graphic();
     cairo_surface_t *_get_transformed_background();
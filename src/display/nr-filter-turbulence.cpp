@@ -380,7 +380,7 @@ void FilterTurbulence::render_cairo(FilterSlot &slot)
 
     // color_interpolation_filter is determined by CSS value (see spec. Turbulence).
     if( _style ) {
-        set_cairo_surface_ci(out, (SPColorInterpolation)_style->color_interpolation_filters.computed );
+        set_cairo_surface_ci(out, (SPColorInterpolation)_color_interpolation );
     }
 
     if (!gen->ready()) {
@@ -9,13 +9,22 @@
  * Released under GNU GPL, read the file 'COPYING' for more information
  */
 
+#include "config.h" // Needed for HAVE_OPENMP
+
 #include <glib.h>
+#include <algorithm>
 #include <cmath>
 #include <cstring>
+#include <map>
 #include <string>
 #include <cairo.h>
 
+#if HAVE_OPENMP
+#include <omp.h>
+#endif //HAVE_OPENMP
+
 #include "display/nr-filter.h"
+#include "display/nr-filter-cache.h"
 #include "display/nr-filter-primitive.h"
 #include "display/nr-filter-slot.h"
 #include "display/nr-filter-types.h"
@@ -54,6 +63,17 @@ namespace Filters {
 using Geom::X;
 using Geom::Y;
 
+/// Element names of the primitive types, used as keys of the render statistics
+static char const *const _primitive_name[NR_FILTER_ENDPRIMITIVETYPE] = {
+    "feBlend", "feColorMatrix", "feComponentTransfer", "feComposite", "feConvolveMatrix",
+    "feDiffuseLighting", "feDisplacementMap", "feFlood", "feGaussianBlur", "feImage",
+    "feMerge", "feMorphology", "feOffset", "feSpecularLighting", "feTile", "feTurbulence"
+};
+
+/// Last version given to the primitives of a filter, see Filter::_version.
+/// Filters are built on the main thread, but incremented atomically all the same.
+static gsize _last_version = 0;
+
 Filter::Filter()
 {
     _common_init();
@@ -85,6 +105,8 @@ void Filter::_common_init() {
 
     _filter_units = SP_FILTER_UNITS_OBJECTBOUNDINGBOX;
     _primitive_units = SP_FILTER_UNITS_USERSPACEONUSE;
+
+    _version = g_atomic_pointer_add(&_last_version, 1) + 1;
 }
 
 Filter::~Filter()
@@ -103,9 +125,6 @@ int Filter::render(Inkscape::DrawingItem const *item, DrawingContext &graphic, D
         graphic.setOperator(CAIRO_OPERATOR_OVER);
         return 1;
     }
-    Inkscape::Preferences *prefs = Inkscape::Preferences::get();
-    item->drawing().setFilterQuality(prefs->getInt("/options/filterquality/value", 0));
-    item->drawing().setBlurQuality(prefs->getInt("/options/blurquality/value", 0));
     FilterQuality const filterquality = (FilterQuality)item->drawing().filterQuality();
     int const blurquality = item->drawing().blurQuality();
 
@@ -147,20 +166,31 @@ int Filter::render(Inkscape::DrawingItem const *item, DrawingContext &graphic, D
         }
     }
 
+    Geom::Point origin = graphic.targetLogicalBounds().min();
+
+    // Only results for the whole filter region are cached; see cached_result().
+    Geom::IntRect area = graphic.targetLogicalBounds().roundOutwards();
+    Geom::OptIntRect drawbox = item->visualBounds();
+    bool use_cache = drawbox && area.contains(*drawbox) && caches_result(item);
+
     FilterSlot slot(const_cast<Inkscape::DrawingItem*>(item), bgdc, graphic, units);
     slot.set_quality(filterquality);
     slot.set_blurquality(blurquality);
+    slot.set_num_threads(item->drawing().numThreads());
 
-    for (unsigned i = 0 ; i < _primitive.size() ; i++) {
-        _primitive[i]->render_cairo(slot);
-    }
+    int last_out = _render_primitives(slot, item->drawing().statistics());
 
-    Geom::Point origin = graphic.targetLogicalBounds().min();
-    cairo_surface_t *result = slot.get_result(_output_slot);
+    cairo_surface_t *result = slot.get_result(_output_slot == NR_FILTER_SLOT_NOT_SET ? last_out : _output_slot);
 
     // Assume for the moment that we paint the filter in sRGB
     set_cairo_surface_ci( result, SP_CSS_COLOR_INTERPOLATION_SRGB );
 
+    if (use_cache) {
+        FilterCacheKey key;
+        _cache_key(item, key);
+        item->drawing().filterCache().insert(key, result, area);
+    }
+
     graphic.setSource(result, origin[Geom::X], origin[Geom::Y]);
     graphic.setOperator(CAIRO_OPERATOR_SOURCE);
     graphic.paint();
@@ -170,6 +200,202 @@ int Filter::render(Inkscape::DrawingItem const *item, DrawingContext &graphic, D
     return 0;
 }
 
+bool Filter::caches_result(Inkscape::DrawingItem const *item)
+{
+    FilterCache &cache = item->drawing().filterCache();
+    Geom::OptIntRect drawbox = item->visualBounds();
+    if (cache.budget() == 0 || !drawbox || !_can_cache_result()) {
+        return false;
+    }
+    // results larger than the whole budget would only flush the cache
+    return static_cast<size_t>(drawbox->width()) * drawbox->height() * 4 <= cache.budget();
+}
+
+/**
+ * The result is looked up by everything it depends on, so that scrolling,
+ * rendering in tiles or changes to unrelated items do not render it again.
+ */
+cairo_surface_t *Filter::cached_result(Inkscape::DrawingItem const *item, Geom::IntRect const &area,
+                                       Geom::IntRect &covered)
+{
+    if (!caches_result(item)) {
+        return NULL;
+    }
+    FilterCacheKey key;
+    _cache_key(item, key);
+    return item->drawing().filterCache().lookup(key, area, covered);
+}
+
+void Filter::_cache_key(Inkscape::DrawingItem const *item, FilterCacheKey &key)
+{
+    key.item = item;
+    key.item_version = item->contentVersion();
+    key.filter_version = _version;
+    if (uses_background()) {
+        // any item below this one may show in the background
+        key.background_version = item->drawing().contentVersion();
+    }
+    key.ctm = item->ctm();
+    key.bbox = item->itemBounds();
+    key.filter_area = filter_effect_area(item->itemBounds());
+    key.filter_quality = item->drawing().filterQuality();
+    key.blur_quality = item->drawing().blurQuality();
+}
+
+/**
+ * Assigns every primitive to a level, such that a primitive only depends on
+ * primitives of lower levels. Primitives of the same level are independent of
+ * each other: they do not write a slot which another one reads or writes.
+ * Returns the number of levels.
+ */
+int Filter::_schedule_primitives(std::vector<int> &level) const
+{
+    std::map<int, int> writer;                // slot -> last primitive writing it
+    std::map<int, std::vector<int> > readers; // slot -> primitives reading it since its last write
+    int prev_out = NR_FILTER_SOURCEGRAPHIC;
+    int levels = 0;
+    int barrier = 0; // no primitive may be scheduled below this level
+
+    level.resize(_primitive.size());
+    for (unsigned i = 0 ; i < _primitive.size() ; i++) {
+        std::vector<int> inputs;
+        _primitive[i]->get_inputs(inputs);
+        int out = _primitive[i]->get_output();
+        if (out == NR_FILTER_SLOT_NOT_SET) out = NR_FILTER_UNNAMED_SLOT;
+
+        int l = barrier;
+        // read after write
+        for (unsigned j = 0 ; j < inputs.size() ; j++) {
+            if (inputs[j] == NR_FILTER_SLOT_NOT_SET) inputs[j] = prev_out;
+            std::map<int, int>::const_iterator w = writer.find(inputs[j]);
+            if (w != writer.end()) l = std::max(l, level[w->second] + 1);
+        }
+        // write after write
+        std::map<int, int>::const_iterator w = writer.find(out);
+        if (w != writer.end()) l = std::max(l, level[w->second] + 1);
+        // write after read
+        std::vector<int> const &r = readers[out];
+        for (unsigned j = 0 ; j < r.size() ; j++) {
+            l = std::max(l, level[r[j]] + 1);
+        }
+        if (!_primitive[i]->can_render_concurrently()) {
+            l = std::max(l, levels);
+            barrier = l + 1;
+        }
+
+        level[i] = l;
+        levels = std::max(levels, l + 1);
+        for (unsigned j = 0 ; j < inputs.size() ; j++) {
+            readers[inputs[j]].push_back(i);
+        }
+        writer[out] = i;
+        readers[out].clear();
+        prev_out = out;
+    }
+    return levels;
+}
+
+/**
+ * Renders all primitives into the slot and returns the slot written last.
+ *
+ * Primitives in independent branches of the filter, such as two blurs feeding
+ * one merge, are rendered at the same time, by at most one thread each. The
+ * threads are shared out among them for their own loops, which only use more
+ * than one thread when nested parallelism is enabled. Each primitive rendered
+ * at the same time as others works on its own FilterSlot sharing the images
+ * of the main one; images read by several of them are copied first, because
+ * primitives convert their inputs to the required colour space in place.
+ */
+int Filter::_render_primitives(FilterSlot &slot, DrawingStatistics *stats)
+{
+    int const count = _primitive.size();
+    int const num_threads = slot.get_num_threads();
+
+    std::vector<int> level;
+    int levels = num_threads > 1 ? _schedule_primitives(level) : count;
+
+    if (levels == count) {
+        // every primitive depends on the previous one
+        for (int i = 0 ; i < count ; i++) {
+            if (stats) {
+                DrawingStatistics::Timer timer(stats, stats->primitiveTimes(), _primitive_name[_primitive_type[i]]);
+                _primitive[i]->render_cairo(slot);
+            } else {
+                _primitive[i]->render_cairo(slot);
+            }
+        }
+        return slot.get_last_out();
+    }
+
+    std::vector<int> last_out(count, NR_FILTER_SLOT_NOT_SET);
+    for (int l = 0 ; l < levels ; l++) {
+        std::vector<int> batch;
+        for (int i = 0 ; i < count ; i++) {
+            if (level[i] == l) batch.push_back(i);
+        }
+
+        int const batch_size = batch.size();
+        int const team = std::min(batch_size, num_threads);
+        bool const parallel = team > 1;
+
+        // Create the inputs in the main slot, so that source images are
+        // extracted once, and find the images read by more than one primitive.
+        std::vector<std::vector<int> > inputs(batch.size());
+        std::map<cairo_surface_t *, int> readers;
+        for (unsigned k = 0 ; k < batch.size() ; k++) {
+            int i = batch[k];
+            int prev_out = i > 0 ? last_out[i - 1] : NR_FILTER_SOURCEGRAPHIC;
+            _primitive[i]->get_inputs(inputs[k]);
+            for (unsigned j = 0 ; j < inputs[k].size() ; j++) {
+                if (inputs[k][j] == NR_FILTER_SLOT_NOT_SET) inputs[k][j] = prev_out;
+                readers[slot.getcairo(inputs[k][j])] += 1;
+            }
+        }
+
+        std::vector<FilterSlot *> workers(batch.size());
+        for (unsigned k = 0 ; k < batch.size() ; k++) {
+            int i = batch[k];
+            workers[k] = new FilterSlot(slot, i > 0 ? last_out[i - 1] : NR_FILTER_SOURCEGRAPHIC);
+            if (parallel) {
+                workers[k]->set_num_threads(std::max(1, num_threads / team));
+            }
+            for (unsigned j = 0 ; parallel && j < inputs[k].size() ; j++) {
+                if (readers[slot.getcairo(inputs[k][j])] > 1) {
+                    workers[k]->detach(inputs[k][j]);
+                }
+            }
+        }
+
+        std::vector<gint64> elapsed(batch.size(), 0);
+        gint64 const batch_start = stats ? g_get_monotonic_time() : 0;
+#if HAVE_OPENMP
+#pragma omp parallel for schedule(dynamic, 1) num_threads(team) if(parallel)
+#endif //HAVE_OPENMP
+        for (int k = 0 ; k < batch_size ; k++) {
+            gint64 start = stats ? g_get_monotonic_time() : 0;
+            _primitive[batch[k]]->render_cairo(*workers[k]);
+            if (stats) elapsed[k] = g_get_monotonic_time() - start;
+        }
+        if (stats) {
+            // the primitives overlap in time, so the filter only leaves out
+            // the wall-clock time of the batch from its own time
+            stats->addNestedTime(g_get_monotonic_time() - batch_start);
+        }
+
+        // store the results in primitive order, as sequential rendering would
+        for (unsigned k = 0 ; k < batch.size() ; k++) {
+            int i = batch[k];
+            slot.take_result(*workers[k]);
+            last_out[i] = workers[k]->get_last_out();
+            delete workers[k];
+            if (stats) {
+                stats->addTime(stats->primitiveTimes(), _primitive_name[_primitive_type[i]], elapsed[k]);
+            }
+        }
+    }
+    return last_out[count - 1];
+}
+
 void Filter::set_filter_units(SPFilterUnits unit) {
     _filter_units = unit;
 }
@@ -282,6 +508,16 @@ double Filter::complexity(Geom::Affine const &ctm)
     return factor;
 }
 
+bool Filter::_can_cache_result()
+{
+    for (unsigned i = 0 ; i < _primitive.size() ; i++) {
+        if (_primitive[i] && !_primitive[i]->can_cache_result()) {
+            return false;
+        }
+    }
+    return true;
+}
+
 bool Filter::uses_background()
 {
     for (unsigned i = 0 ; i < _primitive.size() ; i++) {
@@ -292,6 +528,16 @@ bool Filter::uses_background()
     return false;
 }
 
+bool Filter::reads_document()
+{
+    for (unsigned i = 0 ; i < _primitive.size() ; i++) {
+        if (_primitive[i] && _primitive[i]->reads_document()) {
+            return true;
+        }
+    }
+    return false;
+}
+
 /* Constructor table holds pointers to static methods returning filter
  * primitives. This table is indexed with FilterPrimitiveType, so that
  * for example method in _constructor[NR_FILTER_GAUSSIANBLUR]
@@ -339,6 +585,7 @@ int Filter::add_primitive(FilterPrimitiveType type)
 
     int handle = _primitive.size();
     _primitive.push_back(created);
+    _primitive_type.push_back(type);
     return handle;
 }
 
@@ -358,6 +605,7 @@ int Filter::replace_primitive(int target, FilterPrimitiveType type)
 
     delete _primitive[target];
     _primitive[target] = created;
+    _primitive_type[target] = type;
     return target;
 }
 
@@ -372,6 +620,9 @@ void Filter::clear_primitives()
         delete _primitive[i];
     }
     _primitive.clear();
+    _primitive_type.clear();
+    // the primitives are built again, maybe with other parameters
+    _version = g_atomic_pointer_add(&_last_version, 1) + 1;
 }
 
 void Filter::set_x(SVGLength const &length)
@@ -23,9 +23,13 @@
 namespace Inkscape {
 class DrawingContext;
 class DrawingItem;
+class DrawingStatistics;
 
 namespace Filters {
 
+class FilterSlot;
+struct FilterCacheKey;
+
 class Filter {
 public:
     /** Given background state from @a bgdc and an intermediate rendering from the surface
@@ -35,6 +39,19 @@ public:
      * (0,0 = surface origin, no path, OVER operator) */
     int render(Inkscape::DrawingItem const *item, DrawingContext &graphic, DrawingContext *bgdc);
 
+    /**
+     * Says whether results for the item are kept in the filter cache of its drawing.
+     * They are kept for the whole visual bounding box of the item, which has to be
+     * rendered at once, so that other areas can be taken from the cache afterwards.
+     */
+    bool caches_result(Inkscape::DrawingItem const *item);
+    /**
+     * Returns a new reference to the cached result for the item if it covers area,
+     * or NULL. The area covered by the result is stored in covered.
+     */
+    cairo_surface_t *cached_result(Inkscape::DrawingItem const *item, Geom::IntRect const &area,
+                                   Geom::IntRect &covered);
+
     /**
      * Creates a new filter primitive under this filter object.
      * New primitive is placed so that it will be executed after all filter
@@ -163,6 +180,9 @@ public:
     // says whether the filter accesses any of the background images
     bool uses_background();
 
+    // says whether rendering the filter reads the document, e.g. for feImage
+    bool reads_document();
+
     /** Creates a new filter with space for one filter element */
     Filter();
     /** 
@@ -176,6 +196,7 @@ public:
 
 private:
     std::vector<FilterPrimitive*> _primitive;
+    std::vector<FilterPrimitiveType> _primitive_type; ///< parallel to _primitive, for statistics
     /** Amount of image slots used, when this filter was rendered last time */
     int _slot_count;
 
@@ -197,12 +218,21 @@ private:
     SPFilterUnits _filter_units;
     SPFilterUnits _primitive_units;
 
+    /** Changes whenever the primitives are cleared, which they are before each
+     * rebuild from the document; identifies results in the filter result cache
+     * of the drawing together with the other inputs of the filter. */
+    guint64 _version;
+
     void _create_constructor_table();
     void _common_init();
     int _resolution_limit(FilterQuality const quality) const;
     std::pair<double,double> _filter_resolution(Geom::Rect const &area,
                                                 Geom::Affine const &trans,
                                                 FilterQuality const q) const;
+    bool _can_cache_result();
+    void _cache_key(Inkscape::DrawingItem const *item, FilterCacheKey &key);
+    int _schedule_primitives(std::vector<int> &level) const;
+    int _render_primitives(FilterSlot &slot, DrawingStatistics *stats);
 };
 
 
@@ -51,6 +51,8 @@ NRStyle::NRStyle()
     , dash(NULL)
     , dash_offset(0.0)
     , fill_rule(CAIRO_FILL_RULE_EVEN_ODD)
+    , clip_rule(CAIRO_FILL_RULE_WINDING)
+    , non_scaling_stroke(false)
     , line_cap(CAIRO_LINE_CAP_BUTT)
     , line_join(CAIRO_LINE_JOIN_MITER)
     , fill_pattern(NULL)
@@ -145,6 +147,9 @@ void NRStyle::set(SPStyle *style, SPStyle *context_style)
         default:
             g_assert_not_reached();
     }
+    clip_rule = style->clip_rule.computed == SP_WIND_RULE_EVENODD ?
+        CAIRO_FILL_RULE_EVEN_ODD : CAIRO_FILL_RULE_WINDING;
+    non_scaling_stroke = style->vector_effect.computed == SP_VECTOR_EFFECT_NON_SCALING_STROKE;
 
     const SPIPaint *style_stroke = &(style->stroke);
     if( style_stroke->paintOrigin == SP_CSS_PAINT_ORIGIN_CONTEXT_FILL ) {
@@ -68,6 +68,8 @@ struct NRStyle {
     double *dash;
     float dash_offset;
     cairo_fill_rule_t fill_rule;
+    cairo_fill_rule_t clip_rule;
+    bool non_scaling_stroke;
     cairo_line_cap_t line_cap;
     cairo_line_join_t line_join;
 
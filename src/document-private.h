@@ -31,6 +31,8 @@
 #include "console-output-undo-observer.h"
 
 namespace Inkscape {
+class ItemIndex;
+class StyleCascadeCache;
 namespace XML {
 class Event;
 }
@@ -74,6 +76,16 @@ struct SPDocumentPrivate {
 	Inkscape::ConsoleOutputUndoObserver console_output_undo_observer;
 
 	bool seeking;
+
+	/* Spatial index for item queries, built on first use */
+	Inkscape::ItemIndex *item_index;
+
+	/* Compiled selectors and matches of style_cascade, built on first use */
+	Inkscape::StyleCascadeCache *style_cascade_cache;
+
+	/* Whether the text of the first update has been shaped in parallel */
+	bool text_layouts_prepared;
+
     sigc::connection selChangeConnection;
     sigc::connection desktopActivatedConnection;
 };
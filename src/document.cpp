@@ -39,9 +39,13 @@
 #ifdef HAVE_CONFIG_H
 #include <config.h>
 #endif
+#include <algorithm>
 #include <string>
 #include <cstring>
 #include <2geom/transforms.h>
+#if HAVE_OPENMP
+#include <omp.h>
+#endif
 
 #include "widgets/desktop-widget.h"
 #include "desktop.h"
@@ -53,13 +57,19 @@
 #include "id-clash.h"
 #include "inkscape.h"
 #include "inkscape-version.h"
+#include "item-index.h"
 #include "libavoid/router.h"
+#include "libnrtype/FontFactory.h"
+#include "libnrtype/Layout-TNG.h"
 #include "persp3d.h"
 #include "profile-manager.h"
 #include "rdf.h"
 #include "sp-factory.h"
+#include "sp-flowtext.h"
 #include "sp-namedview.h"
 #include "sp-symbol.h"
+#include "sp-text.h"
+#include "style-cascade-cache.h"
 #include "xml/rebase-hrefs.h"
 
 #include "libcroco/cr-sel-eng.h"
@@ -124,6 +134,9 @@ SPDocument::SPDocument() :
     p->partial = NULL;
     p->history_size = 0;
     p->seeking = false;
+    p->item_index = NULL;
+    p->style_cascade_cache = NULL;
+    p->text_layouts_prepared = false;
 
     priv = p;
 
@@ -166,6 +179,11 @@ SPDocument::~SPDocument() {
         DocumentUndo::clearRedo(this);
         DocumentUndo::clearUndo(this);
 
+        delete priv->item_index;
+        priv->item_index = NULL;
+        delete priv->style_cascade_cache;
+        priv->style_cascade_cache = NULL;
+
         if (root) {
             root->releaseReferences();
             sp_object_unref(root);
@@ -1290,6 +1308,72 @@ SPDocument::_updateDocument()
 }
 
 
+/**
+ * Rebuilds the input of the layouts of the text objects below object that are
+ * waiting for an update, and collects the layouts in document order.
+ */
+static void collect_text_layouts(SPObject *object, std::vector<Inkscape::Text::Layout *> &layouts)
+{
+    for (auto& child: object->children) {
+        if (SPText *text = dynamic_cast<SPText *>(&child)) {
+            if (text->uflags) {
+                text->rebuildLayoutInput();
+                layouts.push_back(&text->layout);
+            }
+        } else if (SPFlowtext *flowtext = dynamic_cast<SPFlowtext *>(&child)) {
+            if (flowtext->uflags) {
+                flowtext->rebuildLayoutInput();
+                layouts.push_back(&flowtext->layout);
+            }
+        } else {
+            collect_text_layouts(&child, layouts);
+        }
+    }
+}
+
+/**
+ * Itemizes and shapes the text of all text objects below root in parallel, so
+ * that the update that follows finds the pango results in the shaping caches of
+ * their layouts. The update then lays the text out on the main thread, in
+ * document order, as before.
+ */
+static void prepare_text_layouts(SPObject *root)
+{
+#if HAVE_OPENMP
+    Inkscape::Preferences *prefs = Inkscape::Preferences::get();
+    int threads = prefs->getIntLimited("/options/threading/numthreads", omp_get_num_procs(), 1, 256);
+#else
+    int threads = 1;
+#endif
+    if (threads <= 1) {
+        return;
+    }
+
+    std::vector<Inkscape::Text::Layout *> layouts;
+    collect_text_layouts(root, layouts);
+    if (layouts.size() <= 1) {
+        return;
+    }
+
+    font_factory *factory = font_factory::Default();
+    int count = layouts.size();
+#if HAVE_OPENMP
+#pragma omp parallel num_threads(threads)
+#endif
+    {
+        PangoContext *context = factory->AcquireWorkerContext();
+#if HAVE_OPENMP
+#pragma omp for schedule(dynamic, 1)
+#endif
+        for (int i = 0; i < count; ++i) {
+            if (context) {
+                layouts[i]->prepareShaping(context);
+            }
+        }
+        factory->ReleaseWorkerContext(context);
+    }
+}
+
 /**
  * Repeatedly works on getting the document updated, since sometimes
  * it takes more than one pass to get the document updated.  But it
@@ -1303,6 +1387,12 @@ gint SPDocument::ensureUpToDate()
     //   1a) Process all document updates.
     //   1b) When completed, process connector routing changes.
     //   2a) Process any updates resulting from connector reroutings.
+    // The first update lays out all the text, so shape it in parallel beforehand.
+    if (!priv->text_layouts_prepared && root && root->uflags) {
+        priv->text_layouts_prepared = true;
+        prepare_text_layouts(root);
+    }
+
     int counter = 32;
     for (unsigned int pass = 1; pass <= 2; ++pass) {
         // Process document updates.
@@ -1382,24 +1472,49 @@ static bool overlaps(Geom::Rect const &area, Geom::Rect const &box)
     return area.intersects(box);
 }
 
-static std::vector<SPItem*> &find_items_in_area(std::vector<SPItem*> &s, SPGroup *group, unsigned int dkey, Geom::Rect const &area,
+/**
+ * Returns true if the recursive walk of the area and point queries tests item itself,
+ * i.e. all its ancestors below the root are groups the walk descends into and item is
+ * not such a group.
+ */
+static bool is_query_leaf(SPItem *item, SPObject *root, unsigned int dkey, bool into_groups)
+{
+    SPGroup *group = dynamic_cast<SPGroup *>(item);
+    if (group && (group->effectiveLayerMode(dkey) == SPGroup::LAYER || into_groups)) {
+        return false;
+    }
+    for (SPObject *o = item->parent; o != root; o = o->parent) {
+        group = dynamic_cast<SPGroup *>(o);
+        if (!group || !(group->effectiveLayerMode(dkey) == SPGroup::LAYER || into_groups)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool is_above(SPItem const *first, SPItem const *second)
+{
+    return sp_object_compare_position_bool(second, first);
+}
+
+/**
+ * Appends the items that pass test(area, visual bounds) to s, in document order.
+ * Candidates come from the spatial index of the document.
+ */
+static std::vector<SPItem*> &find_items_in_area(std::vector<SPItem*> &s, Inkscape::ItemIndex &index, SPGroup *root, unsigned int dkey, Geom::Rect const &area,
                                   bool (*test)(Geom::Rect const &, Geom::Rect const &), bool take_insensitive = false, bool into_groups = false)
 {
-    g_return_val_if_fail(SP_IS_GROUP(group), s);
+    std::vector<SPItem*> found;
+    index.find(area, test, found);
 
-    for (auto& o: group->children) {
-        if ( SP_IS_ITEM(&o) ) {
-            if (SP_IS_GROUP(&o) && (SP_GROUP(&o)->effectiveLayerMode(dkey) == SPGroup::LAYER || into_groups)) {
-                s = find_items_in_area(s, SP_GROUP(&o), dkey, area, test, take_insensitive, into_groups);
-            } else {
-                SPItem *child = SP_ITEM(&o);
-                Geom::OptRect box = child->desktopVisualBounds();
-                if ( box && test(area, *box) && (take_insensitive || child->isVisibleAndUnlocked(dkey))) {
-                    s.push_back(child);
-                }
-            }
+    std::vector<SPItem*>::size_type start = s.size();
+    for (std::vector<SPItem*>::const_iterator i = found.begin(); i != found.end(); ++i) {
+        SPItem *child = *i;
+        if (is_query_leaf(child, root, dkey, into_groups) && (take_insensitive || child->isVisibleAndUnlocked(dkey))) {
+            s.push_back(child);
         }
     }
+    std::sort(s.begin() + start, s.end(), sp_object_compare_position_bool);
 
     return s;
 }
@@ -1559,7 +1674,7 @@ std::vector<SPItem*> SPDocument::getItemsInBox(unsigned int dkey, Geom::Rect con
 {
     std::vector<SPItem*> x;
     g_return_val_if_fail(this->priv != NULL, x);
-    return find_items_in_area(x, SP_GROUP(this->root), dkey, box, is_within, take_insensitive, into_groups);
+    return find_items_in_area(x, getItemIndex(), root, dkey, box, is_within, take_insensitive, into_groups);
 }
 
 /*
@@ -1573,7 +1688,7 @@ std::vector<SPItem*> SPDocument::getItemsPartiallyInBox(unsigned int dkey, Geom:
 {
     std::vector<SPItem*> x;
     g_return_val_if_fail(this->priv != NULL, x);
-    return find_items_in_area(x, SP_GROUP(this->root), dkey, box, overlaps, take_insensitive, into_groups);
+    return find_items_in_area(x, getItemIndex(), root, dkey, box, overlaps, take_insensitive, into_groups);
 }
 
 std::vector<SPItem*> SPDocument::getItemsAtPoints(unsigned const key, std::vector<Geom::Point> points, bool all_layers, size_t limit) const 
@@ -1625,22 +1740,50 @@ SPItem *SPDocument::getItemAtPoint( unsigned const key, Geom::Point const &p,
 {
     g_return_val_if_fail(this->priv != NULL, NULL);
 
-    // Build a flattened SVG DOM for find_item_at_point.
-    std::deque<SPItem*> bak(_node_cache);
-    if(!into_groups){
-        _node_cache.clear();
-        build_flat_item_list(key, SP_GROUP(this->root), into_groups);
+    Inkscape::DrawingItem *rootitem = root->get_arenaitem(key);
+    if (!rootitem) {
+        return NULL;
     }
-    if(!_node_cache_valid && into_groups){
-        _node_cache.clear();
-        build_flat_item_list(key, SP_GROUP(this->root), true);
-        _node_cache_valid=true;
+    // only items below upto are considered; if upto cannot be picked itself, nothing is
+    if (upto && !(is_query_leaf(upto, root, key, into_groups) && upto->isVisibleAndUnlocked(key))) {
+        return NULL;
     }
-    
-    SPItem *res = find_item_at_point(&_node_cache, key, p, upto);
-    if(!into_groups)
-        _node_cache = bak;
-    return res;
+    rootitem->drawing().update();
+
+    // p is in drawing coordinates; look up candidates by their desktop bounds.
+    // The drawing item of the root maps document coordinates to the drawing.
+    Geom::Affine dt2drawing = root->i2dt_affine().inverse() * root->i2doc_affine() * rootitem->ctm();
+    if (dt2drawing.isSingular()) {
+        return NULL;
+    }
+    Inkscape::Preferences *prefs = Inkscape::Preferences::get();
+    gdouble delta = prefs->getDouble("/options/cursortolerance/value", 1.0);
+    // drawing bounding boxes are rounded outwards to whole pixels
+    Geom::Rect area(p, p);
+    area.expandBy(delta + 2);
+    area *= dt2drawing.inverse();
+
+    std::vector<SPItem*> candidates;
+    getItemIndex().find(area, overlaps, candidates);
+    std::vector<SPItem*>::iterator end = candidates.begin();
+    for (std::vector<SPItem*>::iterator i = candidates.begin(); i != candidates.end(); ++i) {
+        if (is_query_leaf(*i, root, key, into_groups) && (*i)->isVisibleAndUnlocked(key)) {
+            *end++ = *i;
+        }
+    }
+    candidates.erase(end, candidates.end());
+    std::sort(candidates.begin(), candidates.end(), is_above);
+
+    for (std::vector<SPItem*>::const_iterator i = candidates.begin(); i != candidates.end(); ++i) {
+        if (upto && !sp_object_compare_position_bool(*i, upto)) {
+            continue;
+        }
+        Inkscape::DrawingItem *arenaitem = (*i)->get_arenaitem(key);
+        if (arenaitem && arenaitem->pick(p, delta, 1) != NULL) {
+            return *i;
+        }
+    }
+    return NULL;
 }
 
 SPItem *SPDocument::getGroupAtPoint(unsigned int key, Geom::Point const &p) const
@@ -1650,6 +1793,28 @@ SPItem *SPDocument::getGroupAtPoint(unsigned int key, Geom::Point const &p) cons
     return find_group_at_point(key, SP_GROUP(this->root), p);
 }
 
+/**
+ * Returns the spatial index of the items of this document, building it on first use.
+ */
+Inkscape::ItemIndex &SPDocument::getItemIndex() const
+{
+    if (!priv->item_index) {
+        priv->item_index = new Inkscape::ItemIndex(root);
+    }
+    return *priv->item_index;
+}
+
+/**
+ * Returns the selector matches of the style sheets of this document, compiling them on first use.
+ */
+Inkscape::StyleCascadeCache &SPDocument::getStyleCascadeCache() const
+{
+    if (!priv->style_cascade_cache) {
+        priv->style_cascade_cache = new Inkscape::StyleCascadeCache(style_cascade, &Inkscape::XML::croco_node_iface);
+    }
+    return *priv->style_cascade_cache;
+}
+
 // Resource management
 
 bool SPDocument::addResource(gchar const *key, SPObject *object)
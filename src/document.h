@@ -59,6 +59,8 @@ class SPRoot;
 
 namespace Inkscape {
     class Selection; 
+    class ItemIndex;
+    class StyleCascadeCache;
     class UndoStackObserver;
     class EventLog;
     class ProfileManager;
@@ -290,6 +292,8 @@ public:
     SPItem *getItemAtPoint(unsigned int key, Geom::Point const &p, bool into_groups, SPItem *upto = NULL) const;
     std::vector<SPItem*> getItemsAtPoints(unsigned const key, std::vector<Geom::Point> points, bool all_layers = true, size_t limit = 0) const ;
     SPItem *getGroupAtPoint(unsigned int key,  Geom::Point const &p) const;
+    Inkscape::ItemIndex &getItemIndex() const;
+    Inkscape::StyleCascadeCache &getStyleCascadeCache() const;
 
     void changeUriAndHrefs(char const *uri);
     void emitResizedSignal(double width, double height);
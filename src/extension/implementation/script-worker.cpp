@@ -0,0 +1,260 @@
+/*
+ * A script extension that keeps running between invocations
+ *
+ * Copyright (C) 2018 Authors
+ *
+ * Released under GNU GPL, read the file 'COPYING' for more information
+ */
+
+#include "script-worker.h"
+
+#include <signal.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <glib.h>
+
+#ifdef WIN32
+#include <windows.h>
+#endif
+
+namespace Inkscape {
+namespace Extension {
+namespace Implementation {
+
+namespace {
+
+/// Longest header line a worker may send
+size_t const MAX_HEADER_LENGTH = 64;
+
+} // namespace
+
+ScriptWorker::ScriptWorker(std::vector<std::string> const &argv, std::string const &working_directory)
+    : _running(false)
+    , _busy(false)
+    , _pid(0)
+    , _stdin(-1)
+    , _stdout(-1)
+    , _sent(0)
+    , _has_header(false)
+    , _header_length(0)
+    , _out_length(0)
+    , _err_length(0)
+    , _failed(false)
+{
+    std::vector<std::string> worker_argv(argv);
+    gchar *version = g_strdup_printf("--inkscape-worker=%d", PROTOCOL_VERSION);
+    worker_argv.push_back(version);
+    g_free(version);
+
+    try {
+        // the worker keeps the standard error of Inkscape, it only sees what
+        // the script prints outside of requests
+        Glib::spawn_async_with_pipes(working_directory,
+                                     worker_argv,
+                                     static_cast<Glib::SpawnFlags>(0),
+                                     sigc::slot<void>(),
+                                     &_pid,
+                                     &_stdin,
+                                     &_stdout,
+                                     NULL);
+        _running = true;
+    } catch (Glib::Error &e) {
+        g_warning("ScriptWorker: can't spawn %s: %s", argv.front().c_str(), e.what().c_str());
+    }
+}
+
+ScriptWorker::~ScriptWorker()
+{
+    _stop();
+}
+
+bool ScriptWorker::run(std::list<std::string> const &args, std::string const &document,
+                       Glib::RefPtr<Glib::MainLoop> const &main_loop,
+                       std::string &out, std::string &err)
+{
+    if (!_running) {
+        return false;
+    }
+
+    std::string arguments;
+    for (std::list<std::string>::const_iterator i = args.begin(); i != args.end(); ++i) {
+        arguments += *i;
+        arguments.push_back('\0');
+    }
+    gchar *header = g_strdup_printf("%lu %lu\n", static_cast<unsigned long>(arguments.size()),
+                                    static_cast<unsigned long>(document.size()));
+    _request = header;
+    _request += arguments;
+    _request += document;
+    g_free(header);
+    _sent = 0;
+
+    _busy = true;
+    _reply.clear();
+    _has_header = false;
+    _failed = false;
+    _main_loop = main_loop;
+
+    // the request is sent from the main loop as the worker reads it, so that
+    // a worker which stops reading can be canceled like a slow one
+    Glib::RefPtr<Glib::IOChannel> input = Glib::IOChannel::create_from_fd(_stdin);
+    input->set_encoding();
+    input->set_buffered(false);
+    input->set_flags(Glib::IO_FLAG_NONBLOCK);
+    Glib::RefPtr<Glib::IOChannel> output = Glib::IOChannel::create_from_fd(_stdout);
+    output->set_encoding();
+    output->set_buffered(false);
+
+#ifndef WIN32
+    // a worker that exited must not take Inkscape down with it
+    void (*previous)(int) = signal(SIGPIPE, SIG_IGN);
+#endif
+    sigc::connection write_conn = main_loop->get_context()->signal_io().connect(
+        sigc::bind<0>(sigc::mem_fun(*this, &ScriptWorker::_write), input),
+        input, Glib::IO_OUT | Glib::IO_HUP | Glib::IO_ERR);
+    sigc::connection read_conn = main_loop->get_context()->signal_io().connect(
+        sigc::bind<0>(sigc::mem_fun(*this, &ScriptWorker::_read), output),
+        output, Glib::IO_IN | Glib::IO_HUP | Glib::IO_ERR);
+    main_loop->run();
+    write_conn.disconnect();
+    read_conn.disconnect();
+#ifndef WIN32
+    (void) signal(SIGPIPE, previous);
+#endif
+    _main_loop.reset();
+
+    bool sent = _sent == _request.size();
+    _request.clear();
+
+    bool complete = sent && !_failed && _has_header &&
+                    _reply.size() == _header_length + _out_length + _err_length;
+    if (!complete) {
+        // failed, or canceled while sending the request or waiting for the reply
+        _stop();
+        return false;
+    }
+
+    out.assign(_reply, _header_length, _out_length);
+    err.assign(_reply, _header_length + _out_length, _err_length);
+    _reply.clear();
+    _busy = false;
+    return true;
+}
+
+bool ScriptWorker::_write(Glib::RefPtr<Glib::IOChannel> channel, Glib::IOCondition condition)
+{
+    if (condition & Glib::IO_OUT) {
+        gsize written = 0;
+        Glib::IOStatus status = Glib::IO_STATUS_ERROR;
+        try {
+            status = channel->write(_request.data() + _sent, _request.size() - _sent, written);
+        } catch (Glib::Error &e) {
+            g_warning("ScriptWorker: %s", e.what().c_str());
+        }
+        _sent += written;
+
+        if (status == Glib::IO_STATUS_NORMAL || status == Glib::IO_STATUS_AGAIN) {
+            // keep watching until the worker took the whole request
+            return _sent < _request.size();
+        }
+    }
+
+    // the worker closed its end or exited before it read the whole request
+    _failed = true;
+    _main_loop->quit();
+    return false;
+}
+
+bool ScriptWorker::_read(Glib::RefPtr<Glib::IOChannel> channel, Glib::IOCondition condition)
+{
+    if (condition & Glib::IO_IN) {
+        char buffer[65536];
+        gsize length = 0;
+        Glib::IOStatus status = Glib::IO_STATUS_ERROR;
+        try {
+            status = channel->read(buffer, sizeof(buffer), length);
+        } catch (Glib::Error &e) {
+            g_warning("ScriptWorker: %s", e.what().c_str());
+        }
+        _reply.append(buffer, length);
+
+        if (status == Glib::IO_STATUS_NORMAL || status == Glib::IO_STATUS_AGAIN) {
+            if (!_has_header && !_parseHeader()) {
+                _failed = true;
+                _main_loop->quit();
+                return false;
+            }
+            if (_has_header && _reply.size() >= _header_length + _out_length + _err_length) {
+                // the worker must not say more than it announced
+                _failed = _reply.size() > _header_length + _out_length + _err_length;
+                _main_loop->quit();
+                return false;
+            }
+            return true;
+        }
+    }
+
+    // the worker closed its end or exited before the whole reply came
+    _failed = true;
+    _main_loop->quit();
+    return false;
+}
+
+bool ScriptWorker::_parseHeader()
+{
+    size_t end = _reply.find('\n');
+    if (end == std::string::npos) {
+        return _reply.size() < MAX_HEADER_LENGTH;
+    }
+
+    int status = 0;
+    unsigned long out_length = 0;
+    unsigned long err_length = 0;
+    std::string header(_reply, 0, end);
+    if (sscanf(header.c_str(), "%d %lu %lu", &status, &out_length, &err_length) != 3) {
+        g_warning("ScriptWorker: invalid reply \"%s\"", header.c_str());
+        return false;
+    }
+
+    _has_header = true;
+    _header_length = end + 1;
+    _out_length = out_length;
+    _err_length = err_length;
+    return true;
+}
+
+void ScriptWorker::_stop()
+{
+    if (!_running) {
+        return;
+    }
+    _running = false;
+
+    // closing its input ends the loop of the worker, unless it is busy
+    close(_stdin);
+    close(_stdout);
+    if (_busy) {
+#ifdef WIN32
+        TerminateProcess(_pid, 1);
+#else
+        kill(_pid, SIGTERM);
+#endif
+        _busy = false;
+    }
+    Glib::spawn_close_pid(_pid);
+}
+
+}  // namespace Implementation
+}  // namespace Extension
+}  // namespace Inkscape
+
+/*
+  Local Variables:
+  mode:c++
+  c-file-style:"stroustrup"
+  c-file-offsets:((innamespace . 0)(inline-open . 0)(case-label . +))
+  indent-tabs-mode:nil
+  fill-column:99
+  End:
+*/
+// vim: filetype=cpp:expandtab:shiftwidth=4:tabstop=8:softtabstop=4 :
@@ -0,0 +1,101 @@
+/*
+ * A script extension that keeps running between invocations
+ *
+ * Copyright (C) 2018 Authors
+ *
+ * Released under GNU GPL, read the file 'COPYING' for more information
+ */
+
+#ifndef INKSCAPE_EXTENSION_IMPLEMENTATION_SCRIPT_WORKER_H_SEEN
+#define INKSCAPE_EXTENSION_IMPLEMENTATION_SCRIPT_WORKER_H_SEEN
+
+#include <list>
+#include <string>
+#include <vector>
+#include <glibmm/iochannel.h>
+#include <glibmm/main.h>
+#include <glibmm/spawn.h>
+
+namespace Inkscape {
+namespace Extension {
+namespace Implementation {
+
+/**
+ * A script started once, with the argument --inkscape-worker=VERSION, that
+ * handles one invocation after the other over its standard input and output,
+ * for extensions whose .inx declares the protocol in the worker element of
+ * their script.
+ *
+ * Version 1 of the protocol: a request is a line "A D" followed by A bytes of
+ * NUL terminated arguments and D bytes of document. When D is 0 the arguments
+ * are those of a script started for a single invocation, ending with the file
+ * to read if there is one. The worker answers with a line "STATUS O E" followed by the O
+ * bytes the script wrote to its standard output and the E bytes it wrote to
+ * its standard error, STATUS being the exit status it would have had. Like for
+ * a script started per invocation, Inkscape only uses the two outputs. The
+ * worker exits when its standard input is closed.
+ */
+class ScriptWorker
+{
+public:
+    /// The version of the protocol Inkscape speaks
+    static int const PROTOCOL_VERSION = 1;
+
+    /// Starts argv (as built for a single invocation, without parameters) in working_directory
+    ScriptWorker(std::vector<std::string> const &argv, std::string const &working_directory);
+    /// Closes the pipes, which makes the worker exit; kills it if it is busy
+    ~ScriptWorker();
+
+    bool running() const { return _running; }
+
+    /**
+     * Sends a request and waits for the answer in main_loop, which is quit to cancel.
+     * Returns false if the worker could not be reached, did not follow the protocol
+     * or was canceled, after which it is no longer running.
+     */
+    bool run(std::list<std::string> const &args, std::string const &document,
+             Glib::RefPtr<Glib::MainLoop> const &main_loop,
+             std::string &out, std::string &err);
+
+private:
+    ScriptWorker(ScriptWorker const &);
+    ScriptWorker &operator=(ScriptWorker const &);
+
+    bool _write(Glib::RefPtr<Glib::IOChannel> channel, Glib::IOCondition condition);
+    bool _read(Glib::RefPtr<Glib::IOChannel> channel, Glib::IOCondition condition);
+    bool _parseHeader();
+    void _stop();
+
+    bool _running;
+    bool _busy;
+    Glib::Pid _pid;
+    int _stdin;
+    int _stdout;
+
+    Glib::RefPtr<Glib::MainLoop> _main_loop;
+    std::string _request;
+    size_t _sent;
+    std::string _reply;
+    bool _has_header;
+    size_t _header_length;
+    size_t _out_length;
+    size_t _err_length;
+    bool _failed;
+};
+
+}  // namespace Implementation
+}  // namespace Extension
+}  // namespace Inkscape
+
+#endif // INKSCAPE_EXTENSION_IMPLEMENTATION_SCRIPT_WORKER_H_SEEN
+
+/*
+  Local Variables:
+  mode:c++
+  c-file-style:"stroustrup"
+  c-file-offsets:((innamespace . 0)(inline-open . 0)(case-label . +))
+  indent-tabs-mode:nil
+  fill-column:99
+  End:
+*/
+// vim: filetype=cpp:expandtab:shiftwidth=4:tabstop=8:softtabstop=4 :
@@ -35,12 +35,14 @@
 #include "io/resource.h"
 #include "preferences.h"
 #include "script.h"
+#include "script-worker.h"
 #include "selection.h"
 #include "sp-namedview.h"
 #include "extension/system.h"
 #include "ui/view/view.h"
 #include "xml/node.h"
 #include "xml/attribute-record.h"
+#include "xml/repr.h"
 #include "ui/tools/node-tool.h"
 #include "ui/tool/multi-path-manipulator.h"
 #include "ui/tool/path-manipulator.h"
@@ -147,7 +149,9 @@ std::string Script::resolveInterpreterExecutable(const Glib::ustring &interpName
 */
 Script::Script() :
     Implementation(),
-    _canceled(false)
+    _canceled(false),
+    worker_protocol(0),
+    _worker(NULL)
 {
 }
 
@@ -156,6 +160,7 @@ Script::Script() :
  */
 Script::~Script()
 {
+    delete _worker;
 }
 
 
@@ -282,6 +287,7 @@ bool Script::load(Inkscape::Extension::Extension *module)
     }
 
     helper_extension = "";
+    worker_protocol = 0;
 
     /* This should probably check to find the executable... */
     Inkscape::XML::Node *child_repr = module->get_repr()->firstChild();
@@ -300,6 +306,18 @@ bool Script::load(Inkscape::Extension::Extension *module)
                 if (!strcmp(child_repr->name(), INKSCAPE_EXTENSION_NS "helper_extension")) {
                     helper_extension = child_repr->firstChild()->content();
                 }
+                if (!strcmp(child_repr->name(), INKSCAPE_EXTENSION_NS "worker")) {
+                    gchar const *protocol = child_repr->attribute("protocol");
+                    if (protocol && atoi(protocol) == ScriptWorker::PROTOCOL_VERSION) {
+                        Inkscape::Preferences *prefs = Inkscape::Preferences::get();
+                        if (prefs->getBool("/options/extensions/workers", true)) {
+                            worker_protocol = ScriptWorker::PROTOCOL_VERSION;
+                        }
+                    } else {
+                        g_warning("Script::load: %s asks for worker protocol %s, which is not supported",
+                                  module->get_id(), protocol ? protocol : "(none)");
+                    }
+                }
                 child_repr = child_repr->next();
             }
 
@@ -326,6 +344,9 @@ void Script::unload(Inkscape::Extension::Extension */*module*/)
 {
     command.clear();
     helper_extension = "";
+    worker_protocol = 0;
+    delete _worker;
+    _worker = NULL;
 }
 
 
@@ -381,21 +402,39 @@ bool Script::check(Inkscape::Extension::Extension *module)
     return true;
 }
 
+/**
+    The document an effect is applied to, kept for live preview.  It is
+    saved to a temporary file, or serialized into a buffer when the
+    script runs as a worker; the other form is made when needed.
+*/
 class ScriptDocCache : public ImplementationDocumentCache {
     friend class Script;
 protected:
     std::string _filename;
     int _tempfd;
+    std::string _buffer;
 public:
-    ScriptDocCache (Inkscape::UI::View::View * view);
+    ScriptDocCache (Inkscape::UI::View::View * view, bool buffered);
     ~ScriptDocCache ( );
+    std::string const &filename();
+    std::string const &buffer();
 };
 
-ScriptDocCache::ScriptDocCache (Inkscape::UI::View::View * view) :
+ScriptDocCache::ScriptDocCache (Inkscape::UI::View::View * view, bool buffered) :
     ImplementationDocumentCache(view),
     _filename(""),
-    _tempfd(0)
+    _tempfd(-1)
 {
+    SPDesktop *desktop = (SPDesktop *) view;
+    sp_namedview_document_from_window(desktop);
+
+    if (buffered) {
+        // the worker runs in the directory of the script, so it gets absolute hrefs
+        _buffer = sp_repr_save_absolute_buf(view->doc()->getReprDoc(), SP_SVG_NS_URI,
+                                            view->doc()->getBase());
+        return;
+    }
+
     try {
         _tempfd = Glib::file_open_tmp(_filename, "ink_ext_XXXXXX.svg");
     } catch (...) {
@@ -403,9 +442,6 @@ ScriptDocCache::ScriptDocCache (Inkscape::UI::View::View * view) :
         return;
     }
 
-    SPDesktop *desktop = (SPDesktop *) view;
-    sp_namedview_document_from_window(desktop);
-
     Inkscape::Extension::save(
               Inkscape::Extension::db.get(SP_MODULE_KEY_OUTPUT_SVG_INKSCAPE),
               view->doc(), _filename.c_str(), false, false, false, Inkscape::Extension::FILE_SAVE_METHOD_TEMPORARY);
@@ -415,12 +451,39 @@ ScriptDocCache::ScriptDocCache (Inkscape::UI::View::View * view) :
 
 ScriptDocCache::~ScriptDocCache ( )
 {
-    close(_tempfd);
-    unlink(_filename.c_str());
+    if (_tempfd >= 0) {
+        close(_tempfd);
+        unlink(_filename.c_str());
+    }
+}
+
+std::string const &ScriptDocCache::filename()
+{
+    if (_tempfd < 0 && !_buffer.empty()) {
+        try {
+            _tempfd = Glib::file_open_tmp(_filename, "ink_ext_XXXXXX.svg");
+            Glib::file_set_contents(_filename, _buffer);
+        } catch (...) {
+            /// \todo Popup dialog here
+        }
+    }
+    return _filename;
+}
+
+std::string const &ScriptDocCache::buffer()
+{
+    if (_buffer.empty() && _tempfd >= 0) {
+        try {
+            _buffer = Glib::file_get_contents(_filename);
+        } catch (Glib::FileError &e) {
+            g_warning("ScriptDocCache: %s", e.what().c_str());
+        }
+    }
+    return _buffer;
 }
 
 ImplementationDocumentCache *Script::newDocCache( Inkscape::Extension::Extension * /*ext*/, Inkscape::UI::View::View * view ) {
-    return new ScriptDocCache(view);
+    return new ScriptDocCache(view, worker_protocol != 0);
 }
 
 
@@ -479,6 +542,32 @@ SPDocument *Script::open(Inkscape::Extension::Input *module,
     std::list<std::string> params;
     module->paramListString(params);
 
+    std::string lfilename = Glib::filename_from_utf8(filenameArg);
+
+    if (worker_protocol != 0 && helper_extension.empty()) {
+        // the worker runs in the directory of the script, like execute() does
+        std::list<std::string> args(params);
+        if (Glib::path_is_absolute(lfilename)) {
+            args.push_back(lfilename);
+        } else {
+            args.push_back(Glib::build_filename(Glib::get_current_dir(), lfilename));
+        }
+
+        std::string output;
+        int data_read = execute_worker(args, std::string(), output);
+        if (data_read >= 0) {
+            SPDocument *mydoc = NULL;
+            if (data_read > 10) {
+                mydoc = SPDocument::createNewDocFromMem(output.data(), output.size(), TRUE);
+            }
+            if (mydoc != NULL) {
+                mydoc->setBase(0);
+                mydoc->changeUriAndHrefs(filenameArg);
+            }
+            return mydoc;
+        }
+    }
+
     std::string tempfilename_out;
     int tempfd_out = 0;
     try {
@@ -488,8 +577,6 @@ SPDocument *Script::open(Inkscape::Extension::Input *module,
         return NULL;
     }
 
-    std::string lfilename = Glib::filename_from_utf8(filenameArg);
-
     file_listener fileout;
     int data_read = execute(command, params, lfilename, fileout);
     fileout.toFile(tempfilename_out);
@@ -554,6 +641,31 @@ void Script::save(Inkscape::Extension::Output *module,
     std::list<std::string> params;
     module->paramListString(params);
 
+    if (worker_protocol != 0 && helper_extension.empty()) {
+        std::string output;
+        std::string document = sp_repr_save_absolute_buf(doc->getReprDoc(), SP_SVG_NS_URI,
+                                                         doc->getBase());
+        int data_read = execute_worker(params, document, output);
+        if (data_read >= 0) {
+            bool success = false;
+            if (data_read > 0) {
+                try {
+                    std::string lfilename = Glib::filename_from_utf8(filenameArg);
+                    Glib::RefPtr<Glib::IOChannel> file = Glib::IOChannel::create_from_file(lfilename, "w");
+                    file->set_encoding();
+                    gsize written = 0;
+                    file->write(output.data(), output.size(), written);
+                    success = (written == output.size());
+                } catch (Glib::Error &e) {
+                }
+            }
+            if (success == false) {
+                throw Inkscape::Extension::Output::save_failed();
+            }
+            return;
+        }
+    }
+
     std::string tempfilename_in;
     int tempfd_in = 0;
     try {
@@ -656,6 +768,11 @@ void Script::effect(Inkscape::Extension::Effect *module,
         // this is a no-doc extension, e.g. a Help menu command;
         // just run the command without any files, ignoring errors
 
+        std::string output;
+        if (worker_protocol != 0 && execute_worker(params, std::string(), output) >= 0) {
+            return;
+        }
+
         Glib::ustring empty;
         file_listener outfile;
         execute(command, params, empty, outfile);
@@ -663,15 +780,6 @@ void Script::effect(Inkscape::Extension::Effect *module,
         return;
     }
 
-    std::string tempfilename_out;
-    int tempfd_out = 0;
-    try {
-        tempfd_out = Glib::file_open_tmp(tempfilename_out, "ink_ext_XXXXXX.svg");
-    } catch (...) {
-        /// \todo Popup dialog here
-        return;
-    }
-
     auto selected =
             desktop->getSelection()->items(); //desktop should not be NULL since doc was checked and desktop is a casted pointer
     for(auto x = selected.begin(); x != selected.end(); ++x){
@@ -724,25 +832,45 @@ void Script::effect(Inkscape::Extension::Effect *module,
     }
     }//end add selected nodes
 
-    file_listener fileout;
-    int data_read = execute(command, params, dc->_filename, fileout);
-    fileout.toFile(tempfilename_out);
+    SPDocument * mydoc = NULL;
+    std::string output;
+    if (worker_protocol != 0 && execute_worker(params, dc->buffer(), output) >= 0) {
+        pump_events();
 
-    pump_events();
+        if (output.size() > 10) {
+            mydoc = SPDocument::createNewDocFromMem(output.data(), output.size(), TRUE);
+        }
 
-    SPDocument * mydoc = NULL;
-    if (data_read > 10) {
-        mydoc = Inkscape::Extension::open(
-              Inkscape::Extension::db.get(SP_MODULE_KEY_INPUT_SVG),
-              tempfilename_out.c_str());
-    } // data_read
+        pump_events();
+    } else {
+        std::string tempfilename_out;
+        int tempfd_out = 0;
+        try {
+            tempfd_out = Glib::file_open_tmp(tempfilename_out, "ink_ext_XXXXXX.svg");
+        } catch (...) {
+            /// \todo Popup dialog here
+            return;
+        }
 
-    pump_events();
+        file_listener fileout;
+        int data_read = execute(command, params, dc->filename(), fileout);
+        fileout.toFile(tempfilename_out);
 
-    // make sure we don't leak file descriptors from Glib::file_open_tmp
-    close(tempfd_out);
+        pump_events();
 
-    g_unlink(tempfilename_out.c_str());
+        if (data_read > 10) {
+            mydoc = Inkscape::Extension::open(
+                  Inkscape::Extension::db.get(SP_MODULE_KEY_INPUT_SVG),
+                  tempfilename_out.c_str());
+        } // data_read
+
+        pump_events();
+
+        // make sure we don't leak file descriptors from Glib::file_open_tmp
+        close(tempfd_out);
+
+        g_unlink(tempfilename_out.c_str());
+    }
 
     if (mydoc) {
         SPDocument* vd=doc->doc();
@@ -961,6 +1089,50 @@ bool Script::cancelProcessing (void) {
 }
 
 
+/**
+    \return   The program and script to run for a command, without arguments
+    \brief    Resolves the program of in_command in the path, and sets
+              working_directory to that of the script if it is interpreted.
+*/
+std::vector<std::string> Script::command_argv (const std::list<std::string> &in_command,
+                                               std::string &working_directory)
+{
+    std::vector<std::string> argv;
+
+    bool interpreted = (in_command.size() == 2);
+    std::string program = in_command.front();
+    std::string script = interpreted ? in_command.back() : "";
+
+    // Use Glib::find_program_in_path instead of the equivalent
+    // Glib::spawn_* functionality, because _wspawnp is broken on Windows:
+    // it doesn't work when PATH contains Unicode directories
+    if (!Glib::path_is_absolute(program)) {
+        program = Glib::find_program_in_path(program);
+    }
+    argv.push_back(program);
+
+    if (interpreted) {
+        // On Windows, Python garbles Unicode command line parameters
+        // in an useless way. This means extensions fail when Inkscape
+        // is run from an Unicode directory.
+        // As a workaround, we set the working directory to the one
+        // containing the script.
+        working_directory = Glib::path_get_dirname(script);
+        script = Glib::path_get_basename(script);
+        #ifdef G_OS_WIN32
+        // ANNOYING: glibmm does not wrap g_win32_locale_filename_from_utf8
+        gchar *workdir_s = g_win32_locale_filename_from_utf8(working_directory.data());
+        working_directory = workdir_s;
+        g_free(workdir_s);
+        #endif
+
+        argv.push_back(script);
+    }
+
+    return argv;
+}
+
+
 /** \brief    This is the core of the extension file as it actually does
               the execution of the extension.
     \param    in_command  The command to be executed
@@ -996,38 +1168,8 @@ int Script::execute (const std::list<std::string> &in_command,
     g_return_val_if_fail(!in_command.empty(), 0);
     // printf("Executing\n");
 
-    std::vector<std::string> argv;
-
-    bool interpreted = (in_command.size() == 2);
-    std::string program = in_command.front();
-    std::string script = interpreted ? in_command.back() : "";
     std::string working_directory = "";
-
-    // Use Glib::find_program_in_path instead of the equivalent
-    // Glib::spawn_* functionality, because _wspawnp is broken on Windows:
-    // it doesn't work when PATH contains Unicode directories
-    if (!Glib::path_is_absolute(program)) {
-        program = Glib::find_program_in_path(program);
-    }
-    argv.push_back(program);
-
-    if (interpreted) {
-        // On Windows, Python garbles Unicode command line parameters
-        // in an useless way. This means extensions fail when Inkscape
-        // is run from an Unicode directory.
-        // As a workaround, we set the working directory to the one
-        // containing the script.
-        working_directory = Glib::path_get_dirname(script);
-        script = Glib::path_get_basename(script);
-        #ifdef G_OS_WIN32
-        // ANNOYING: glibmm does not wrap g_win32_locale_filename_from_utf8
-        gchar *workdir_s = g_win32_locale_filename_from_utf8(working_directory.data());
-        working_directory = workdir_s;
-        g_free(workdir_s);
-        #endif
-
-        argv.push_back(script);
-    }
+    std::vector<std::string> argv = command_argv(in_command, working_directory);
 
     // assemble the rest of argv
     std::copy(in_params.begin(), in_params.end(), std::back_inserter(argv));
@@ -1104,6 +1246,67 @@ int Script::execute (const std::list<std::string> &in_command,
 }
 
 
+/** \brief    Runs the script in its worker process, see ScriptWorker.
+    \param    in_params  The parameters of the invocation, ending with the
+                         file to read if there is no document
+    \param    document   The document to send, or an empty string
+    \param    output     What the script wrote to its standard output
+    \return   Number of bytes that were read into output, or -1 if the
+              script has to be started for this invocation instead.
+
+    The worker is started on first use, and runs until the extension is
+    unloaded.  If it can't be started or stops following the protocol,
+    the script is started for each invocation from then on.
+*/
+int Script::execute_worker (const std::list<std::string> &in_params,
+                            const std::string &document,
+                            std::string &output)
+{
+    g_return_val_if_fail(!command.empty(), -1);
+
+    if (_worker != NULL && !_worker->running()) {
+        // stopped by a canceled invocation
+        delete _worker;
+        _worker = NULL;
+    }
+    if (_worker == NULL) {
+        std::string working_directory = "";
+        std::vector<std::string> argv = command_argv(command, working_directory);
+        _worker = new ScriptWorker(argv, working_directory);
+    }
+
+    Glib::RefPtr<Glib::MainContext> main_context = Glib::MainContext::create();
+    _main_loop = Glib::MainLoop::create(main_context, false);
+    _canceled = false;
+
+    std::string errors;
+    bool answered = _worker->run(in_params, document, _main_loop, output, errors);
+
+    if (_canceled) {
+        return 0;
+    }
+
+    if (!answered) {
+        g_warning("Script::execute_worker: %s does not work as a worker, starting it for each invocation",
+                  command.back().c_str());
+        worker_protocol = 0;
+        delete _worker;
+        _worker = NULL;
+        return -1;
+    }
+
+    if (errors.length() != 0 &&
+        INKSCAPE.use_gui()
+       ) {
+        checkStderr(errors, Gtk::MESSAGE_INFO,
+                                 _("Inkscape has received additional data from the script executed.  "
+                                   "The script did not return an error, but this may indicate the results will not be as expected."));
+    }
+
+    return output.length();
+}
+
+
 void Script::file_listener::init(int fd, Glib::RefPtr<Glib::MainLoop> main) {
     _channel = Glib::IOChannel::create_from_fd(fd);
     _channel->set_encoding();
@@ -27,6 +27,8 @@ class Node;
 namespace Extension {
 namespace Implementation {
 
+class ScriptWorker;
+
 /**
  * Utility class used for loading and launching script extensions
  */
@@ -66,6 +68,13 @@ private:
       */
     Glib::ustring helper_extension;
 
+    /**
+     * The version of the worker protocol the script speaks, or 0 if it is
+     * started for each invocation, see ScriptWorker
+     */
+    int worker_protocol;
+    ScriptWorker *_worker;
+
     std::string solve_reldir(Inkscape::XML::Node *repr_in);
     bool check_existence (std::string const& command);
     void copy_doc(Inkscape::XML::Node * olddoc, Inkscape::XML::Node * newdoc);
@@ -91,10 +100,15 @@ private:
         bool toFile(const Glib::ustring &name);
     };
 
+    std::vector<std::string> command_argv (const std::list<std::string> &in_command,
+                                           std::string &working_directory);
     int execute (const std::list<std::string> &in_command,
                  const std::list<std::string> &in_params,
                  const Glib::ustring &filein,
                  file_listener &fileout);
+    int execute_worker (const std::list<std::string> &in_params,
+                        const std::string &document,
+                        std::string &output);
 
     void pump_events(void);
 
@@ -18,6 +18,10 @@
 #endif
 
 #include <png.h>
+#include <glib/gstdio.h>
+#include <algorithm>
+#include <cstring>
+#include <vector>
 #include "ui/interface.h"
 #include <2geom/rect.h>
 #include <2geom/transforms.h>
@@ -34,6 +38,10 @@
 #include "display/cairo-utils.h"
 #include "util/units.h"
 
+#ifdef HAVE_OPENMP
+#include <omp.h>
+#endif
+
 /* This is an example of how to use libpng to read and write PNG files.
  * The file libpng.txt is much more verbose then this.  If you have not
  * read it, do so first.  This was designed to be a starting point of an
@@ -48,13 +56,31 @@
 
 static unsigned int const MAX_STRIPE_SIZE = 1024*1024;
 
+/**
+ * A strip of the export area rendered ahead of the PNG writer by a worker.
+ */
+struct SPEBPStrip {
+    int row;
+    int num_rows;
+    guchar const *px; // converted PNG rows, handed over to the writer
+    std::vector<guchar const *> rows;
+};
+
 struct SPEBP {
     unsigned long int width, height, sheight;
+    unsigned long int x0, y0; // position of the written image within the export area
+    unsigned long int chunk_width; // strips are rendered in chunks of at most this width
     guint32 background;
     Inkscape::Drawing *drawing; // it is assumed that all unneeded items are hidden
-    guchar *px;
     unsigned (*status)(float, void *);
     void *data;
+    bool aborted; // status asked to cancel the export
+    double progress_done, progress_total; // pixels, for progress over several files
+    // Threaded export: every worker renders its strip through a separate drawing,
+    // because DrawingItem state is not safe to share between threads.
+    std::vector<Inkscape::Drawing *> drawings;
+    std::vector<SPEBPStrip> strips; // rendered strips not yet passed to libpng
+    size_t next_strip;
 };
 
 /* write a png file */
@@ -120,6 +146,19 @@ void PngTextList::add(gchar const* key, gchar const* text)
     }
 }
 
+/**
+ * Removes a file that could not be written completely.
+ */
+static void
+sp_png_remove_file(gchar const *utf8name)
+{
+    gchar *filename = g_filename_from_utf8(utf8name, -1, NULL, NULL, NULL);
+    if (filename) {
+        g_unlink(filename);
+        g_free(filename);
+    }
+}
+
 static bool
 sp_png_write_rgba_striped(SPDocument *doc,
                           gchar const *filename, unsigned long int width, unsigned long int height, double xdpi, double ydpi,
@@ -170,6 +209,7 @@ sp_png_write_rgba_striped(SPDocument *doc,
         // If we get here, we had a problem reading the file
         fclose(fp);
         png_destroy_write_struct(&png_ptr, &info_ptr);
+        sp_png_remove_file(filename);
         return false;
     }
 
@@ -287,7 +327,14 @@ sp_png_write_rgba_striped(SPDocument *doc,
         while (r < static_cast<png_uint_32>(height)) {
             void *to_free;
             int n = get_rows((unsigned char const **) row_pointers, &to_free, r, height-r, data, color_type, bit_depth, antialiasing);
-            if (!n) break;
+            if (!n) {
+                // cancelled or out of memory: don't leave a truncated image behind
+                delete[] row_pointers;
+                png_destroy_write_struct(&png_ptr, &info_ptr);
+                fclose(fp);
+                sp_png_remove_file(filename);
+                return false;
+            }
             png_write_rows(png_ptr, row_pointers, n);
             g_free(to_free);
             r += n;
@@ -317,43 +364,52 @@ sp_png_write_rgba_striped(SPDocument *doc,
 
 
 /**
- *
+ * Returns the area of the drawing covered by num_rows rows starting at row.
  */
-static int
-sp_export_get_rows(guchar const **rows, void **to_free, int row, int num_rows, void *data, int color_type, int bit_depth, int antialiasing)
+static Geom::IntRect
+sp_export_rows_area(struct SPEBP *ebp, int row, int num_rows)
 {
-    struct SPEBP *ebp = (struct SPEBP *) data;
-
-    if (ebp->status) {
-        if (!ebp->status((float) row / ebp->height, ebp->data)) return 0;
-    }
-
-    num_rows = MIN(num_rows, static_cast<int>(ebp->sheight));
-    num_rows = MIN(num_rows, static_cast<int>(ebp->height - row));
-
-    /* Set area of interest */
     // bbox is now set to the entire image to prevent discontinuities
     // in the image when blur is used (the borders may still be a bit
     // off, but that's less noticeable).
-    Geom::IntRect bbox = Geom::IntRect::from_xywh(0, row, ebp->width, num_rows);
+    return Geom::IntRect::from_xywh(ebp->x0, ebp->y0 + row, ebp->width, num_rows);
+}
 
-    /* Update to renderable state */
-    ebp->drawing->update(bbox);
+/**
+ * Render num_rows rows starting at row through the given drawing and convert them
+ * to the requested PNG format. The returned buffer backs the row pointers in rows.
+ * The drawing must have been updated for the area of the rows.
+ */
+static guchar const *
+sp_export_render_rows(Inkscape::Drawing *drawing, struct SPEBP *ebp, guchar const **rows, int row, int num_rows,
+                      int color_type, int bit_depth, int antialiasing)
+{
+    Geom::IntRect bbox = sp_export_rows_area(ebp, row, num_rows);
 
     int stride = cairo_format_stride_for_width(CAIRO_FORMAT_ARGB32, ebp->width);
-    unsigned char *px = g_new(guchar, num_rows * stride);
-
-    cairo_surface_t *s = cairo_image_surface_create_for_data(
-        px, CAIRO_FORMAT_ARGB32, ebp->width, num_rows, stride);
-    Inkscape::DrawingContext dc(s, bbox.min());
-    dc.setSource(ebp->background);
-    dc.setOperator(CAIRO_OPERATOR_SOURCE);
-    dc.paint();
-    dc.setOperator(CAIRO_OPERATOR_OVER);
+    unsigned char *px = g_try_new(guchar, num_rows * stride);
+    if (!px) {
+        g_warning("Not enough memory to render %d rows of %lu pixels", num_rows, ebp->width);
+        return NULL;
+    }
 
-    /* Render */
-    ebp->drawing->render(dc, bbox, 0, antialiasing);
-    cairo_surface_destroy(s);
+    // Render in chunks, so that the temporary surfaces of the renderer stay
+    // small however wide the strip is.
+    for (unsigned long x = 0; x < ebp->width; x += ebp->chunk_width) {
+        Geom::IntRect chunk = Geom::IntRect::from_xywh(bbox.left() + x, bbox.top(),
+                                                       MIN(ebp->chunk_width, ebp->width - x), num_rows);
+        cairo_surface_t *s = cairo_image_surface_create_for_data(
+            px + 4 * x, CAIRO_FORMAT_ARGB32, chunk.width(), num_rows, stride);
+        Inkscape::DrawingContext dc(s, chunk.min());
+        dc.setSource(ebp->background);
+        dc.setOperator(CAIRO_OPERATOR_SOURCE);
+        dc.paint();
+        dc.setOperator(CAIRO_OPERATOR_OVER);
+
+        /* Render */
+        drawing->render(dc, chunk, 0, antialiasing);
+        cairo_surface_destroy(s);
+    }
 
     // PNG stores data as unpremultiplied big-endian RGBA, which means
     // it's identical to the GdkPixbuf format.
@@ -361,12 +417,142 @@ sp_export_get_rows(guchar const **rows, void **to_free, int row, int num_rows, v
     
     // If a custom bit depth or color type is asked, then convert rgb to grayscale, etc.
     const guchar* new_data = pixbuf_to_png(rows, px, num_rows, ebp->width, stride, color_type, bit_depth);
-    *to_free = (void*) new_data;
     free(px);
 
+    return new_data;
+}
+
+/**
+ * Reports the progress of the export when a strip starting at row is requested.
+ * Returns false if the export should be cancelled.
+ */
+static bool
+sp_export_report_progress(struct SPEBP *ebp, int row)
+{
+    if (!ebp->status) return true;
+    double done = ebp->progress_done + (double) row * ebp->width;
+    if (!ebp->status((float) (done / ebp->progress_total), ebp->data)) {
+        ebp->aborted = true;
+        return false;
+    }
+    return true;
+}
+
+/**
+ *
+ */
+static int
+sp_export_get_rows(guchar const **rows, void **to_free, int row, int num_rows, void *data, int color_type, int bit_depth, int antialiasing)
+{
+    struct SPEBP *ebp = (struct SPEBP *) data;
+
+    if (!sp_export_report_progress(ebp, row)) return 0;
+
+    num_rows = MIN(num_rows, static_cast<int>(ebp->sheight));
+    num_rows = MIN(num_rows, static_cast<int>(ebp->height - row));
+
+    /* Update to renderable state */
+    ebp->drawing->update(sp_export_rows_area(ebp, row, num_rows));
+
+    *to_free = (void*) sp_export_render_rows(ebp->drawing, ebp, rows, row, num_rows, color_type, bit_depth, antialiasing);
+    if (!*to_free) return 0;
+
     return num_rows;
 }
 
+static void
+sp_export_free_strips(struct SPEBP *ebp)
+{
+    for (std::vector<SPEBPStrip>::iterator i = ebp->strips.begin(); i != ebp->strips.end(); ++i) {
+        free((void *) i->px);
+    }
+    ebp->strips.clear();
+    ebp->next_strip = 0;
+}
+
+/**
+ * Threaded variant of sp_export_get_rows().
+ *
+ * When the writer asks for a row that has not been rendered yet, the following strips
+ * (one per drawing) are rendered in parallel. They are then handed to libpng one at a
+ * time, in order. Each strip covers exactly the same area as in the single-threaded
+ * export, so the output is identical.
+ */
+static int
+sp_export_get_rows_threaded(guchar const **rows, void **to_free, int row, int num_rows, void *data, int color_type, int bit_depth, int antialiasing)
+{
+    struct SPEBP *ebp = (struct SPEBP *) data;
+
+    if (!sp_export_report_progress(ebp, row)) return 0;
+
+    if (ebp->next_strip >= ebp->strips.size() || ebp->strips[ebp->next_strip].row != row) {
+        sp_export_free_strips(ebp);
+
+        int r = row;
+        for (size_t i = 0; i < ebp->drawings.size() && r < static_cast<int>(ebp->height); ++i) {
+            SPEBPStrip strip;
+            strip.row = r;
+            strip.num_rows = MIN(static_cast<int>(ebp->sheight), static_cast<int>(ebp->height) - r);
+            strip.px = NULL;
+            strip.rows.resize(strip.num_rows);
+            ebp->strips.push_back(strip);
+            r += strip.num_rows;
+        }
+
+        // Updating is not safe to run in parallel, and only the area of each strip is
+        // brought to renderable state, so memory stays bounded by the strips.
+        // The drawings share the document, so the parts of rendering which read it
+        // are done here as well. Strips showing items which read the document
+        // whenever they are rendered, like filters with feImage, are rendered
+        // one after the other.
+        int count = ebp->strips.size();
+        bool parallel = true;
+        for (int i = 0; i < count; ++i) {
+            SPEBPStrip &strip = ebp->strips[i];
+            Geom::IntRect area = sp_export_rows_area(ebp, strip.row, strip.num_rows);
+            ebp->drawings[i]->update(area);
+            if (!ebp->drawings[i]->prepareRender(area)) {
+                parallel = false;
+            }
+        }
+        #if HAVE_OPENMP
+        #pragma omp parallel for schedule(dynamic, 1) num_threads(count) if(parallel)
+        #endif
+        for (int i = 0; i < count; ++i) {
+            SPEBPStrip &strip = ebp->strips[i];
+            strip.px = sp_export_render_rows(ebp->drawings[i], ebp, &strip.rows[0], strip.row, strip.num_rows,
+                                             color_type, bit_depth, antialiasing);
+        }
+    }
+
+    SPEBPStrip &strip = ebp->strips[ebp->next_strip++];
+    if (!strip.px) return 0;
+    num_rows = MIN(num_rows, strip.num_rows);
+    std::copy(strip.rows.begin(), strip.rows.begin() + num_rows, rows);
+    *to_free = (void *) strip.px;
+    strip.px = NULL;
+
+    return num_rows;
+}
+
+/**
+ * Returns the name of the file for one tile of a tiled export: the row and column
+ * are inserted before the extension, e.g. "drawing_0_1.png". Free with g_free().
+ */
+static gchar *
+sp_export_tile_filename(gchar const *filename, unsigned long row, unsigned long col)
+{
+    gchar const *base = strrchr(filename, G_DIR_SEPARATOR);
+    gchar const *dot = strrchr(base ? base : filename, '.');
+    if (!dot) {
+        return g_strdup_printf("%s_%lu_%lu", filename, row, col);
+    }
+    gchar *stem = g_strndup(filename, dot - filename);
+    gchar *result = g_strdup_printf("%s_%lu_%lu%s", stem, row, col, dot);
+    g_free(stem);
+    return result;
+}
+
 /**
  * Hide all items that are not listed in list, recursively, skipping groups and defs.
  */
@@ -396,10 +582,13 @@ ExportResult sp_export_png_file(SPDocument *doc, gchar const *filename,
                                 unsigned long bgcolor,
                                 unsigned int (*status) (float, void *),
                                 void *data, bool force_overwrite,
-                                const std::vector<SPItem*> &items_only, bool interlace, int color_type, int bit_depth, int zlib, int antialiasing)
+                                const std::vector<SPItem*> &items_only, bool interlace, int color_type, int bit_depth, int zlib, int antialiasing,
+                                int threads, Inkscape::DrawingStatistics *stats,
+                                size_t memory_limit, unsigned long tile_width, unsigned long tile_height)
 {
     return sp_export_png_file(doc, filename, Geom::Rect(Geom::Point(x0,y0),Geom::Point(x1,y1)),
-                              width, height, xdpi, ydpi, bgcolor, status, data, force_overwrite, items_only, interlace, color_type, bit_depth, zlib, antialiasing);
+                              width, height, xdpi, ydpi, bgcolor, status, data, force_overwrite, items_only, interlace, color_type, bit_depth, zlib, antialiasing,
+                              threads, stats, memory_limit, tile_width, tile_height);
 }
 
 ExportResult sp_export_png_file(SPDocument *doc, gchar const *filename,
@@ -408,7 +597,9 @@ ExportResult sp_export_png_file(SPDocument *doc, gchar const *filename,
                                 unsigned long bgcolor,
                                 unsigned (*status)(float, void *),
                                 void *data, bool force_overwrite,
-                                const std::vector<SPItem*> &items_only, bool interlace, int color_type, int bit_depth, int zlib, int antialiasing)
+                                const std::vector<SPItem*> &items_only, bool interlace, int color_type, int bit_depth, int zlib, int antialiasing,
+                                int threads, Inkscape::DrawingStatistics *stats,
+                                size_t memory_limit, unsigned long tile_width, unsigned long tile_height)
 {
     g_return_val_if_fail(doc != NULL, EXPORT_ERROR);
     g_return_val_if_fail(filename != NULL, EXPORT_ERROR);
@@ -417,7 +608,8 @@ ExportResult sp_export_png_file(SPDocument *doc, gchar const *filename,
     g_return_val_if_fail(!area.hasZeroArea(), EXPORT_ERROR);
 
 
-    if (!force_overwrite && !sp_ui_overwrite_file(filename)) {
+    bool tiled = (tile_width > 0 && tile_width < width) || (tile_height > 0 && tile_height < height);
+    if (!tiled && !force_overwrite && !sp_ui_overwrite_file(filename)) {
         // aborted overwrite
 	return EXPORT_ABORTED;
     }
@@ -457,6 +649,7 @@ ExportResult sp_export_png_file(SPDocument *doc, gchar const *filename,
     /* Create new drawing */
     Inkscape::Drawing drawing;
     drawing.setExact(true); // export with maximum blur rendering quality
+    drawing.setStatisticsEnabled(stats != NULL);
     unsigned const dkey = SPItem::display_key_new(1);
 
     // Create ArenaItems and set transform
@@ -472,20 +665,105 @@ ExportResult sp_export_png_file(SPDocument *doc, gchar const *filename,
 
     ebp.status = status;
     ebp.data   = data;
+    ebp.aborted = false;
+    ebp.next_strip = 0;
+    ebp.x0 = 0;
+    ebp.y0 = 0;
+    ebp.progress_done = 0;
+    ebp.progress_total = (double) width * height;
 
     bool write_status = false;;
 
+    // Without a tile size, the whole export area is written to one file
+    unsigned long tw = (tile_width > 0) ? MIN(tile_width, width) : width;
+    unsigned long th = (tile_height > 0) ? MIN(tile_height, height) : height;
+
     ebp.sheight = 64;
-    ebp.px = g_try_new(guchar, 4 * ebp.sheight * width);
+    ebp.chunk_width = tw;
+    if (memory_limit > 0) {
+        // Every worker holds one strip: ARGB32 pixels plus at most 8 bytes per
+        // pixel after conversion to the PNG format.
+        size_t per_worker = memory_limit / MAX(threads, 1);
+        size_t row_bytes = 12 * (size_t) tw;
+        ebp.sheight = CLAMP(per_worker / row_bytes, 1UL, 64UL);
+        // Leave room for a few temporary surfaces of the renderer per chunk.
+        size_t chunk_pixels = per_worker / 16;
+        ebp.chunk_width = CLAMP(chunk_pixels / ebp.sheight, 64UL, tw);
+    }
 
-    if (ebp.px) {
-        write_status = sp_png_write_rgba_striped(doc, filename, width, height, xdpi, ydpi, sp_export_get_rows, &ebp, interlace, color_type, bit_depth, zlib, antialiasing);
-        g_free(ebp.px);
+    // Never use more workers than there are strips to render
+    unsigned long strip_count = (th + ebp.sheight - 1) / ebp.sheight;
+    threads = CLAMP(threads, 1, static_cast<int>(MIN(strip_count, 256UL)));
+
+    // Every additional worker gets its own drawing of the same document
+    std::vector<unsigned> worker_dkeys;
+    if (threads > 1) {
+        ebp.drawings.push_back(&drawing);
+        for (int i = 1; i < threads; ++i) {
+            Inkscape::Drawing *worker = new Inkscape::Drawing();
+            worker->setExact(true);
+            worker->setStatisticsEnabled(stats != NULL);
+            unsigned const worker_dkey = SPItem::display_key_new(1);
+            worker->setRoot(doc->getRoot()->invoke_show(*worker, worker_dkey, SP_ITEM_SHOW_DISPLAY));
+            worker->root()->setTransform(affine);
+            if (!items_only.empty()) {
+                hide_other_items_recursively(doc->getRoot(), items_only, worker_dkey);
+            }
+            ebp.drawings.push_back(worker);
+            worker_dkeys.push_back(worker_dkey);
+        }
+    }
+
+    if (tw == width && th == height) {
+        write_status = sp_png_write_rgba_striped(doc, filename, width, height, xdpi, ydpi,
+                                                 threads > 1 ? sp_export_get_rows_threaded : sp_export_get_rows,
+                                                 &ebp, interlace, color_type, bit_depth, zlib, antialiasing);
+    } else {
+        // Write every tile to a separate file, reusing the drawings
+        unsigned long rows = (height + th - 1) / th;
+        unsigned long cols = (width + tw - 1) / tw;
+        write_status = true;
+        for (unsigned long r = 0; r < rows && write_status; ++r) {
+            for (unsigned long c = 0; c < cols && write_status; ++c) {
+                ebp.x0 = c * tw;
+                ebp.y0 = r * th;
+                ebp.width = MIN(tw, width - ebp.x0);
+                ebp.height = MIN(th, height - ebp.y0);
+                gchar *tile_filename = sp_export_tile_filename(filename, r, c);
+                if (!force_overwrite && !sp_ui_overwrite_file(tile_filename)) {
+                    g_free(tile_filename);
+                    ebp.aborted = true;
+                    write_status = false;
+                    break;
+                }
+                write_status = sp_png_write_rgba_striped(doc, tile_filename, ebp.width, ebp.height, xdpi, ydpi,
+                                                         threads > 1 ? sp_export_get_rows_threaded : sp_export_get_rows,
+                                                         &ebp, interlace, color_type, bit_depth, zlib, antialiasing);
+                g_free(tile_filename);
+                sp_export_free_strips(&ebp);
+                ebp.progress_done += (double) ebp.width * ebp.height;
+            }
+        }
+    }
+    sp_export_free_strips(&ebp);
+
+    if (stats) {
+        stats->merge(*drawing.statistics());
+        for (size_t i = 1; i < ebp.drawings.size(); ++i) {
+            stats->merge(*ebp.drawings[i]->statistics());
+        }
     }
 
     // Hide items, this releases arenaitem
     doc->getRoot()->invoke_hide(dkey);
+    for (size_t i = 0; i < worker_dkeys.size(); ++i) {
+        doc->getRoot()->invoke_hide(worker_dkeys[i]);
+        delete ebp.drawings[i + 1];
+    }
 
+    if (ebp.aborted) {
+        return EXPORT_ABORTED;
+    }
     return write_status ? EXPORT_OK : EXPORT_ERROR;
 }
 
@@ -14,11 +14,16 @@
  * Released under GNU GPL, read the file 'COPYING' for more information
  */
 
+#include <cstddef>
 #include <2geom/forward.h>
 
 class SPDocument;
 class SPItem;
 
+namespace Inkscape {
+class DrawingStatistics;
+}
+
 enum ExportResult {
     EXPORT_ERROR = 0,
     EXPORT_OK,
@@ -28,20 +33,36 @@ enum ExportResult {
 /**
  * Export the given document as a Portable Network Graphics (PNG) file.
  *
- * @return EXPORT_OK if succeeded, EXPORT_ABORTED if no action was taken, EXPORT_ERROR (false) if an error occurred.
+ * With threads > 1 the export area is rendered by that many workers, each using its
+ * own drawing of the document; the resulting file is identical to a single-threaded export.
+ * When stats is not NULL, render statistics of the export are added to it.
+ *
+ * A non-zero memory_limit (in bytes) bounds the memory used for pixels during the export,
+ * independently of the output size: strips get fewer rows and are rendered in narrower
+ * chunks. At least one full row per thread is always kept in memory.
+ * A non-zero tile_width or tile_height splits the output into files of at most that size,
+ * named after filename with the tile row and column inserted before the extension
+ * (e.g. "drawing_0_1.png"). The progress passed to status covers all tiles.
+ *
+ * @return EXPORT_OK if succeeded, EXPORT_ABORTED if no action was taken or the export was cancelled,
+ * EXPORT_ERROR (false) if an error occurred; no partially written file is left behind.
  */
 ExportResult sp_export_png_file(SPDocument *doc, gchar const *filename,
 				double x0, double y0, double x1, double y1,
 				unsigned long int width, unsigned long int height, double xdpi, double ydpi,
 				unsigned long bgcolor,
 				unsigned int (*status) (float, void *), void *data, bool force_overwrite = false, const std::vector<SPItem*> &items_only = std::vector<SPItem*>(), 
-                                bool interlace = false, int color_type = 6, int bit_depth = 8, int zlib = 6, int antialiasing = 2);
+                                bool interlace = false, int color_type = 6, int bit_depth = 8, int zlib = 6, int antialiasing = 2,
+                                int threads = 1, Inkscape::DrawingStatistics *stats = NULL,
+                                size_t memory_limit = 0, unsigned long tile_width = 0, unsigned long tile_height = 0);
 
 ExportResult sp_export_png_file(SPDocument *doc, gchar const *filename,
 				Geom::Rect const &area,
 				unsigned long int width, unsigned long int height, double xdpi, double ydpi,
 				unsigned long bgcolor,
 				unsigned int (*status) (float, void *), void *data, bool force_overwrite = false, const std::vector<SPItem*> &items_only = std::vector<SPItem*>(), 
-                                bool interlace = false, int color_type = 6, int bit_depth = 8, int zlib = 6, int antialiasing = 2);
+                                bool interlace = false, int color_type = 6, int bit_depth = 8, int zlib = 6, int antialiasing = 2,
+                                int threads = 1, Inkscape::DrawingStatistics *stats = NULL,
+                                size_t memory_limit = 0, unsigned long tile_width = 0, unsigned long tile_height = 0);
 
 #endif // SEEN_SP_PNG_WRITE_H
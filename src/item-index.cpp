@@ -0,0 +1,165 @@
+/*
+ * Spatial index of the items of a document
+ *
+ * Copyright (C) 2018 Authors
+ *
+ * Released under GNU GPL, read the file 'COPYING' for more information
+ */
+
+#include <iterator>
+#include <boost/geometry.hpp>
+
+#include "item-index.h"
+#include "sp-item-group.h"
+#include "sp-item.h"
+
+namespace Inkscape {
+
+ItemIndex::ItemIndex(SPGroup *root)
+    : _root(root)
+{
+    _root_connection = _root->connectModified(sigc::mem_fun(*this, &ItemIndex::_onModified));
+    _addChildren(_root);
+}
+
+ItemIndex::~ItemIndex()
+{
+    _root_connection.disconnect();
+    for (EntryMap::iterator i = _entries.begin(); i != _entries.end(); ++i) {
+        i->second.modified_connection.disconnect();
+        i->second.release_connection.disconnect();
+    }
+}
+
+void ItemIndex::find(Geom::Rect const &area, AreaTest test, std::vector<SPItem *> &items)
+{
+    _update();
+
+    std::vector<Value> found;
+    _tree.query(boost::geometry::index::intersects(_box(area)), std::back_inserter(found));
+    for (std::vector<Value>::const_iterator i = found.begin(); i != found.end(); ++i) {
+        Entry const &e = _entries.find(i->second)->second;
+        if (test(area, *e.bounds)) {
+            items.push_back(i->second);
+        }
+    }
+}
+
+ItemIndex::Box ItemIndex::_box(Geom::Rect const &r)
+{
+    return Box(Point(r.left(), r.top()), Point(r.right(), r.bottom()));
+}
+
+void ItemIndex::_add(SPItem *item)
+{
+    Entry &e = _entries[item];
+    e.stale = true;
+    e.modified_connection = item->connectModified(sigc::mem_fun(*this, &ItemIndex::_onModified));
+    e.release_connection = item->connectRelease(sigc::mem_fun(*this, &ItemIndex::_onRelease));
+    _stale.push_back(item);
+
+    SPGroup *group = dynamic_cast<SPGroup *>(item);
+    if (group) {
+        _addChildren(group);
+    }
+}
+
+void ItemIndex::_addChildren(SPGroup *group)
+{
+    for (auto &o : group->children) {
+        SPItem *item = dynamic_cast<SPItem *>(&o);
+        if (item && !item->cloned && _entries.find(item) == _entries.end()) {
+            _add(item);
+        }
+    }
+}
+
+void ItemIndex::_update()
+{
+    if (_stale.empty()) {
+        return;
+    }
+    // bulk loading is much faster than inserting many boxes one by one
+    bool rebuild = _stale.size() > _tree.size() / 4;
+
+    for (std::vector<SPItem *>::const_iterator i = _stale.begin(); i != _stale.end(); ++i) {
+        EntryMap::iterator found = _entries.find(*i);
+        if (found == _entries.end() || !found->second.stale) {
+            continue;
+        }
+        SPItem *item = found->first;
+        Entry &e = found->second;
+        if (e.bounds && !rebuild) {
+            _tree.remove(Value(_box(*e.bounds), item));
+        }
+        SPGroup *group = dynamic_cast<SPGroup *>(item);
+        if (group && group->layerMode() == SPGroup::LAYER) {
+            e.bounds = Geom::OptRect();
+        } else {
+            e.bounds = item->desktopVisualBounds();
+        }
+        if (e.bounds && !rebuild) {
+            _tree.insert(Value(_box(*e.bounds), item));
+        }
+        e.stale = false;
+    }
+    _stale.clear();
+
+    if (rebuild) {
+        std::vector<Value> values;
+        values.reserve(_entries.size());
+        for (EntryMap::const_iterator i = _entries.begin(); i != _entries.end(); ++i) {
+            if (i->second.bounds) {
+                values.push_back(Value(_box(*i->second.bounds), i->first));
+            }
+        }
+        Tree packed(values.begin(), values.end());
+        _tree.swap(packed);
+    }
+}
+
+void ItemIndex::_onModified(SPObject *object, unsigned flags)
+{
+    SPItem *item = static_cast<SPItem *>(object);
+    EntryMap::iterator found = _entries.find(item);
+    if (found != _entries.end() && !found->second.stale) {
+        found->second.stale = true;
+        _stale.push_back(item);
+    }
+
+    // groups request a modification whenever a child is added
+    if (flags & SP_OBJECT_MODIFIED_FLAG) {
+        SPGroup *group = dynamic_cast<SPGroup *>(object);
+        if (group) {
+            _addChildren(group);
+        }
+    }
+}
+
+void ItemIndex::_onRelease(SPObject *object)
+{
+    EntryMap::iterator found = _entries.find(static_cast<SPItem *>(object));
+    if (found == _entries.end()) {
+        return;
+    }
+    Entry &e = found->second;
+    if (e.bounds) {
+        _tree.remove(Value(_box(*e.bounds), found->first));
+    }
+    e.modified_connection.disconnect();
+    e.release_connection.disconnect();
+    _entries.erase(found);
+}
+
+} // namespace Inkscape
+
+/*
+  Local Variables:
+  mode:c++
+  c-file-style:"stroustrup"
+  c-file-offsets:((innamespace . 0)(inline-open . 0)(case-label . +))
+  indent-tabs-mode:nil
+  fill-column:99
+  End:
+*/
+// vim: filetype=cpp:expandtab:shiftwidth=4:tabstop=8:softtabstop=4:fileencoding=utf-8:textwidth=99 :
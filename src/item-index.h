@@ -0,0 +1,97 @@
+#ifndef SEEN_INKSCAPE_ITEM_INDEX_H
+#define SEEN_INKSCAPE_ITEM_INDEX_H
+
+/*
+ * Spatial index of the items of a document
+ *
+ * Copyright (C) 2018 Authors
+ *
+ * Released under GNU GPL, read the file 'COPYING' for more information
+ */
+
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include <2geom/rect.h>
+#include <boost/geometry/geometries/box.hpp>
+#include <boost/geometry/geometries/point.hpp>
+#include <boost/geometry/index/rtree.hpp>
+#include <boost/utility.hpp>
+#include <sigc++/connection.h>
+
+class SPGroup;
+class SPItem;
+class SPObject;
+
+namespace Inkscape {
+
+/**
+ * R-tree of the desktop visual bounding boxes of all items that can be reached from
+ * the root through groups, i.e. all items the area and point queries of SPDocument
+ * can return.
+ *
+ * The index connects to the modified and release signals of every indexed item.
+ * A modified item is only marked stale; stale boxes are recomputed at the next query,
+ * so that moving a group with many children costs one update per item at most.
+ * Modification of a group adds any children it does not know yet. Layers are indexed
+ * without a box, since queries always descend into them.
+ *
+ * Bounding boxes in desktop coordinates do not depend on the display key, so one index
+ * serves all desktops of a document. Per-desktop state (visibility, locking, entered
+ * groups) is checked by the caller.
+ */
+class ItemIndex
+    : boost::noncopyable
+{
+public:
+    typedef bool (*AreaTest)(Geom::Rect const &area, Geom::Rect const &box);
+
+    explicit ItemIndex(SPGroup *root);
+    ~ItemIndex();
+
+    /// Appends the items whose box passes test(area, box), in no particular order
+    void find(Geom::Rect const &area, AreaTest test, std::vector<SPItem *> &items);
+    size_t size() const { return _entries.size(); }
+
+private:
+    typedef boost::geometry::model::point<double, 2, boost::geometry::cs::cartesian> Point;
+    typedef boost::geometry::model::box<Point> Box;
+    typedef std::pair<Box, SPItem *> Value;
+    typedef boost::geometry::index::rtree<Value, boost::geometry::index::rstar<16> > Tree;
+
+    struct Entry {
+        Geom::OptRect bounds; ///< box stored in the tree, if any
+        bool stale;
+        sigc::connection modified_connection;
+        sigc::connection release_connection;
+    };
+    typedef std::unordered_map<SPItem *, Entry> EntryMap;
+
+    static Box _box(Geom::Rect const &r);
+    void _add(SPItem *item);
+    void _addChildren(SPGroup *group);
+    void _update();
+    void _onModified(SPObject *object, unsigned flags);
+    void _onRelease(SPObject *object);
+
+    SPGroup *_root;
+    sigc::connection _root_connection;
+    Tree _tree;
+    EntryMap _entries;
+    std::vector<SPItem *> _stale;
+};
+
+} // namespace Inkscape
+
+#endif // !SEEN_INKSCAPE_ITEM_INDEX_H
+
+/*
+  Local Variables:
+  mode:c++
+  c-file-style:"stroustrup"
+  c-file-offsets:((innamespace . 0)(inline-open . 0)(case-label . +))
+  indent-tabs-mode:nil
+  fill-column:99
+  End:
+*/
+// vim: filetype=cpp:expandtab:shiftwidth=4:tabstop=8:softtabstop=4:fileencoding=utf-8:textwidth=99 :
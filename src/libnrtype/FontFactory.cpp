@@ -21,48 +21,56 @@
 #include <pango/pango-ot.h>
 #include "libnrtype/FontFactory.h"
 #include "libnrtype/font-instance.h"
-#include "util/unordered-containers.h"
+#include "preferences.h"
 #include <map>
 
 #include <harfbuzz/hb-ft.h>
 #include <harfbuzz/hb-ot.h>
 
-typedef INK_UNORDERED_MAP<PangoFontDescription*, font_instance*, font_descr_hash, font_descr_equal> FaceMapType;
-
-// need to avoid using the size field
-size_t font_descr_hash::operator()( PangoFontDescription *const &x) const {
-    int h = 0;
-    char const *theF = sp_font_description_get_family(x);
-    h += (theF)?g_str_hash(theF):0;
-    h *= 1128467;
-    h += (int)pango_font_description_get_style(x);
-    h *= 1128467;
-    h += (int)pango_font_description_get_variant(x);
-    h *= 1128467;
-    h += (int)pango_font_description_get_weight(x);
-    h *= 1128467;
-    h += (int)pango_font_description_get_stretch(x);
-    return h;
-}
-bool  font_descr_equal::operator()( PangoFontDescription *const&a, PangoFontDescription *const &b) const {
-    //if ( pango_font_description_equal(a,b) ) return true;
-    char const *fa = sp_font_description_get_family(a);
-    char const *fb = sp_font_description_get_family(b);
-    if ( ( fa && fb == NULL ) || ( fb && fa == NULL ) ) return false;
-    if ( fa && fb && strcmp(fa,fb) != 0 ) return false;
-    if ( pango_font_description_get_style(a) != pango_font_description_get_style(b) ) return false;
-    if ( pango_font_description_get_variant(a) != pango_font_description_get_variant(b) ) return false;
-    if ( pango_font_description_get_weight(a) != pango_font_description_get_weight(b) ) return false;
-    if ( pango_font_description_get_stretch(a) != pango_font_description_get_stretch(b) ) return false;
-    return true;
-}
-
 /////////////////// helper functions
 
 static void noop(...) {}
 //#define PANGO_DEBUG g_print
 #define PANGO_DEBUG noop
 
+/// The key of a font description in font_factory::loadedFaces: the family, with the substitutions
+/// of sp_font_description_get_family(), and the style, variant, weight and stretch. The size
+/// does not matter, all fonts are loaded at font_factory::fontSize.
+static std::string font_key(PangoFontDescription const *descr)
+{
+    char const *family = sp_font_description_get_family(descr);
+    gchar *fields = g_strdup_printf("\n%d,%d,%d,%d",
+                                    (int)pango_font_description_get_style(descr),
+                                    (int)pango_font_description_get_variant(descr),
+                                    (int)pango_font_description_get_weight(descr),
+                                    (int)pango_font_description_get_stretch(descr));
+    std::string key = family ? family : "";
+    key += fields;
+    g_free(fields);
+    return key;
+}
+
+/// The key of a style in font_factory::styleFaces: everything FaceFromStyle() reads.
+static std::string style_key(SPStyle const *style)
+{
+    gchar *fields = g_strdup_printf("\n%d,%d,%d,%d",
+                                    (int)style->font_style.computed,
+                                    (int)style->font_weight.computed,
+                                    (int)style->font_stretch.computed,
+                                    (int)style->font_variant.computed);
+    std::string key;
+    if (style->font_specification.set && style->font_specification.value) {
+        key += style->font_specification.value;
+    }
+    key += '\n';
+    if (style->font_family.value) {
+        key += style->font_family.value;
+    }
+    key += fields;
+    g_free(fields);
+    return key;
+}
+
 
 ///////////////////// FontFactory
 #ifndef USE_PANGO_WIN32
@@ -86,9 +94,6 @@ font_factory *font_factory::Default(void)
 }
 
 font_factory::font_factory(void) :
-    nbEnt(0), // Note: this "ents" cache only keeps fonts from being unreffed, does not speed up access
-    maxEnt(32),
-    ents(static_cast<font_entry*>(g_malloc(maxEnt*sizeof(font_entry)))),
 #ifdef USE_PANGO_WIN32
     fontServer(pango_win32_font_map_for_display()),
     pangoFontCache(pango_win32_font_map_get_font_cache(fontServer)),
@@ -98,8 +103,18 @@ font_factory::font_factory(void) :
 #endif
     fontContext(pango_font_map_create_context(fontServer)),
     fontSize(512),
-    loadedPtr(new FaceMapType())
+    faceCacheSize(32),
+    styleCacheSize(1024)
 {
+    stats.hits = 0;
+    stats.misses = 0;
+    stats.evictions = 0;
+    stats.load_time = 0.0;
+
+    Inkscape::Preferences *prefs = Inkscape::Preferences::get();
+    faceCacheSize = prefs->getIntLimited("/options/font/cacheSize", faceCacheSize, 0, 65536);
+    styleCacheSize = prefs->getIntLimited("/options/font/styleCacheSize", styleCacheSize, 0, 1048576);
+
 #ifndef USE_PANGO_WIN32
     pango_ft2_font_map_set_resolution(PANGO_FT2_FONT_MAP(fontServer),
                                       72, 72);
@@ -112,8 +127,12 @@ font_factory::font_factory(void) :
 
 font_factory::~font_factory(void)
 {
-    for (int i = 0;i < nbEnt;i++) ents[i].f->Unref();
-    if ( ents ) g_free(ents);
+    faceCacheSize = 0;
+    _trimRecentFaces();
+
+    for (std::vector<PangoContext *>::iterator it = workerContexts.begin(); it != workerContexts.end(); ++it) {
+        g_object_unref(*it);
+    }
 
     g_object_unref(fontServer);
 #ifdef USE_PANGO_WIN32
@@ -122,12 +141,6 @@ font_factory::~font_factory(void)
     //pango_ft2_shutdown_display();
 #endif
     //g_object_unref(fontContext);
-
-    if (loadedPtr) {
-        FaceMapType* tmp = static_cast<FaceMapType*>(loadedPtr);
-        delete tmp;
-        loadedPtr = 0;
-    }
 }
 
 
@@ -410,6 +423,20 @@ font_instance* font_factory::FaceFromStyle(SPStyle const *style)
     g_assert(style);
 
     if (style) {
+        Glib::Threads::RecMutex::Lock lock(mutex);
+
+        // A style with the same font properties as an earlier one gets the same font,
+        // without building a PangoFontDescription.
+        std::string key = style_key(style);
+        INK_UNORDERED_MAP<std::string, std::string>::iterator found = styleFaces.find(key);
+        if (found != styleFaces.end()) {
+            font = _findLoaded(found->second);
+            if (font) {
+                stats.hits++;
+                font->InitTheFace();
+                return font;
+            }
+        }
 
         //  First try to use the font specification if it is set
         if (style->font_specification.set
@@ -548,6 +575,13 @@ font_instance* font_factory::FaceFromStyle(SPStyle const *style)
             font = Face(temp_descr);
             pango_font_description_free(temp_descr);
         }
+
+        if (font && styleCacheSize > 0) {
+            if (styleFaces.size() >= styleCacheSize) {
+                styleFaces.clear();
+            }
+            styleFaces[key] = font_key(font->descr);
+        }
     }
 
     return font;
@@ -771,6 +805,8 @@ void extract_openTypeTables(font_instance *res) {
 
 font_instance *font_factory::Face(PangoFontDescription *descr, bool canFail)
 {
+    Glib::Threads::RecMutex::Lock lock(mutex);
+
 #ifdef USE_PANGO_WIN32
     // damn Pango fudges the size, so we need to unfudge. See source of pango_win32_font_map_init()
     pango_font_description_set_size(descr, (int) (fontSize*PANGO_SCALE*72/GetDeviceCaps(pango_win32_get_dc(),LOGPIXELSY))); // mandatory huge size (hinting workaround)
@@ -778,11 +814,11 @@ font_instance *font_factory::Face(PangoFontDescription *descr, bool canFail)
     pango_font_description_set_size(descr, (int) (fontSize*PANGO_SCALE)); // mandatory huge size (hinting workaround)
 #endif
 
-    font_instance *res = NULL;
-
-    FaceMapType& loadedFaces = *static_cast<FaceMapType*>(loadedPtr);
-    if ( loadedFaces.find(descr) == loadedFaces.end() ) {
+    std::string key = font_key(descr);
+    font_instance *res = _findLoaded(key);
+    if ( res == NULL ) {
         // not yet loaded
+        gint64 start = g_get_monotonic_time();
         PangoFont *nFace = NULL;
 
         // workaround for bug #1025565.
@@ -819,9 +855,11 @@ font_instance *font_factory::Face(PangoFontDescription *descr, bool canFail)
                     res = Face(descr,false);
                 }
             } else {
-                loadedFaces[res->descr]=res;
+                LoadedFace &entry = loadedFaces[key];
+                entry.face = res;
+                entry.recent = false;
                 res->Ref();
-                AddInCache(res);
+                _touch(key, entry);
             }
         } else {
             // no match
@@ -839,11 +877,13 @@ font_instance *font_factory::Face(PangoFontDescription *descr, bool canFail)
         if (res) {
             extract_openTypeTables(res);
         }
+        if ( canFail ) { // the fallbacks count as part of this lookup
+            stats.misses++;
+            stats.load_time += (g_get_monotonic_time() - start) / 1e6;
+        }
     } else {
         // already here
-        res = loadedFaces[descr];
-        res->Ref();
-        AddInCache(res);
+        if ( canFail ) stats.hits++;
     }
     if (res) {
         res->InitTheFace();
@@ -866,52 +906,109 @@ font_instance *font_factory::Face(char const *family, int variant, int style, in
 
 void font_factory::UnrefFace(font_instance *who)
 {
-    if ( who ) {
-        FaceMapType& loadedFaces = *static_cast<FaceMapType*>(loadedPtr);
+    Glib::Threads::RecMutex::Lock lock(mutex);
 
-        if ( loadedFaces.find(who->descr) == loadedFaces.end() ) {
+    if ( who ) {
+        INK_UNORDERED_MAP<std::string, LoadedFace>::iterator it = loadedFaces.find(font_key(who->descr));
+        if ( it == loadedFaces.end() || it->second.face != who ) {
             // not found
             char *tc = pango_font_description_to_string(who->descr);
             g_warning("unrefFace %p=%s: failed\n",who,tc);
             g_free(tc);
         } else {
-            loadedFaces.erase(loadedFaces.find(who->descr));
+            if ( it->second.recent ) recentFaces.erase(it->second.position);
+            loadedFaces.erase(it);
             //            printf("unrefFace %p: success\n",who);
         }
     }
 }
 
-void font_factory::AddInCache(font_instance *who)
+/// Returns a new reference to the loaded font with the key, or NULL.
+font_instance *font_factory::_findLoaded(std::string const &key)
 {
-    if ( who == NULL ) return;
-    for (int i = 0;i < nbEnt;i++) ents[i].age *= 0.9;
-    for (int i = 0;i < nbEnt;i++) {
-        if ( ents[i].f == who ) {
-            //            printf("present\n");
-            ents[i].age += 1.0;
-            return;
-        }
-    }
-    if ( nbEnt > maxEnt ) {
-        printf("cache sur-plein?\n");
-        return;
+    INK_UNORDERED_MAP<std::string, LoadedFace>::iterator it = loadedFaces.find(key);
+    if ( it == loadedFaces.end() ) return NULL;
+    it->second.face->Ref();
+    _touch(key, it->second);
+    return it->second.face;
+}
+
+/// Moves the font to the front of recentFaces, where the cache keeps a reference to it.
+void font_factory::_touch(std::string const &key, LoadedFace &entry)
+{
+    if ( entry.recent ) {
+        recentFaces.splice(recentFaces.begin(), recentFaces, entry.position);
+    } else if ( faceCacheSize > 0 ) {
+        entry.face->Ref();
+        recentFaces.push_front(key);
+        entry.position = recentFaces.begin();
+        entry.recent = true;
+        _trimRecentFaces();
     }
-    who->Ref();
-    if ( nbEnt == maxEnt ) { // cache is filled, unref the oldest-accessed font in it
-        int    bi = 0;
-        double ba = ents[bi].age;
-        for (int i = 1;i < nbEnt;i++) {
-            if ( ents[i].age < ba ) {
-                bi = i;
-                ba = ents[bi].age;
-            }
+}
+
+/// Drops the least recently used fonts beyond faceCacheSize.
+void font_factory::_trimRecentFaces()
+{
+    while ( recentFaces.size() > faceCacheSize ) {
+        INK_UNORDERED_MAP<std::string, LoadedFace>::iterator it = loadedFaces.find(recentFaces.back());
+        recentFaces.pop_back();
+        stats.evictions++;
+        if ( it != loadedFaces.end() ) {
+            it->second.recent = false;
+            it->second.face->Unref(); // may remove it from loadedFaces
         }
-        ents[bi].f->Unref();
-        ents[bi]=ents[--nbEnt];
     }
-    ents[nbEnt].f = who;
-    ents[nbEnt].age = 1.0;
-    nbEnt++;
+}
+
+void font_factory::SetCacheSize(unsigned faces, unsigned styles)
+{
+    Glib::Threads::RecMutex::Lock lock(mutex);
+    faceCacheSize = faces;
+    _trimRecentFaces();
+    styleCacheSize = styles;
+    if ( styleFaces.size() > styleCacheSize ) styleFaces.clear();
+}
+
+font_factory::CacheStats font_factory::GetCacheStats()
+{
+    Glib::Threads::RecMutex::Lock lock(mutex);
+    return stats;
+}
+
+PangoContext *font_factory::AcquireWorkerContext()
+{
+#ifdef USE_PANGO_WIN32
+    // the win32 font map is per display, there is no second one to shape with
+    return NULL;
+#else
+    Glib::Threads::RecMutex::Lock lock(mutex);
+
+    if ( !workerContexts.empty() ) {
+        PangoContext *context = workerContexts.back();
+        workerContexts.pop_back();
+        return context;
+    }
+
+    // set up like fontServer, so that the fonts and glyphs are the same
+    PangoFontMap *fontMap = pango_ft2_font_map_new();
+    pango_ft2_font_map_set_resolution(PANGO_FT2_FONT_MAP(fontMap),
+                                      72, 72);
+    pango_ft2_font_map_set_default_substitute(PANGO_FT2_FONT_MAP(fontMap),
+                                              FactorySubstituteFunc,
+                                              this,
+                                              NULL);
+    PangoContext *context = pango_font_map_create_context(fontMap);
+    g_object_unref(fontMap); // the context holds it
+    return context;
+#endif
+}
+
+void font_factory::ReleaseWorkerContext(PangoContext *context)
+{
+    if ( context == NULL ) return;
+    Glib::Threads::RecMutex::Lock lock(mutex);
+    workerContexts.push_back(context);
 }
 
 /*
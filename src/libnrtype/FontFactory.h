@@ -11,6 +11,11 @@
 
 #include <functional>
 #include <algorithm>
+#include <list>
+#include <string>
+#include <vector>
+#include <glibmm/threads.h>
+#include "util/unordered-containers.h"
 
 #ifdef HAVE_CONFIG_H
 # include <config.h>
@@ -39,14 +44,9 @@ namespace Glib
     class ustring;
 }
 
-// the font_factory keeps a hashmap of all the loaded font_instances, and uses the PangoFontDescription
-// as index (nota: since pango already does that, using the PangoFont could work too)
-struct font_descr_hash : public std::unary_function<PangoFontDescription*,size_t> {
-    size_t operator()(PangoFontDescription *const &x) const;
-};
-struct font_descr_equal : public std::binary_function<PangoFontDescription*, PangoFontDescription*, bool> {
-    bool operator()(PangoFontDescription *const &a, PangoFontDescription *const &b) const;
-};
+// the font_factory keeps a hashmap of all the loaded font_instances, indexed by a normalized font
+// specification: the family and the style, variant, weight and stretch of the PangoFontDescription
+// (nota: since pango already does that, using the PangoFont could work too)
 
 // Wraps calls to pango_font_description_get_family with some name substitution
 const char *sp_font_description_get_family(PangoFontDescription const *fontDescr);
@@ -77,19 +77,22 @@ public:
                                   *   ("l'usine" is french for "the factory".)
                                   */
 
-    /** A little cache for fonts, so that you don't loose your time looking up fonts in the font list
-     *  each font in the cache is refcounted once (and deref'd when removed from the cache). */
-    struct font_entry {
-        font_instance *f;
-        double age;
+    /** Counters of the font lookups, see GetCacheStats(). */
+    struct CacheStats {
+        unsigned long hits;       ///< Lookups that found a loaded font.
+        unsigned long misses;     ///< Lookups that had to load the font from pango.
+        unsigned long evictions;  ///< Fonts dropped from the cache of recently used fonts.
+        double        load_time;  ///< Seconds spent loading fonts on misses.
     };
-    int nbEnt;   ///< Number of entries.
-    int maxEnt;  ///< Cache size.
-    font_entry *ents;
 
     // Pango data.  Backend-specific structures are cast to these opaque types.
     PangoFontMap *fontServer;
     PangoContext *fontContext;
+
+    /** Guards the font lookups and the reference counts of the font_instances, which the
+     *  worker threads of text layout use too (see AcquireWorkerContext()). Recursive, since
+     *  Face() falls back on itself and unreffing a font_instance calls UnrefFace(). */
+    Glib::Threads::RecMutex mutex;
 #ifdef USE_PANGO_WIN32
     PangoWin32FontCache *pangoFontCache;
     HDC hScreenDC;
@@ -133,11 +136,47 @@ public:
     /// Semi-private: tells the font_factory taht the font_instance 'who' has died and should be removed from loadedFaces
     void                  UnrefFace(font_instance* who);
 
-    // internal
-    void                  AddInCache(font_instance *who);
+    /// Sets how many fonts stay loaded after their last user let go of them, and how many
+    /// styles FaceFromStyle() remembers the font of. Read from the preferences at first.
+    void                  SetCacheSize(unsigned faces, unsigned styles);
+
+    /// Returns the counters of the lookups since the factory was created.
+    CacheStats            GetCacheStats();
+
+    /// Returns a context with a font map of its own, for one worker thread to itemize and
+    /// shape text with while others do the same. NULL if the backend cannot do that.
+    PangoContext*         AcquireWorkerContext();
+
+    /// Gives back a context of AcquireWorkerContext(). It is kept (with its fonts) for the
+    /// next worker, since the shaping caches of layouts may still refer to its fonts.
+    void                  ReleaseWorkerContext(PangoContext *context);
 
 private:
-    void*                 loadedPtr;
+    /// A loaded font_instance. While in recentFaces, the cache holds a reference to it.
+    struct LoadedFace {
+        font_instance *face;
+        bool recent;
+        std::list<std::string>::iterator position; ///< in recentFaces, if recent
+    };
+
+    font_instance*        _findLoaded(std::string const &key);
+    void                  _touch(std::string const &key, LoadedFace &entry);
+    void                  _trimRecentFaces();
+
+    /// All loaded fonts, by font_key() (see FontFactory.cpp); they remove themselves when destroyed.
+    INK_UNORDERED_MAP<std::string, LoadedFace> loadedFaces;
+    /// Keys of the most recently used fonts first, at most faceCacheSize of them.
+    std::list<std::string> recentFaces;
+    unsigned              faceCacheSize;
+
+    /// Font key of the font FaceFromStyle() found for a style key, at most styleCacheSize of them.
+    INK_UNORDERED_MAP<std::string, std::string> styleFaces;
+    unsigned              styleCacheSize;
+
+    CacheStats            stats;
+
+    /// Contexts of AcquireWorkerContext() not in use.
+    std::vector<PangoContext *> workerContexts;
 
 
     // The following two commented out maps were an attempt to allow Inkscape to use font faces
@@ -237,6 +237,7 @@ font_instance::~font_instance(void)
 
 void font_instance::Ref(void)
 {
+    Glib::Threads::RecMutex::Lock lock(font_factory::Default()->mutex);
     refCount++;
     //char *tc=pango_font_description_to_string(descr);
     //printf("font %x %s ref'd %i\n",this,tc,refCount);
@@ -245,6 +246,7 @@ void font_instance::Ref(void)
 
 void font_instance::Unref(void)
 {
+    Glib::Threads::RecMutex::Lock lock(font_factory::Default()->mutex);
     refCount--;
     //char *tc=pango_font_description_to_string(descr);
     //printf("font %x %s unref'd %i\n",this,tc,refCount);
@@ -14,6 +14,7 @@
 #include "svg/svg-length.h"
 #include "sp-object.h"
 #include "Layout-TNG-Scanline-Maker.h"
+#include "Layout-TNG-Shaping-Cache.h"
 #include <limits>
 
 namespace Inkscape {
@@ -26,6 +27,19 @@ namespace Text {
 
 #define TRACE(_args) IFTRACE(g_print _args)
 
+/** Appends the bytes of \a value to a key of Layout::ShapingCache. */
+template<typename T> static void append_to_key(std::string &key, T const &value)
+{
+    key.append(reinterpret_cast<char const *>(&value), sizeof(value));
+}
+
+/** Appends a string, preceded by its length, to a key of Layout::ShapingCache. */
+static void append_to_key(std::string &key, char const *value, size_t bytes)
+{
+    append_to_key(key, bytes);
+    key.append(value, bytes);
+}
+
 /** \brief private to Layout. Does the real work of text flowing.
 
 This class does a standard greedy paragraph wrapping algorithm.
@@ -237,6 +251,7 @@ class Layout::Calculator
         int whitespace_count;
     };
 
+    void _setupPangoContext(PangoContext *context);
     void _buildPangoItemizationForPara(ParagraphInfo *para) const;
     static double _computeFontLineHeight( SPStyle const *style ); // Returns line_height_multiplier
     unsigned _buildSpansForPara(ParagraphInfo *para) const;
@@ -285,6 +300,8 @@ public:
         : _flow(*text_flow) {}
 
     bool calculate();
+
+    void prepareShaping(PangoContext *context);
 };
 
 
@@ -1071,6 +1088,7 @@ void  Layout::Calculator::_buildPangoItemizationForPara(ParagraphInfo *para) con
     Glib::ustring para_text;
     PangoAttrList *attributes_list;
     unsigned input_index;
+    std::string cache_key;    // the fonts and features of every text source, see Layout::ShapingCache
 
     para->free_sequence(para->pango_items);
     para->char_attributes.clear();
@@ -1097,6 +1115,13 @@ void  Layout::Calculator::_buildPangoItemizationForPara(ParagraphInfo *para) con
             PangoAttribute *attribute_font_description = pango_attr_font_desc_new(font->descr);
             attribute_font_description->start_index = para_text.bytes();
 
+            gchar *font_description_string = pango_font_description_to_string(font->descr);
+            Glib::ustring font_features = text_source->style->getFontFeatureString();
+            append_to_key(cache_key, para_text.bytes());
+            append_to_key(cache_key, font_description_string, strlen(font_description_string));
+            append_to_key(cache_key, font_features.data(), font_features.bytes());
+            g_free(font_description_string);
+
 #if PANGO_VERSION_CHECK(1,37,1)
             PangoAttribute *attribute_font_features =
                 pango_attr_font_features_new( text_source->style->getFontFeatureString().c_str());
@@ -1118,14 +1143,42 @@ void  Layout::Calculator::_buildPangoItemizationForPara(ParagraphInfo *para) con
 
     TRACE(("whole para: \"%s\"\n", para_text.data()));
     TRACE(("%d input sources used\n", input_index - para->first_input_index));
-    // do the pango_itemize()
-    GList *pango_items_glist = NULL;
     para->direction = LEFT_TO_RIGHT; // CSS default
-    if (_flow._input_stream[para->first_input_index]->Type() == TEXT_SOURCE) {
+    bool base_dir = _flow._input_stream[para->first_input_index]->Type() == TEXT_SOURCE;
+    PangoDirection pango_direction = PANGO_DIRECTION_LTR;
+    if (base_dir) {
         Layout::InputStreamTextSource const *text_source = static_cast<Layout::InputStreamTextSource *>(_flow._input_stream[para->first_input_index]);
 
-        para->direction =                (text_source->style->direction.computed == SP_CSS_DIRECTION_LTR) ? LEFT_TO_RIGHT : RIGHT_TO_LEFT;
-        PangoDirection pango_direction = (text_source->style->direction.computed == SP_CSS_DIRECTION_LTR) ? PANGO_DIRECTION_LTR : PANGO_DIRECTION_RTL;
+        para->direction = (text_source->style->direction.computed == SP_CSS_DIRECTION_LTR) ? LEFT_TO_RIGHT : RIGHT_TO_LEFT;
+        pango_direction = (text_source->style->direction.computed == SP_CSS_DIRECTION_LTR) ? PANGO_DIRECTION_LTR : PANGO_DIRECTION_RTL;
+    }
+
+    // the same text, fonts and context itemize the same way as last time
+    append_to_key(cache_key, para_text.data(), para_text.bytes());
+    append_to_key(cache_key, base_dir);
+    append_to_key(cache_key, pango_direction);
+    append_to_key(cache_key, pango_context_get_base_gravity(_pango_context));
+    append_to_key(cache_key, pango_context_get_gravity_hint(_pango_context));
+    append_to_key(cache_key, pango_context_get_language(_pango_context));
+    Layout::ShapingCache::Paragraph const *cached = _flow._shaping_cache->findParagraph(cache_key);
+    if (cached) {
+        pango_attr_list_unref(attributes_list);
+        para->pango_items.reserve(cached->items.size());
+        for (unsigned i = 0 ; i < cached->items.size() ; i++) {
+            PangoItemInfo new_item;
+            new_item.item = pango_item_copy(cached->items[i]);
+            new_item.font = cached->fonts[i];
+            if (new_item.font) new_item.font->Ref();
+            para->pango_items.push_back(new_item);
+        }
+        para->char_attributes = cached->char_attributes;
+        TRACE(("para itemization found in cache, %lu sections\n", para->pango_items.size()));
+        return;
+    }
+
+    // do the pango_itemize()
+    GList *pango_items_glist = NULL;
+    if (base_dir) {
         pango_items_glist = pango_itemize_with_base_dir(_pango_context, pango_direction, para_text.data(), 0, para_text.bytes(), attributes_list, NULL);
     }
 
@@ -1153,6 +1206,14 @@ void  Layout::Calculator::_buildPangoItemizationForPara(ParagraphInfo *para) con
     para->char_attributes.resize(para_text.length() + 1);
     pango_get_log_attrs(para_text.data(), para_text.bytes(), -1, NULL, &*para->char_attributes.begin(), para->char_attributes.size());
 
+    std::vector<PangoItem *> items;
+    std::vector<font_instance *> fonts;
+    for (std::vector<PangoItemInfo>::const_iterator it = para->pango_items.begin() ; it != para->pango_items.end() ; ++it) {
+        items.push_back(it->item);
+        fonts.push_back(it->font);
+    }
+    _flow._shaping_cache->addParagraph(cache_key, items, fonts, para->char_attributes);
+
     TRACE(("end para itemize, direction = %d\n", para->direction));
 }
 
@@ -1319,98 +1380,116 @@ unsigned Layout::Calculator::_buildSpansForPara(ParagraphInfo *para) const
                 // now we know the length, do some final calculations and add the UnbrokenSpan to the list
                 new_span.font_size = text_source->style->font_size.computed * _flow.getTextLengthMultiplierDue();
                 if (new_span.text_bytes) {
-                    new_span.glyph_string = pango_glyph_string_new();
-                    /* Some assertions intended to help diagnose bug #1277746. */
-                    g_assert( 0 < new_span.text_bytes );
-                    g_assert( span_start_byte_in_source < text_source->text->bytes() );
-                    g_assert( span_start_byte_in_source + new_span.text_bytes <= text_source->text->bytes() );
-                    g_assert( memchr(text_source->text->data() + span_start_byte_in_source, '\0', static_cast<size_t>(new_span.text_bytes))
-                              == NULL );
-
-                    /* Notes as of 4/29/13.  Pango_shape is not generating English language ligatures, but it is generating
-                    them for Hebrew (and probably other similar languages).  In the case observed 3 unicode characters (a base
-                    and 2 Mark, nonspacings) are merged into two glyphs (the base + first Mn, the 2nd Mn).  All of these map
-                    from glyph to first character of the log_cluster range.  This destroys the 1:1 correspondence between
-                    characters and glyphs.  A big chunk of the conditional code which immediately follows this call
-                    is there to clean up the resulting mess.
-                    */
+                    PangoAnalysis const &analysis = para->pango_items[pango_item_index].item->analysis;
+                    Glib::ustring font_features = text_source->style->getFontFeatureString();
+                    std::string cache_key;
+                    append_to_key(cache_key, text_source->text->data() + span_start_byte_in_source, new_span.text_bytes);
+                    append_to_key(cache_key, analysis.shape_engine);
+                    append_to_key(cache_key, analysis.font);
+                    append_to_key(cache_key, analysis.level);
+                    append_to_key(cache_key, analysis.gravity);
+                    append_to_key(cache_key, analysis.flags);
+                    append_to_key(cache_key, analysis.script);
+                    append_to_key(cache_key, analysis.language);
+                    append_to_key(cache_key, font_features.data(), font_features.bytes());
+                    PangoGlyphString const *cached_glyphs = _flow._shaping_cache->findGlyphs(cache_key);
+                    if (cached_glyphs) {
+                        new_span.glyph_string = pango_glyph_string_copy(const_cast<PangoGlyphString *>(cached_glyphs));
+                    } else {
+                        new_span.glyph_string = pango_glyph_string_new();
+                        /* Some assertions intended to help diagnose bug #1277746. */
+                        g_assert( 0 < new_span.text_bytes );
+                        g_assert( span_start_byte_in_source < text_source->text->bytes() );
+                        g_assert( span_start_byte_in_source + new_span.text_bytes <= text_source->text->bytes() );
+                        g_assert( memchr(text_source->text->data() + span_start_byte_in_source, '\0', static_cast<size_t>(new_span.text_bytes))
+                                  == NULL );
+
+                        /* Notes as of 4/29/13.  Pango_shape is not generating English language ligatures, but it is generating
+                        them for Hebrew (and probably other similar languages).  In the case observed 3 unicode characters (a base
+                        and 2 Mark, nonspacings) are merged into two glyphs (the base + first Mn, the 2nd Mn).  All of these map
+                        from glyph to first character of the log_cluster range.  This destroys the 1:1 correspondence between
+                        characters and glyphs.  A big chunk of the conditional code which immediately follows this call
+                        is there to clean up the resulting mess.
+                        */
                     
-                    // Convert characters to glyphs
-                    pango_shape(text_source->text->data() + span_start_byte_in_source,
-                                new_span.text_bytes,
-                                &para->pango_items[pango_item_index].item->analysis,
-                                new_span.glyph_string);
-
-                    if (para->pango_items[pango_item_index].item->analysis.level & 1) {
-                        // pango_shape() will reorder glyphs in rtl sections into visual order which messes
-                        // us up because the svg spec requires us to draw glyphs in logical order
-                        // let's reverse the glyphstring on a cluster-by-cluster basis
-                        const unsigned nglyphs = new_span.glyph_string->num_glyphs;
-                        std::vector<PangoGlyphInfo> infos(nglyphs);
-                        std::vector<gint>           clusters(nglyphs);
-                        unsigned i, j;
-                        for (i = 0 ; i < nglyphs ; i++)new_span.glyph_string->glyphs[i].attr.is_cluster_start = 0;
-                        for (i = 0 ; i < nglyphs ; i++) {
-                            j=i;
-                            while(  (j < nglyphs-1) &&  
-                                    (new_span.glyph_string->log_clusters[j+1] == new_span.glyph_string->log_clusters[i])
-                            )j++;
-                            /*      
-                            CAREFUL, within a log_cluster the order of glyphs may not map 1:1, or
-                            even in the same order, to the original unicode characters!!!  Among
-                            other things, diacritical mark glyphs can end up sequentially in front of the base
-                            character glyph.  That makes determining kerning, even approximately, difficult
-                            later on.  
+                        // Convert characters to glyphs
+                        pango_shape(text_source->text->data() + span_start_byte_in_source,
+                                    new_span.text_bytes,
+                                    &para->pango_items[pango_item_index].item->analysis,
+                                    new_span.glyph_string);
+
+                        if (para->pango_items[pango_item_index].item->analysis.level & 1) {
+                            // pango_shape() will reorder glyphs in rtl sections into visual order which messes
+                            // us up because the svg spec requires us to draw glyphs in logical order
+                            // let's reverse the glyphstring on a cluster-by-cluster basis
+                            const unsigned nglyphs = new_span.glyph_string->num_glyphs;
+                            std::vector<PangoGlyphInfo> infos(nglyphs);
+                            std::vector<gint>           clusters(nglyphs);
+                            unsigned i, j;
+                            for (i = 0 ; i < nglyphs ; i++)new_span.glyph_string->glyphs[i].attr.is_cluster_start = 0;
+                            for (i = 0 ; i < nglyphs ; i++) {
+                                j=i;
+                                while(  (j < nglyphs-1) &&  
+                                        (new_span.glyph_string->log_clusters[j+1] == new_span.glyph_string->log_clusters[i])
+                                )j++;
+                                /*      
+                                CAREFUL, within a log_cluster the order of glyphs may not map 1:1, or
+                                even in the same order, to the original unicode characters!!!  Among
+                                other things, diacritical mark glyphs can end up sequentially in front of the base
+                                character glyph.  That makes determining kerning, even approximately, difficult
+                                later on.  
                             
-                            To resolve this to the extent possible sort the glyphs within the same
-                            log_cluster into descending order by width in a special manner before copying.  Diacritical marks
-                            and similar have zero width and the glyph they modify has nonzero width.  The order 
-                            of the zero width ones does not matter.  A logical cluster is sorted into sequential order
-                               [base] [zw_modifier1] [zw_modifier2] 
-                            where all the modifiers have zero width and the base does not. This works for languages like Hebrew. 
+                                To resolve this to the extent possible sort the glyphs within the same
+                                log_cluster into descending order by width in a special manner before copying.  Diacritical marks
+                                and similar have zero width and the glyph they modify has nonzero width.  The order 
+                                of the zero width ones does not matter.  A logical cluster is sorted into sequential order
+                                   [base] [zw_modifier1] [zw_modifier2] 
+                                where all the modifiers have zero width and the base does not. This works for languages like Hebrew. 
                             
-                            Pango also creates log clusters for languages like Telugu having many glyphs with nonzero widths. 
-                            Since these are nonzero, their order is not modified.
+                                Pango also creates log clusters for languages like Telugu having many glyphs with nonzero widths. 
+                                Since these are nonzero, their order is not modified.
                             
-                            If some language mixes these modes, having a log cluster having something like 
-                               [base1] [zw_modifier1] [base2] [zw_modifier2]
-                            the result will be incorrect: 
-                               base1] [base2] [zw_modifier1] [zw_modifier2]
+                                If some language mixes these modes, having a log cluster having something like 
+                                   [base1] [zw_modifier1] [base2] [zw_modifier2]
+                                the result will be incorrect: 
+                                   base1] [base2] [zw_modifier1] [zw_modifier2]
 
                                
-                            If ligatures other than with Mark, nonspacing are ever implemented in Pango this will screw up, for instance
-                            changing "fi" to "if".
-                            */
-                            if(j - i){
-                                std::sort(&(new_span.glyph_string->glyphs[i]), &(new_span.glyph_string->glyphs[j+1]), compareGlyphWidth);
+                                If ligatures other than with Mark, nonspacing are ever implemented in Pango this will screw up, for instance
+                                changing "fi" to "if".
+                                */
+                                if(j - i){
+                                    std::sort(&(new_span.glyph_string->glyphs[i]), &(new_span.glyph_string->glyphs[j+1]), compareGlyphWidth);
+                                }
+
+                                new_span.glyph_string->glyphs[i].attr.is_cluster_start = 1;
+                                std::copy(&new_span.glyph_string->glyphs[      i], &new_span.glyph_string->glyphs[      j+1], infos.end()    - j -1);
+                                std::copy(&new_span.glyph_string->log_clusters[i], &new_span.glyph_string->log_clusters[j+1], clusters.end() - j -1);
+                                i = j;
                             }
-
-                            new_span.glyph_string->glyphs[i].attr.is_cluster_start = 1;
-                            std::copy(&new_span.glyph_string->glyphs[      i], &new_span.glyph_string->glyphs[      j+1], infos.end()    - j -1);
-                            std::copy(&new_span.glyph_string->log_clusters[i], &new_span.glyph_string->log_clusters[j+1], clusters.end() - j -1);
-                            i = j;
+                            std::copy(infos.begin(), infos.end(), new_span.glyph_string->glyphs);
+                            std::copy(clusters.begin(), clusters.end(), new_span.glyph_string->log_clusters);
+                            /* glyphs[].x_offset values are probably out of order within any log_clusters, apparently harmless */
                         }
-                        std::copy(infos.begin(), infos.end(), new_span.glyph_string->glyphs);
-                        std::copy(clusters.begin(), clusters.end(), new_span.glyph_string->log_clusters);
-                        /* glyphs[].x_offset values are probably out of order within any log_clusters, apparently harmless */
-                    }
-                    else {  //  ltr sections are in order but glyphs in a log_cluster following a ligature may not be.  Sort, but no block swapping.
-                        const unsigned nglyphs = new_span.glyph_string->num_glyphs;
-                        unsigned i, j;
-                        for (i = 0 ; i < nglyphs ; i++)new_span.glyph_string->glyphs[i].attr.is_cluster_start = 0;
-                        for (i = 0 ; i < nglyphs ; i++) {
-                            j=i;
-                            while(  (j < nglyphs-1) &&  
-                                    (new_span.glyph_string->log_clusters[j+1] == new_span.glyph_string->log_clusters[i])
-                            )j++;
-                            /* see note in preceding section */
-                            if(j - i){
-                                std::sort(&(new_span.glyph_string->glyphs[i]), &(new_span.glyph_string->glyphs[j+1]), compareGlyphWidth);
+                        else {  //  ltr sections are in order but glyphs in a log_cluster following a ligature may not be.  Sort, but no block swapping.
+                            const unsigned nglyphs = new_span.glyph_string->num_glyphs;
+                            unsigned i, j;
+                            for (i = 0 ; i < nglyphs ; i++)new_span.glyph_string->glyphs[i].attr.is_cluster_start = 0;
+                            for (i = 0 ; i < nglyphs ; i++) {
+                                j=i;
+                                while(  (j < nglyphs-1) &&  
+                                        (new_span.glyph_string->log_clusters[j+1] == new_span.glyph_string->log_clusters[i])
+                                )j++;
+                                /* see note in preceding section */
+                                if(j - i){
+                                    std::sort(&(new_span.glyph_string->glyphs[i]), &(new_span.glyph_string->glyphs[j+1]), compareGlyphWidth);
+                                }
+                                new_span.glyph_string->glyphs[i].attr.is_cluster_start = 1;
+                                i = j;
                             }
-                            new_span.glyph_string->glyphs[i].attr.is_cluster_start = 1;
-                            i = j;
+                            /* glyphs[].x_offset values may be out of order within any log_clusters, apparently harmless */
                         }
-                        /* glyphs[].x_offset values may be out of order within any log_clusters, apparently harmless */
+                        _flow._shaping_cache->addGlyphs(cache_key, new_span.glyph_string, analysis.font);
                     }
                     new_span.pango_item_index = pango_item_index;
                     new_span.line_height_multiplier = _computeFontLineHeight( text_source->style );
@@ -1755,26 +1834,10 @@ static void Layout::Calculator::dumpUnbrokenSpans(ParagraphInfo *para){
 }
 #endif //DEBUG_LAYOUT_TNG_COMPUTE
 
-/** The management function to start the whole thing off. */
-bool Layout::Calculator::calculate()
+/** Sets the context to itemize with and its gravity for the block progression. */
+void Layout::Calculator::_setupPangoContext(PangoContext *context)
 {
-    if (_flow._input_stream.empty())
-        return false;
-    /**
-    * hm, why do we want assert (crash) the application, now do simply return false
-    * \todo check if this is the correct behaviour
-    * g_assert(_flow._input_stream.front()->Type() == TEXT_SOURCE);
-    */
-    if (_flow._input_stream.front()->Type() != TEXT_SOURCE)
-    {
-        g_warning("flow text is not of type TEXT_SOURCE. Abort.");
-        return false;
-    }
-    TRACE(("begin calculate()\n"));
-
-    _flow._clearOutputObjects();
-
-    _pango_context = (font_factory::Default())->fontContext;
+    _pango_context = context;
 
     _font_factory_size_multiplier = (font_factory::Default())->fontSize;
 
@@ -1794,6 +1857,54 @@ bool Layout::Calculator::calculate()
         // Horizontal text
         pango_context_set_base_gravity(_pango_context, PANGO_GRAVITY_AUTO);
     }
+}
+
+/** Itemizes and shapes every paragraph into the shaping cache, without
+breaking lines or producing output. See Layout::prepareShaping(). */
+void Layout::Calculator::prepareShaping(PangoContext *context)
+{
+    if (_flow._input_stream.empty() || _flow._input_stream.front()->Type() != TEXT_SOURCE)
+        return;
+    TRACE(("begin prepareShaping()\n"));
+
+    _setupPangoContext(context);
+
+    ParagraphInfo para;
+    for(para.first_input_index = 0 ; para.first_input_index < _flow._input_stream.size() ; ) {
+        if (_flow._input_stream[para.first_input_index]->Type() == CONTROL_CODE) {
+            InputStreamControlCode const *control_code = static_cast<InputStreamControlCode const *>(_flow._input_stream[para.first_input_index]);
+            if (control_code->code == SHAPE_BREAK) {
+                para.first_input_index++;
+                continue;
+            }
+        }
+        _buildPangoItemizationForPara(&para);
+        unsigned para_end_input_index = _buildSpansForPara(&para);
+        para.free();
+        para.first_input_index = para_end_input_index + 1;
+    }
+}
+
+/** The management function to start the whole thing off. */
+bool Layout::Calculator::calculate()
+{
+    if (_flow._input_stream.empty())
+        return false;
+    /**
+    * hm, why do we want assert (crash) the application, now do simply return false
+    * \todo check if this is the correct behaviour
+    * g_assert(_flow._input_stream.front()->Type() == TEXT_SOURCE);
+    */
+    if (_flow._input_stream.front()->Type() != TEXT_SOURCE)
+    {
+        g_warning("flow text is not of type TEXT_SOURCE. Abort.");
+        return false;
+    }
+    TRACE(("begin calculate()\n"));
+
+    _flow._clearOutputObjects();
+
+    _setupPangoContext((font_factory::Default())->fontContext);
 
     // Minimum line box height determined by block container.
     FontMetrics strut_height = _flow.strut;
@@ -1979,17 +2090,28 @@ void Layout::_calculateCursorShapeForEmpty()
 bool Layout::calculateFlow()
 {
     TRACE(("begin calculateFlow()\n"));
+    if (_shaping_cache == NULL)
+        _shaping_cache = new ShapingCache;
     Layout::Calculator calc = Calculator(this);
     bool result = calc.calculate();
     if (textLengthIncrement != 0) {
         TRACE(("Recalculating layout the second time to fit textLength!\n"));
         result = calc.calculate();
     }
+    _shaping_cache->endLayout();
     if (_characters.empty())
         _calculateCursorShapeForEmpty();
     return result;
 }
 
+void Layout::prepareShaping(PangoContext *context)
+{
+    if (_shaping_cache == NULL)
+        _shaping_cache = new ShapingCache;
+    Layout::Calculator calc = Calculator(this);
+    calc.prepareShaping(context);
+}
+
 }//namespace Text
 }//namespace Inkscape
 
@@ -0,0 +1,130 @@
+/*
+ * Inkscape::Text::Layout::ShapingCache - pango results kept between layouts
+ *
+ * Copyright (C) 2018 Authors
+ *
+ * Released under GNU GPL, read the file 'COPYING' for more information
+ */
+#include "Layout-TNG-Shaping-Cache.h"
+#include "font-instance.h"
+
+namespace Inkscape {
+namespace Text {
+
+Layout::ShapingCache::ShapingCache() :
+    _generation(0)
+{
+}
+
+Layout::ShapingCache::~ShapingCache()
+{
+    for (std::unordered_map<std::string, ParagraphEntry>::iterator it = _paragraphs.begin() ; it != _paragraphs.end() ; ++it)
+        _free(it->second);
+    for (std::unordered_map<std::string, GlyphsEntry>::iterator it = _glyphs.begin() ; it != _glyphs.end() ; ++it)
+        _free(it->second);
+}
+
+Layout::ShapingCache::Paragraph const *Layout::ShapingCache::findParagraph(std::string const &key)
+{
+    std::unordered_map<std::string, ParagraphEntry>::iterator found = _paragraphs.find(key);
+    if (found == _paragraphs.end())
+        return NULL;
+    found->second.generation = _generation;
+    return &found->second.paragraph;
+}
+
+void Layout::ShapingCache::addParagraph(std::string const &key, std::vector<PangoItem *> const &items,
+                                        std::vector<font_instance *> const &fonts, std::vector<PangoLogAttr> const &char_attributes)
+{
+    ParagraphEntry entry;
+    entry.generation = _generation;
+    entry.paragraph.items.reserve(items.size());
+    for (std::vector<PangoItem *>::const_iterator it = items.begin() ; it != items.end() ; ++it)
+        entry.paragraph.items.push_back(pango_item_copy(*it));
+    entry.paragraph.fonts = fonts;
+    for (std::vector<font_instance *>::const_iterator it = fonts.begin() ; it != fonts.end() ; ++it)
+        if (*it) (*it)->Ref();
+    entry.paragraph.char_attributes = char_attributes;
+
+    std::pair<std::unordered_map<std::string, ParagraphEntry>::iterator, bool> added = _paragraphs.insert(std::make_pair(key, entry));
+    if (!added.second) {
+        _free(added.first->second);
+        added.first->second = entry;
+    }
+}
+
+PangoGlyphString const *Layout::ShapingCache::findGlyphs(std::string const &key)
+{
+    std::unordered_map<std::string, GlyphsEntry>::iterator found = _glyphs.find(key);
+    if (found == _glyphs.end())
+        return NULL;
+    found->second.generation = _generation;
+    return found->second.glyphs;
+}
+
+void Layout::ShapingCache::addGlyphs(std::string const &key, PangoGlyphString const *glyphs, PangoFont *font)
+{
+    GlyphsEntry entry;
+    entry.glyphs = pango_glyph_string_copy(const_cast<PangoGlyphString *>(glyphs));
+    entry.font = font;
+    if (font) g_object_ref(font);
+    entry.generation = _generation;
+
+    std::pair<std::unordered_map<std::string, GlyphsEntry>::iterator, bool> added = _glyphs.insert(std::make_pair(key, entry));
+    if (!added.second) {
+        _free(added.first->second);
+        added.first->second = entry;
+    }
+}
+
+void Layout::ShapingCache::endLayout()
+{
+    for (std::unordered_map<std::string, ParagraphEntry>::iterator it = _paragraphs.begin() ; it != _paragraphs.end() ; ) {
+        if (it->second.generation != _generation) {
+            _free(it->second);
+            it = _paragraphs.erase(it);
+        } else
+            ++it;
+    }
+    for (std::unordered_map<std::string, GlyphsEntry>::iterator it = _glyphs.begin() ; it != _glyphs.end() ; ) {
+        if (it->second.generation != _generation) {
+            _free(it->second);
+            it = _glyphs.erase(it);
+        } else
+            ++it;
+    }
+    _generation++;
+}
+
+void Layout::ShapingCache::_free(ParagraphEntry &entry)
+{
+    for (std::vector<PangoItem *>::iterator it = entry.paragraph.items.begin() ; it != entry.paragraph.items.end() ; ++it)
+        pango_item_free(*it);
+    for (std::vector<font_instance *>::iterator it = entry.paragraph.fonts.begin() ; it != entry.paragraph.fonts.end() ; ++it)
+        if (*it) (*it)->Unref();
+    entry.paragraph.items.clear();
+    entry.paragraph.fonts.clear();
+}
+
+void Layout::ShapingCache::_free(GlyphsEntry &entry)
+{
+    pango_glyph_string_free(entry.glyphs);
+    entry.glyphs = NULL;
+    if (entry.font) g_object_unref(entry.font);
+    entry.font = NULL;
+}
+
+}//namespace Text
+}//namespace Inkscape
+
+
+/*
+  Local Variables:
+  mode:c++
+  c-file-style:"stroustrup"
+  c-file-offsets:((innamespace . 0)(inline-open . 0)(case-label . +))
+  indent-tabs-mode:nil
+  fill-column:99
+  End:
+*/
+// vim: filetype=cpp:expandtab:shiftwidth=4:tabstop=8:softtabstop=4:fileencoding=utf-8:textwidth=99 :
@@ -0,0 +1,96 @@
+/*
+ * Inkscape::Text::Layout::ShapingCache - pango results kept between layouts
+ *
+ * Copyright (C) 2018 Authors
+ *
+ * Released under GNU GPL, read the file 'COPYING' for more information
+ */
+#ifndef __LAYOUT_TNG_SHAPING_CACHE_H__
+#define __LAYOUT_TNG_SHAPING_CACHE_H__
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <pango/pango.h>
+#include "libnrtype/Layout-TNG.h"
+
+namespace Inkscape {
+namespace Text {
+
+/** \brief private to Layout. Itemized paragraphs and shaped runs of glyphs.
+
+Layout::Calculator calls pango_itemize() on every paragraph and pango_shape() on
+every span each time a text is laid out again, which happens on every edit. This
+cache keeps the results of the previous layout of the same Layout object, so that
+only the paragraphs and runs that changed are itemized and shaped again.
+
+Paragraphs are keyed by their text, the font description and font features of every
+text source and the base direction and gravity; runs by their text, the PangoFont and
+the other fields of the PangoAnalysis pango_shape() uses, and the font features.
+Building the keys is up to the calculator. Entries that were not used during a layout
+are dropped at the end of it, see endLayout().
+*/
+class Layout::ShapingCache
+{
+public:
+    ShapingCache();
+    ~ShapingCache();
+
+    struct Paragraph {
+        std::vector<PangoItem *> items;
+        std::vector<font_instance *> fonts;   ///< one per item
+        std::vector<PangoLogAttr> char_attributes;
+    };
+
+    /** Returns the itemization stored for the key, or NULL. */
+    Paragraph const *findParagraph(std::string const &key);
+
+    /** Stores copies of the items and attributes and references to the fonts. */
+    void addParagraph(std::string const &key, std::vector<PangoItem *> const &items,
+                      std::vector<font_instance *> const &fonts, std::vector<PangoLogAttr> const &char_attributes);
+
+    /** Returns the glyphs stored for the key, or NULL. */
+    PangoGlyphString const *findGlyphs(std::string const &key);
+
+    /** Stores a copy of the glyphs, which were shaped with font. The font is
+    referenced so that its address stays unique while it is part of a key. */
+    void addGlyphs(std::string const &key, PangoGlyphString const *glyphs, PangoFont *font);
+
+    /** Drops the entries that have not been found or added since the previous call. */
+    void endLayout();
+
+private:
+    struct ParagraphEntry {
+        Paragraph paragraph;
+        unsigned generation;
+    };
+    struct GlyphsEntry {
+        PangoGlyphString *glyphs;
+        PangoFont *font;
+        unsigned generation;
+    };
+
+    static void _free(ParagraphEntry &entry);
+    static void _free(GlyphsEntry &entry);
+
+    std::unordered_map<std::string, ParagraphEntry> _paragraphs;
+    std::unordered_map<std::string, GlyphsEntry> _glyphs;
+    unsigned _generation;
+};
+
+}//namespace Text
+}//namespace Inkscape
+
+#endif
+
+
+/*
+  Local Variables:
+  mode:c++
+  c-file-style:"stroustrup"
+  c-file-offsets:((innamespace . 0)(inline-open . 0)(case-label . +))
+  indent-tabs-mode:nil
+  fill-column:99
+  End:
+*/
+// vim: filetype=cpp:expandtab:shiftwidth=4:tabstop=8:softtabstop=4:fileencoding=utf-8:textwidth=99 :
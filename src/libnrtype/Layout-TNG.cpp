@@ -9,6 +9,7 @@
  * Released under GNU GPL, read the file 'COPYING' for more information
  */
 #include "Layout-TNG.h"
+#include "Layout-TNG-Shaping-Cache.h"
 
 namespace Inkscape {
 namespace Text {
@@ -18,7 +19,8 @@ const double Layout::LINE_HEIGHT_NORMAL = 1.25;
 
 Layout::Layout() :
     _input_truncated(0),
-    _path_fitted(NULL)
+    _path_fitted(NULL),
+    _shaping_cache(NULL)
 {
       textLength._set = false;
       textLengthMultiplier = 1;
@@ -29,6 +31,7 @@ Layout::Layout() :
 Layout::~Layout()
 {
     clear();
+    delete _shaping_cache;
 }
 
 void Layout::clear()
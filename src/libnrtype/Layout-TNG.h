@@ -152,6 +152,7 @@ public:
     class ScanlineMaker;
     class InfiniteScanlineMaker;
     class ShapeScanlineMaker;
+    class ShapingCache;
 
     Layout();
     virtual ~Layout();
@@ -355,6 +356,14 @@ public:
     */
     bool calculateFlow();
 
+    /** Does the pango_itemize() and pango_shape() part of calculateFlow() ahead of
+    time, with the given context, and keeps the results for the next calculateFlow().
+    Unlike calculateFlow(), this can run in a worker thread while other threads
+    prepare other layouts, provided every thread has a context of its own from
+    font_factory::AcquireWorkerContext().
+    */
+    void prepareShaping(PangoContext *context);
+
     //@}
 
     // ************************** operating on the output glyphs *************************
@@ -882,6 +891,9 @@ private:
     std::vector<Character> _characters;
     std::vector<Glyph> _glyphs;
 
+    /** pango results of the previous calculateFlow(), created on first use. */
+    ShapingCache *_shaping_cache;
+
     /** gets the overall matrix that transforms the given glyph from local
     space to world space. */
     void _getGlyphTransformMatrix(int glyph_index, Geom::Affine *matrix) const;
@@ -10,7 +10,9 @@
 #include <cstdlib>
 #include <glib.h>
 #include "Shape.h"
+#include "livarot/sweep-event.h"
 #include "livarot/sweep-event-queue.h"
+#include "livarot/sweep-tree.h"
 #include "livarot/sweep-tree-list.h"
 
 /*
@@ -48,13 +50,189 @@ Shape::Shape()
 
   type = shape_polygon;
 }
+
+/*
+ * The arena
+ */
+
+/// Largest array or sweep structure the arena keeps, in bytes
+static size_t const ARENA_MAX_BYTES = 256 * 1024;
+/// Number of arrays of each kind the arena keeps: a boolean operation uses up to four shapes
+static size_t const ARENA_SPARES = 4;
+
+// Keeps the storage of v as a spare array, unless there are enough larger ones; v is left
+// without storage
+template <typename T>
+static void
+arena_keep(std::vector<T> &v, std::vector<std::vector<T> > &spares)
+{
+  if (v.capacity() > 0 && v.capacity() * sizeof(T) <= ARENA_MAX_BYTES) {
+    v.clear();
+    if (spares.size() < ARENA_SPARES) {
+      spares.push_back(std::vector<T>());
+      spares.back().swap(v);
+    } else {
+      typename std::vector<std::vector<T> >::iterator smallest = spares.begin();
+      for (typename std::vector<std::vector<T> >::iterator i = spares.begin(); i != spares.end(); ++i) {
+        if (i->capacity() < smallest->capacity()) {
+          smallest = i;
+        }
+      }
+      if (v.capacity() > smallest->capacity()) {
+        smallest->swap(v);
+      }
+    }
+  }
+  std::vector<T>().swap(v);
+}
+
+// Hands a spare array over to v if v has no storage
+template <typename T>
+static void
+arena_take(std::vector<T> &v, std::vector<std::vector<T> > &spares)
+{
+  if (v.capacity() == 0 && !spares.empty()) {
+    v.swap(spares.back());
+    spares.pop_back();
+  }
+}
+
+struct Shape::Arena
+{
+  SweepTreeList *tree;
+  SweepEventQueue *events;
+  std::vector<std::vector<dg_point> > _pts;
+  std::vector<std::vector<dg_arete> > _aretes;
+  std::vector<std::vector<point_data> > pData;
+  std::vector<std::vector<edge_data> > eData;
+  std::vector<std::vector<sweep_src_data> > swsData;
+  std::vector<std::vector<sweep_dest_data> > swdData;
+  std::vector<std::vector<raster_data> > swrData;
+  std::vector<std::vector<back_data> > ebData;
+  std::vector<std::vector<sTreeChange> > chgts;
+
+  Arena() : tree(NULL), events(NULL) {}
+  ~Arena() { clear(); }
+
+  void clear()
+  {
+    delete tree;
+    tree = NULL;
+    delete events;
+    events = NULL;
+    _pts.clear();
+    _aretes.clear();
+    pData.clear();
+    eData.clear();
+    swsData.clear();
+    swdData.clear();
+    swrData.clear();
+    ebData.clear();
+    chgts.clear();
+  }
+};
+
+Shape::Arena *
+Shape::_arena()
+{
+  static thread_local Arena arena;
+  return &arena;
+}
+
 Shape::~Shape (void)
 {
+  ResetTemporaryData();
+  Arena *arena = _arena();
+  arena_keep(_pts, arena->_pts);
+  arena_keep(_aretes, arena->_aretes);
+  arena_keep(ebData, arena->ebData);
   maxPt = 0;
   maxAr = 0;
   free(qrsData);
 }
 
+/**
+ * Frees the sweep structures and arrays that the operations of the calling thread handed over
+ * to the arena. Call it after a burst of operations on large shapes.
+ */
+void
+Shape::FreeArena()
+{
+  _arena()->clear();
+}
+
+/**
+ * Drops the temporary data of the last operation, except the back data, and hands the arrays
+ * over to the arena. Shapes that are kept around after an operation should call this, so that
+ * the next operation can reuse the arrays.
+ */
+void
+Shape::ResetTemporaryData()
+{
+  EndSweep();
+  Arena *arena = _arena();
+  _has_points_data = false;
+  _point_data_initialised = false;
+  _has_edges_data = false;
+  _has_sweep_src_data = false;
+  _has_sweep_dest_data = false;
+  _has_raster_data = false;
+  arena_keep(pData, arena->pData);
+  arena_keep(eData, arena->eData);
+  arena_keep(swsData, arena->swsData);
+  arena_keep(swdData, arena->swdData);
+  arena_keep(swrData, arena->swrData);
+  arena_keep(chgts, arena->chgts);
+}
+
+/**
+ * Prepares the sweepline and the event queue for a sweep over at most nbEdges edges, reusing
+ * the ones of the arena.
+ */
+void
+Shape::BeginSweep(int nbEdges)
+{
+  Arena *arena = _arena();
+  arena_take(chgts, arena->chgts);
+  if (sTree == NULL) {
+    std::swap(sTree, arena->tree);
+  }
+  if (sTree) {
+    sTree->reset(nbEdges);
+  } else {
+    sTree = new SweepTreeList(nbEdges);
+  }
+  if (sEvts == NULL) {
+    std::swap(sEvts, arena->events);
+  }
+  if (sEvts) {
+    sEvts->reset(nbEdges);
+  } else {
+    sEvts = new SweepEventQueue(nbEdges);
+  }
+}
+
+/**
+ * Hands the sweepline and event queue back to the arena.
+ */
+void
+Shape::EndSweep()
+{
+  Arena *arena = _arena();
+  if (sTree && sTree->maxTree * sizeof(SweepTree) <= ARENA_MAX_BYTES
+      && (arena->tree == NULL || sTree->maxTree > arena->tree->maxTree)) {
+    std::swap(sTree, arena->tree);
+  }
+  delete sTree;
+  sTree = NULL;
+  if (sEvts && sEvts->capacity() * sizeof(SweepEvent) <= ARENA_MAX_BYTES
+      && (arena->events == NULL || sEvts->capacity() > arena->events->capacity())) {
+    std::swap(sEvts, arena->events);
+  }
+  delete sEvts;
+  sEvts = NULL;
+}
+
 void Shape::Affiche(void)
 {
   printf("sh=%p nbPt=%i nbAr=%i\n", this, static_cast<int>(_pts.size()), static_cast<int>(_aretes.size())); // localizing ok
@@ -80,6 +258,7 @@ Shape::MakePointData (bool nVal)
           _has_points_data = true;
           _point_data_initialised = false;
           _bbox_up_to_date = false;
+          arena_take(pData, _arena()->pData);
           pData.resize(maxPt);
         }
     }
@@ -94,6 +273,7 @@ Shape::MakeEdgeData (bool nVal)
       if (_has_edges_data == false)
         {
           _has_edges_data = true;
+          arena_take(eData, _arena()->eData);
           eData.resize(maxAr);
         }
     }
@@ -115,6 +295,7 @@ Shape::MakeRasterData (bool nVal)
       if (_has_raster_data == false)
         {
           _has_raster_data = true;
+          arena_take(swrData, _arena()->swrData);
           swrData.resize(maxAr);
         }
     }
@@ -159,6 +340,7 @@ Shape::MakeSweepSrcData (bool nVal)
       if (_has_sweep_src_data == false)
         {
           _has_sweep_src_data = true;
+          arena_take(swsData, _arena()->swsData);
           swsData.resize(maxAr);
         }
     }
@@ -179,6 +361,7 @@ Shape::MakeSweepDestData (bool nVal)
       if (_has_sweep_dest_data == false)
         {
           _has_sweep_dest_data = true;
+          arena_take(swdData, _arena()->swdData);
           swdData.resize(maxAr);
         }
     }
@@ -199,6 +382,7 @@ Shape::MakeBackData (bool nVal)
       if (_has_back_data == false)
         {
           _has_back_data = true;
+          arena_take(ebData, _arena()->ebData);
           ebData.resize(maxAr);
         }
     }
@@ -255,10 +439,7 @@ Shape::Copy (Shape * who)
   MakeQuickRasterData (false);
   MakeBackData (false);
 
-  delete sTree;
-  sTree = NULL;
-  delete sEvts;
-  sEvts = NULL;
+  EndSweep();
 
   Reset (who->numberOfPoints(), who->numberOfEdges());
   type = who->type;
@@ -287,6 +468,11 @@ Shape::Reset (int pointCount, int edgeCount)
 {
   _pts.clear();
   _aretes.clear();
+  if (_pts.capacity() == 0 || _aretes.capacity() == 0) {
+    Arena *arena = _arena();
+    arena_take(_pts, arena->_pts);
+    arena_take(_aretes, arena->_aretes);
+  }
   
   type = shape_polygon;
   if (pointCount > maxPt)
@@ -126,6 +126,11 @@ public:
     void Copy(Shape *a);
     // -reset the graph, and ensure there's room for n points and m edges
     void Reset(int n = 0, int m = 0);
+    // -drop the temporary data of the last operation (but not the back data), handing the arrays
+    // over to the next operation of this thread; use it on shapes that are kept around
+    void ResetTemporaryData();
+    // -free the arrays the operations of the calling thread have handed over
+    static void FreeArena();
     //  -points:
     int AddPoint(const Geom::Point x);        // as the function name says
     // returns the index at which the point has been added in the array
@@ -334,7 +339,7 @@ public:
     int maxInc;
 
     incidenceData *iData;
-    // these ones are allocated at the beginning of each sweep and freed at the end of the sweep
+    // these ones are taken from the arena at the beginning of each sweep and handed back at the end
     SweepTreeList *sTree;
     SweepEventQueue *sEvts;
     
@@ -461,6 +466,10 @@ private:
     void _countUpDownTotalDegree2(int P, int *numberUp, int *numberDown, int *upEdge, int *downEdge) const;
     void _updateIntersection(int e, int p);
   
+    // sweepline and event queue for a sweep over at most nbEdges edges
+    void BeginSweep(int nbEdges);
+    void EndSweep();
+
     // activation/deactivation of the temporary data arrays
     void MakePointData(bool nVal);
     void MakeEdgeData(bool nVal);
@@ -555,6 +564,14 @@ private:
     std::vector<sweep_dest_data> swdData;
     std::vector<raster_data> swrData;
     std::vector<point_data> pData;
+
+    /*
+     * Per-thread store of the sweep structures and temporary arrays that operations no longer
+     * need, so that the next operation reuses them instead of allocating new ones. A few arrays
+     * of each kind are kept, of at most ARENA_MAX_BYTES each.
+     */
+    struct Arena;
+    static Arena *_arena();
     
     static int CmpQRs(const quick_raster_data &p1, const quick_raster_data &p2) {
         if ( fabs(p1.x - p2.x) < 0.00001 ) {
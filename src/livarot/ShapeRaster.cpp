@@ -34,12 +34,7 @@ void Shape::BeginRaster(float &pos, int &curPt)
     MakePointData(true);
     MakeEdgeData(true);
 
-    if (sTree == NULL) {
-        sTree = new SweepTreeList(numberOfEdges());
-    }
-    if (sEvts == NULL) {
-        sEvts = new SweepEventQueue(numberOfEdges());
-    }
+    BeginSweep(numberOfEdges());
 
     SortPoints();
 
@@ -63,10 +58,7 @@ void Shape::BeginRaster(float &pos, int &curPt)
 
 void Shape::EndRaster()
 {
-    delete sTree;
-    sTree = NULL;
-    delete sEvts;
-    sEvts = NULL;
+    EndSweep();
     
     MakePointData(false);
     MakeEdgeData(false);
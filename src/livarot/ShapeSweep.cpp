@@ -179,12 +179,7 @@ Shape::ConvertToShape (Shape * a, FillRule directed, bool invert)
   
     a->ResetSweep();
 
-    if (sTree == NULL) {
-	sTree = new SweepTreeList(a->numberOfEdges());
-    }
-    if (sEvts == NULL) {
-	sEvts = new SweepEventQueue(a->numberOfEdges());
-    }
+    BeginSweep(a->numberOfEdges());
   
     MakePointData(true);
     MakeEdgeData(true);
@@ -817,10 +812,7 @@ Shape::ConvertToShape (Shape * a, FillRule directed, bool invert)
   
 //      Plot(200.0,200.0,2.0,400.0,400.0,true,true,true,true);
 
-  delete sTree;
-  sTree = NULL;
-  delete sEvts;
-  sEvts = NULL;
+  EndSweep();
 
   MakePointData (false);
   MakeEdgeData (false);
@@ -856,12 +848,7 @@ Shape::Booleen (Shape * a, Shape * b, BooleanOp mod,int cutPathID)
   a->ResetSweep ();
   b->ResetSweep ();
 
-  if (sTree == NULL) {
-      sTree = new SweepTreeList(a->numberOfEdges() + b->numberOfEdges());
-  }
-  if (sEvts == NULL) {
-      sEvts = new SweepEventQueue(a->numberOfEdges() + b->numberOfEdges());
-  }
+  BeginSweep(a->numberOfEdges() + b->numberOfEdges());
   
   MakePointData (true);
   MakeEdgeData (true);
@@ -1625,10 +1612,7 @@ Shape::Booleen (Shape * a, Shape * b, BooleanOp mod,int cutPathID)
     }
   }
   
-  delete sTree;
-  sTree = NULL;
-  delete sEvts;
-  sEvts = NULL;
+  EndSweep();
   
   if ( mod == bool_op_cut ) {
     // on garde le askForWinding
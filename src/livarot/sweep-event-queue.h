@@ -22,6 +22,9 @@ public:
     virtual ~SweepEventQueue();
 
     int size() const { return nbEvt; }
+    int capacity() const { return maxEvt; }
+    /// Empties the queue for a new sweep over s edges, keeping the arrays if they are large enough.
+    void reset(int s);
 
     /// Look for the topmost intersection in the heap
     bool peek(SweepTree * &iLeft, SweepTree * &iRight, Geom::Point &oPt, double &itl, double &itr);
@@ -22,6 +22,18 @@ SweepTreeList::~SweepTreeList()
 }
 
 
+void SweepTreeList::reset(int s)
+{
+    if (s > maxTree) {
+        g_free(trees);
+        trees = (SweepTree *) g_malloc(s * sizeof(SweepTree));
+        maxTree = s;
+    }
+    nbTree = 0;
+    racine = NULL;
+}
+
+
 SweepTree *SweepTreeList::add(Shape *iSrc, int iBord, int iWeight, int iStartPoint, Shape */*iDst*/)
 {
     if (nbTree >= maxTree) {
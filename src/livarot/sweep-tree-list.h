@@ -15,7 +15,7 @@ class SweepTree;
 class SweepTreeList {
 public:
     int nbTree;   ///< Number of nodes in the tree.
-    int const maxTree;   ///< Max number of nodes in the tree.
+    int maxTree;         ///< Max number of nodes in the tree.
     SweepTree *trees;    ///< The array of nodes.
     SweepTree *racine;   ///< Root of the tree.
 
@@ -23,6 +23,8 @@ public:
     virtual ~SweepTreeList();
 
     SweepTree *add(Shape *iSrc, int iBord, int iWeight, int iStartPoint, Shape *iDst);
+    /// Empties the tree for a new sweep over at most s edges, keeping the node array if it is large enough.
+    void reset(int s);
 };
 
 
@@ -83,6 +83,7 @@
 
 #include "helper/action-context.h"
 #include "helper/png-write.h"
+#include "display/drawing-statistics.h"
 #ifdef ENABLE_NLS
 #include "helper/gettext.h"
 #endif
@@ -119,6 +120,7 @@
 #include "verbs.h"
 
 #include "path-chemistry.h"
+#include "splivarot.h"
 #include "object-set.h"
 #include "sp-text.h"
 #include "sp-flowtext.h"
@@ -145,6 +147,11 @@ enum {
     SP_ARG_EXPORT_USE_HINTS,
     SP_ARG_EXPORT_BACKGROUND,
     SP_ARG_EXPORT_BACKGROUND_OPACITY,
+    SP_ARG_EXPORT_THREADS,
+    SP_ARG_EXPORT_RENDER_STATS,
+    SP_ARG_EXPORT_MEMORY_LIMIT,
+    SP_ARG_EXPORT_TILES,
+    SP_ARG_EXPORT_PROGRESS,
     SP_ARG_EXPORT_SVG,
     SP_ARG_EXPORT_INKSCAPE_SVG,
     SP_ARG_EXPORT_PS,
@@ -169,6 +176,7 @@ enum {
     SP_ARG_VACUUM_DEFS,
     SP_ARG_NO_CONVERT_TEXT_BASELINE_SPACING,
     SP_ARG_CONVERT_DPI_METHOD,
+    SP_ARG_BOOLOPS_ENGINE,
 #ifdef WITH_DBUS
     SP_ARG_DBUS_LISTEN,
     SP_ARG_DBUS_NAME,
@@ -207,6 +215,11 @@ static gchar *sp_export_background_opacity = NULL;
 static gboolean sp_export_area_snap = FALSE;
 static gboolean sp_export_use_hints = FALSE;
 static gboolean sp_export_id_only = FALSE;
+static gint sp_export_threads = 1;
+static gchar *sp_export_render_stats = NULL;
+static gint sp_export_memory_limit = 0;
+static gchar *sp_export_tiles = NULL;
+static gboolean sp_export_progress = FALSE;
 static gchar *sp_export_svg = NULL;
 static gchar *sp_export_inkscape_svg = NULL;
 static gchar *sp_export_ps = NULL;
@@ -261,6 +274,11 @@ static void resetCommandlineGlobals() {
         sp_export_area_snap = FALSE;
         sp_export_use_hints = FALSE;
         sp_export_id_only = FALSE;
+        sp_export_threads = 1;
+        sp_export_render_stats = NULL;
+        sp_export_memory_limit = 0;
+        sp_export_tiles = NULL;
+        sp_export_progress = FALSE;
         sp_export_svg = NULL;
         sp_export_inkscape_svg = NULL;
         sp_export_ps = NULL;
@@ -282,6 +300,7 @@ static void resetCommandlineGlobals() {
         sp_vacuum_defs = FALSE;
         sp_no_convert_text_baseline_spacing = FALSE;
         sp_file_convert_dpi_method_commandline = -1;
+        sp_boolop_engine_commandline = -1;
 #ifdef WITH_DBUS
         sp_dbus_listen = FALSE;
         sp_dbus_name = NULL;
@@ -400,6 +419,31 @@ struct poptOption options[] = {
      N_("Background opacity of exported bitmap (either 0.0 to 1.0, or 1 to 255)"),
      N_("VALUE")},
 
+    {"export-threads", 0,
+     POPT_ARG_INT, &sp_export_threads, SP_ARG_EXPORT_THREADS,
+     N_("Number of threads used to render the exported bitmap (default 1)"),
+     N_("N")},
+
+    {"export-render-stats", 0,
+     POPT_ARG_STRING, &sp_export_render_stats, SP_ARG_EXPORT_RENDER_STATS,
+     N_("Write render performance statistics of the exported bitmap to a JSON file"),
+     N_("FILENAME")},
+
+    {"export-memory-limit", 0,
+     POPT_ARG_INT, &sp_export_memory_limit, SP_ARG_EXPORT_MEMORY_LIMIT,
+     N_("Limit the memory used for pixels of the exported bitmap, regardless of its size (in MiB)"),
+     N_("MIB")},
+
+    {"export-tiles", 0,
+     POPT_ARG_STRING, &sp_export_tiles, SP_ARG_EXPORT_TILES,
+     N_("Split the exported bitmap into files of at most WIDTHxHEIGHT pixels; a size of 0 spans the whole bitmap"),
+     N_("WIDTHxHEIGHT")},
+
+    {"export-progress", 0,
+     POPT_ARG_NONE, &sp_export_progress, SP_ARG_EXPORT_PROGRESS,
+     N_("Print the progress of the bitmap export"),
+     NULL},
+
     {"export-inkscape-svg", 0,
      POPT_ARG_STRING, &sp_export_inkscape_svg, SP_ARG_EXPORT_INKSCAPE_SVG,
      N_("Export document to an inkscape SVG file (similar to save as.)"),
@@ -548,6 +592,11 @@ struct poptOption options[] = {
     N_("Method used to convert pre-.92 document dpi, if needed. ([none|scale-viewbox|scale-document])"),
     "[...]"},
 
+    {"boolops-engine", 0,
+    POPT_ARG_STRING, NULL, SP_ARG_BOOLOPS_ENGINE,
+    N_("Engine for union, intersection, difference and exclusion, overriding the preference. ([livarot|2geom])"),
+    "[...]"},
+
     POPT_AUTOHELP POPT_TABLEEND
 };
 
@@ -1323,6 +1372,22 @@ do_query_all_recurse (SPObject *o)
     }
 }
 
+/**
+ *  Print the progress of a PNG export whenever it changes by a percent
+ *
+ *  \param data Pointer to the last printed percentage.
+ */
+static unsigned int sp_export_png_progress(float value, void *data)
+{
+    int *last_percent = static_cast<int *>(data);
+    int percent = static_cast<int>(value * 100);
+    if (percent != *last_percent) {
+        *last_percent = percent;
+        g_print("\rExporting: %d%%", percent);
+    }
+    return TRUE;
+}
+
 /**
  *  Perform a PNG export
  *
@@ -1522,6 +1587,38 @@ static int do_export_png(SPDocument *doc)
         }
     }
 
+    if (sp_export_threads < 1 || sp_export_threads > 256) {
+        g_warning("Number of export threads %d out of range (1 - 256). Nothing exported.", sp_export_threads);
+        return 1;
+    }
+
+    if (sp_export_memory_limit < 0) {
+        g_warning("Export memory limit %d is negative. Nothing exported.", sp_export_memory_limit);
+        return 1;
+    }
+
+    unsigned long tile_width = 0;
+    unsigned long tile_height = 0;
+    if (sp_export_tiles) {
+        // WIDTHxHEIGHT, or a single size for square tiles; 0 spans the whole bitmap
+        char *end = sp_export_tiles;
+        bool valid = g_ascii_isdigit(*end);
+        if (valid) {
+            tile_width = strtoul(end, &end, 10);
+            tile_height = tile_width;
+            if (*end == 'x') {
+                valid = g_ascii_isdigit(end[1]);
+                if (valid) {
+                    tile_height = strtoul(end + 1, &end, 10);
+                }
+            }
+        }
+        if (!valid || *end) {
+            g_warning("Invalid tile size '%s', expected WIDTHxHEIGHT. Nothing exported.", sp_export_tiles);
+            return 1;
+        }
+    }
+
     Glib::ustring path;
     if (filename_from_hint) {
         //Make relative paths go from the document location, if possible:
@@ -1550,9 +1647,21 @@ static int do_export_png(SPDocument *doc)
         reverse(items.begin(),items.end());
 
         if ((width >= 1) && (height >= 1) && (width <= PNG_UINT_31_MAX) && (height <= PNG_UINT_31_MAX)) {
-            if( sp_export_png_file(doc, path.c_str(), area, width, height, dpi,
-              dpi, bgcolor, NULL, NULL, true, sp_export_id_only ? items : std::vector<SPItem*>()) == 1 ) {
+            Inkscape::DrawingStatistics stats;
+            int last_percent = -1;
+            ExportResult result = sp_export_png_file(doc, path.c_str(), area, width, height, dpi,
+              dpi, bgcolor, sp_export_progress ? sp_export_png_progress : NULL, &last_percent, true,
+              sp_export_id_only ? items : std::vector<SPItem*>(),
+              false, 6, 8, 6, 2, sp_export_threads, sp_export_render_stats ? &stats : NULL,
+              (size_t) sp_export_memory_limit << 20, tile_width, tile_height);
+            if (sp_export_progress) {
+                g_print("\n");
+            }
+            if( result == 1 ) {
                 g_print("Bitmap saved as: %s\n", filename.c_str());
+                if (sp_export_render_stats && stats.writeJSON(sp_export_render_stats)) {
+                    g_print("Render statistics saved as: %s\n", sp_export_render_stats);
+                }
             } else {
                 g_warning("Bitmap failed to save to: %s", filename.c_str());
                 return 1;
@@ -2213,6 +2322,19 @@ sp_process_args(poptContext ctx)
                 }
                 break;
             }
+            case SP_ARG_BOOLOPS_ENGINE: {
+                gchar const *arg = poptGetOptArg(ctx);
+                if (arg != NULL) {
+                    if (!strcmp(arg,"livarot")) {
+                        sp_boolop_engine_commandline = BOOLOP_ENGINE_LIVAROT;
+                    } else if (!strcmp(arg,"2geom")) {
+                        sp_boolop_engine_commandline = BOOLOP_ENGINE_2GEOM;
+                    } else {
+                        g_warning("Invalid boolean operation engine %s", arg);
+                    }
+                }
+                break;
+            }
             case POPT_ERROR_BADOPT: {
                 g_warning ("Invalid option %s", poptBadOption(ctx, 0));
                 exit(1);
@@ -12,6 +12,8 @@
  * Released under GNU GPL, read the file 'COPYING' for more information
  */
 
+#include <algorithm>
+#include <set>
 #include "svg/svg.h"
 #include <2geom/path-intersection.h>
 #include <2geom/line.h>
@@ -30,14 +32,21 @@
 #include "sp-clippath.h"
 #include "sp-mask.h"
 #include "desktop.h"
+#include "item-index.h"
 #include "sp-root.h"
 
+static bool bbox_intersects(Geom::Rect const &area, Geom::Rect const &box)
+{
+    return area.intersects(box);
+}
+
 Inkscape::ObjectSnapper::ObjectSnapper(SnapManager *sm, Geom::Coord const d)
     : Snapper(sm, d)
 {
     _candidates = new std::vector<SnapCandidateItem>;
     _points_to_snap_to = new std::vector<SnapCandidatePoint>;
     _paths_to_snap_to = new std::vector<SnapCandidatePath >;
+    _item_targets = new std::map<SPItem const *, ItemTargets>;
 }
 
 Inkscape::ObjectSnapper::~ObjectSnapper()
@@ -50,6 +59,12 @@ Inkscape::ObjectSnapper::~ObjectSnapper()
 
     _clear_paths();
     delete _paths_to_snap_to;
+
+    for (std::map<SPItem const *, ItemTargets>::iterator i = _item_targets->begin(); i != _item_targets->end(); ++i) {
+        i->second.modified_connection.disconnect();
+        i->second.release_connection.disconnect();
+    }
+    delete _item_targets;
 }
 
 Geom::Coord Inkscape::ObjectSnapper::getSnapperTolerance() const
@@ -81,6 +96,13 @@ void Inkscape::ObjectSnapper::_findCandidates(SPObject* parent,
         _candidates->clear();
     }
 
+    if (!clip_or_mask && dt && parent == parent->document->getRoot()) {
+        // Only the candidates found for the first point are used, see _collectNodes() and _collectPaths()
+        if (!first_point || _findCandidatesIndexed(parent, it, bbox_to_snap)) {
+            return;
+        }
+    }
+
     Geom::Rect bbox_to_snap_incl = bbox_to_snap; // _incl means: will include the snapper tolerance
     bbox_to_snap_incl.expandBy(getSnapperTolerance()); // see?
 
@@ -156,6 +178,148 @@ void Inkscape::ObjectSnapper::_findCandidates(SPObject* parent,
 }
 
 
+bool Inkscape::ObjectSnapper::_findCandidatesIndexed(SPObject *root,
+                                                     std::vector<SPItem const *> const *it,
+                                                     Geom::Rect const &bbox_to_snap) const
+{
+    // Clipping paths and masks are not in the index, and a rotation center might lie outside
+    // the bounding box of its item
+    if (_snapmanager->snapprefs.isTargetSnappable(SNAPTARGET_PATH_CLIP, SNAPTARGET_PATH_MASK, SNAPTARGET_ROTATION_CENTER)) {
+        return false;
+    }
+
+    SPDesktop const *dt = _snapmanager->getDesktop();
+    Geom::Rect bbox_to_snap_incl = bbox_to_snap;
+    bbox_to_snap_incl.expandBy(getSnapperTolerance());
+
+    std::set<SPItem const *> ignored;
+    if (it != NULL) {
+        ignored.insert(it->begin(), it->end());
+    }
+
+    Preferences *prefs = Preferences::get();
+    int prefs_bbox = prefs->getBool("/tools/bounding_box", 0);
+    SPItem::BBoxType bbox_type = (!prefs_bbox && _snapmanager->snapprefs.isTargetSnappable(SNAPTARGET_BBOX_CATEGORY)) ?
+        SPItem::VISUAL_BBOX : SPItem::GEOMETRIC_BBOX;
+
+    // The index holds the visual bounding boxes, which contain the geometric ones
+    std::vector<SPItem *> found;
+    root->document->getItemIndex().find(bbox_to_snap_incl, bbox_intersects, found);
+    std::sort(found.begin(), found.end(), sp_object_compare_position_bool);
+
+    for (std::vector<SPItem *>::const_iterator i = found.begin(); i != found.end(); ++i) {
+        SPItem *item = *i;
+        if (dynamic_cast<SPGroup *>(item)) {
+            continue;
+        }
+        // Like _findCandidates(), skip hidden or ignored items, and all items in hidden or ignored groups
+        bool skip = false;
+        for (SPObject *o = item; o != root; o = o->parent) {
+            SPItem *ancestor = dynamic_cast<SPItem *>(o);
+            if (!ancestor || dt->itemIsHidden(ancestor) || ignored.count(ancestor)) {
+                skip = true;
+                break;
+            }
+        }
+        if (skip) {
+            continue;
+        }
+
+        Geom::OptRect bbox_of_item = _getItemBounds(_getItemTargets(item), item, bbox_type);
+        if (bbox_of_item && bbox_to_snap_incl.intersects(*bbox_of_item)) {
+            _candidates->push_back(SnapCandidateItem(item, false, Geom::identity()));
+            if (_candidates->size() > 200) { // This makes Inkscape crawl already
+                std::cout << "Warning: limit of 200 snap target paths reached, some will be ignored" << std::endl;
+                break;
+            }
+        }
+    }
+    return true;
+}
+
+/**
+ * Returns the cached snap targets of a candidate item, or NULL if they cannot be cached.
+ */
+Inkscape::ObjectSnapper::ItemTargets *Inkscape::ObjectSnapper::_getItemTargets(SPItem *item) const
+{
+    SPItem *root_item = item;
+    SPUse *use = dynamic_cast<SPUse *>(item);
+    if (use) {
+        root_item = use->root();
+    }
+
+    // Items with a pending update may have changed without being modified yet. Clipping paths
+    // and masks contribute to the targets of an item, but do not notify it of their changes.
+    if (!root_item || item->uflags || item->mflags || root_item->uflags || root_item->mflags
+            || item->clip_ref->getObject() || item->mask_ref->getObject()
+            || root_item->clip_ref->getObject() || root_item->mask_ref->getObject()) {
+        _onItemRelease(item);
+        return NULL;
+    }
+
+    std::map<SPItem const *, ItemTargets>::iterator found = _item_targets->find(item);
+    if (found != _item_targets->end()) {
+        return &found->second;
+    }
+    ItemTargets &targets = (*_item_targets)[item];
+    targets.modified_connection = item->connectModified(sigc::mem_fun(*this, &ObjectSnapper::_onItemModified));
+    targets.release_connection = item->connectRelease(sigc::mem_fun(*this, &ObjectSnapper::_onItemRelease));
+    return &targets;
+}
+
+/**
+ * Returns the desktop bounding box of item, from targets if not NULL.
+ */
+Geom::OptRect Inkscape::ObjectSnapper::_getItemBounds(ItemTargets *targets, SPItem *item, SPItem::BBoxType bbox_type) const
+{
+    if (!targets) {
+        return item->desktopBounds(bbox_type);
+    }
+    std::map<int, Geom::OptRect>::iterator found = targets->bounds.find(bbox_type);
+    if (found == targets->bounds.end()) {
+        found = targets->bounds.insert(std::make_pair(int(bbox_type), item->desktopBounds(bbox_type))).first;
+    }
+    return found->second;
+}
+
+/**
+ * Returns a bit mask of the snap targets that SPItem::getSnappoints() looks at, apart from
+ * the rotation center.
+ */
+int Inkscape::ObjectSnapper::_getNodesSignature() const
+{
+    static SnapTargetType const targets[] = {
+        SNAPTARGET_NODE_CUSP, SNAPTARGET_NODE_SMOOTH, SNAPTARGET_LINE_MIDPOINT, SNAPTARGET_PATH_INTERSECTION,
+        SNAPTARGET_OBJECT_MIDPOINT, SNAPTARGET_ELLIPSE_QUADRANT_POINT, SNAPTARGET_RECT_CORNER,
+        SNAPTARGET_IMG_CORNER, SNAPTARGET_TEXT_BASELINE };
+
+    int signature = 0;
+    for (unsigned k = 0; k < G_N_ELEMENTS(targets); ++k) {
+        if (_snapmanager->snapprefs.isTargetSnappable(targets[k])) {
+            signature |= 1 << k;
+        }
+    }
+    if (_snapmanager->snapprefs.isSourceSnappable(SNAPSOURCE_PATH_INTERSECTION)) {
+        signature |= 1 << G_N_ELEMENTS(targets);
+    }
+    return signature;
+}
+
+void Inkscape::ObjectSnapper::_onItemModified(SPObject *object, unsigned /*flags*/) const
+{
+    _onItemRelease(object);
+}
+
+void Inkscape::ObjectSnapper::_onItemRelease(SPObject *object) const
+{
+    std::map<SPItem const *, ItemTargets>::iterator found = _item_targets->find(static_cast<SPItem *>(object));
+    if (found != _item_targets->end()) {
+        found->second.modified_connection.disconnect();
+        found->second.release_connection.disconnect();
+        _item_targets->erase(found);
+    }
+}
+
 void Inkscape::ObjectSnapper::_collectNodes(SnapSourceType const &t,
                                             bool const &first_point) const
 {
@@ -198,6 +362,7 @@ void Inkscape::ObjectSnapper::_collectNodes(SnapSourceType const &t,
                 root_item = use->root();
             }
             g_return_if_fail(root_item);
+            ItemTargets *targets = (*i).clip_or_mask ? NULL : _getItemTargets((*i).item);
 
             //Collect all nodes so we can snap to them
             if (p_is_a_node || p_is_other || (p_is_a_bbox && !_snapmanager->snapprefs.getStrictSnapping())) {
@@ -231,18 +396,36 @@ void Inkscape::ObjectSnapper::_collectNodes(SnapSourceType const &t,
                 // We should not snap a transformation center to any of the centers of the items in the
                 // current selection (see the comment in SelTrans::centerRequest())
                 bool old_pref2 = _snapmanager->snapprefs.isTargetSnappable(SNAPTARGET_ROTATION_CENTER);
+                bool snap_to_center = old_pref2;
                 if (old_pref2) {
                 	std::vector<SPItem*> rotationSource=_snapmanager->getRotationCenterSource();
                     for ( std::vector<SPItem*>::const_iterator itemlist = rotationSource.begin(); itemlist != rotationSource.end(); ++itemlist) {
                         if ((*i).item == *itemlist) {
                             // don't snap to this item's rotation center
                             _snapmanager->snapprefs.setTargetSnappable(SNAPTARGET_ROTATION_CENTER, false);
+                            snap_to_center = false;
                             break;
                         }
                     }
                 }
 
-                root_item->getSnappoints(*_points_to_snap_to, &_snapmanager->snapprefs);
+                if (targets) {
+                    // The rotation center is not cached, because SPItem::setCenter() moves it
+                    // without modifying the item
+                    _snapmanager->snapprefs.setTargetSnappable(SNAPTARGET_ROTATION_CENTER, false);
+                    int signature = _getNodesSignature();
+                    if (targets->nodes_signature != signature) {
+                        targets->nodes.clear();
+                        root_item->getSnappoints(targets->nodes, &_snapmanager->snapprefs);
+                        targets->nodes_signature = signature;
+                    }
+                    _points_to_snap_to->insert(_points_to_snap_to->end(), targets->nodes.begin(), targets->nodes.end());
+                    if (snap_to_center) {
+                        _points_to_snap_to->push_back(SnapCandidatePoint(root_item->getCenter(), SNAPSOURCE_ROTATION_CENTER, SNAPTARGET_ROTATION_CENTER));
+                    }
+                } else {
+                    root_item->getSnappoints(*_points_to_snap_to, &_snapmanager->snapprefs);
+                }
 
                 // restore the original snap preferences
                 _snapmanager->snapprefs.setTargetSnappable(SNAPTARGET_PATH_INTERSECTION, old_pref);
@@ -254,7 +437,7 @@ void Inkscape::ObjectSnapper::_collectNodes(SnapSourceType const &t,
                 // Discard the bbox of a clipped path / mask, because we don't want to snap to both the bbox
                 // of the item AND the bbox of the clipping path at the same time
                 if (!(*i).clip_or_mask) {
-                    Geom::OptRect b = root_item->desktopBounds(bbox_type);
+                    Geom::OptRect b = _getItemBounds(root_item == (*i).item ? targets : NULL, root_item, bbox_type);
                     getBBoxPoints(b, _points_to_snap_to, true,
                             _snapmanager->snapprefs.isTargetSnappable(SNAPTARGET_BBOX_CORNER),
                             _snapmanager->snapprefs.isTargetSnappable(SNAPTARGET_BBOX_EDGE_MIDPOINT),
@@ -389,6 +572,7 @@ void Inkscape::ObjectSnapper::_collectPaths(Geom::Point /*p*/,
                 i2doc = (*i).item->i2doc_affine();
                 root_item = (*i).item;
             }
+            ItemTargets *targets = (*i).clip_or_mask ? NULL : _getItemTargets((*i).item);
 
             //Build a list of all paths considered for snapping to
 
@@ -415,7 +599,10 @@ void Inkscape::ObjectSnapper::_collectPaths(Geom::Point /*p*/,
                             very_complex_path = path->nodesInPath() > 500;
                         }
 
-                        if (!very_complex_path && root_item && _snapmanager->snapprefs.isTargetSnappable(SNAPTARGET_PATH, SNAPTARGET_PATH_INTERSECTION)) {
+                        bool snap_to_path = _snapmanager->snapprefs.isTargetSnappable(SNAPTARGET_PATH, SNAPTARGET_PATH_INTERSECTION);
+                        if (!very_complex_path && snap_to_path && targets && targets->has_path) {
+                            _paths_to_snap_to->push_back(SnapCandidatePath(new Geom::PathVector(targets->path), SNAPTARGET_PATH, Geom::OptRect()));
+                        } else if (!very_complex_path && root_item && snap_to_path) {
                             SPCurve *curve = NULL;
                             SPShape *shape = dynamic_cast<SPShape *>(root_item);
                             if (shape) {
@@ -433,6 +620,10 @@ void Inkscape::ObjectSnapper::_collectPaths(Geom::Point /*p*/,
 
                                 _paths_to_snap_to->push_back(SnapCandidatePath(pv, SNAPTARGET_PATH, Geom::OptRect())); // Perhaps for speed, get a reference to the Geom::pathvector, and store the transformation besides it.
                                 curve->unref();
+                                if (targets) {
+                                    targets->path = *pv;
+                                    targets->has_path = true;
+                                }
                             }
                         }
                     }
@@ -448,7 +639,7 @@ void Inkscape::ObjectSnapper::_collectPaths(Geom::Point /*p*/,
                         Geom::OptRect rect = root_item->bounds(bbox_type, i2doc);
                         if (rect) {
                             Geom::PathVector *path = _getPathvFromRect(*rect);
-                            rect = root_item->desktopBounds(bbox_type);
+                            rect = _getItemBounds(root_item == (*i).item ? targets : NULL, root_item, bbox_type);
                             _paths_to_snap_to->push_back(SnapCandidatePath(path, SNAPTARGET_BBOX_EDGE, rect));
                         }
                     }
@@ -10,6 +10,8 @@
  * Released under GNU GPL, read the file 'COPYING' for more information
  */
 
+#include <map>
+#include <sigc++/connection.h>
 #include "snapper.h"
 #include "sp-path.h"
 #include "splivarot.h"
@@ -63,6 +65,22 @@ private:
     std::vector<SnapCandidatePoint> *_points_to_snap_to;
     std::vector<SnapCandidatePath > *_paths_to_snap_to;
 
+    /**
+     * Snap targets of a candidate item in desktop coordinates. They are kept between snap
+     * requests until the item is modified or released.
+     */
+    struct ItemTargets {
+        ItemTargets() : nodes_signature(-1), has_path(false) {}
+        int nodes_signature; ///< node targets that were enabled when collecting the nodes, or -1
+        std::vector<SnapCandidatePoint> nodes; ///< without the rotation center
+        std::map<int, Geom::OptRect> bounds; ///< desktop bounds by bounding box type
+        bool has_path;
+        Geom::PathVector path;
+        sigc::connection modified_connection;
+        sigc::connection release_connection;
+    };
+    std::map<SPItem const *, ItemTargets> *_item_targets;
+
     /**
      * Find all items within snapping range.
      * @param parent Pointer to the document's root, or to a clipped path or mask object.
@@ -77,6 +95,20 @@ private:
                        bool const _clip_or_mask,
                        Geom::Affine const additional_affine) const;
 
+    /**
+     * Find all items within snapping range through the spatial index of the document.
+     * @return false if the index cannot be used with the current snap targets.
+     */
+    bool _findCandidatesIndexed(SPObject *root,
+                                std::vector<SPItem const *> const *it,
+                                Geom::Rect const &bbox_to_snap) const;
+
+    ItemTargets *_getItemTargets(SPItem *item) const;
+    Geom::OptRect _getItemBounds(ItemTargets *targets, SPItem *item, SPItem::BBoxType bbox_type) const;
+    int _getNodesSignature() const;
+    void _onItemModified(SPObject *object, unsigned flags) const;
+    void _onItemRelease(SPObject *object) const;
+
     void _snapNodes(IntermSnapResults &isr,
                       Inkscape::SnapCandidatePoint const &p, // in desktop coordinates
                       std::vector<SnapCandidatePoint> *unselected_nodes,
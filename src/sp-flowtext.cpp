@@ -398,15 +398,17 @@ void SPFlowtext::_buildLayoutInput(SPObject *root, Shape const *exclusion_shape,
         } else {
             SPFlowregion *region = dynamic_cast<SPFlowregion *>(&child);
             if (region) {
-                std::vector<Shape*> const &computed = region->computed;
-                for (std::vector<Shape*>::const_iterator it = computed.begin() ; it != computed.end() ; ++it) {
-                    shapes->push_back(Shape());
-                    if (exclusion_shape->hasEdges()) {
-                        shapes->back().Booleen(*it, const_cast<Shape*>(exclusion_shape), bool_op_diff);
-                    } else {
-                        shapes->back().Copy(*it);
+                if (shapes) {
+                    std::vector<Shape*> const &computed = region->computed;
+                    for (std::vector<Shape*>::const_iterator it = computed.begin() ; it != computed.end() ; ++it) {
+                        shapes->push_back(Shape());
+                        if (exclusion_shape->hasEdges()) {
+                            shapes->back().Booleen(*it, const_cast<Shape*>(exclusion_shape), bool_op_diff);
+                        } else {
+                            shapes->back().Copy(*it);
+                        }
+                        layout.appendWrapShape(&shapes->back());
                     }
-                    layout.appendWrapShape(&shapes->back());
                 }
             }
             //Xml Tree is being directly used while it shouldn't be.
@@ -462,6 +464,13 @@ void SPFlowtext::rebuildLayout()
 #endif
 }
 
+void SPFlowtext::rebuildLayoutInput()
+{
+    layout.clear();
+    SPObject *pending_line_break_object = NULL;
+    _buildLayoutInput(this, NULL, NULL, &pending_line_break_object);
+}
+
 void SPFlowtext::_clearFlow(Inkscape::DrawingGroup *in_arena)
 {
     in_arena->clearChildren();
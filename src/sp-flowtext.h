@@ -28,6 +28,11 @@ public:
     /** Completely recalculates the layout. */
     void rebuildLayout();
 
+    /** Rebuilds the input of the layout without laying it out, see
+    Inkscape::Text::Layout::prepareShaping(). The wrap shapes are left out,
+    as only rebuildLayout() needs them. */
+    void rebuildLayoutInput();
+
     /** Converts the flowroot in into a \<text\> tree, keeping all the formatting and positioning,
     but losing the automatic wrapping ability. */
     Inkscape::XML::Node *getAsText();
@@ -60,7 +65,8 @@ public:
         {_optimizeScaledText = true;}
 
 private:
-    /** Recursively walks the xml tree adding tags and their contents. */
+    /** Recursively walks the xml tree adding tags and their contents. The
+    flow regions are only added as wrap shapes if \a shapes is not NULL. */
     void _buildLayoutInput(SPObject *root, Shape const *exclusion_shape, std::list<Shape> *shapes, SPObject **pending_line_break_object);
 
     /** calculates the union of all the \<flowregionexclude\> children
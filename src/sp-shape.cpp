@@ -1143,20 +1143,16 @@ void SPShape::snappoints(std::vector<Inkscape::SnapCandidatePoint> &p, Inkscape:
         // Find the internal intersections of each path and consider these for snapping
         // (using "Method 1" as described in Inkscape::ObjectSnapper::_collectNodes())
         if (snapprefs->isTargetSnappable(Inkscape::SNAPTARGET_PATH_INTERSECTION) || snapprefs->isSourceSnappable(Inkscape::SNAPSOURCE_PATH_INTERSECTION)) {
-            Geom::Crossings cs;
-
             try {
-                cs = self_crossings(*path_it); // This can be slow!
-
-                if (!cs.empty()) { // There might be multiple intersections...
-                    for (Geom::Crossings::const_iterator i = cs.begin(); i != cs.end(); ++i) {
-                        Geom::Point p_ix = (*path_it).pointAt((*i).ta);
-                        p.push_back(Inkscape::SnapCandidatePoint(p_ix * i2dt, Inkscape::SNAPSOURCE_PATH_INTERSECTION, Inkscape::SNAPTARGET_PATH_INTERSECTION));
-                    }
+                std::vector<Geom::PathIntersection> xs = path_it->intersectSelf();
+                for (std::vector<Geom::PathIntersection>::const_iterator i = xs.begin(); i != xs.end(); ++i) {
+                    Geom::Point p_ix = path_it->pointAt(i->first);
+                    p.push_back(Inkscape::SnapCandidatePoint(p_ix * i2dt, Inkscape::SNAPSOURCE_PATH_INTERSECTION, Inkscape::SNAPTARGET_PATH_INTERSECTION));
                 }
-            } catch (Geom::RangeError &e) {
+            } catch (Geom::Exception &e) {
                 // do nothing
-                // The exception could be Geom::InfiniteSolutions: then no snappoints should be added
+                // The exception could be Geom::InfiniteSolutions, or come from curves on the same
+                // ellipse: then no snappoints should be added
             }
 
         }
@@ -6,6 +6,7 @@
 #include "sp-root.h"
 #include "attributes.h"
 #include "style.h"
+#include "style-cascade-cache.h"
 
 // For external style sheets
 #include "io/resource.h"
@@ -387,6 +388,7 @@ void SPStyleElem::read_content() {
     if (parse_status == CR_OK) {
         // Also destroys old style sheet:
         cr_cascade_set_sheet (document->style_cascade, document->style_sheet, ORIGIN_AUTHOR);
+        document->getStyleCascadeCache().invalidate();
     } else {
         cr_stylesheet_destroy (document->style_sheet);
         document->style_sheet = NULL;
@@ -739,11 +739,16 @@ Shape* SPText::_buildExclusionShape() const
     return result;
 }
 
-void SPText::rebuildLayout()
+void SPText::rebuildLayoutInput()
 {
     layout.clear();
     Inkscape::Text::Layout::OptionalTextTagAttrs optional_attrs;
     _buildLayoutInput(this, optional_attrs, 0, false);
+}
+
+void SPText::rebuildLayout()
+{
+    rebuildLayoutInput();
     layout.calculateFlow();
     for (auto& child: children) {
         if (SP_IS_TEXTPATH(&child)) {
@@ -42,6 +42,10 @@ public:
     /** Completely recalculates the layout. */
     void rebuildLayout();
 
+    /** Rebuilds the input of the layout without laying it out, see
+    Inkscape::Text::Layout::prepareShaping(). */
+    void rebuildLayoutInput();
+
     //semiprivate:  (need to be accessed by the C-style functions still)
     TextTagAttributes attributes;
     Inkscape::Text::Layout layout;
@@ -15,10 +15,15 @@
 #ifdef HAVE_CONFIG_H
 #endif
 
+#include "config.h" // Needed for HAVE_OPENMP
+#include <algorithm>
 #include <cstring>
 #include <string>
 #include <vector>
 #include <glib.h>
+#if HAVE_OPENMP
+#include <omp.h>
+#endif //HAVE_OPENMP
 #include "xml/repr.h"
 #include "svg/svg.h"
 #include "sp-path.h"
@@ -37,6 +42,7 @@
 #include <glibmm/i18n.h>
 
 #include "xml/repr-sorting.h"
+#include <2geom/intersection-graph.h>
 #include <2geom/svg-path-writer.h>
 #include "helper/geom.h"
 
@@ -107,6 +113,199 @@ boolop_display_error_message(SPDesktop *desktop, Glib::ustring const &msg)
     }
 }
 
+int sp_boolop_engine_commandline = -1;
+
+/**
+ * Returns the engine for union, intersection, difference and exclusion: the one given on
+ * the command line, or else the one chosen in the preferences.
+ */
+BoolOpEngine
+sp_boolop_engine()
+{
+    if (sp_boolop_engine_commandline != -1) {
+        return static_cast<BoolOpEngine>(sp_boolop_engine_commandline);
+    }
+    Inkscape::Preferences *prefs = Inkscape::Preferences::get();
+    return static_cast<BoolOpEngine>(prefs->getIntLimited("/options/boolops/engine", BOOLOP_ENGINE_LIVAROT,
+                                                          BOOLOP_ENGINE_LIVAROT, BOOLOP_ENGINE_2GEOM));
+}
+
+// twice the signed area of the polygon through sample points of a closed path;
+// positive if the path has the same orientation as a positive winding number
+static double
+bool_op_orientation(Geom::Path const &path)
+{
+    double area = 0;
+    Geom::Point prev = path.initialPoint();
+    for (Geom::Path::const_iterator it = path.begin(); it != path.end_closed(); ++it) {
+        int samples = it->isLineSegment() ? 1 : 8;
+        for (int k = 1; k <= samples; ++k) {
+            Geom::Point cur = it->pointAt(double(k) / samples);
+            area += Geom::cross(prev, cur);
+            prev = cur;
+        }
+    }
+    return area;
+}
+
+// winding numbers of all paths except skip at p
+static int
+bool_op_winding_of_others(Geom::PathVector const &pv, std::vector<Geom::OptRect> const &bounds,
+                          size_t skip, Geom::Point const &p)
+{
+    int wind = 0;
+    for (size_t i = 0; i < pv.size(); ++i) {
+        if (i != skip && bounds[i] && bounds[i]->contains(p)) {
+            wind += pv[i].winding(p);
+        }
+    }
+    return wind;
+}
+
+/* Geom::PathIntersectionGraph decides what is inside with the even-odd rule. For paths that
+ * do not cross, the nonzero rule covers the same area if the winding number is -1, 0 or 1
+ * everywhere. It only changes across a path, so checking both sides of each path is enough. */
+static bool
+bool_op_nonzero_is_evenodd(Geom::PathVector const &pv)
+{
+    std::vector<Geom::OptRect> bounds;
+    for (size_t i = 0; i < pv.size(); ++i) {
+        bounds.push_back(pv[i].boundsFast());
+    }
+    for (size_t i = 0; i < pv.size(); ++i) {
+        if (pv[i].empty()) continue;
+        int outside = bool_op_winding_of_others(pv, bounds, i, pv[i].pointAt(0.5));
+        int inside = outside + (bool_op_orientation(pv[i]) > 0 ? 1 : -1);
+        if (abs(outside) > 1 || abs(inside) > 1) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// reverses paths of a result of Geom::PathIntersectionGraph, so that each path runs opposite
+// to the one enclosing it and the nonzero rule gives the same area as the even-odd rule
+static void
+bool_op_orient_evenodd(Geom::PathVector &pv)
+{
+    std::vector<Geom::OptRect> bounds;
+    for (size_t i = 0; i < pv.size(); ++i) {
+        bounds.push_back(pv[i].boundsFast());
+    }
+    for (size_t i = 0; i < pv.size(); ++i) {
+        if (pv[i].empty()) continue;
+        Geom::Point p = pv[i].pointAt(0.5);
+        int depth = 0;
+        for (size_t j = 0; j < pv.size(); ++j) {
+            if (j != i && bounds[j] && bounds[j]->contains(p) && pv[j].winding(p) != 0) {
+                depth++;
+            }
+        }
+        if ((bool_op_orientation(pv[i]) > 0) == (depth % 2 == 1)) {
+            pv[i] = pv[i].reversed();
+        }
+    }
+}
+
+// whether an operand can be handed to Geom::PathIntersectionGraph; its paths are closed
+// by the graph, and must not cross or touch each other or themselves
+static bool
+bool_op_exact_operand(Geom::PathVector const &pv, FillRule fr)
+{
+    if (fr != fill_nonZero && fr != fill_oddEven) {
+        return false;
+    }
+    Geom::PathVector closed(pv);
+    for (size_t i = 0; i < closed.size(); ++i) {
+        closed[i].close();
+    }
+    if (!closed.intersectSelf().empty()) {
+        return false;
+    }
+    return fr == fill_oddEven || bool_op_nonzero_is_evenodd(closed);
+}
+
+/**
+ * Boolean operation on exact curves with Geom::PathIntersectionGraph, with the same operand
+ * order as sp_pathvector_boolop(). The result can be filled with either fill rule.
+ *
+ * Returns false if the operation cannot be done this way and livarot has to be used: for
+ * cut and slice, fill rules other than nonzero and even-odd, operands that cross or touch
+ * themselves, nonzero operands that cover some area twice, and intersections the graph
+ * cannot classify, such as those of overlapping segments.
+ */
+bool
+sp_pathvector_boolop_exact(Geom::PathVector const &pathva, Geom::PathVector const &pathvb, bool_op bop,
+                           FillRule fra, FillRule frb, Geom::PathVector &result)
+{
+    if (bop != bool_op_union && bop != bool_op_inters && bop != bool_op_diff && bop != bool_op_symdiff) {
+        return false;
+    }
+    if (!bool_op_exact_operand(pathva, fra) || !bool_op_exact_operand(pathvb, frb)) {
+        return false;
+    }
+
+    try {
+        if (pathva.empty() || pathvb.empty()) {
+            // the graph is not built for empty operands, same rules as in pathBoolOp()
+            bool resultIsB = ((bop == bool_op_union || bop == bool_op_symdiff) && pathva.empty())
+                             || (bop == bool_op_inters && pathvb.empty())
+                             || bop == bool_op_diff;
+            result = resultIsB ? pathvb : pathva;
+        } else {
+            Geom::PathIntersectionGraph pig(pathva, pathvb);
+            if (!pig.valid()) {
+                return false;
+            }
+            switch (bop) {
+                case bool_op_union:
+                    result = pig.getUnion();
+                    break;
+                case bool_op_inters:
+                    result = pig.getIntersection();
+                    break;
+                case bool_op_diff:
+                    // livarot computes Booleen(B, A, bool_op_diff), i.e. B minus A
+                    result = pig.getBminusA();
+                    break;
+                default:
+                    result = pig.getXOR();
+                    break;
+            }
+        }
+        for (size_t i = 0; i < result.size(); ++i) {
+            result[i].close();
+        }
+        bool_op_orient_evenodd(result);
+    } catch (Geom::Exception const &e) {
+        return false;
+    }
+    return true;
+}
+
+// sp_pathvector_boolop_exact() applied to the operands in turn, like the livarot code in
+// pathBoolOp(); false if any step has to fall back to livarot
+static bool
+bool_op_exact_many(std::vector<Geom::PathVector> const &pathv, std::vector<FillRule> const &origWind,
+                   bool_op bop, Geom::PathVector &result)
+{
+    // a single operand is unioned to remove its self-overlaps, which is livarot's job
+    if (pathv.size() < 2) {
+        return false;
+    }
+    result = pathv[0];
+    FillRule fr = origWind[0];
+    for (size_t i = 1; i < pathv.size(); ++i) {
+        Geom::PathVector step;
+        if (!sp_pathvector_boolop_exact(result, pathv[i], bop, fr, origWind[i], step)) {
+            return false;
+        }
+        result = step;
+        fr = fill_oddEven;
+    }
+    return true;
+}
+
 // boolean operations PathVectors A,B -> PathVector result.
 // This is derived from sp_selected_path_boolop
 // take the source paths from the file, do the operation, delete the originals and add the results
@@ -114,6 +313,11 @@ boolop_display_error_message(SPDesktop *desktop, Glib::ustring const &msg)
 Geom::PathVector 
 sp_pathvector_boolop(Geom::PathVector const &pathva, Geom::PathVector const &pathvb, bool_op bop, fill_typ fra, fill_typ frb)
 {        
+    Geom::PathVector exact;
+    if (sp_boolop_engine() == BOOLOP_ENGINE_2GEOM &&
+        sp_pathvector_boolop_exact(pathva, pathvb, bop, fra, frb, exact)) {
+        return exact;
+    }
 
     // extract the livarot Paths from the source objects
     // also get the winding rule specified in the style
@@ -305,6 +509,258 @@ Geom::PathVector pathliv_to_pathvector(Path *pathliv){
     return outres;
 }
 
+// Many-operand unions and intersections.
+// Instead of folding the operands into the result one at a time, which sweeps the ever growing
+// result once per operand, the operands are merged pairwise in a balanced tree, and the merges
+// of each level are independent, so they run in parallel. For unions, operands are first grouped
+// into clusters whose bounding boxes overlap (transitively); clusters cannot touch each other,
+// so each is merged and converted back on its own and operands that overlap nothing are never
+// swept against anything. An intersection of operands whose bounding boxes have no common
+// point is empty without any sweep.
+
+// Bounding box of the points of a livarot Shape, or nothing if it has no edges
+static Geom::OptRect
+bool_op_shape_bounds(Shape *shape)
+{
+    Geom::OptRect bounds;
+    if (shape->numberOfEdges() == 0) {
+        return bounds;
+    }
+    for (int i = 0; i < shape->numberOfPoints(); i++) {
+        bounds.unionWith(Geom::Rect(shape->getPoint(i).x, shape->getPoint(i).x));
+    }
+    return bounds;
+}
+
+// Bounding boxes sharing only an edge still overlap: the operands may touch along it
+static bool
+bool_op_bounds_overlap(Geom::OptRect const &a, Geom::OptRect const &b)
+{
+    return a && b && a->intersects(*b);
+}
+
+// Combines two partial results of a union or intersection, with the same rules for empty
+// operands as the sequential operation in pathBoolOp(); a and b are consumed
+static Shape *
+bool_op_merge(Shape *a, Shape *b, bool_op bop)
+{
+    if (bop == bool_op_inters && !bool_op_bounds_overlap(bool_op_shape_bounds(a), bool_op_shape_bounds(b))) {
+        // also covers empty operands: the intersection is empty
+        delete a;
+        delete b;
+        return new Shape;
+    }
+    if (a->numberOfEdges() == 0) {
+        delete a;
+        return b;
+    }
+    if (b->numberOfEdges() == 0) {
+        delete b;
+        return a;
+    }
+    Shape *result = new Shape;
+    // same operand order as the sequential operation: the accumulated result comes last
+    result->Booleen(b, a, bop);
+    delete a;
+    delete b;
+    return result;
+}
+
+// Position of the center of a box along a Z-order curve over the given area, used to sort
+// operands so that neighbours are merged first
+static guint32
+bool_op_morton_code(Geom::Rect const &box, Geom::Rect const &area)
+{
+    guint32 code = 0;
+    guint32 q[2];
+    for (unsigned d = 0; d < 2; d++) {
+        Geom::Dim2 dim = Geom::Dim2(d);
+        double extent = area[dim].extent();
+        double t = extent > 0 ? (box.midpoint()[dim] - area[dim].min()) / extent : 0;
+        q[d] = CLAMP(t, 0.0, 1.0) * 65535;
+    }
+    for (int bit = 15; bit >= 0; bit--) {
+        code = (code << 2) | (((q[Geom::Y] >> bit) & 1) << 1) | ((q[Geom::X] >> bit) & 1);
+    }
+    return code;
+}
+
+namespace {
+
+struct MortonLess {
+    MortonLess(std::vector<guint32> const &codes) : _codes(codes) {}
+    bool operator()(int a, int b) const {
+        return _codes[a] < _codes[b] || (_codes[a] == _codes[b] && a < b);
+    }
+    std::vector<guint32> const &_codes;
+};
+
+struct LeftLess {
+    LeftLess(std::vector<Geom::OptRect> const &bounds) : _bounds(bounds) {}
+    bool operator()(int a, int b) const {
+        return (*_bounds[a])[Geom::X].min() < (*_bounds[b])[Geom::X].min();
+    }
+    std::vector<Geom::OptRect> const &_bounds;
+};
+
+int
+bool_op_cluster_root(std::vector<int> &parent, int i)
+{
+    while (parent[i] != i) {
+        parent[i] = parent[parent[i]];
+        i = parent[i];
+    }
+    return i;
+}
+
+} // namespace
+
+// Union or intersection of all the operands; the result is appended to res.
+// The operands are converted to polygons with back data, as in the sequential operation.
+static void
+bool_op_many(std::vector<Path *> &originaux, std::vector<FillRule> const &origWind, bool_op bop, Path *res)
+{
+    int nbOriginaux = originaux.size();
+
+#if HAVE_OPENMP
+    Inkscape::Preferences *prefs = Inkscape::Preferences::get();
+    int numOfThreads = prefs->getIntLimited("/options/threading/numthreads", omp_get_num_procs(), 1, 256);
+    (void) numOfThreads; // suppress unused variable warning
+#endif // HAVE_OPENMP
+
+    std::vector<Shape *> leaves(nbOriginaux);
+    std::vector<Geom::OptRect> bounds(nbOriginaux);
+#if HAVE_OPENMP
+#pragma omp parallel for schedule(dynamic) num_threads(numOfThreads)
+#endif // HAVE_OPENMP
+    for (int i = 0; i < nbOriginaux; i++) {
+        Shape polygon;
+        originaux[i]->ConvertWithBackData(0.1);
+        originaux[i]->Fill(&polygon, i);
+        leaves[i] = new Shape;
+        leaves[i]->ConvertToShape(&polygon, origWind[i]);
+        bounds[i] = bool_op_shape_bounds(leaves[i]);
+    }
+
+    // group the operands that have to be swept together
+    std::vector<std::vector<int> > clusters;
+    if (bop == bool_op_inters) {
+        Geom::OptRect common = bounds[0];
+        for (int i = 1; i < nbOriginaux; i++) {
+            common.intersectWith(bounds[i]);
+        }
+        if (common) {
+            clusters.push_back(std::vector<int>());
+            for (int i = 0; i < nbOriginaux; i++) {
+                clusters.back().push_back(i);
+            }
+        }
+    } else {
+        // empty operands don't change a union
+        std::vector<int> order;
+        for (int i = 0; i < nbOriginaux; i++) {
+            if (bounds[i]) {
+                order.push_back(i);
+            }
+        }
+        std::sort(order.begin(), order.end(), LeftLess(bounds));
+        std::vector<int> parent(nbOriginaux);
+        for (int i = 0; i < nbOriginaux; i++) {
+            parent[i] = i;
+        }
+        for (size_t i = 0; i < order.size(); i++) {
+            Geom::Rect const &a = *bounds[order[i]];
+            for (size_t j = i + 1; j < order.size() && (*bounds[order[j]])[Geom::X].min() <= a[Geom::X].max(); j++) {
+                if (a.intersects(*bounds[order[j]])) {
+                    parent[bool_op_cluster_root(parent, order[j])] = bool_op_cluster_root(parent, order[i]);
+                }
+            }
+        }
+        std::vector<int> cluster_of(nbOriginaux, -1);
+        for (int i = 0; i < nbOriginaux; i++) {
+            if (!bounds[i]) {
+                continue;
+            }
+            int root = bool_op_cluster_root(parent, i);
+            if (cluster_of[root] < 0) {
+                cluster_of[root] = clusters.size();
+                clusters.push_back(std::vector<int>());
+            }
+            clusters[cluster_of[root]].push_back(i);
+        }
+    }
+
+    // merge the operands of each cluster in a balanced tree, in Z-order so that neighbours are
+    // merged first and the partial results stay small
+    std::vector<std::vector<Shape *> > levels(clusters.size());
+    for (size_t c = 0; c < clusters.size(); c++) {
+        std::vector<int> &members = clusters[c];
+        if (members.size() > 2) {
+            Geom::Rect area = *bounds[members[0]];
+            for (size_t i = 1; i < members.size(); i++) {
+                area.unionWith(*bounds[members[i]]);
+            }
+            std::vector<guint32> codes(nbOriginaux);
+            for (size_t i = 0; i < members.size(); i++) {
+                codes[members[i]] = bool_op_morton_code(*bounds[members[i]], area);
+            }
+            std::sort(members.begin(), members.end(), MortonLess(codes));
+        }
+        for (size_t i = 0; i < members.size(); i++) {
+            levels[c].push_back(leaves[members[i]]);
+            leaves[members[i]] = NULL;
+        }
+    }
+    for (int i = 0; i < nbOriginaux; i++) {
+        delete leaves[i];
+    }
+
+    while (true) {
+        // the merges of one level of all clusters
+        std::vector<std::pair<int, int> > merges;
+        for (size_t c = 0; c < levels.size(); c++) {
+            for (size_t i = 0; i + 1 < levels[c].size(); i += 2) {
+                merges.push_back(std::make_pair(c, i));
+            }
+        }
+        if (merges.empty()) {
+            break;
+        }
+        int nbMerges = merges.size();
+#if HAVE_OPENMP
+#pragma omp parallel for schedule(dynamic) num_threads(numOfThreads)
+#endif // HAVE_OPENMP
+        for (int m = 0; m < nbMerges; m++) {
+            std::vector<Shape *> &level = levels[merges[m].first];
+            int i = merges[m].second;
+            level[i] = bool_op_merge(level[i], level[i + 1], bop);
+            level[i + 1] = NULL;
+        }
+        for (size_t c = 0; c < levels.size(); c++) {
+            levels[c].erase(std::remove(levels[c].begin(), levels[c].end(), (Shape *) NULL), levels[c].end());
+        }
+    }
+
+    // rebuild the curves of each cluster; the clusters are ordered by their first operand
+    int nbClusters = levels.size();
+    std::vector<Path *> parts(nbClusters);
+#if HAVE_OPENMP
+#pragma omp parallel for schedule(dynamic) num_threads(numOfThreads)
+#endif // HAVE_OPENMP
+    for (int c = 0; c < nbClusters; c++) {
+        parts[c] = new Path;
+        parts[c]->SetBackData(false);
+        levels[c][0]->ConvertToForme(parts[c], nbOriginaux, &originaux[0]);
+        delete levels[c][0];
+    }
+    for (int c = 0; c < nbClusters; c++) {
+        Path *part = parts[c];
+        res->descr_cmd.insert(res->descr_cmd.end(), part->descr_cmd.begin(), part->descr_cmd.end());
+        part->descr_cmd.clear(); // now owned by res
+        delete part;
+    }
+}
+
 
 // boolean operations on the desktop
 // take the source paths from the file, do the operation, delete the originals and add the results
@@ -412,6 +868,10 @@ BoolOpErrors Inkscape::ObjectSet::pathBoolOp(bool_op bop, const bool skip_undo,
     int nbOriginaux = il.size();
     std::vector<Path *> originaux(nbOriginaux);
     std::vector<FillRule> origWind(nbOriginaux);
+    // with the 2geom engine, also keep the exact curves
+    bool exact = (bop == bool_op_inters || bop == bool_op_union || bop == bool_op_diff || bop == bool_op_symdiff)
+                 && sp_boolop_engine() == BOOLOP_ENGINE_2GEOM;
+    std::vector<Geom::PathVector> origPathv(exact ? nbOriginaux : 0);
     int curOrig;
     {
         curOrig = 0;
@@ -438,6 +898,13 @@ BoolOpErrors Inkscape::ObjectSet::pathBoolOp(bool_op bop, const bool skip_undo,
                 for (int i = curOrig; i >= 0; i--) delete originaux[i];
                 return DONE_NO_ACTION;
             }
+            if (exact) {
+                SPCurve *curve = curve_for_item(*l);
+                Geom::PathVector *pathv = pathvector_for_curve(*l, curve, true, true, Geom::identity(), Geom::identity());
+                origPathv[curOrig] = *pathv;
+                delete pathv;
+                curve->unref();
+            }
             curOrig++;
         }
     }
@@ -447,6 +914,9 @@ BoolOpErrors Inkscape::ObjectSet::pathBoolOp(bool_op bop, const bool skip_undo,
         using std::swap;
         swap(originaux[0], originaux[1]);
         swap(origWind[0], origWind[1]);
+        if (exact) {
+            swap(origPathv[0], origPathv[1]);
+        }
     }
 
     // and work
@@ -459,7 +929,20 @@ BoolOpErrors Inkscape::ObjectSet::pathBoolOp(bool_op bop, const bool skip_undo,
     Path::cut_position  *toCut=NULL;
     int                  nbToCut=0;
 
-    if ( bop == bool_op_inters || bop == bool_op_union || bop == bool_op_diff || bop == bool_op_symdiff ) {
+    // exact curves with 2geom, unless a degenerate case needs livarot
+    Geom::PathVector exactResult;
+    if (exact) {
+        exact = bool_op_exact_many(origPathv, origWind, bop, exactResult);
+    }
+
+    // many operands: merge them in a balanced tree, see bool_op_many()
+    bool merged = !exact && (bop == bool_op_inters || bop == bool_op_union) && nbOriginaux > 2;
+
+    if ( exact ) {
+        res->LoadPathVector(exactResult);
+    } else if ( merged ) {
+        bool_op_many(originaux, origWind, bop, res);
+    } else if ( bop == bool_op_inters || bop == bool_op_union || bop == bool_op_diff || bop == bool_op_symdiff ) {
         // true boolean op
         // get the polygons of each path, with the winding rule specified, and apply the operation iteratively
         originaux[0]->ConvertWithBackData(0.1);
@@ -654,7 +1137,7 @@ BoolOpErrors Inkscape::ObjectSet::pathBoolOp(bool_op bop, const bool skip_undo,
         // this function uses the point_data to get the winding number of each path (ie: is a hole or not)
         // for later reconstruction in objects, you also need to extract which path is parent of holes (nesting info)
         theShape->ConvertToFormeNested(res, nbOriginaux, &originaux[0], 1, nbNest, nesting, conts);
-    } else {
+    } else if ( !merged && !exact ) {
         theShape->ConvertToForme(res, nbOriginaux, &originaux[0]);
     }
 
@@ -55,6 +55,16 @@ boost::optional<Path::cut_position> get_nearest_position_on_Path(Path *path, Geo
 Geom::Point get_point_on_Path(Path *path, int piece, double t);
 Geom::PathVector sp_pathvector_boolop(Geom::PathVector const &pathva, Geom::PathVector const &pathvb, bool_op bop, FillRule fra, FillRule frb);
 
+// engine for union, intersection, difference and exclusion, see /options/boolops/engine
+enum BoolOpEngine {
+    BOOLOP_ENGINE_LIVAROT, // polygons with back data, curves are refitted
+    BOOLOP_ENGINE_2GEOM    // Geom::PathIntersectionGraph, curves are kept
+};
+extern int sp_boolop_engine_commandline; // -1 if not given on the command line
+BoolOpEngine sp_boolop_engine();
+bool sp_pathvector_boolop_exact(Geom::PathVector const &pathva, Geom::PathVector const &pathvb, bool_op bop,
+                                FillRule fra, FillRule frb, Geom::PathVector &result);
+
 #endif
 
 /*
@@ -0,0 +1,514 @@
+/*
+ * Compiled selectors and matched declarations of the style sheets of a document
+ *
+ * Copyright (C) 2018 Authors
+ *
+ * Released under GNU GPL, read the file 'COPYING' for more information
+ */
+
+#include <algorithm>
+#include <cstring>
+
+#include "style-cascade-cache.h"
+#include "attributes.h"
+#include "svg/css-ostringstream.h"
+
+namespace {
+
+/// libcroco follows imports and sheet chains recursively, without any check for cycles
+unsigned const MAX_SHEET_DEPTH = 32;
+
+/// Distinct signatures kept before the matches are dropped
+size_t const MAX_RESULTS = 10000;
+
+} // namespace
+
+namespace Inkscape {
+
+StyleCascadeCache::StyleCascadeCache(CRCascade *cascade, CRNodeIface const *node_iface)
+    : _cascade(cascade)
+    , _node_iface(node_iface)
+    , _compiled(false)
+    , _occurrences(0)
+    , _ancestors(false)
+    , _classes(false)
+{
+}
+
+StyleCascadeCache::~StyleCascadeCache()
+{
+}
+
+void StyleCascadeCache::invalidate()
+{
+    _compiled = false;
+    _rules.clear();
+    _simple = Index();
+    _complex = Index();
+    _occurrences = 0;
+    _ancestors = false;
+    _classes = false;
+    _ids.clear();
+    _results.clear();
+    _declarations.clear();
+}
+
+std::vector<StyleCascadeCache::Declaration const *> const &
+StyleCascadeCache::match(CRSelEng *sel_eng, CRXMLNodePtr node)
+{
+    if (!_compiled) {
+        _compile();
+    }
+    if (_rules.empty() || !_node_iface->isElementNode(node)) {
+        return _none;
+    }
+
+    NodeData data = _nodeData(node);
+    std::string key;
+    _appendSignature(data, key);
+    if (_ancestors) {
+        for (CRXMLNodePtr parent = _node_iface->getParentNode(node); parent;
+             parent = _node_iface->getParentNode(parent)) {
+            if (_node_iface->isElementNode(parent)) {
+                NodeData parent_data = _nodeData(parent);
+                _appendSignature(parent_data, key);
+                _freeNodeData(parent_data);
+            } else {
+                key += '\x02';
+            }
+        }
+    }
+
+    // selectors the cache cannot match are part of the key
+    std::vector<unsigned> rules;
+    _candidates(_complex, data, rules);
+    std::sort(rules.begin(), rules.end());
+    key += '\x03';
+    std::vector<unsigned> matched;
+    for (std::vector<unsigned>::const_iterator i = rules.begin(); i != rules.end(); ++i) {
+        gboolean matches = FALSE;
+        if (cr_sel_eng_matches_node(sel_eng, _rules[*i].sel, node, &matches) == CR_OK && matches) {
+            matched.push_back(*i);
+            key.append(reinterpret_cast<char const *>(&*i), sizeof(unsigned));
+        }
+    }
+
+    std::unordered_map<std::string, std::vector<Declaration const *> >::const_iterator found = _results.find(key);
+    if (found != _results.end()) {
+        _freeNodeData(data);
+        return found->second;
+    }
+
+    rules.clear();
+    _candidates(_simple, data, rules);
+    for (std::vector<unsigned>::const_iterator i = rules.begin(); i != rules.end(); ++i) {
+        std::vector<Compound> const &compounds = _rules[*i].compounds;
+        if (_matches(compounds, compounds.size() - 1, node)) {
+            matched.push_back(*i);
+        }
+    }
+    std::sort(matched.begin(), matched.end());
+    _freeNodeData(data);
+
+    if (_results.size() >= MAX_RESULTS) {
+        _results.clear();
+    }
+    std::vector<Declaration const *> &result = _results[key];
+    _resolve(matched, result);
+    return result;
+}
+
+void StyleCascadeCache::_compile()
+{
+    for (int origin = ORIGIN_UA; origin < NB_ORIGINS; ++origin) {
+        CRStyleSheet *sheet = cr_cascade_get_sheet(_cascade, static_cast<CRStyleOrigin>(origin));
+        if (sheet) {
+            _visitSheet(sheet, 0);
+        }
+    }
+    _compiled = true;
+}
+
+/**
+ * Adds the rules of the sheet in the order of cr_sel_eng_process_stylesheet(): imports
+ * first, then the sheet, then the sheets chained to it, each with their own imports and
+ * chains. Sheets reached twice are visited twice, as libcroco does.
+ */
+void StyleCascadeCache::_visitSheet(CRStyleSheet *sheet, unsigned depth)
+{
+    if (depth > MAX_SHEET_DEPTH) {
+        return;
+    }
+    for (CRStyleSheet *cur = sheet->import; cur; cur = cur->next) {
+        _visitSheet(cur, depth + 1);
+    }
+    for (CRStatement *stmt = sheet->statements; stmt; stmt = stmt->next) {
+        // declarations of @media rules are never used by libcroco
+        if (stmt->type != RULESET_STMT || !stmt->kind.ruleset || !stmt->kind.ruleset->sel_list ||
+            !stmt->parent_sheet) {
+            continue;
+        }
+        unsigned occurrence = _occurrences++;
+        for (CRSelector *sel = stmt->kind.ruleset->sel_list; sel; sel = sel->next) {
+            if (sel->simple_sel) {
+                _addRule(stmt, sel->simple_sel, occurrence);
+            }
+        }
+    }
+    for (CRStyleSheet *cur = sheet->next; cur; cur = cur->next) {
+        _visitSheet(cur, depth + 1);
+    }
+}
+
+void StyleCascadeCache::_addRule(CRStatement *stmt, CRSimpleSel *sel, unsigned occurrence)
+{
+    Rule rule;
+    rule.stmt = stmt;
+    rule.sel = sel;
+    rule.occurrence = occurrence;
+    rule.specificity = _specificity(sel);
+    rule.complex = false;
+
+    for (CRSimpleSel const *cur = sel; cur; cur = cur->next) {
+        Compound compound;
+        compound.type = cur->type_mask & TYPE_SELECTOR;
+        compound.universal = cur->type_mask & UNIVERSAL_SELECTOR;
+        compound.has_name = cur->name && cur->name->stryng && cur->name->stryng->str;
+        if (compound.has_name) {
+            compound.name = cur->name->stryng->str;
+        }
+        compound.has_add_sel = cur->add_sel != NULL;
+        compound.combinator = cur->combinator;
+        for (CRAdditionalSel const *add = cur->add_sel; add; add = add->next) {
+            if (add->type == CLASS_ADD_SELECTOR && add->content.class_name &&
+                add->content.class_name->stryng && add->content.class_name->stryng->str) {
+                GString const *name = add->content.class_name->stryng;
+                compound.classes.push_back(std::string(name->str, name->len));
+            } else if (add->type == ID_ADD_SELECTOR && add->content.id_name &&
+                       add->content.id_name->stryng && add->content.id_name->stryng->str) {
+                GString const *name = add->content.id_name->stryng;
+                compound.ids.push_back(std::string(name->str, name->len));
+            } else {
+                rule.complex = true;
+            }
+        }
+        if (cur != sel && compound.combinator != NO_COMBINATOR && compound.combinator != COMB_WS &&
+            compound.combinator != COMB_GT) {
+            rule.complex = true;
+        }
+        rule.compounds.push_back(compound);
+    }
+
+    // all of the rightmost compound has to match the node itself
+    unsigned const index = _rules.size();
+    Compound const &last = rule.compounds.back();
+    Index &rules = rule.complex ? _complex : _simple;
+    if (!last.ids.empty()) {
+        rules.ids[last.ids.front()].push_back(index);
+    } else if (!last.classes.empty()) {
+        rules.classes[last.classes.front()].push_back(index);
+    } else if (last.type && last.has_name && !last.universal) {
+        rules.names[last.name].push_back(index);
+    } else {
+        rules.universal.push_back(index);
+    }
+
+    if (rule.complex) {
+        rule.compounds.clear();
+    } else {
+        _ancestors = _ancestors || rule.compounds.size() > 1;
+        for (std::vector<Compound>::const_iterator i = rule.compounds.begin(); i != rule.compounds.end(); ++i) {
+            _classes = _classes || !i->classes.empty();
+            _ids.insert(i->ids.begin(), i->ids.end());
+        }
+    }
+    _rules.push_back(rule);
+}
+
+void StyleCascadeCache::_candidates(Index const &index, NodeData const &data, std::vector<unsigned> &rules) const
+{
+    if (data.id) {
+        Bucket::const_iterator found = index.ids.find(data.id);
+        if (found != index.ids.end()) {
+            rules.insert(rules.end(), found->second.begin(), found->second.end());
+        }
+    }
+    // class names are compared the way libcroco does, not split at whitespace
+    if (data.klass) {
+        for (Bucket::const_iterator i = index.classes.begin(); i != index.classes.end(); ++i) {
+            if (_classMatches(data.klass, i->first)) {
+                rules.insert(rules.end(), i->second.begin(), i->second.end());
+            }
+        }
+    }
+    Bucket::const_iterator found = index.names.find(data.name);
+    if (found != index.names.end()) {
+        rules.insert(rules.end(), found->second.begin(), found->second.end());
+    }
+    rules.insert(rules.end(), index.universal.begin(), index.universal.end());
+}
+
+void StyleCascadeCache::_appendSignature(NodeData const &data, std::string &key) const
+{
+    key += data.name;
+    key += '\0';
+    if (_classes) {
+        if (data.klass) {
+            key += '\x01';
+            key += data.klass;
+        }
+        key += '\0';
+    }
+    if (data.id && _ids.find(data.id) != _ids.end()) {
+        key += data.id;
+    }
+    key += '\0';
+}
+
+StyleCascadeCache::NodeData StyleCascadeCache::_nodeData(CRXMLNodePtr node) const
+{
+    NodeData data;
+    data.name = _node_iface->getLocalName(node);
+    data.klass = _node_iface->getProp(node, "class");
+    data.id = _node_iface->getProp(node, "id");
+    return data;
+}
+
+void StyleCascadeCache::_freeNodeData(NodeData &data) const
+{
+    if (data.klass) {
+        _node_iface->freePropVal(data.klass);
+        data.klass = NULL;
+    }
+    if (data.id) {
+        _node_iface->freePropVal(data.id);
+        data.id = NULL;
+    }
+}
+
+/**
+ * Whether the compounds up to and including last match node and its ancestors, like
+ * sel_matches_node_real() in libcroco.
+ */
+bool StyleCascadeCache::_matches(std::vector<Compound> const &compounds, int last, CRXMLNodePtr node) const
+{
+    if (!_node_iface->isElementNode(node)) {
+        return false;
+    }
+    for (int i = last; i >= 0; --i) {
+        if (!_compoundMatches(compounds[i], node)) {
+            return false;
+        }
+        if (i == 0) {
+            break;
+        }
+        switch (compounds[i].combinator) {
+            case COMB_WS: {
+                for (CRXMLNodePtr n = _node_iface->getParentNode(node); n; n = _node_iface->getParentNode(n)) {
+                    if (_matches(compounds, i - 1, n)) {
+                        return true;
+                    }
+                }
+                return false;
+            }
+            case COMB_GT:
+                do {
+                    node = _node_iface->getParentNode(node);
+                } while (node && !_node_iface->isElementNode(node));
+                if (!node) {
+                    return false;
+                }
+                break;
+            default:
+                break;
+        }
+    }
+    return true;
+}
+
+bool StyleCascadeCache::_compoundMatches(Compound const &compound, CRXMLNodePtr node) const
+{
+    bool const name_matches = (compound.type && compound.has_name &&
+                               !std::strcmp(compound.name.c_str(), _node_iface->getLocalName(node))) ||
+                              compound.universal;
+    if (!name_matches && (compound.type || compound.universal)) {
+        return false;
+    }
+    if (!compound.has_add_sel) {
+        return name_matches;
+    }
+
+    bool matches = true;
+    if (!compound.classes.empty()) {
+        char *klass = _node_iface->getProp(node, "class");
+        for (std::vector<std::string>::const_iterator i = compound.classes.begin();
+             matches && i != compound.classes.end(); ++i) {
+            matches = _classMatches(klass, *i);
+        }
+        if (klass) {
+            _node_iface->freePropVal(klass);
+        }
+    }
+    if (matches && !compound.ids.empty()) {
+        char *id = _node_iface->getProp(node, "id");
+        for (std::vector<std::string>::const_iterator i = compound.ids.begin();
+             matches && i != compound.ids.end(); ++i) {
+            matches = id && *i == id;
+        }
+        if (id) {
+            _node_iface->freePropVal(id);
+        }
+    }
+    return matches;
+}
+
+/**
+ * Same as class_add_sel_matches_node() in libcroco, which also accepts a name that
+ * follows a longer word of the attribute it starts.
+ */
+bool StyleCascadeCache::_classMatches(char const *klass, std::string const &name)
+{
+    if (!klass) {
+        return false;
+    }
+    size_t const len = name.size();
+    for (char const *cur = klass; *cur; cur++) {
+        while (*cur && cr_utils_is_white_space(*cur)) {
+            cur++;
+        }
+        if (!std::strncmp(cur, name.c_str(), len)) {
+            cur += len;
+            if (!*cur || cr_utils_is_white_space(*cur)) {
+                return true;
+            }
+        } else {
+            while (*cur && !cr_utils_is_white_space(*cur)) {
+                cur++;
+            }
+        }
+        if (!*cur) {
+            break;
+        }
+    }
+    return false;
+}
+
+/// Same as cr_simple_sel_compute_specificity(), without changing the selector
+unsigned long StyleCascadeCache::_specificity(CRSimpleSel const *sel)
+{
+    unsigned long a = 0, b = 0, c = 0;
+    for (CRSimpleSel const *cur = sel; cur; cur = cur->next) {
+        if (cur->type_mask & TYPE_SELECTOR) {
+            c++;
+        } else if (!cur->name || !cur->name->stryng || !cur->name->stryng->str) {
+            if (cur->add_sel && cur->add_sel->type == PSEUDO_CLASS_ADD_SELECTOR) {
+                continue;
+            }
+        }
+        for (CRAdditionalSel const *add = cur->add_sel; add; add = add->next) {
+            if (add->type == ID_ADD_SELECTOR) {
+                a++;
+            } else if (add->type != NO_ADD_SELECTOR) {
+                b++;
+            }
+        }
+    }
+    return a * 1000000 + b * 1000 + c;
+}
+
+/**
+ * Applies the cascade of put_css_properties_in_props_list() to the rulesets of the
+ * matched rules, and converts the resulting declarations in reverse order.
+ *
+ * libcroco lists a ruleset once per matching selector, and takes the specificity of
+ * the last one; listing a ruleset again right after itself changes nothing.
+ */
+void StyleCascadeCache::_resolve(std::vector<unsigned> const &rules, std::vector<Declaration const *> &result)
+{
+    std::unordered_map<CRStatement const *, unsigned long> specificity;
+    for (std::vector<unsigned>::const_iterator i = rules.begin(); i != rules.end(); ++i) {
+        specificity[_rules[*i].stmt] = _rules[*i].specificity;
+    }
+
+    std::vector<CRDeclaration *> props;
+    unsigned occurrence = _occurrences;
+    for (std::vector<unsigned>::const_iterator i = rules.begin(); i != rules.end(); ++i) {
+        Rule const &rule = _rules[*i];
+        if (rule.occurrence == occurrence) {
+            continue;
+        }
+        occurrence = rule.occurrence;
+        CRStatement const *stmt = rule.stmt;
+        for (CRDeclaration *decl = stmt->kind.ruleset->decl_list; decl; decl = decl->next) {
+            if (!decl->property || !decl->property->stryng || !decl->property->stryng->str) {
+                continue;
+            }
+            std::vector<CRDeclaration *>::iterator pair = props.begin();
+            while (pair != props.end() &&
+                   std::strcmp((*pair)->property->stryng->str, decl->property->stryng->str)) {
+                ++pair;
+            }
+            if (pair == props.end()) {
+                props.push_back(decl);
+                continue;
+            }
+
+            CRDeclaration const *old = *pair;
+            CRStyleSheet const *old_sheet = old->parent_statement ? old->parent_statement->parent_sheet : NULL;
+            if (old_sheet && old_sheet->origin < stmt->parent_sheet->origin) {
+                if (old->important == TRUE && decl->important != TRUE && old_sheet->origin != ORIGIN_UA) {
+                    continue;
+                }
+            } else if (old_sheet && old_sheet->origin > stmt->parent_sheet->origin) {
+                continue;
+            } else if (specificity[stmt] < specificity[old->parent_statement] ||
+                       (old->important == TRUE && decl->important != TRUE)) {
+                continue;
+            }
+            props.erase(pair);
+            props.push_back(decl);
+        }
+    }
+
+    // later declarations take precedence, and properties are only set if not set yet
+    for (std::vector<CRDeclaration *>::reverse_iterator i = props.rbegin(); i != props.rend(); ++i) {
+        Declaration const *decl = _declaration(*i);
+        if (decl) {
+            result.push_back(decl);
+        }
+    }
+}
+
+StyleCascadeCache::Declaration const *StyleCascadeCache::_declaration(CRDeclaration const *decl)
+{
+    std::unordered_map<CRDeclaration const *, Declaration>::iterator found = _declarations.find(decl);
+    if (found == _declarations.end()) {
+        Declaration &converted = _declarations[decl];
+        converted.prop_idx = sp_attribute_lookup(decl->property->stryng->str);
+        if (converted.prop_idx != SP_ATTR_INVALID) {
+            gchar *const str_value = reinterpret_cast<gchar *>(cr_term_to_string(decl->value));
+
+            // Add "!important" rule if necessary as this is not handled by cr_term_to_string().
+            gchar const *important = decl->important ? " !important" : "";
+            Inkscape::CSSOStringStream os;
+            os << str_value << important;
+            converted.value = os.str();
+            g_free(str_value);
+        }
+        return converted.prop_idx != SP_ATTR_INVALID ? &converted : NULL;
+    }
+    return found->second.prop_idx != SP_ATTR_INVALID ? &found->second : NULL;
+}
+
+} // namespace Inkscape
+
+/*
+  Local Variables:
+  mode:c++
+  c-file-style:"stroustrup"
+  c-file-offsets:((innamespace . 0)(inline-open . 0)(case-label . +))
+  indent-tabs-mode:nil
+  fill-column:99
+  End:
+*/
+// vim: filetype=cpp:expandtab:shiftwidth=4:tabstop=8:softtabstop=4:fileencoding=utf-8:textwidth=99 :
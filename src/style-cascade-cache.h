@@ -0,0 +1,142 @@
+#ifndef SEEN_INKSCAPE_STYLE_CASCADE_CACHE_H
+#define SEEN_INKSCAPE_STYLE_CASCADE_CACHE_H
+
+/*
+ * Compiled selectors and matched declarations of the style sheets of a document
+ *
+ * Copyright (C) 2018 Authors
+ *
+ * Released under GNU GPL, read the file 'COPYING' for more information
+ */
+
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+#include <boost/utility.hpp>
+
+#include "libcroco/cr-sel-eng.h"
+
+namespace Inkscape {
+
+/**
+ * Style sheet declarations of a CRCascade that apply to XML nodes, as computed by
+ * cr_sel_eng_get_matched_properties_from_cascade(), without matching every selector
+ * against every node.
+ *
+ * The selectors of the cascade are compiled on first use, and indexed by the id, class
+ * or element name their rightmost compound requires. Selectors made of element names,
+ * classes and ids joined by descendant and child combinators are matched by the cache
+ * itself. For these, the result only depends on the element name, class attribute and
+ * (referenced) id of the node and its ancestors, so the declarations are computed once
+ * per distinct signature. Other selectors (attributes, pseudo-classes, sibling
+ * combinators) are matched per node by the selection engine and become part of the key.
+ *
+ * The order of declarations and the cascading rules (origin, !important, specificity of
+ * the last matching selector of a ruleset) are those of libcroco, so that styles do not
+ * change. The cache must be invalidated whenever a style sheet of the cascade changes.
+ */
+class StyleCascadeCache
+    : boost::noncopyable
+{
+public:
+    /// A declaration converted to a property id and value for SPStyle::readIfUnset()
+    struct Declaration {
+        unsigned prop_idx;
+        std::string value;
+    };
+
+    StyleCascadeCache(CRCascade *cascade, CRNodeIface const *node_iface);
+    ~StyleCascadeCache();
+
+    /**
+     * The declarations that apply to node, in the order they are to be read (earlier
+     * ones take precedence). The list stays valid until the next call.
+     */
+    std::vector<Declaration const *> const &match(CRSelEng *sel_eng, CRXMLNodePtr node);
+
+    /// Forgets the compiled selectors and matches; call after changing the cascade
+    void invalidate();
+
+private:
+    /// A simple selector: element name or universal selector, classes and ids
+    struct Compound {
+        bool type;          ///< TYPE_SELECTOR
+        bool universal;     ///< UNIVERSAL_SELECTOR
+        bool has_name;
+        bool has_add_sel;
+        std::string name;
+        std::vector<std::string> classes;
+        std::vector<std::string> ids;
+        int combinator;     ///< combinator with the preceding compound
+    };
+
+    /// One selector of a ruleset, in the order libcroco visits them
+    struct Rule {
+        CRStatement *stmt;
+        CRSimpleSel *sel;
+        unsigned occurrence; ///< visit of the ruleset
+        unsigned long specificity;
+        bool complex;
+        std::vector<Compound> compounds; ///< from left to right, only if !complex
+    };
+
+    typedef std::unordered_map<std::string, std::vector<unsigned> > Bucket;
+    struct Index {
+        Bucket ids;
+        Bucket classes;
+        Bucket names;
+        std::vector<unsigned> universal;
+    };
+
+    /// The attributes of a node the matches depend on
+    struct NodeData {
+        char const *name;
+        char *klass;
+        char *id;
+    };
+
+    void _compile();
+    void _visitSheet(CRStyleSheet *sheet, unsigned depth);
+    void _addRule(CRStatement *stmt, CRSimpleSel *sel, unsigned occurrence);
+    void _candidates(Index const &index, NodeData const &data, std::vector<unsigned> &rules) const;
+    void _appendSignature(NodeData const &data, std::string &key) const;
+    NodeData _nodeData(CRXMLNodePtr node) const;
+    void _freeNodeData(NodeData &data) const;
+    bool _matches(std::vector<Compound> const &compounds, int last, CRXMLNodePtr node) const;
+    bool _compoundMatches(Compound const &compound, CRXMLNodePtr node) const;
+    void _resolve(std::vector<unsigned> const &rules, std::vector<Declaration const *> &result);
+    Declaration const *_declaration(CRDeclaration const *decl);
+
+    static bool _classMatches(char const *klass, std::string const &name);
+    static unsigned long _specificity(CRSimpleSel const *sel);
+
+    CRCascade *_cascade;
+    CRNodeIface const *_node_iface;
+    bool _compiled;
+    std::vector<Rule> _rules;
+    Index _simple;
+    Index _complex;
+    unsigned _occurrences;
+    bool _ancestors;     ///< whether simple rules depend on ancestors
+    bool _classes;       ///< whether simple rules depend on classes
+    std::unordered_set<std::string> _ids; ///< ids referenced by simple rules
+    std::unordered_map<std::string, std::vector<Declaration const *> > _results;
+    std::unordered_map<CRDeclaration const *, Declaration> _declarations;
+    std::vector<Declaration const *> _none;
+};
+
+} // namespace Inkscape
+
+#endif // !SEEN_INKSCAPE_STYLE_CASCADE_CACHE_H
+
+/*
+  Local Variables:
+  mode:c++
+  c-file-style:"stroustrup"
+  c-file-offsets:((innamespace . 0)(inline-open . 0)(case-label . +))
+  indent-tabs-mode:nil
+  fill-column:99
+  End:
+*/
+// vim: filetype=cpp:expandtab:shiftwidth=4:tabstop=8:softtabstop=4:fileencoding=utf-8:textwidth=99 :
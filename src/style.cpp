@@ -43,6 +43,7 @@
 #include "uri-references.h"
 #include "uri.h"
 #include "sp-paint-server.h"
+#include "style-cascade-cache.h"
 #include "svg/css-ostringstream.h"
 #include "xml/simple-document.h"
 #include "util/units.h"
@@ -1181,20 +1182,6 @@ SPStyle::_mergeDecl(  CRDeclaration const *const decl, SPStyleSrc const &source
     }
 }
 
-void
-SPStyle::_mergeProps( CRPropList *const props ) {
-
-    // std::cout << "SPStyle::_mergeProps" << std::endl;
-
-    // In reverse order, as later declarations to take precedence over earlier ones.
-    if (props) {
-        _mergeProps( cr_prop_list_get_next( props ) );
-        CRDeclaration *decl = NULL;
-        cr_prop_list_get_decl(props, &decl);
-        _mergeDecl( decl, SP_STYLE_SRC_STYLE_SHEET );
-    }
-}
-
 void
 SPStyle::_mergeObjectStylesheet( SPObject const *const object ) {
 
@@ -1205,18 +1192,13 @@ SPStyle::_mergeObjectStylesheet( SPObject const *const object ) {
         sel_eng = sp_repr_sel_eng();
     }
 
-    CRPropList *props = NULL;
-
+    // Matches of the selectors are cached per document, for all objects that only differ in
+    // what no selector looks at.
     //XML Tree being directly used here while it shouldn't be.
-    CRStatus status = cr_sel_eng_get_matched_properties_from_cascade(sel_eng,
-                                                                     object->document->style_cascade,
-                                                                     object->getRepr(),
-                                                                     &props);
-    g_return_if_fail(status == CR_OK);
-    /// \todo Check what errors can occur, and handle them properly.
-    if (props) {
-        _mergeProps(props);
-        cr_prop_list_destroy(props);
+    std::vector<Inkscape::StyleCascadeCache::Declaration const *> const &decls =
+        object->document->getStyleCascadeCache().match(sel_eng, object->getRepr());
+    for (auto decl : decls) {
+        readIfUnset( decl->prop_idx, decl->value.c_str(), SP_STYLE_SRC_STYLE_SHEET );
     }
 }
 
@@ -67,7 +67,6 @@ private:
     void _mergeString( char const *const p );
     void _mergeDeclList( CRDeclaration const *const decl_list, SPStyleSrc const &source );
     void _mergeDecl(     CRDeclaration const *const decl,      SPStyleSrc const &source );
-    void _mergeProps( CRPropList *const props );
     void _mergeObjectStylesheet( SPObject const *const object );
 
 private:
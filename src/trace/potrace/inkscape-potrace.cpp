@@ -14,11 +14,19 @@
  *
  */
 
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
 #include "inkscape-potrace.h"
 
+#include <algorithm>
 #include <glibmm/i18n.h>
 #include <gtkmm/main.h>
 #include <iomanip>
+#if HAVE_OPENMP
+#include <omp.h>
+#endif
 
 #include "trace/filterset.h"
 #include "trace/quantize.h"
@@ -27,6 +35,7 @@
 #include <inkscape.h>
 #include "desktop.h"
 #include "message-stack.h"
+#include "preferences.h"
 #include <sp-path.h>
 #include <svg/path-string.h>
 #include "bitmap.h"
@@ -167,7 +176,7 @@ static long writePaths(PotraceTracingEngine *engine, potrace_path_t *plist,
 
         for (int i=0 ; i<curve->n ; i++)
             {
-            if (!engine->keepGoing)
+            if (!g_atomic_int_get(&engine->keepGoing))
                 return 0L;
             pt = curve->c[i];
             x0 = pt[0].x;
@@ -202,6 +211,50 @@ static long writePaths(PotraceTracingEngine *engine, potrace_path_t *plist,
 }
 
 
+/**
+ * Makes the pixels of gm with a brightness from floor up to cutoff black,
+ * and the others white.
+ */
+static GrayMap *brightnessBand(GrayMap *gm, double brightnessFloor, double brightnessThreshold)
+{
+    GrayMap *newGm = GrayMapCreate(gm->width, gm->height);
+    if (!newGm)
+        return NULL;
+
+    double floor =  3.0 *
+           ( brightnessFloor * 256.0 );
+    double cutoff =  3.0 *
+           ( brightnessThreshold * 256.0 );
+    for (int y=0 ; y<gm->height ; y++)
+        {
+        for (int x=0 ; x<gm->width ; x++)
+            {
+            double brightness = (double)gm->getPixel(gm, x, y);
+            if (brightness >= floor && brightness < cutoff)
+                newGm->setPixel(newGm, x, y, GRAYMAP_BLACK);  //black pixel
+            else
+                newGm->setPixel(newGm, x, y, GRAYMAP_WHITE); //white pixel
+            }
+        }
+
+    return newGm;
+}
+
+
+static void invertGrayMap(GrayMap *gm)
+{
+    for (int y=0 ; y<gm->height ; y++)
+        {
+        for (int x=0 ; x<gm->width ; x++)
+            {
+            unsigned long brightness = gm->getPixel(gm, x, y);
+            brightness = 765 - brightness;
+            gm->setPixel(gm, x, y, brightness);
+            }
+        }
+}
+
+
 static GrayMap *filter(PotraceTracingEngine &engine, GdkPixbuf * pixbuf)
 {
     if (!pixbuf)
@@ -226,22 +279,8 @@ static GrayMap *filter(PotraceTracingEngine &engine, GdkPixbuf * pixbuf)
         {
         GrayMap *gm = gdkPixbufToGrayMap(pixbuf);
 
-        newGm = GrayMapCreate(gm->width, gm->height);
-        double floor =  3.0 *
-               ( engine.getBrightnessFloor() * 256.0 );
-        double cutoff =  3.0 *
-               ( engine.getBrightnessThreshold() * 256.0 );
-        for (int y=0 ; y<gm->height ; y++)
-            {
-            for (int x=0 ; x<gm->width ; x++)
-                {
-                double brightness = (double)gm->getPixel(gm, x, y);
-                if (brightness >= floor && brightness < cutoff)
-                    newGm->setPixel(newGm, x, y, GRAYMAP_BLACK);  //black pixel
-                else
-                    newGm->setPixel(newGm, x, y, GRAYMAP_WHITE); //white pixel
-                }
-            }
+        newGm = brightnessBand(gm, engine.getBrightnessFloor(),
+                               engine.getBrightnessThreshold());
 
         gm->destroy(gm);
         //newGm->writePPM(newGm, "brightness.ppm");
@@ -261,15 +300,7 @@ static GrayMap *filter(PotraceTracingEngine &engine, GdkPixbuf * pixbuf)
     /*### Do I invert the image? ###*/
     if (newGm && engine.getInvert())
         {
-        for (int y=0 ; y<newGm->height ; y++)
-            {
-            for (int x=0 ; x<newGm->width ; x++)
-                {
-                unsigned long brightness = newGm->getPixel(newGm, x, y);
-                brightness = 765 - brightness;
-                newGm->setPixel(newGm, x, y, brightness);
-                }
-            }
+        invertGrayMap(newGm);
         }
 
     return newGm;//none of the above
@@ -350,12 +381,19 @@ PotraceTracingEngine::preview(Glib::RefPtr<Gdk::Pixbuf> thePixbuf)
 
 
 //*This is the core inkscape-to-potrace binding
-std::string PotraceTracingEngine::grayMapToPath(GrayMap *grayMap, long *nodeCount)
+std::string PotraceTracingEngine::grayMapToPath(GrayMap *grayMap, long *nodeCount,
+                                                potrace_param_t const *params)
+{
+    return stateToPath(grayMapToState(grayMap, params), nodeCount);
+}
+
+
+potrace_state_t *PotraceTracingEngine::grayMapToState(GrayMap *grayMap, potrace_param_t const *params)
 {
-    if (!keepGoing)
+    if (!g_atomic_int_get(&keepGoing))
     {
         g_warning("aborted");
-        return "";
+        return NULL;
     }
 
     potrace_bitmap_t *potraceBitmap = bm_new(grayMap->width, grayMap->height);
@@ -379,19 +417,28 @@ std::string PotraceTracingEngine::grayMapToPath(GrayMap *grayMap, long *nodeCoun
     */
 
     /* trace a bitmap*/
-    potrace_state_t *potraceState = potrace_trace(potraceParams,
+    potrace_state_t *potraceState = potrace_trace(params ? params : potraceParams,
                                                   potraceBitmap);
 
     //## Free the Potrace bitmap
     bm_free(potraceBitmap);
 
-    if (!keepGoing)
+    if (!g_atomic_int_get(&keepGoing))
         {
         g_warning("aborted");
         potrace_state_free(potraceState);
-        return "";
+        return NULL;
         }
 
+    return potraceState;
+}
+
+
+std::string PotraceTracingEngine::stateToPath(potrace_state_t *potraceState, long *nodeCount)
+{
+    if (!potraceState)
+        return "";
+
     Inkscape::SVG::PathString data;
 
     //## copy the path information into our d="" attribute string
@@ -401,7 +448,7 @@ std::string PotraceTracingEngine::grayMapToPath(GrayMap *grayMap, long *nodeCoun
     /* free a potrace items */
     potrace_state_free(potraceState);
 
-    if (!keepGoing)
+    if (!g_atomic_int_get(&keepGoing))
         return "";
 
     if ( nodeCount)
@@ -467,6 +514,85 @@ std::vector<TracingEngineResult> PotraceTracingEngine::traceGrayMap(GrayMap *gra
     return results;
 }
 
+/**
+ *  Traces the layers of a multiple scan.  The gray map of each layer is made
+ *  by makeGrayMap and traced by one of several threads, so makeGrayMap must
+ *  only read shared data.  Meanwhile the calling thread keeps the GUI going,
+ *  so that the trace can be aborted, and writes the path data of each layer
+ *  and calls finished for it in order, as soon as it and all layers before
+ *  it are traced.  The layers that were not traced yet when aborting are
+ *  left empty.
+ */
+void PotraceTracingEngine::traceLayers(std::vector<Layer> &layers,
+                                       std::function<GrayMap *(int)> const &makeGrayMap,
+                                       std::function<void (int)> const &finished)
+{
+    int count = layers.size();
+#if HAVE_OPENMP
+    Inkscape::Preferences *prefs = Inkscape::Preferences::get();
+    int threads = prefs->getIntLimited("/options/threading/numthreads", omp_get_num_procs(), 1, 256);
+#else
+    int threads = 1;
+#endif
+    threads = std::min(threads, count);
+
+    if (threads <= 1) {
+        for (int i = 0; i < count; i++) {
+            GrayMap *grayMap = makeGrayMap(i);
+            if (grayMap) {
+                layers[i].d = grayMapToPath(grayMap, &layers[i].nodeCount);
+                grayMap->destroy(grayMap);
+            }
+            finished(i);
+        }
+        return;
+    }
+
+#if HAVE_OPENMP
+    // the progress callback updates the GUI, which only the calling thread may do
+    potrace_param_t params = *potraceParams;
+    params.progress.callback = NULL;
+
+    std::vector<gint> done(count, 0);
+    gint next = 0;
+    int reported = 0;
+
+#pragma omp parallel num_threads(threads + 1)
+    {
+        if (omp_get_thread_num() == 0 && omp_get_num_threads() > 1) {
+            for (; reported < count; reported++) {
+                while (!g_atomic_int_get(&done[reported])) {
+                    updateGui();
+                    g_usleep(10000);
+                }
+                Layer &layer = layers[reported];
+                layer.d = stateToPath(layer.state, &layer.nodeCount);
+                layer.state = NULL;
+                finished(reported);
+            }
+        } else {
+            for (int i = g_atomic_int_add(&next, 1); i < count; i = g_atomic_int_add(&next, 1)) {
+                GrayMap *grayMap = g_atomic_int_get(&keepGoing) ? makeGrayMap(i) : NULL;
+                if (grayMap) {
+                    layers[i].state = grayMapToState(grayMap, &params);
+                    grayMap->destroy(grayMap);
+                }
+                g_atomic_int_set(&done[i], 1);
+            }
+        }
+    }
+
+    // when the calling thread got no helpers it traced everything itself
+    for (; reported < count; reported++) {
+        Layer &layer = layers[reported];
+        layer.d = stateToPath(layer.state, &layer.nodeCount);
+        layer.state = NULL;
+        finished(reported);
+    }
+#endif
+}
+
+
 /**
  *  Called for multiple-scanning algorithms
  */
@@ -479,41 +605,74 @@ std::vector<TracingEngineResult> PotraceTracingEngine::traceBrightnessMulti(GdkP
         double high    = 0.9; //top of range
         double delta   = (high - low ) / ((double)multiScanNrColors);
 
-        brightnessFloor = 0.0; //Set bottom to black
+        GrayMap *gm = gdkPixbufToGrayMap(thePixbuf);
+        if ( !gm ) {
+            return results;
+        }
 
-        int traceCount = 0;
+        std::vector<double> thresholds;
+        for (double threshold = low ; threshold <= high ; threshold += delta) {
+            thresholds.push_back(threshold);
+        }
 
-        for ( brightnessThreshold = low ;
-              brightnessThreshold <= high ;
-              brightnessThreshold += delta) {
-            GrayMap *grayMap = filter(*this, thePixbuf);
-            if ( grayMap ) {
-                long nodeCount = 0L;
-                std::string d = grayMapToPath(grayMap, &nodeCount);
+        // Unless stacked, each scan starts at the threshold of the last scan
+        // that was not empty.  Scans are traced assuming none is, and traced
+        // again in the rare case a scan below turns out to be empty.
+        std::vector<double> floors(thresholds.size(), 0.0); //Set bottom to black
+        if (!multiScanStack) {
+            for (unsigned i = 1 ; i < thresholds.size() ; i++) {
+                floors[i] = thresholds[i - 1];
+            }
+        }
 
-                grayMap->destroy(grayMap);
+        bool invertGm = invert;
+        auto makeBand = [gm, invertGm](double floor, double threshold) {
+            GrayMap *band = brightnessBand(gm, floor, threshold);
+            if (band && invertGm) {
+                invertGrayMap(band);
+            }
+            return band;
+        };
 
-                if ( !d.empty() ) {
-                    //### get style info
-                    int grayVal = (int)(256.0 * brightnessThreshold);
-                    ustring style = ustring::compose("fill-opacity:1.0;fill:#%1%2%3", twohex(grayVal), twohex(grayVal), twohex(grayVal) );
+        std::vector<Layer> layers(thresholds.size());
+        double floor = 0.0;
+        int traceCount = 0;
+        traceLayers(layers,
+                    [&](int i) { return makeBand(floors[i], thresholds[i]); },
+                    [&](int i) {
+            Layer &layer = layers[i];
+            if (floors[i] != floor) {
+                GrayMap *band = makeBand(floor, thresholds[i]);
+                if (band) {
+                    layer.d = grayMapToPath(band, &layer.nodeCount);
+                    band->destroy(band);
+                }
+            }
 
-                    //g_message("### GOT '%s' \n", style.c_str());
-                    TracingEngineResult result(style, d, nodeCount);
-                    results.push_back(result);
+            if ( !layer.d.empty() ) {
+                //### get style info
+                int grayVal = (int)(256.0 * thresholds[i]);
+                ustring style = ustring::compose("fill-opacity:1.0;fill:#%1%2%3", twohex(grayVal), twohex(grayVal), twohex(grayVal) );
 
-                    if (!multiScanStack) {
-                        brightnessFloor = brightnessThreshold;
-                    }
+                //g_message("### GOT '%s' \n", style.c_str());
+                TracingEngineResult result(style, layer.d, layer.nodeCount);
+                results.push_back(result);
 
-                    SPDesktop *desktop = SP_ACTIVE_DESKTOP;
-                    if (desktop) {
-                        ustring msg = ustring::compose(_("Trace: %1.  %2 nodes"), traceCount++, nodeCount);
-                        desktop->getMessageStack()->flash(Inkscape::NORMAL_MESSAGE, msg);
-                    }
+                if (!multiScanStack) {
+                    floor = thresholds[i];
+                }
+
+                SPDesktop *desktop = SP_ACTIVE_DESKTOP;
+                if (desktop) {
+                    ustring msg = ustring::compose(_("Trace: %1.  %2 nodes"), traceCount++, layer.nodeCount);
+                    desktop->getMessageStack()->flash(Inkscape::NORMAL_MESSAGE, msg);
                 }
             }
-        }
+            // the trace of the layer is no longer needed
+            layer = Layer();
+        });
+
+        gm->destroy(gm);
 
         //# Remove the bottom-most scan, if requested
         if (results.size() > 1 && multiScanRemoveBackground) {
@@ -535,49 +694,49 @@ std::vector<TracingEngineResult> PotraceTracingEngine::traceQuant(GdkPixbuf * th
     if (thePixbuf) {
         IndexedMap *iMap = filterIndexed(*this, thePixbuf);
         if ( iMap ) {
-            //Create and clear a gray map
-            GrayMap *gm = GrayMapCreate(iMap->width, iMap->height);
-            for (int row=0 ; row<gm->height ; row++) {
-                for (int col=0 ; col<gm->width ; col++) {
-                    gm->setPixel(gm, col, row, GRAYMAP_WHITE);
+            // Make a gray map for each color index, which also has the
+            // colors below it when stacking
+            bool stack = multiScanStack;
+            auto makeGrayMap = [iMap, stack](int colorIndex) {
+                GrayMap *gm = GrayMapCreate(iMap->width, iMap->height);
+                if (!gm) {
+                    return gm;
                 }
-            }
-
-            for (int colorIndex=0 ; colorIndex<iMap->nrColors ; colorIndex++) {
-                // Make a gray map for each color index
                 for (int row=0 ; row<iMap->height ; row++) {
                     for (int col=0 ; col<iMap->width ; col++) {
                         int indx = (int) iMap->getPixel(iMap, col, row);
-                        if (indx == colorIndex) {
+                        if (indx == colorIndex || (stack && indx < colorIndex)) {
                             gm->setPixel(gm, col, row, GRAYMAP_BLACK); //black
-                        } else if (!multiScanStack) {
+                        } else {
                             gm->setPixel(gm, col, row, GRAYMAP_WHITE); //white
                         }
                     }
                 }
+                return gm;
+            };
 
-                //## Now we have a traceable graymap
-                long nodeCount = 0L;
-                std::string d = grayMapToPath(gm, &nodeCount);
-
-                if ( !d.empty() ) {
+            std::vector<Layer> layers(iMap->nrColors);
+            traceLayers(layers, makeGrayMap, [&](int colorIndex) {
+                Layer &layer = layers[colorIndex];
+                if ( !layer.d.empty() ) {
                     //### get style info
                     RGB rgb = iMap->clut[colorIndex];
                     ustring style = ustring::compose("fill:#%1%2%3", twohex(rgb.r), twohex(rgb.g), twohex(rgb.b) );
 
                     //g_message("### GOT '%s' \n", style.c_str());
-                    TracingEngineResult result(style, d, nodeCount);
+                    TracingEngineResult result(style, layer.d, layer.nodeCount);
                     results.push_back(result);
 
                     SPDesktop *desktop = SP_ACTIVE_DESKTOP;
                     if (desktop) {
-                        ustring msg = ustring::compose(_("Trace: %1.  %2 nodes"), colorIndex, nodeCount);
+                        ustring msg = ustring::compose(_("Trace: %1.  %2 nodes"), colorIndex, layer.nodeCount);
                         desktop->getMessageStack()->flash(Inkscape::NORMAL_MESSAGE, msg);
                     }
                 }
-            }// for colorIndex
+                // the trace of the layer is no longer needed
+                layer = Layer();
+            });
 
-            gm->destroy(gm);
             iMap->destroy(iMap);
         }
 
@@ -604,7 +763,7 @@ PotraceTracingEngine::trace(Glib::RefPtr<Gdk::Pixbuf> pixbuf)
     GdkPixbuf *thePixbuf = pixbuf->gobj();
 
     //Set up for messages
-    keepGoing             = 1;
+    g_atomic_int_set(&keepGoing, 1);
 
     if ( traceType == TRACE_QUANT_COLOR ||
          traceType == TRACE_QUANT_MONO   )
@@ -628,7 +787,7 @@ PotraceTracingEngine::trace(Glib::RefPtr<Gdk::Pixbuf> pixbuf)
 void PotraceTracingEngine::abort()
 {
     //g_message("PotraceTracingEngine::abort()\n");
-    keepGoing = 0;
+    g_atomic_int_set(&keepGoing, 0);
 }
 
 
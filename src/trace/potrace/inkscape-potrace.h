@@ -17,6 +17,7 @@
 #ifndef __INKSCAPE_POTRACE_H__
 #define __INKSCAPE_POTRACE_H__
 
+#include <functional>
 #include <trace/trace.h>
 #include <potracelib.h>
 
@@ -233,9 +234,10 @@ class PotraceTracingEngine : public TracingEngine
     Glib::RefPtr<Gdk::Pixbuf> preview(Glib::RefPtr<Gdk::Pixbuf> pixbuf);
 
     /**
-     *
+     * Cleared to abort the trace. Read by tracing threads, so access it
+     * with g_atomic_int_get() and g_atomic_int_set().
      */
-    int keepGoing;
+    gint keepGoing;
 
     std::vector<TracingEngineResult>traceGrayMap(GrayMap *grayMap);
 
@@ -266,8 +268,41 @@ class PotraceTracingEngine : public TracingEngine
     /**
      * This is the actual wrapper of the call to Potrace.  nodeCount
      * returns the count of nodes created.  May be NULL if ignored.
+     * Uses potraceParams unless other params are given.
+     */
+    std::string grayMapToPath(GrayMap *gm, long *nodeCount,
+                              potrace_param_t const *params = NULL);
+
+    /**
+     * The part of grayMapToPath() which may run on any thread: traces gm
+     * with Potrace. Returns NULL if aborted.
+     */
+    potrace_state_t *grayMapToState(GrayMap *gm, potrace_param_t const *params = NULL);
+
+    /**
+     * The part of grayMapToPath() which must run on the calling thread, since
+     * writing path data reads the preferences. Frees state.
+     */
+    std::string stateToPath(potrace_state_t *state, long *nodeCount);
+
+    /**
+     * One scan of a multiple scan trace
+     */
+    struct Layer
+        {
+        Layer() : state(NULL), nodeCount(0L) {}
+        potrace_state_t *state; ///< traced, but not yet written to d
+        std::string d;
+        long nodeCount;
+        };
+
+    /**
+     * Traces the gray maps makeGrayMap makes for each layer, several
+     * at a time, and calls finished for each layer in order.
      */
-    std::string grayMapToPath(GrayMap *gm, long *nodeCount);
+    void traceLayers(std::vector<Layer> &layers,
+                     std::function<GrayMap *(int)> const &makeGrayMap,
+                     std::function<void (int)> const &finished);
 
     std::vector<TracingEngineResult>traceBrightnessMulti(GdkPixbuf *pixbuf);
     std::vector<TracingEngineResult>traceQuant(GdkPixbuf *pixbuf);
@@ -34,6 +34,7 @@
 #include "style.h"
 #include "selection.h"
 #include "selection-chemistry.h"
+#include "splivarot.h"
 #include "ui/widget/style-swatch.h"
 #include "display/nr-filter-gaussian.h"
 #include "cms-system.h"
@@ -1161,6 +1162,14 @@ void InkscapePreferences::initPageBehavior()
     _page_behavior.add_line( false, _("_Simplification threshold:"), _misc_simpl, "",
                            _("How strong is the Node tool's Simplify command by default. If you invoke this command several times in quick succession, it will act more and more aggressively; invoking it again after a pause restores the default threshold."), false);
 
+    {
+        Glib::ustring labels[] = {_("Livarot (polygons)"), _("2Geom (exact curves)")};
+        int values[] = {BOOLOP_ENGINE_LIVAROT, BOOLOP_ENGINE_2GEOM};
+        _misc_boolops_engine.init("/options/boolops/engine", labels, values, G_N_ELEMENTS(values), BOOLOP_ENGINE_LIVAROT);
+        _page_behavior.add_line( false, _("_Boolean operations:"), _misc_boolops_engine, "",
+                               _("Livarot flattens paths to polygons and fits curves to the result. 2Geom intersects the curves directly and keeps them, and uses Livarot for paths that cross themselves or overlap along a segment."), false);
+    }
+
     _markers_color_stock.init ( _("Color stock markers the same color as object"), "/options/markers/colorStockMarkers", true);
     _markers_color_custom.init ( _("Color custom markers the same color as object"), "/options/markers/colorCustomMarkers", false);
     _markers_color_update.init ( _("Update marker color when object color changes"), "/options/markers/colorUpdateMarkers", true);
@@ -1410,10 +1419,26 @@ void InkscapePreferences::initPageRendering()
     _rendering_cache_size.init("/options/renderingcache/size", 0.0, 4096.0, 1.0, 32.0, 64.0, true, false);
     _page_rendering.add_line( false, _("Rendering _cache size:"), _rendering_cache_size, C_("mebibyte (2^20 bytes) abbreviation","MiB"), _("Set the amount of memory per document which can be used to store rendered parts of the drawing for later reuse; set to zero to disable caching"), false);
 
+    // filter result cache
+    _rendering_filter_cache_size.init("/options/renderingcache/filtersize", 0.0, 4096.0, 1.0, 32.0, 32.0, true, false);
+    _page_rendering.add_line( false, _("_Filter cache size:"), _rendering_filter_cache_size, C_("mebibyte (2^20 bytes) abbreviation","MiB"), _("Set the amount of memory per document which can be used to store the results of filters, so that scrolling and unrelated edits do not render them again; set to zero to disable caching"), false);
+
+    // glyph raster cache
+    _rendering_glyph_cache_size.init("/options/renderingcache/glyphs", 0.0, 4096.0, 1.0, 4.0, 4.0, true, false);
+    _page_rendering.add_line( false, _("_Glyph cache size:"), _rendering_glyph_cache_size, C_("mebibyte (2^20 bytes) abbreviation","MiB"), _("Set the amount of memory per document which can be used to keep rasterized glyphs of small text, so that they are not filled from their outlines on every redraw; set to zero to disable caching"), false);
+
+    // canvas tile cache
+    _rendering_tile_cache_size.init("/options/renderingcache/tiles", 0.0, 4096.0, 1.0, 32.0, 32.0, true, false);
+    _page_rendering.add_line( false, _("_Zoom cache size:"), _rendering_tile_cache_size, C_("mebibyte (2^20 bytes) abbreviation","MiB"), _("Set the amount of memory per window which can be used to keep rendered parts of the canvas at recently used zoom levels, so that zooming back or scrolling over them does not render them again; set to zero to disable caching"), false);
+
     // rendering tile multiplier
     _rendering_tile_multiplier.init("/options/rendering/tile-multiplier", 1.0, 64.0, 1.0, 4.0, 1.0, true, false);
     _page_rendering.add_line( false, _("Rendering tile multiplier:"), _rendering_tile_multiplier, _("requires restart"), _("Set the relative size of tiles used to render the canvas. The larger the value, the bigger the tile size."), false);
 
+    // background rendering
+    _rendering_background.init( _("Render in the background"), "/options/rendering/background", false);
+    _page_rendering.add_line( false, "", _rendering_background, "", _("Render the canvas on a separate thread, so that the interface stays responsive while complex drawings are rendered; parts which are not rendered yet show a scaled copy of the previous view"), false);
+
     /* blur quality */
     _blur_quality_best.init ( _("Best quality (slowest)"), "/options/blurquality/value",
                                   BLUR_QUALITY_BEST, false, 0);
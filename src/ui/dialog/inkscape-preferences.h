@@ -295,7 +295,11 @@ protected:
     UI::Widget::PrefCombo       _switcher_style;
     UI::Widget::PrefCheckButton _rendering_image_outline;
     UI::Widget::PrefSpinButton  _rendering_cache_size;
+    UI::Widget::PrefSpinButton  _rendering_filter_cache_size;
+    UI::Widget::PrefSpinButton  _rendering_glyph_cache_size;
+    UI::Widget::PrefSpinButton  _rendering_tile_cache_size;
     UI::Widget::PrefSpinButton  _rendering_tile_multiplier;
+    UI::Widget::PrefCheckButton _rendering_background;
     UI::Widget::PrefSpinButton  _filter_multi_threaded;
 
     UI::Widget::PrefCheckButton _trans_scale_stroke;
@@ -340,6 +344,7 @@ protected:
     // System page
     UI::Widget::PrefSpinButton  _misc_latency_skew;
     UI::Widget::PrefSpinButton  _misc_simpl;
+    UI::Widget::PrefCombo       _misc_boolops_engine;
     Gtk::Entry                  _sys_user_prefs;
     Gtk::Entry                  _sys_tmp_files;
     Gtk::Entry                  _sys_extension_dir;
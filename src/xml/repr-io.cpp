@@ -14,11 +14,21 @@
 #include <config.h>
 #endif
 
+#include <algorithm>
 #include <cstring>
+#include <deque>
+#include <map>
 #include <string>
 #include <stdexcept>
+#include <utility>
+#include <vector>
 
+#include <glibmm/threads.h>
 #include <libxml/parser.h>
+#include <zlib.h>
+#if HAVE_OPENMP
+#include <omp.h>
+#endif
 
 #include "xml/repr.h"
 #include "xml/attribute-record.h"
@@ -26,6 +36,8 @@
 #include "xml/simple-document.h"
 #include "xml/text-node.h"
 
+#include "inkgc/gc-alloc.h"
+
 #include "io/sys.h"
 #include "io/uristream.h"
 #include "io/stringstream.h"
@@ -51,6 +63,7 @@ using Inkscape::XML::calc_abs_doc_base;
 using Inkscape::XML::rebase_href_attrs;
 
 Document *sp_repr_do_read (xmlDocPtr doc, const gchar *default_ns);
+static Document *sp_repr_finish_read (Document *rdoc, Node *root, const gchar *default_ns);
 static Node *sp_repr_svg_read_node (Document *xml_doc, xmlNodePtr node, const gchar *default_ns, std::map<std::string, std::string> &prefix_map);
 static gint sp_repr_qualified_name (gchar *p, gint len, xmlNsPtr ns, const xmlChar *name, const gchar *default_ns, std::map<std::string, std::string> &prefix_map);
 static void sp_repr_write_stream_root_element(Node *repr, Writer &out,
@@ -58,6 +71,8 @@ static void sp_repr_write_stream_root_element(Node *repr, Writer &out,
                                               int inlineattrs, int indent,
                                               gchar const *old_href_abs_base,
                                               gchar const *new_href_abs_base);
+static List<AttributeRecord const> sp_repr_prepare_root_element(Node *repr, gchar const *default_ns,
+                                                                Glib::QueryQuark &elide_prefix);
 
 static void sp_repr_write_stream_element(Node *repr, Writer &out,
                                          gint indent_level, bool add_whitespace,
@@ -99,7 +114,7 @@ public:
 
     int setFile( char const * filename, bool load_entities );
 
-    xmlDocPtr readXml();
+    Document *readXml(const gchar *default_ns);
 
     static int readCb( void * context, char * buffer, int len );
     static int closeCb( void * context );
@@ -121,6 +136,331 @@ private:
     Inkscape::IO::GzipInputStream* gzin;
 };
 
+namespace {
+
+/**
+ * Builds a Document directly from the SAX2 events of libxml2, instead of letting libxml2
+ * build its own tree first and copying that in sp_repr_do_read(). The result is the same:
+ * adjacent character data is merged into one text node, all-whitespace text is dropped,
+ * comments and processing instructions in the DTD are skipped, and entity references that
+ * are not substituted become elements named after the entity.
+ *
+ * Only the handlers for the document content are replaced; the default handlers still
+ * record the DTD and entity declarations in a libxml2 document without any elements.
+ */
+class SaxBuilder
+{
+public:
+    SaxBuilder();
+    ~SaxBuilder();
+
+    /// The parser context to read with, or NULL if it could not be allocated
+    xmlParserCtxtPtr context() { return _ctxt; }
+    Document *finish(xmlDocPtr doc, const gchar *default_ns);
+
+private:
+    static SaxBuilder *_get(void *ctx);
+    static void _startElement(void *ctx, const xmlChar *localname, const xmlChar *prefix,
+                              const xmlChar *uri, int nb_namespaces, const xmlChar **namespaces,
+                              int nb_attributes, int nb_defaulted, const xmlChar **attributes);
+    static void _endElement(void *ctx, const xmlChar *localname, const xmlChar *prefix,
+                            const xmlChar *uri);
+    static void _characters(void *ctx, const xmlChar *ch, int len);
+    static void _cdataBlock(void *ctx, const xmlChar *value, int len);
+    static void _comment(void *ctx, const xmlChar *value);
+    static void _processingInstruction(void *ctx, const xmlChar *target, const xmlChar *data);
+    static void _reference(void *ctx, const xmlChar *name);
+
+    void _setAttribute(Node *repr, const xmlChar **attribute);
+    void _addText(const xmlChar *text, int len, bool cdata);
+    void _flushText();
+    void _append(Node *node);
+    const gchar *_qualifiedName(const xmlChar *localname, const xmlChar *prefix, const xmlChar *uri);
+
+    /// An element whose end has not been read yet
+    struct OpenElement {
+        Node *node;
+        /// Whether xml:space="preserve" is in effect for its content
+        bool preserve_space;
+    };
+
+    xmlParserCtxtPtr _ctxt;
+    Document *_doc;
+    Node *_root;
+    int _root_elements;
+    std::vector<OpenElement> _open;
+    std::string _text;
+    bool _text_is_cdata;
+    std::string _value;
+    gchar _name[256];
+    /// Namespace URIs seen so far with their prefix from sp_xml_ns_uri_prefix()
+    std::vector<std::pair<std::string, const gchar *> > _prefixes;
+};
+
+SaxBuilder::SaxBuilder()
+    : _ctxt(xmlNewParserCtxt()),
+      _doc(new Inkscape::XML::SimpleDocument()),
+      _root(NULL),
+      _root_elements(0),
+      _text_is_cdata(false)
+{
+    if (_ctxt) {
+        // the callbacks get the context, which the default handlers need as well
+        _ctxt->_private = this;
+        xmlSAXHandlerPtr sax = _ctxt->sax;
+        sax->startElementNs = _startElement;
+        sax->endElementNs = _endElement;
+        sax->characters = _characters;
+        sax->ignorableWhitespace = _characters;
+        sax->cdataBlock = _cdataBlock;
+        sax->comment = _comment;
+        sax->processingInstruction = _processingInstruction;
+        sax->reference = _reference;
+    }
+}
+
+SaxBuilder::~SaxBuilder()
+{
+    if (_ctxt) {
+        xmlFreeParserCtxt(_ctxt);
+    }
+    if (_doc) {
+        Inkscape::GC::release(_doc);
+    }
+}
+
+/**
+ * Takes the libxml2 document returned by the read function of the context, and returns
+ * the Document built while reading, or NULL if nothing could be read.
+ */
+Document *SaxBuilder::finish(xmlDocPtr doc, const gchar *default_ns)
+{
+    if (doc) {
+        xmlFreeDoc(doc);
+    }
+    if (doc == NULL || _root_elements == 0) {
+        return NULL;
+    }
+
+    Document *rdoc = _doc;
+    _doc = NULL;
+    return sp_repr_finish_read(rdoc, _root_elements == 1 ? _root : NULL, default_ns);
+}
+
+/**
+ * Returns the builder for the callbacks that should add to the document. The content of
+ * entities is parsed in a context of its own; it is only added if entities are substituted.
+ */
+SaxBuilder *SaxBuilder::_get(void *ctx)
+{
+    SaxBuilder *self = static_cast<SaxBuilder *>(static_cast<xmlParserCtxtPtr>(ctx)->_private);
+    if (ctx != self->_ctxt && !self->_ctxt->replaceEntities) {
+        return NULL;
+    }
+    return self;
+}
+
+void SaxBuilder::_startElement(void *ctx, const xmlChar *localname, const xmlChar *prefix,
+                               const xmlChar *uri, int /*nb_namespaces*/, const xmlChar ** /*namespaces*/,
+                               int nb_attributes, int /*nb_defaulted*/, const xmlChar **attributes)
+{
+    SaxBuilder *self = _get(ctx);
+    if (!self) {
+        return;
+    }
+    self->_flushText();
+
+    Node *repr = self->_doc->createElement(self->_qualifiedName(localname, prefix, uri));
+    for (int i = 0; i < nb_attributes; ++i) {
+        self->_setAttribute(repr, attributes + 5 * i);
+    }
+
+    OpenElement element = { repr, false };
+    if (self->_open.empty()) {
+        self->_root = repr;
+        self->_root_elements++;
+    } else {
+        element.preserve_space = self->_open.back().preserve_space;
+    }
+    const gchar *space = repr->attribute("xml:space");
+    if (space) {
+        if (!strcmp(space, "preserve")) {
+            element.preserve_space = true;
+        } else if (!strcmp(space, "default")) {
+            element.preserve_space = false;
+        }
+    }
+    self->_append(repr);
+    self->_open.push_back(element);
+}
+
+void SaxBuilder::_endElement(void *ctx, const xmlChar * /*localname*/, const xmlChar * /*prefix*/,
+                             const xmlChar * /*uri*/)
+{
+    SaxBuilder *self = _get(ctx);
+    if (!self) {
+        return;
+    }
+    self->_flushText();
+    if (!self->_open.empty()) {
+        self->_open.pop_back();
+    }
+}
+
+void SaxBuilder::_characters(void *ctx, const xmlChar *ch, int len)
+{
+    SaxBuilder *self = _get(ctx);
+    if (self) {
+        self->_addText(ch, len, false);
+    }
+}
+
+void SaxBuilder::_cdataBlock(void *ctx, const xmlChar *value, int len)
+{
+    SaxBuilder *self = _get(ctx);
+    if (self) {
+        self->_addText(value, len, true);
+    }
+}
+
+void SaxBuilder::_comment(void *ctx, const xmlChar *value)
+{
+    SaxBuilder *self = _get(ctx);
+    if (!self || static_cast<xmlParserCtxtPtr>(ctx)->inSubset) {
+        return;
+    }
+    self->_flushText();
+    self->_append(self->_doc->createComment(reinterpret_cast<const gchar *>(value)));
+}
+
+void SaxBuilder::_processingInstruction(void *ctx, const xmlChar *target, const xmlChar *data)
+{
+    SaxBuilder *self = _get(ctx);
+    if (!self || static_cast<xmlParserCtxtPtr>(ctx)->inSubset) {
+        return;
+    }
+    self->_flushText();
+    self->_append(self->_doc->createPI(reinterpret_cast<const gchar *>(target),
+                                       reinterpret_cast<const gchar *>(data)));
+}
+
+void SaxBuilder::_reference(void *ctx, const xmlChar *name)
+{
+    SaxBuilder *self = _get(ctx);
+    if (!self || self->_open.empty()) {
+        return;
+    }
+    self->_flushText();
+    Node *repr = self->_doc->createElement(reinterpret_cast<const gchar *>(name));
+    xmlEntityPtr entity = xmlGetDocEntity(self->_ctxt->myDoc, name);
+    if (entity && entity->content) {
+        repr->setContent(reinterpret_cast<const gchar *>(entity->content));
+    }
+    self->_append(repr);
+}
+
+/**
+ * Sets an attribute given as (localname, prefix, URI, value, end of value).
+ */
+void SaxBuilder::_setAttribute(Node *repr, const xmlChar **attribute)
+{
+    const xmlChar *value = attribute[3];
+    int len = attribute[4] - value;
+    const gchar *name = _qualifiedName(attribute[0], attribute[1], attribute[2]);
+
+    if (!_ctxt->replaceEntities && memchr(value, '&', len)) {
+        // references are left in the value; the tree of libxml2 has the text up to the
+        // first entity that is not predefined
+        xmlNodePtr list = xmlStringLenGetNodeList(_ctxt->myDoc, value, len);
+        if (list) {
+            repr->setAttribute(name, reinterpret_cast<const gchar *>(list->content));
+            xmlFreeNodeList(list);
+        }
+        return;
+    }
+    _value.assign(reinterpret_cast<const char *>(value), len);
+    repr->setAttribute(name, _value.c_str());
+}
+
+/**
+ * Character data arrives in pieces, so it is collected until some other event comes.
+ */
+void SaxBuilder::_addText(const xmlChar *text, int len, bool cdata)
+{
+    if (_open.empty()) {
+        return; // no text outside of the root
+    }
+    if (cdata != _text_is_cdata) {
+        _flushText();
+        _text_is_cdata = cdata;
+    }
+    _text.append(reinterpret_cast<const char *>(text), len);
+}
+
+/**
+ * Adds the collected text, unless it is only whitespace outside of xml:space="preserve".
+ */
+void SaxBuilder::_flushText()
+{
+    if (_text.empty()) {
+        return;
+    }
+    const char *p = _text.c_str();
+    if (!_open.back().preserve_space) {
+        while (*p && g_ascii_isspace(*p)) {
+            p++;
+        }
+    }
+    if (*p) {
+        Node *repr = _doc->createTextNode(_text.c_str(), _text_is_cdata);
+        _open.back().node->appendChild(repr);
+        Inkscape::GC::release(repr);
+    }
+    _text.clear();
+}
+
+void SaxBuilder::_append(Node *node)
+{
+    if (_open.empty()) {
+        _doc->appendChild(node);
+    } else {
+        _open.back().node->appendChild(node);
+    }
+    Inkscape::GC::release(node);
+}
+
+/**
+ * Returns the name of an element or attribute with the prefix Inkscape uses for its
+ * namespace. A prefix that is not bound to a namespace is kept as it is.
+ */
+const gchar *SaxBuilder::_qualifiedName(const xmlChar *localname, const xmlChar *prefix, const xmlChar *uri)
+{
+    const gchar *ns_prefix = reinterpret_cast<const gchar *>(prefix);
+    if (uri) {
+        const gchar *href = reinterpret_cast<const gchar *>(uri);
+        ns_prefix = NULL;
+        for (size_t i = 0; i < _prefixes.size(); ++i) {
+            if (_prefixes[i].first == href) {
+                ns_prefix = _prefixes[i].second;
+                break;
+            }
+        }
+        if (!ns_prefix) {
+            ns_prefix = sp_xml_ns_uri_prefix(href, reinterpret_cast<const gchar *>(prefix));
+            _prefixes.push_back(std::make_pair(std::string(href), ns_prefix));
+        }
+    }
+
+    if (ns_prefix) {
+        g_snprintf(_name, sizeof(_name), "%s:%s", ns_prefix, reinterpret_cast<const gchar *>(localname));
+    } else {
+        g_snprintf(_name, sizeof(_name), "%s", reinterpret_cast<const gchar *>(localname));
+    }
+    return _name;
+}
+
+}
+
 int XmlSource::setFile(char const *filename, bool load_entities=false)
 {
     int retVal = -1;
@@ -215,7 +555,10 @@ int XmlSource::setFile(char const *filename, bool load_entities=false)
     return retVal;
 }
 
-xmlDocPtr XmlSource::readXml()
+/**
+ * Reads the file set with setFile() into a new Document, or returns NULL on failure.
+ */
+Document *XmlSource::readXml(const gchar *default_ns)
 {
     int parse_options = XML_PARSE_HUGE | XML_PARSE_RECOVER;
 
@@ -226,8 +569,14 @@ xmlDocPtr XmlSource::readXml()
     // Allow NOENT only if we're filtering out SYSTEM and PUBLIC entities
     if (LoadEntities)     parse_options |= XML_PARSE_NOENT;
 
-    return xmlReadIO( readCb, closeCb, this,
-                      filename, getEncoding(), parse_options);
+    SaxBuilder builder;
+    if (!builder.context()) {
+        close();
+        return NULL;
+    }
+    xmlDocPtr doc = xmlCtxtReadIO( builder.context(), readCb, closeCb, this,
+                                   filename, getEncoding(), parse_options);
+    return builder.finish(doc, default_ns);
 }
 
 int XmlSource::readCb( void * context, char * buffer, int len )
@@ -323,7 +672,6 @@ int XmlSource::close()
  */
 Document *sp_repr_read_file (const gchar * filename, const gchar *default_ns)
 {
-    xmlDocPtr doc = 0;
     Document * rdoc = 0;
 
     xmlSubstituteEntitiesDefault(1);
@@ -350,22 +698,16 @@ Document *sp_repr_read_file (const gchar * filename, const gchar *default_ns)
     XmlSource src;
 
     if (src.setFile(filename) == 0) {
-        doc = src.readXml();
-        rdoc = sp_repr_do_read(doc, default_ns);
+        rdoc = src.readXml(default_ns);
         // For some reason, failed ns loading results in this
         // We try a system check version of load with NOENT for adobe
         if (rdoc && strcmp(rdoc->root()->name(), "ns:svg") == 0) {
-            xmlFreeDoc(doc);
+            Inkscape::GC::release(rdoc);
             src.setFile(filename, true);
-            doc = src.readXml();
-            rdoc = sp_repr_do_read(doc, default_ns);
+            rdoc = src.readXml(default_ns);
         }
     }
 
-    if (doc) {
-        xmlFreeDoc(doc);
-    }
-
     if (localFilename) {
         g_free(localFilename);
     }
@@ -378,9 +720,6 @@ Document *sp_repr_read_file (const gchar * filename, const gchar *default_ns)
  */
 Document *sp_repr_read_mem (const gchar * buffer, gint length, const gchar *default_ns)
 {
-    xmlDocPtr doc;
-    Document * rdoc;
-
     xmlSubstituteEntitiesDefault(1);
 
     g_return_val_if_fail (buffer != NULL, NULL);
@@ -390,13 +729,12 @@ Document *sp_repr_read_mem (const gchar * buffer, gint length, const gchar *defa
                                        // proper solution would be to check the preference "/options/externalresources/xml/allow_net_access"
                                        // as done in XmlSource::readXml which gets called by the analogous sp_repr_read_file()
                                        // but sp_repr_read_mem() seems to be called in locations where Inkscape::Preferences::get() fails badly
-    doc = xmlReadMemory (const_cast<gchar *>(buffer), length, NULL, NULL, parser_options);
-
-    rdoc = sp_repr_do_read (doc, default_ns);
-    if (doc) {
-        xmlFreeDoc (doc);
+    SaxBuilder builder;
+    if (!builder.context()) {
+        return NULL;
     }
-    return rdoc;
+    xmlDocPtr doc = xmlCtxtReadMemory (builder.context(), buffer, length, NULL, NULL, parser_options);
+    return builder.finish(doc, default_ns);
 }
 
 /**
@@ -497,6 +835,15 @@ Document *sp_repr_do_read (xmlDocPtr doc, const gchar *default_ns)
         }
     }
 
+    return sp_repr_finish_read(rdoc, root, default_ns);
+}
+
+/**
+ * Namespace promotion and cleaning of a document read by sp_repr_do_read() or the SAX
+ * reader. The root is NULL if the document has more than one element at the top level.
+ */
+static Document *sp_repr_finish_read (Document *rdoc, Node *root, const gchar *default_ns)
+{
     if (root != NULL) {
         /* promote elements of some XML documents that don't use namespaces
          * into their default namespace */
@@ -666,23 +1013,689 @@ Glib::ustring sp_repr_save_buf(Document *doc)
 }
 
 
+namespace {
+
+/// Size at which the serializer passes its buffer on to the file
+size_t const SAVE_CHUNK_SIZE = 1 << 20;
+/// Number of chunks that may wait for compression
+size_t const SAVE_QUEUE_LENGTH = 4;
+
+/// Attributes with rebased hrefs, created on the main thread since they are garbage collected
+typedef std::map<Node const *, List<AttributeRecord const>, std::less<Node const *>,
+                 Inkscape::GC::Alloc<std::pair<Node const *const, List<AttributeRecord const> >,
+                                     Inkscape::GC::MANUAL> > RebasedAttributes;
+
+void write_bytes(FILE *fp, void const *data, size_t len)
+{
+    if (len && fwrite(data, 1, len, fp) != len) {
+        throw Inkscape::IO::StreamException("ERROR writing to file ");
+    }
+}
+
+/**
+ * Destination of a saved document.
+ */
+class SaveOutput {
+public:
+    virtual ~SaveOutput() {}
+    /// Writes the chunk, which may be left empty afterwards
+    virtual void write(std::string &chunk) = 0;
+    virtual void close() = 0;
+};
+
+class StringSaveOutput : public SaveOutput {
+public:
+    explicit StringSaveOutput(std::string &buffer) : _buffer(buffer) {}
+    void write(std::string &chunk) { _buffer += chunk; }
+    void close() {}
+private:
+    std::string &_buffer;
+};
+
+class FileSaveOutput : public SaveOutput {
+public:
+    explicit FileSaveOutput(FILE *fp) : _fp(fp) {}
+    void write(std::string &chunk) { write_bytes(_fp, chunk.data(), chunk.size()); }
+    void close() { fflush(_fp); }
+private:
+    FILE *_fp;
+};
+
+/**
+ * Writes the gzip stream GzipOutputStream writes. That stream buffers the whole document
+ * and compresses it with one call of compress() when closed; here a thread deflates the
+ * chunks while the document is being serialized. Deflate produces the same bytes for any
+ * split of its input, so only the zlib header and checksum need to be left out.
+ */
+class GzipSaveOutput : public SaveOutput {
+public:
+    explicit GzipSaveOutput(FILE *fp);
+    ~GzipSaveOutput();
+    void write(std::string &chunk);
+    void close();
+
+private:
+    void _run();
+    bool _deflate(std::string const &chunk, int flush);
+    void _stop();
+
+    FILE *_fp;
+    z_stream _stream;
+    uLong _crc;
+    uLong _total_in;
+    Glib::Threads::Thread *_thread;
+    bool _closed;
+
+    // shared with the compression thread, guarded by _mutex
+    Glib::Threads::Mutex _mutex;
+    Glib::Threads::Cond _cond;
+    std::deque<std::string> _queue;
+    bool _finished; ///< no more chunks will be queued
+    bool _failed;
+};
+
+GzipSaveOutput::GzipSaveOutput(FILE *fp)
+    : _fp(fp)
+    , _crc(crc32(0L, Z_NULL, 0))
+    , _total_in(0)
+    , _thread(NULL)
+    , _closed(false)
+    , _finished(false)
+    , _failed(false)
+{
+    // no file name, time or OS code
+    static unsigned char const header[] = { 0x1f, 0x8b, Z_DEFLATED, 0, 0, 0, 0, 0, 0, 0 };
+    write_bytes(_fp, header, sizeof(header));
+
+    _stream.zalloc = Z_NULL;
+    _stream.zfree = Z_NULL;
+    _stream.opaque = Z_NULL;
+    deflateInit2(&_stream, Z_DEFAULT_COMPRESSION, Z_DEFLATED, -MAX_WBITS, 8, Z_DEFAULT_STRATEGY);
+
+    try {
+        _thread = Glib::Threads::Thread::create(sigc::mem_fun(*this, &GzipSaveOutput::_run));
+    } catch (Glib::Threads::ThreadError const &e) {
+        g_warning("Could not start the compression thread: %s", e.what().c_str());
+        _thread = NULL;
+    }
+}
+
+GzipSaveOutput::~GzipSaveOutput()
+{
+    if (!_closed) {
+        {
+            Glib::Threads::Mutex::Lock lock(_mutex);
+            _queue.clear();
+            _failed = true;
+        }
+        _stop();
+        deflateEnd(&_stream);
+    }
+}
+
+void GzipSaveOutput::write(std::string &chunk)
+{
+    if (chunk.empty()) {
+        return;
+    }
+    if (!_thread) {
+        if (!_deflate(chunk, Z_NO_FLUSH)) {
+            throw Inkscape::IO::StreamException("ERROR writing to file ");
+        }
+        return;
+    }
+
+    Glib::Threads::Mutex::Lock lock(_mutex);
+    while (_queue.size() >= SAVE_QUEUE_LENGTH && !_failed) {
+        _cond.wait(_mutex);
+    }
+    if (_failed) {
+        throw Inkscape::IO::StreamException("ERROR writing to file ");
+    }
+    _queue.push_back(std::string());
+    _queue.back().swap(chunk);
+    _cond.broadcast();
+}
+
+void GzipSaveOutput::close()
+{
+    if (_closed) {
+        return;
+    }
+    _closed = true;
+
+    bool ok;
+    if (_thread) {
+        _stop();
+        ok = !_failed;
+    } else {
+        ok = _deflate(std::string(), Z_FINISH);
+    }
+    deflateEnd(&_stream);
+    if (!ok) {
+        throw Inkscape::IO::StreamException("ERROR writing to file ");
+    }
+
+    unsigned char trailer[8];
+    uLong crc = _crc;
+    uLong total_in = _total_in & 0xffffffffL;
+    for (int n = 0; n < 4; n++) {
+        trailer[n] = crc & 0xff;
+        trailer[n + 4] = total_in & 0xff;
+        crc >>= 8;
+        total_in >>= 8;
+    }
+    write_bytes(_fp, trailer, sizeof(trailer));
+    fflush(_fp);
+}
+
+/// Lets the compression thread finish the stream and waits for it
+void GzipSaveOutput::_stop()
+{
+    if (!_thread) {
+        return;
+    }
+    {
+        Glib::Threads::Mutex::Lock lock(_mutex);
+        _finished = true;
+        _cond.broadcast();
+    }
+    _thread->join();
+    _thread = NULL;
+}
+
+void GzipSaveOutput::_run()
+{
+    bool ok = true;
+    bool last = false;
+    while (!last) {
+        std::string chunk;
+        {
+            Glib::Threads::Mutex::Lock lock(_mutex);
+            while (_queue.empty() && !_finished) {
+                _cond.wait(_mutex);
+            }
+            if (!_queue.empty()) {
+                chunk.swap(_queue.front());
+                _queue.pop_front();
+            }
+            last = _queue.empty() && _finished;
+            ok = ok && !_failed;
+            _cond.broadcast();
+        }
+        if (ok && !_deflate(chunk, last ? Z_FINISH : Z_NO_FLUSH)) {
+            ok = false;
+            Glib::Threads::Mutex::Lock lock(_mutex);
+            _failed = true;
+            _cond.broadcast();
+        }
+    }
+}
+
+bool GzipSaveOutput::_deflate(std::string const &chunk, int flush)
+{
+    _crc = crc32(_crc, reinterpret_cast<Bytef const *>(chunk.data()), chunk.size());
+    _total_in += chunk.size();
+
+    _stream.next_in = reinterpret_cast<Bytef *>(const_cast<char *>(chunk.data()));
+    _stream.avail_in = chunk.size();
+    Bytef out[16384];
+    do {
+        _stream.next_out = out;
+        _stream.avail_out = sizeof(out);
+        if (deflate(&_stream, flush) == Z_STREAM_ERROR) {
+            return false;
+        }
+        size_t len = sizeof(out) - _stream.avail_out;
+        if (len && fwrite(out, 1, len, _fp) != len) {
+            return false;
+        }
+    } while (_stream.avail_out == 0);
+    return true;
+}
+
+/**
+ * Appends the bytes an OutputStreamWriter writes to a file for writeString() or printf()
+ * of str followed by suffix: the writer passes the string on as Glib::ustring characters,
+ * of which the file stream keeps the low byte. An incomplete character at the end of str
+ * takes bytes of the suffix with it.
+ */
+void append_narrowed(std::string &buf, gchar const *str, gchar const *suffix = "")
+{
+    gchar const *p = str;
+    while (*p && !(*p & 0x80)) {
+        ++p;
+    }
+    buf.append(str, p);
+    if (*p) {
+        std::string rest(p);
+        rest += suffix;
+        p = rest.c_str();
+        glong n = g_utf8_pointer_to_offset(p, p + rest.size());
+        for (glong i = 0; i < n; ++i) {
+            buf += static_cast<char>(g_utf8_get_char(p) & 0xff);
+            p = g_utf8_next_char(p);
+        }
+    } else {
+        buf += suffix;
+    }
+}
+
+struct SerializerOptions {
+    int inlineattrs;
+    int indent;
+    gchar const *elide_prefix; ///< prefix omitted from element names, or NULL
+    RebasedAttributes const *rebased;
+};
+
+/**
+ * Serializes nodes into a string with the bytes sp_repr_write_stream() writes to a file.
+ * The serializer neither allocates garbage collected memory nor changes shared state, so
+ * several of them can serialize parts of a document at the same time.
+ */
+class NodeSerializer {
+public:
+    /// Passes the buffer on to output whenever it gets large, if there is one
+    NodeSerializer(std::string &buffer, SerializerOptions const &options, SaveOutput *output = NULL)
+        : _buf(buffer), _options(options), _output(output) {}
+
+    void writeString(gchar const *str) { append_narrowed(_buf, str); }
+    void writeChar(char ch) { _buf += ch; }
+    void writeNode(Node const *repr, gint indent_level, bool add_whitespace);
+    void writeElement(Node const *repr, gint indent_level, bool add_whitespace,
+                      List<AttributeRecord const> attributes);
+    void writeRootElement(Node const *repr, List<AttributeRecord const> attributes, int threads);
+    /// Writes the buffer and then the chunk to the output
+    void write(std::string &chunk);
+    void flush();
+
+private:
+    struct Element {
+        Node const *repr;
+        gchar const *name;
+        gint indent_level;
+        bool add_whitespace;
+        bool loose;
+        gint childIndentLevel() const { return loose ? indent_level + 1 : 0; }
+    };
+
+    Element _openElement(Node const *repr, gint indent_level, bool add_whitespace,
+                         List<AttributeRecord const> attributes);
+    void _closeElement(Element const &element);
+    void _writeComment(gchar const *val, bool add_whitespace, gint indent_level);
+    void _writeIndent(gint indent_level);
+    void _writeQuoted(gchar const *val);
+    /// Writes what printf() writes for "%s" + suffix
+    void _writePrintfString(gchar const *str, gchar const *suffix) {
+        append_narrowed(_buf, str ? str : "(null)", suffix);
+    }
+    gchar const *_elementName(Node const *repr) const;
+    List<AttributeRecord const> _attributes(Node const *repr) const;
+    void _maybeFlush() {
+        if (_output && _buf.size() >= SAVE_CHUNK_SIZE) {
+            flush();
+        }
+    }
+
+    std::string &_buf;
+    SerializerOptions const &_options;
+    SaveOutput *_output;
+};
+
+void NodeSerializer::write(std::string &chunk)
+{
+    flush();
+    _output->write(chunk);
+}
+
+void NodeSerializer::flush()
+{
+    if (_output && !_buf.empty()) {
+        _output->write(_buf);
+        _buf.clear();
+        _buf.reserve(SAVE_CHUNK_SIZE);
+    }
+}
+
+void NodeSerializer::writeNode(Node const *repr, gint indent_level, bool add_whitespace)
+{
+    switch (repr->type()) {
+        case Inkscape::XML::TEXT_NODE: {
+            if (dynamic_cast<Inkscape::XML::TextNode const *>(repr)->is_CData()) {
+                _buf += "<![CDATA[";
+                _writePrintfString(repr->content(), "]]>");
+            } else {
+                _writeQuoted(repr->content());
+            }
+            break;
+        }
+        case Inkscape::XML::COMMENT_NODE: {
+            _writeComment(repr->content(), add_whitespace, indent_level);
+            break;
+        }
+        case Inkscape::XML::PI_NODE: {
+            std::string pi = repr->name() ? repr->name() : "(null)";
+            pi += ' ';
+            pi += repr->content() ? repr->content() : "(null)";
+            _buf += "<?";
+            append_narrowed(_buf, pi.c_str(), "?>");
+            break;
+        }
+        case Inkscape::XML::ELEMENT_NODE: {
+            writeElement(repr, indent_level, add_whitespace, _attributes(repr));
+            break;
+        }
+        default: {
+            g_assert_not_reached();
+        }
+    }
+    _maybeFlush();
+}
+
+void NodeSerializer::writeElement(Node const *repr, gint indent_level, bool add_whitespace,
+                                  List<AttributeRecord const> attributes)
+{
+    Element element = _openElement(repr, indent_level, add_whitespace, attributes);
+    for (Node const *child = repr->firstChild(); child; child = child->next()) {
+        writeNode(child, element.childIndentLevel(), element.add_whitespace);
+    }
+    _closeElement(element);
+}
+
+/**
+ * Writes the element, serializing its children on several threads. The children are
+ * serialized in batches into separate buffers, which are then written in order.
+ */
+void NodeSerializer::writeRootElement(Node const *repr, List<AttributeRecord const> attributes,
+                                      int threads)
+{
+    std::vector<Node const *> children;
+    for (Node const *child = repr->firstChild(); child; child = child->next()) {
+        children.push_back(child);
+    }
+    if (threads <= 1 || children.size() <= 1) {
+        writeElement(repr, 0, true, attributes);
+        return;
+    }
+
+    Element element = _openElement(repr, 0, true, attributes);
+    std::vector<std::string> parts(std::min<size_t>(threads * 4, children.size()));
+    for (size_t start = 0; start < children.size(); start += parts.size()) {
+        int count = std::min(parts.size(), children.size() - start);
+#if HAVE_OPENMP
+#pragma omp parallel for schedule(dynamic, 1) num_threads(threads)
+#endif
+        for (int i = 0; i < count; ++i) {
+            NodeSerializer part(parts[i], _options);
+            part.writeNode(children[start + i], element.childIndentLevel(), element.add_whitespace);
+        }
+        for (int i = 0; i < count; ++i) {
+            write(parts[i]);
+            parts[i].clear();
+        }
+    }
+    _closeElement(element);
+}
+
+NodeSerializer::Element NodeSerializer::_openElement(Node const *repr, gint indent_level,
+                                                     bool add_whitespace,
+                                                     List<AttributeRecord const> attributes)
+{
+    if ( indent_level > 16 ) {
+        indent_level = 16;
+    }
+    if (add_whitespace) {
+        _writeIndent(indent_level);
+    }
+
+    Element element;
+    element.repr = repr;
+    element.name = _elementName(repr);
+    element.indent_level = indent_level;
+    _buf += '<';
+    writeString(element.name);
+
+    // if this is a <text> element, suppress formatting whitespace
+    // for its content and children:
+    gchar const *xml_space_attr = repr->attribute("xml:space");
+    if (xml_space_attr != NULL && !strcmp(xml_space_attr, "preserve")) {
+        add_whitespace = false;
+    }
+    element.add_whitespace = add_whitespace;
+
+    for (List<AttributeRecord const> iter = attributes; iter; ++iter) {
+        if (!_options.inlineattrs) {
+            _buf += '\n';
+            _writeIndent(indent_level + 1);
+        }
+        _buf += ' ';
+        append_narrowed(_buf, g_quark_to_string(iter->key), "=\"");
+        _writeQuoted(iter->value);
+        _buf += '"';
+    }
+
+    element.loose = true;
+    for (Node const *child = repr->firstChild(); child; child = child->next()) {
+        if (child->type() == Inkscape::XML::TEXT_NODE) {
+            element.loose = false;
+            break;
+        }
+    }
+    if (repr->firstChild()) {
+        _buf += '>';
+        if (element.loose && add_whitespace) {
+            _buf += '\n';
+        }
+    }
+    return element;
+}
+
+void NodeSerializer::_closeElement(Element const &element)
+{
+    if (element.repr->firstChild()) {
+        if (element.loose && element.add_whitespace) {
+            _writeIndent(element.indent_level);
+        }
+        _buf += "</";
+        append_narrowed(_buf, element.name, ">");
+    } else {
+        _buf += " />";
+    }
+
+    // text elements cannot nest, so we can output newline
+    // after closing text
+    if (element.add_whitespace || !strcmp(element.repr->name(), "svg:text")) {
+        _buf += '\n';
+    }
+}
+
+void NodeSerializer::_writeComment(gchar const *val, bool add_whitespace, gint indent_level)
+{
+    if ( indent_level > 16 ) {
+        indent_level = 16;
+    }
+    if (add_whitespace) {
+        _writeIndent(indent_level);
+    }
+    _buf += "<!--";
+    _buf += val ? val : " ";
+    _buf += "-->";
+    if (add_whitespace) {
+        _buf += '\n';
+    }
+}
+
+void NodeSerializer::_writeIndent(gint indent_level)
+{
+    if (indent_level > 0 && _options.indent > 0) {
+        _buf.append(indent_level * _options.indent, ' ');
+    }
+}
+
+void NodeSerializer::_writeQuoted(gchar const *val)
+{
+    if (!val) {
+        return;
+    }
+    gchar const *start = val;
+    for (; *val != '\0'; val++) {
+        gchar const *entity;
+        switch (*val) {
+            case '"': entity = "&quot;"; break;
+            case '&': entity = "&amp;"; break;
+            case '<': entity = "&lt;"; break;
+            case '>': entity = "&gt;"; break;
+            default: continue;
+        }
+        _buf.append(start, val);
+        _buf += entity;
+        start = val + 1;
+    }
+    _buf.append(start, val);
+}
+
+gchar const *NodeSerializer::_elementName(Node const *repr) const
+{
+    gchar const *name = g_quark_to_string(repr->code());
+    gchar const *prefix_end = strchr(name, ':');
+    gchar const *elide_prefix = _options.elide_prefix;
+    if (!prefix_end) {
+        return name;
+    }
+    if (elide_prefix && !strncmp(name, elide_prefix, prefix_end - name) &&
+        elide_prefix[prefix_end - name] == '\0') {
+        return prefix_end + 1;
+    }
+    return name;
+}
+
+List<AttributeRecord const> NodeSerializer::_attributes(Node const *repr) const
+{
+    if (!_options.rebased->empty()) {
+        RebasedAttributes::const_iterator found = _options.rebased->find(repr);
+        if (found != _options.rebased->end()) {
+            return found->second;
+        }
+    }
+    return repr->attributeList();
+}
+
+/// Rebases the hrefs of all elements below repr, which the serializer cannot do
+void collect_rebased_attributes(RebasedAttributes &rebased, Node const *repr,
+                                gchar const *old_href_abs_base, gchar const *new_href_abs_base)
+{
+    static GQuark const href_key = g_quark_from_static_string("xlink:href");
+
+    for (Node const *child = repr->firstChild(); child; child = child->next()) {
+        if (child->type() != Inkscape::XML::ELEMENT_NODE) {
+            continue;
+        }
+        List<AttributeRecord const> attributes = child->attributeList();
+        for (List<AttributeRecord const> iter = attributes; iter; ++iter) {
+            if (iter->key == href_key) {
+                List<AttributeRecord const> result = rebase_href_attrs(old_href_abs_base,
+                                                                       new_href_abs_base, attributes);
+                if (result != attributes) {
+                    rebased.insert(RebasedAttributes::value_type(child, result));
+                }
+                break;
+            }
+        }
+        collect_rebased_attributes(rebased, child, old_href_abs_base, new_href_abs_base);
+    }
+}
+
+} // namespace
+
+/**
+ * Writes the document like sp_repr_save_writer() does with an OutputStreamWriter on a file
+ * stream, but without passing every character through the stream classes: the nodes are
+ * serialized into large buffers, and the top-level subtrees of the root element are
+ * serialized in parallel.
+ */
+static void sp_repr_save_serialized(Document *doc, SaveOutput &output, gchar const *default_ns,
+                                    gchar const *old_href_abs_base,
+                                    gchar const *new_href_abs_base)
+{
+    Inkscape::Preferences *prefs = Inkscape::Preferences::get();
+    bool inlineattrs = prefs->getBool("/options/svgoutput/inlineattrs");
+    int indent = prefs->getInt("/options/svgoutput/indent", 2);
+#if HAVE_OPENMP
+    int threads = prefs->getIntLimited("/options/threading/numthreads", omp_get_num_procs(), 1, 256);
+#else
+    int threads = 1;
+#endif
+
+    RebasedAttributes rebased;
+    SerializerOptions options = { inlineattrs, indent, NULL, &rebased };
+    std::string buffer;
+    buffer.reserve(SAVE_CHUNK_SIZE);
+    NodeSerializer out(buffer, options, &output);
+
+    out.writeString("<?xml version=\"1.0\" encoding=\"UTF-8\" standalone=\"no\"?>\n");
+
+    const gchar *str = static_cast<Node *>(doc)->attribute("doctype");
+    if (str) {
+        out.writeString(str);
+    }
+
+    for (Node *repr = sp_repr_document_first_child(doc); repr; repr = repr->next()) {
+        Inkscape::XML::NodeType const node_type = repr->type();
+        if ( node_type == Inkscape::XML::ELEMENT_NODE ) {
+            Glib::QueryQuark elide_prefix = GQuark(0);
+            List<AttributeRecord const> attributes = sp_repr_prepare_root_element(repr, default_ns,
+                                                                                  elide_prefix);
+            attributes = rebase_href_attrs(old_href_abs_base, new_href_abs_base, attributes);
+            rebased.clear();
+            if (old_href_abs_base != new_href_abs_base) {
+                collect_rebased_attributes(rebased, repr, old_href_abs_base, new_href_abs_base);
+            }
+            options.elide_prefix = elide_prefix.id() ? g_quark_to_string(elide_prefix) : NULL;
+            out.writeRootElement(repr, attributes, threads);
+        } else {
+            out.writeNode(repr, 0, true);
+            if ( node_type == Inkscape::XML::COMMENT_NODE ) {
+                out.writeChar('\n');
+            }
+        }
+    }
+
+    out.flush();
+    output.close();
+}
+
 void sp_repr_save_stream(Document *doc, FILE *fp, gchar const *default_ns, bool compress,
                     gchar const *const old_href_abs_base,
                     gchar const *const new_href_abs_base)
 {
-    Inkscape::URI dummy("x");
-    Inkscape::IO::UriOutputStream bout(fp, dummy);
-    Inkscape::IO::GzipOutputStream *gout = compress ? new Inkscape::IO::GzipOutputStream(bout) : NULL;
-    Inkscape::IO::OutputStreamWriter *out  = compress ? new Inkscape::IO::OutputStreamWriter( *gout ) : new Inkscape::IO::OutputStreamWriter( bout );
-
-    sp_repr_save_writer(doc, out, default_ns, old_href_abs_base, new_href_abs_base);
-
-    delete out;
-    delete gout;
+    if (!fp) {
+        throw Inkscape::IO::StreamException("cannot save to a null file");
+    }
+    if (compress) {
+        GzipSaveOutput output(fp);
+        sp_repr_save_serialized(doc, output, default_ns, old_href_abs_base, new_href_abs_base);
+    } else {
+        FileSaveOutput output(fp);
+        sp_repr_save_serialized(doc, output, default_ns, old_href_abs_base, new_href_abs_base);
+    }
 }
 
 
 
+/**
+ * Serializes the document into a buffer for a reader that does not know where the document
+ * is: relative hrefs, taken relative to old_base, are made absolute.
+ */
+std::string sp_repr_save_absolute_buf(Document *doc, gchar const *default_ns, gchar const *old_base)
+{
+    std::string buffer;
+    StringSaveOutput output(buffer);
+    Glib::ustring old_href_abs_base = calc_abs_doc_base(old_base);
+    // relative to no directory, sp_relative_path_from_path() keeps the absolute path
+    sp_repr_save_serialized(doc, output, default_ns, old_href_abs_base.c_str(), "");
+    return buffer;
+}
+
 /**
  * Returns true if file successfully saved.
  *
@@ -859,10 +1872,25 @@ static void sp_repr_write_stream_root_element(Node *repr, Writer &out,
                                   gchar const *const old_href_base,
                                   gchar const *const new_href_base)
 {
-    using Inkscape::Util::ptr_shared;
-
     g_assert(repr != NULL);
 
+    Glib::QueryQuark elide_prefix=GQuark(0);
+    List<AttributeRecord const> attributes = sp_repr_prepare_root_element(repr, default_ns, elide_prefix);
+
+    return sp_repr_write_stream_element(repr, out, 0, add_whitespace, elide_prefix, attributes,
+                                        inlineattrs, indent, old_href_base, new_href_base);
+}
+
+/**
+ * Cleans and sorts the attributes of the tree as the preferences ask, and returns the
+ * attributes of the root element with the namespace declarations of the tree, along
+ * with the prefix that element names may omit.
+ */
+static List<AttributeRecord const> sp_repr_prepare_root_element(Node *repr, gchar const *default_ns,
+                                                                Glib::QueryQuark &elide_prefix)
+{
+    using Inkscape::Util::ptr_shared;
+
     // Clean unnecessary attributes and stype properties. (Controlled by preferences.)
     Inkscape::Preferences *prefs = Inkscape::Preferences::get();
     bool clean = prefs->getBool("/options/svgoutput/check_on_writing");
@@ -877,7 +1905,7 @@ static void sp_repr_write_stream_root_element(Node *repr, Writer &out,
     NSMap ns_map;
     populate_ns_map(ns_map, *repr);
 
-    Glib::QueryQuark elide_prefix=GQuark(0);
+    elide_prefix=GQuark(0);
     if ( default_ns && ns_map.find(GQuark(0)) == ns_map.end() ) {
         elide_prefix = g_quark_from_string(sp_xml_ns_uri_prefix(default_ns, NULL));
     }
@@ -906,8 +1934,7 @@ static void sp_repr_write_stream_root_element(Node *repr, Writer &out,
         }
     }
 
-    return sp_repr_write_stream_element(repr, out, 0, add_whitespace, elide_prefix, attributes,
-                                        inlineattrs, indent, old_href_base, new_href_base);
+    return attributes;
 }
 
 void sp_repr_write_stream( Node *repr, Writer &out, gint indent_level,
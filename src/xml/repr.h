@@ -14,6 +14,7 @@
 #ifndef SEEN_SP_REPR_H
 #define SEEN_SP_REPR_H
 
+#include <string>
 #include <vector>
 #include <glibmm/quark.h>
 
@@ -60,6 +61,8 @@ void sp_repr_write_stream(Inkscape::XML::Node *repr, Inkscape::IO::Writer &out,
                           char const *new_href_base = NULL);
 Inkscape::XML::Document *sp_repr_read_buf (const Glib::ustring &buf, const char *default_ns);
 Glib::ustring sp_repr_save_buf(Inkscape::XML::Document *doc);
+std::string sp_repr_save_absolute_buf(Inkscape::XML::Document *doc, char const *default_ns,
+                                      char const *old_base);
 
 // TODO convert to std::string
 void sp_repr_save_stream(Inkscape::XML::Document *doc, FILE *to_file,
@@ -162,8 +162,19 @@ using Util::cons;
 using Util::rest;
 using Util::set_rest;
 
+namespace {
+
+/// Attributes are looked up in the list until a node has more than this many
+unsigned const ATTRIBUTE_INDEX_THRESHOLD = 4;
+
+inline std::size_t attribute_hash(GQuark key) {
+    return key * 2654435761u;
+}
+
+}
+
 SimpleNode::SimpleNode(int code, Document *document)
-: Node(), _name(code), _attributes(), _child_count(0),
+: Node(), _name(code), _attributes(), _attribute_count(0), _child_count(0),
   _cached_positions_valid(false)
 {
     g_assert(document != NULL);
@@ -178,7 +189,7 @@ SimpleNode::SimpleNode(int code, Document *document)
 SimpleNode::SimpleNode(SimpleNode const &node, Document *document)
 : Node(),
   _cached_position(node._cached_position),
-  _name(node._name), _attributes(), _content(node._content),
+  _name(node._name), _attributes(), _attribute_count(0), _content(node._content),
   _child_count(node._child_count),
   _cached_positions_valid(node._cached_positions_valid)
 {
@@ -208,6 +219,13 @@ SimpleNode::SimpleNode(SimpleNode const &node, Document *document)
           iter ; ++iter )
     {
         _attributes = cons(*iter, _attributes);
+        if (!_last_attribute) {
+            _last_attribute = _attributes;
+        }
+        _attribute_count++;
+    }
+    if (_attribute_count > ATTRIBUTE_INDEX_THRESHOLD) {
+        _rebuildAttributeIndex();
     }
 
     _observers.add(_subtree_observers);
@@ -224,16 +242,17 @@ gchar const *SimpleNode::content() const {
 gchar const *SimpleNode::attribute(gchar const *name) const {
     g_return_val_if_fail(name != NULL, NULL);
 
-    GQuark const key = g_quark_from_string(name);
-
-    for ( List<AttributeRecord const> iter = _attributes ;
-          iter ; ++iter )
-    {
-        if ( iter->key == key ) {
-            return iter->value;
-        }
+    // an attribute that was ever set has a quark already
+    GQuark const key = g_quark_try_string(name);
+    if (!key) {
+        return NULL;
     }
 
+    MutableList<AttributeRecord> before;
+    MutableList<AttributeRecord> found = const_cast<SimpleNode *>(this)->_findAttribute(key, before);
+    if (found) {
+        return found->value;
+    }
     return NULL;
 }
 
@@ -355,14 +374,8 @@ SimpleNode::setAttribute(gchar const *name, gchar const *value, bool const /*is_
 
     GQuark const key = g_quark_from_string(name);
 
-    MutableList<AttributeRecord> ref;
-    MutableList<AttributeRecord> existing;
-    for ( existing = _attributes ; existing ; ++existing ) {
-        if ( existing->key == key ) {
-            break;
-        }
-        ref = existing;
-    }
+    MutableList<AttributeRecord> before;
+    MutableList<AttributeRecord> existing = _findAttribute(key, before);
     Debug::EventTracker<> tracker;
 
     ptr_shared old_value=( existing ? existing->value : ptr_shared() );
@@ -372,23 +385,14 @@ SimpleNode::setAttribute(gchar const *name, gchar const *value, bool const /*is_
         new_value = share_string(cleaned_value);
         tracker.set<DebugSetAttribute>(*this, key, new_value);
         if (!existing) {
-            if (ref) {
-                set_rest(ref, MutableList<AttributeRecord>(AttributeRecord(key, new_value)));
-            } else {
-                _attributes = MutableList<AttributeRecord>(AttributeRecord(key, new_value));
-            }
+            _appendAttribute(key, new_value);
         } else {
             existing->value = new_value;
         }
     } else {
         tracker.set<DebugClearAttribute>(*this, key);
         if (existing) {
-            if (ref) {
-                set_rest(ref, rest(existing));
-            } else {
-                _attributes = rest(existing);
-            }
-            set_rest(existing, MutableList<AttributeRecord>());
+            _removeAttribute(existing, before);
         }
     }
 
@@ -400,6 +404,122 @@ SimpleNode::setAttribute(gchar const *name, gchar const *value, bool const /*is_
     g_free( cleaned_value );
 }
 
+/**
+ * Returns the cell of the attribute with the given key, or an empty list if there is none.
+ * The cell before it is stored in before.
+ */
+MutableList<AttributeRecord> SimpleNode::_findAttribute(GQuark key, MutableList<AttributeRecord> &before) {
+    if (!_attribute_index.empty()) {
+        AttributeSlot &slot = _attributeSlot(key);
+        if (!slot.key) {
+            return MutableList<AttributeRecord>();
+        }
+        before = slot.before;
+        return before ? rest(before) : _attributes;
+    }
+
+    before = MutableList<AttributeRecord>();
+    for ( MutableList<AttributeRecord> iter = _attributes ; iter ; ++iter ) {
+        if ( iter->key == key ) {
+            return iter;
+        }
+        before = iter;
+    }
+    return MutableList<AttributeRecord>();
+}
+
+void SimpleNode::_appendAttribute(GQuark key, ptr_shared value) {
+    MutableList<AttributeRecord> cell(AttributeRecord(key, value));
+    if (_last_attribute) {
+        set_rest(_last_attribute, cell);
+    } else {
+        _attributes = cell;
+    }
+    MutableList<AttributeRecord> before = _last_attribute;
+    _last_attribute = cell;
+    _attribute_count++;
+
+    if (_attribute_index.empty()) {
+        if (_attribute_count > ATTRIBUTE_INDEX_THRESHOLD) {
+            _rebuildAttributeIndex();
+        }
+    } else if (2 * _attribute_count > _attribute_index.size()) {
+        _rebuildAttributeIndex();
+    } else {
+        AttributeSlot &slot = _attributeSlot(key);
+        slot.key = key;
+        slot.before = before;
+    }
+}
+
+void SimpleNode::_removeAttribute(MutableList<AttributeRecord> attribute, MutableList<AttributeRecord> before) {
+    MutableList<AttributeRecord> next = rest(attribute);
+    if (before) {
+        set_rest(before, next);
+    } else {
+        _attributes = next;
+    }
+    if (!next) {
+        _last_attribute = before;
+    }
+    set_rest(attribute, MutableList<AttributeRecord>());
+    _attribute_count--;
+
+    if (!_attribute_index.empty()) {
+        _removeAttributeSlot(attribute->key);
+        if (next) {
+            _attributeSlot(next->key).before = before;
+        }
+    }
+}
+
+/**
+ * Returns the slot of the index that holds the key, or the unused slot where it belongs.
+ */
+SimpleNode::AttributeSlot &SimpleNode::_attributeSlot(GQuark key) {
+    std::size_t const mask = _attribute_index.size() - 1;
+    std::size_t i = attribute_hash(key) & mask;
+    while (_attribute_index[i].key && _attribute_index[i].key != key) {
+        i = (i + 1) & mask;
+    }
+    return _attribute_index[i];
+}
+
+/**
+ * Removes a key from the index, moving back the following keys of its probe sequence so
+ * that no lookup stops early at the freed slot.
+ */
+void SimpleNode::_removeAttributeSlot(GQuark key) {
+    std::size_t const mask = _attribute_index.size() - 1;
+    std::size_t hole = &_attributeSlot(key) - &_attribute_index[0];
+    for ( std::size_t i = (hole + 1) & mask ; _attribute_index[i].key ; i = (i + 1) & mask ) {
+        std::size_t home = attribute_hash(_attribute_index[i].key) & mask;
+        // the key can fill the hole unless its home lies after the hole, up to where it is now
+        bool stays = hole <= i ? (hole < home && home <= i) : (hole < home || home <= i);
+        if (!stays) {
+            _attribute_index[hole] = _attribute_index[i];
+            hole = i;
+        }
+    }
+    _attribute_index[hole] = AttributeSlot();
+}
+
+void SimpleNode::_rebuildAttributeIndex() {
+    std::size_t size = 16;
+    while (size < 2 * _attribute_count) {
+        size *= 2;
+    }
+    _attribute_index.assign(size, AttributeSlot());
+
+    MutableList<AttributeRecord> before;
+    for ( MutableList<AttributeRecord> iter = _attributes ; iter ; ++iter ) {
+        AttributeSlot &slot = _attributeSlot(iter->key);
+        slot.key = iter->key;
+        slot.before = before;
+        before = iter;
+    }
+}
+
 void SimpleNode::addChild(Node *generic_child, Node *generic_ref) {
     g_assert(generic_child);
     g_assert(generic_child->document() == _document);
@@ -20,10 +20,12 @@
 
 #include <cassert>
 #include <iostream>
+#include <vector>
 
 #include "xml/node.h"
 #include "xml/attribute-record.h"
 #include "xml/composite-node-observer.h"
+#include "inkgc/gc-alloc.h"
 #include "util/list-container.h"
 
 namespace Inkscape {
@@ -132,9 +134,30 @@ protected:
 private:
     void operator=(Node const &); // no assign
 
+    /**
+     * Entry of the hash table of attributes. It refers to the list cell before the attribute,
+     * so that the attribute can be unlinked without searching the list.
+     */
+    struct AttributeSlot {
+        AttributeSlot() : key(0) {}
+
+        GQuark key; ///< 0 for an unused slot
+        Inkscape::Util::MutableList<AttributeRecord> before; ///< empty for the first attribute
+    };
+    // nodes are not finalized, so the table must be collectable as well
+    typedef std::vector<AttributeSlot, Inkscape::GC::Alloc<AttributeSlot, Inkscape::GC::AUTO> > AttributeIndex;
+
     void _setParent(SimpleNode *parent);
     unsigned _childPosition(SimpleNode const &child) const;
 
+    Inkscape::Util::MutableList<AttributeRecord> _findAttribute(GQuark key, Inkscape::Util::MutableList<AttributeRecord> &before);
+    void _appendAttribute(GQuark key, Inkscape::Util::ptr_shared value);
+    void _removeAttribute(Inkscape::Util::MutableList<AttributeRecord> attribute,
+                          Inkscape::Util::MutableList<AttributeRecord> before);
+    AttributeSlot &_attributeSlot(GQuark key);
+    void _removeAttributeSlot(GQuark key);
+    void _rebuildAttributeIndex();
+
     SimpleNode *_parent;
     SimpleNode *_next;
     Document *_document;
@@ -142,7 +165,12 @@ private:
 
     int _name;
 
+    /// Attributes in the order they were added, which is the order they are written in
     Inkscape::Util::MutableList<AttributeRecord> _attributes;
+    Inkscape::Util::MutableList<AttributeRecord> _last_attribute;
+    unsigned _attribute_count;
+    /// Open addressing table of the attributes by key, only used for nodes with many attributes
+    AttributeIndex _attribute_index;
 
     Inkscape::Util::ptr_shared _content;
 
@@ -0,0 +1,82 @@
+/*
+ * Looking up fonts through the cache of the font factory
+ *
+ * Copyright (C) 2018 Authors
+ *
+ * Released under GNU GPL, read the file 'COPYING' for more information
+ */
+#include <gtest/gtest.h>
+
+#include "libnrtype/FontFactory.h"
+#include "libnrtype/font-instance.h"
+#include "style.h"
+
+TEST(FontFactoryTest, StylesWithTheSameFontShareIt) {
+    font_factory *factory = font_factory::Default();
+
+    SPStyle bold;
+    bold.mergeString("font-family:sans-serif;font-weight:bold");
+    font_instance *first = factory->FaceFromStyle(&bold);
+    ASSERT_TRUE(first != NULL);
+
+    // the second lookup of the style is answered by the cache
+    font_factory::CacheStats before = factory->GetCacheStats();
+    font_instance *second = factory->FaceFromStyle(&bold);
+    font_factory::CacheStats after = factory->GetCacheStats();
+    EXPECT_EQ(first, second);
+    EXPECT_EQ(before.hits + 1, after.hits);
+    EXPECT_EQ(before.misses, after.misses);
+
+    // as is a description of the same font
+    PangoFontDescription *descr = pango_font_description_copy(first->descr);
+    font_instance *third = factory->Face(descr);
+    pango_font_description_free(descr);
+    EXPECT_EQ(first, third);
+
+    first->Unref();
+    second->Unref();
+    third->Unref();
+}
+
+TEST(FontFactoryTest, UnusedFontsAreEvicted) {
+    font_factory *factory = font_factory::Default();
+    factory->SetCacheSize(1, 16);
+
+    SPStyle normal;
+    normal.mergeString("font-family:sans-serif");
+    SPStyle italic;
+    italic.mergeString("font-family:serif;font-style:italic");
+
+    font_instance *font = factory->FaceFromStyle(&normal);
+    ASSERT_TRUE(font != NULL);
+    font->Unref();
+
+    // only the cache keeps the first font loaded, and it makes room for the second
+    font_factory::CacheStats before = factory->GetCacheStats();
+    font_instance *other = factory->FaceFromStyle(&italic);
+    ASSERT_TRUE(other != NULL);
+    EXPECT_EQ(before.evictions + 1, factory->GetCacheStats().evictions);
+
+    // which is found again while in use
+    before = factory->GetCacheStats();
+    font_instance *again = factory->FaceFromStyle(&italic);
+    EXPECT_EQ(other, again);
+    EXPECT_EQ(before.hits + 1, factory->GetCacheStats().hits);
+    other->Unref();
+    again->Unref();
+
+    factory->SetCacheSize(0, 0);
+    EXPECT_LT(0u, factory->GetCacheStats().evictions);
+    factory->SetCacheSize(32, 1024);
+}
+
+/*
+  Local Variables:
+  mode:c++
+  c-file-style:"stroustrup"
+  c-file-offsets:((innamespace . 0)(inline-open . 0)(case-label . +))
+  indent-tabs-mode:nil
+  fill-column:99
+  End:
+*/
+// vim: filetype=cpp:expandtab:shiftwidth=4:tabstop=8:softtabstop=4:fileencoding=utf-8:textwidth=99 :
@@ -0,0 +1,100 @@
+/*
+ * Area queries of SPDocument through the spatial item index
+ *
+ * Copyright (C) 2018 Authors
+ *
+ * Released under GNU GPL, read the file 'COPYING' for more information
+ */
+#include <gtest/gtest.h>
+#include <doc-per-case-test.h>
+#include <src/sp-item.h>
+#include <src/sp-root.h>
+#include <xml/node.h>
+#include <xml/repr.h>
+#include <2geom/rect.h>
+
+using namespace Inkscape;
+using namespace Inkscape::XML;
+
+class ItemIndexTest: public DocPerCaseTest {
+public:
+    Node *addRect(Node *parent, char const *x, char const *y) {
+        Node *repr = _doc->getReprDoc()->createElement("svg:rect");
+        repr->setAttribute("x", x);
+        repr->setAttribute("y", y);
+        repr->setAttribute("width", "10");
+        repr->setAttribute("height", "10");
+        parent->appendChild(repr);
+        Inkscape::GC::release(repr);
+        return repr;
+    }
+    SPItem *item(Node *repr) {
+        return dynamic_cast<SPItem *>(_doc->getObjectByRepr(repr));
+    }
+    Geom::Rect areaAround(Node *repr) {
+        Geom::Rect area = *item(repr)->desktopVisualBounds();
+        area.expandBy(1);
+        return area;
+    }
+};
+
+// there is no desktop, so all queries take insensitive items
+TEST_F(ItemIndexTest, FollowsChanges) {
+    Node *group = _doc->getReprDoc()->createElement("svg:g");
+    _doc->getReprRoot()->appendChild(group);
+    Inkscape::GC::release(group);
+    Node *r1 = addRect(group, "0", "0");
+    Node *r2 = addRect(group, "1000", "1000");
+    _doc->ensureUpToDate();
+
+    Geom::Rect area = areaAround(r1);
+    std::vector<SPItem*> items = _doc->getItemsInBox(0, area, true, true);
+    ASSERT_EQ(1u, items.size());
+    EXPECT_EQ(item(r1), items[0]);
+    EXPECT_TRUE(_doc->getItemsInBox(0, area, true, false).empty());
+    items = _doc->getItemsPartiallyInBox(0, area, true, false);
+    ASSERT_EQ(1u, items.size());
+    EXPECT_EQ(item(group), items[0]);
+
+    // moved items are found at their new position only
+    r1->setAttribute("x", "500");
+    _doc->ensureUpToDate();
+    EXPECT_TRUE(_doc->getItemsInBox(0, area, true, true).empty());
+    Geom::Rect moved = areaAround(r1);
+    items = _doc->getItemsInBox(0, moved, true, true);
+    ASSERT_EQ(1u, items.size());
+    EXPECT_EQ(item(r1), items[0]);
+
+    // added items are found, in document order
+    Node *r3 = addRect(group, "500", "0");
+    Node *r4 = addRect(_doc->getReprRoot(), "500", "0");
+    _doc->ensureUpToDate();
+    items = _doc->getItemsInBox(0, moved, true, true);
+    ASSERT_EQ(3u, items.size());
+    EXPECT_EQ(item(r1), items[0]);
+    EXPECT_EQ(item(r3), items[1]);
+    EXPECT_EQ(item(r4), items[2]);
+
+    // deleted items are not
+    sp_repr_unparent(r1);
+    sp_repr_unparent(r4);
+    _doc->ensureUpToDate();
+    items = _doc->getItemsInBox(0, moved, true, true);
+    ASSERT_EQ(1u, items.size());
+    EXPECT_EQ(item(r3), items[0]);
+    EXPECT_TRUE(item(r2) != NULL);
+
+    sp_repr_unparent(group);
+    _doc->ensureUpToDate();
+}
+
+/*
+  Local Variables:
+  mode:c++
+  c-file-style:"stroustrup"
+  c-file-offsets:((innamespace . 0)(inline-open . 0)(case-label . +))
+  indent-tabs-mode:nil
+  fill-column:99
+  End:
+*/
+// vim: filetype=cpp:expandtab:shiftwidth=4:tabstop=8:softtabstop=4:fileencoding=utf-8:textwidth=99 :
@@ -0,0 +1,125 @@
+/*
+ * Unit tests for the vectorised Gaussian blur kernels.
+ *
+ * Copyright (C) 2018 Authors
+ *
+ * Released under GNU GPL, read the file 'COPYING' for more information
+ */
+
+#include "gtest/gtest.h"
+
+#include <algorithm>
+#include <cairo.h>
+#include <cstdlib>
+#include <cstring>
+#include <glib.h>
+#include <2geom/coord.h>
+
+#include "display/nr-filter-gaussian.h"
+
+using namespace Inkscape::Filters;
+
+namespace {
+
+/**
+ * Create a premultiplied ARGB32 surface with pseudo-random content, including
+ * flat areas which the scalar FIR kernel treats specially.
+ */
+cairo_surface_t *create_test_surface(int w, int h, unsigned seed)
+{
+    cairo_surface_t *s = cairo_image_surface_create(CAIRO_FORMAT_ARGB32, w, h);
+    unsigned char *data = cairo_image_surface_get_data(s);
+    int stride = cairo_image_surface_get_stride(s);
+    srand(seed);
+    for (int y = 0; y < h; ++y) {
+        guint32 *row = reinterpret_cast<guint32*>(data + y * stride);
+        for (int x = 0; x < w; ++x) {
+            if (y < h / 3 && x < w / 2) {
+                row[x] = 0x80402010;
+                continue;
+            }
+            guint32 a = rand() % 256;
+            guint32 r = a ? rand() % (a + 1) : 0;
+            guint32 g = a ? rand() % (a + 1) : 0;
+            guint32 b = a ? rand() % (a + 1) : 0;
+            row[x] = (a << 24) | (r << 16) | (g << 8) | b;
+        }
+    }
+    cairo_surface_mark_dirty(s);
+    return s;
+}
+
+cairo_surface_t *copy_surface(cairo_surface_t *src)
+{
+    int w = cairo_image_surface_get_width(src);
+    int h = cairo_image_surface_get_height(src);
+    cairo_surface_t *s = cairo_image_surface_create(CAIRO_FORMAT_ARGB32, w, h);
+    cairo_surface_flush(src);
+    memcpy(cairo_image_surface_get_data(s), cairo_image_surface_get_data(src),
+           cairo_image_surface_get_stride(src) * h);
+    cairo_surface_mark_dirty(s);
+    return s;
+}
+
+int max_difference(cairo_surface_t *a, cairo_surface_t *b)
+{
+    cairo_surface_flush(a);
+    cairo_surface_flush(b);
+    int h = cairo_image_surface_get_height(a);
+    int w = cairo_image_surface_get_width(a);
+    int stride = cairo_image_surface_get_stride(a);
+    unsigned char const *pa = cairo_image_surface_get_data(a);
+    unsigned char const *pb = cairo_image_surface_get_data(b);
+    int diff = 0;
+    for (int y = 0; y < h; ++y) {
+        for (int x = 0; x < w * 4; ++x) {
+            diff = std::max(diff, std::abs(pa[y * stride + x] - pb[y * stride + x]));
+        }
+    }
+    return diff;
+}
+
+void check_blur(bool iir, double deviation)
+{
+    // odd sizes exercise the tails of the vector loops
+    cairo_surface_t *reference = create_test_surface(67, 41, 7);
+    for (int simd = BLUR_SIMD_SSE2; simd <= blur_simd_supported(); ++simd) {
+        cairo_surface_t *scalar = copy_surface(reference);
+        cairo_surface_t *vector = copy_surface(reference);
+        blur_surface_axis(scalar, Geom::X, deviation, iir, BLUR_SIMD_NONE);
+        blur_surface_axis(scalar, Geom::Y, deviation, iir, BLUR_SIMD_NONE);
+        blur_surface_axis(vector, Geom::X, deviation, iir, simd);
+        blur_surface_axis(vector, Geom::Y, deviation, iir, simd);
+        EXPECT_LE(max_difference(scalar, vector), 1) << "simd level " << simd << ", deviation " << deviation;
+        cairo_surface_destroy(scalar);
+        cairo_surface_destroy(vector);
+    }
+    cairo_surface_destroy(reference);
+}
+
+} // namespace
+
+TEST(FilterGaussianTest, FIRMatchesScalar)
+{
+    check_blur(false, 0.4);
+    check_blur(false, 1.0);
+    check_blur(false, 2.5);
+}
+
+TEST(FilterGaussianTest, IIRMatchesScalar)
+{
+    check_blur(true, 3.5);
+    check_blur(true, 8.0);
+    check_blur(true, 20.0);
+}
+
+/*
+  Local Variables:
+  mode:c++
+  c-file-style:"stroustrup"
+  c-file-offsets:((innamespace . 0)(inline-open . 0))
+  indent-tabs-mode:nil
+  fill-column:99
+  End:
+*/
+// vim: filetype=cpp:expandtab:shiftwidth=4:tabstop=8:softtabstop=4:fileencoding=utf-8:textwidth=99 :
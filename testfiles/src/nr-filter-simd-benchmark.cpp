@@ -0,0 +1,138 @@
+/*
+ * Micro-benchmark of the vectorised filter pixel kernels against the scalar ones.
+ *
+ * Runs every kernel at each PIXEL_SIMD_* level the CPU supports on surfaces of
+ * common sizes, checks that all levels produce identical pixels, and prints the
+ * throughput. Exits with a non-zero status if any result differs.
+ *
+ * Copyright (C) 2018 Authors
+ *
+ * Released under GNU GPL, read the file 'COPYING' for more information
+ */
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+#include <glib.h>
+
+#include "display/nr-filter-simd.h"
+
+using namespace Inkscape::Filters;
+
+namespace {
+
+char const *const level_names[] = { "scalar", "sse2", "avx2" };
+
+struct Size {
+    int width;
+    int height;
+};
+
+Size const sizes[] = { {256, 256}, {1024, 1024}, {2048, 2048} };
+
+void fill_premultiplied(std::vector<guint32> &px, unsigned seed)
+{
+    srand(seed);
+    for (size_t i = 0; i < px.size(); ++i) {
+        guint32 a = rand() % 256;
+        guint32 r = rand() % (a + 1);
+        guint32 g = rand() % (a + 1);
+        guint32 b = rand() % (a + 1);
+        px[i] = (a << 24) | (r << 16) | (g << 8) | b;
+    }
+}
+
+enum Kernel {
+    KERNEL_COMPOSITE_ARITHMETIC,
+    KERNEL_COLOR_MATRIX,
+    KERNEL_HUE_ROTATE,
+    KERNEL_COUNT
+};
+
+char const *const kernel_names[] = { "composite-arithmetic", "colormatrix-matrix", "colormatrix-hue" };
+
+void run_kernel(int kernel, std::vector<guint32> const &in1, std::vector<guint32> const &in2,
+                std::vector<guint32> &out, int simd)
+{
+    // k1..k4 = 0.5, 0.25, 0.25, 0.1 and a sepia matrix, in the fixed point used by the filters
+    static gint32 const k[4] = { 128, 16256, 16256, 1658138 };
+    static gint32 const matrix[20] = {
+        100, 196,  48, 0, 0,
+         89, 175,  43, 0, 0,
+         69, 136,  33, 0, 0,
+          0,   0,   0, 255, 0 };
+    static gint32 const hue[9] = { 158, 168, -71, -17, 209, 63, 113, -62, 204 };
+
+    int n = out.size();
+    switch (kernel) {
+    case KERNEL_COMPOSITE_ARITHMETIC:
+        composite_arithmetic_span(&in1[0], &in2[0], &out[0], n, k, simd);
+        break;
+    case KERNEL_COLOR_MATRIX:
+        color_matrix_span(&in1[0], &out[0], n, matrix, simd);
+        break;
+    case KERNEL_HUE_ROTATE:
+        hue_rotate_span(&in1[0], &out[0], n, hue, simd);
+        break;
+    default:
+        break;
+    }
+}
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+    int repeats = argc > 1 ? atoi(argv[1]) : 10;
+    if (repeats < 1) repeats = 1;
+    int max_level = pixel_simd_supported();
+    bool identical = true;
+
+    printf("%-22s %-10s %-7s %12s %9s\n", "kernel", "size", "level", "Mpixel/s", "speedup");
+    for (size_t s = 0; s < G_N_ELEMENTS(sizes); ++s) {
+        size_t n = size_t(sizes[s].width) * sizes[s].height;
+        std::vector<guint32> in1(n), in2(n), reference(n), out(n);
+        fill_premultiplied(in1, 1);
+        fill_premultiplied(in2, 2);
+
+        for (int kernel = 0; kernel < KERNEL_COUNT; ++kernel) {
+            double scalar_rate = 0;
+            for (int level = PIXEL_SIMD_NONE; level <= max_level; ++level) {
+                std::vector<guint32> &result = level == PIXEL_SIMD_NONE ? reference : out;
+                run_kernel(kernel, in1, in2, result, level); // warm up
+                gint64 start = g_get_monotonic_time();
+                for (int r = 0; r < repeats; ++r) {
+                    run_kernel(kernel, in1, in2, result, level);
+                }
+                gint64 elapsed = std::max<gint64>(g_get_monotonic_time() - start, 1);
+                double rate = double(n) * repeats / elapsed;
+                if (level == PIXEL_SIMD_NONE) {
+                    scalar_rate = rate;
+                } else if (memcmp(&reference[0], &out[0], n * sizeof(guint32)) != 0) {
+                    fprintf(stderr, "%s: %s results differ from scalar\n",
+                            kernel_names[kernel], level_names[level]);
+                    identical = false;
+                }
+
+                char size[32];
+                g_snprintf(size, sizeof(size), "%dx%d", sizes[s].width, sizes[s].height);
+                printf("%-22s %-10s %-7s %12.1f %8.2fx\n", kernel_names[kernel], size,
+                       level_names[level], rate, rate / scalar_rate);
+            }
+        }
+    }
+    return identical ? 0 : 1;
+}
+
+/*
+  Local Variables:
+  mode:c++
+  c-file-style:"stroustrup"
+  c-file-offsets:((innamespace . 0)(inline-open . 0)(case-label . +))
+  indent-tabs-mode:nil
+  fill-column:99
+  End:
+*/
+// vim: filetype=cpp:expandtab:shiftwidth=4:tabstop=8:softtabstop=4:fileencoding=utf-8:textwidth=99 :
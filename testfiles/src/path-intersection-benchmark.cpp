@@ -0,0 +1,141 @@
+/*
+ * Benchmark of the sweepline path intersection in 2Geom.
+ *
+ * Builds random polylines of 10k to 100k segments and times
+ * PathVector::intersectSelf() and PathVector::intersect() against a test of all
+ * pairs of segments. The all-pairs test is only run on inputs up to the size
+ * given as the first argument (default 30000 segments), because it is quadratic.
+ * Exits with a non-zero status if the results differ.
+ *
+ * Copyright (C) 2018 Authors
+ *
+ * Released under GNU GPL, read the file 'COPYING' for more information
+ */
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+#include <glib.h>
+#include <2geom/path.h>
+#include <2geom/pathvector.h>
+
+namespace {
+
+std::size_t const sizes[] = { 10000, 30000, 100000 };
+
+/**
+ * A random walk of the given number of segments in a square whose area grows with the
+ * number of segments, so that every segment crosses a few others on average.
+ */
+Geom::Path random_polyline(std::size_t segments, unsigned seed)
+{
+    srand(seed);
+    double extent = 10 * sqrt(double(segments));
+    Geom::Point cur(extent / 2, extent / 2);
+    Geom::Path path(cur);
+    for (std::size_t i = 0; i < segments; ++i) {
+        Geom::Point next;
+        do {
+            next = cur + Geom::Point(rand() * 20.0 / RAND_MAX - 10, rand() * 20.0 / RAND_MAX - 10);
+        } while (next[Geom::X] < 0 || next[Geom::Y] < 0 || next[Geom::X] > extent || next[Geom::Y] > extent);
+        path.appendNew<Geom::LineSegment>(next);
+        cur = next;
+    }
+    return path;
+}
+
+/// Intersections of all pairs of segments, skipping the common nodes of neighbours.
+std::vector<Geom::PVIntersection> all_pairs(Geom::PathVector const &a, Geom::PathVector const &b, bool self)
+{
+    std::vector<Geom::PVIntersection> result;
+    Geom::Path const &pa = a[0], &pb = b[0];
+    for (std::size_t i = 0; i < pa.size(); ++i) {
+        Geom::Rect ra = pa[i].boundsFast();
+        for (std::size_t j = self ? i + 1 : 0; j < pb.size(); ++j) {
+            if (!ra.intersects(pb[j].boundsFast())) continue;
+            std::vector<Geom::CurveIntersection> cx = pa[i].intersect(pb[j]);
+            for (std::size_t k = 0; k < cx.size(); ++k) {
+                if (self && j == i + 1 && Geom::are_near(cx[k].point(), pa[i].finalPoint())) continue;
+                Geom::PathVectorTime ta(0, i, cx[k].first), tb(0, j, cx[k].second);
+                if (ta.t >= 1 && i + 1 < pa.size()) ta.normalizeForward(pa.size());
+                if (tb.t >= 1 && j + 1 < pb.size()) tb.normalizeForward(pb.size());
+                if (self && tb < ta) std::swap(ta, tb);
+                result.push_back(Geom::PVIntersection(ta, tb, cx[k].point()));
+            }
+        }
+    }
+    std::sort(result.begin(), result.end());
+    result.erase(std::unique(result.begin(), result.end()), result.end());
+    return result;
+}
+
+/// The intersection times may differ in the last bits depending on the order of the curves.
+bool same_intersections(std::vector<Geom::PVIntersection> const &a, std::vector<Geom::PVIntersection> const &b)
+{
+    if (a.size() != b.size()) return false;
+    for (std::size_t i = 0; i < a.size(); ++i) {
+        if (a[i].first.curve_index != b[i].first.curve_index ||
+            a[i].second.curve_index != b[i].second.curve_index ||
+            !Geom::are_near(a[i].first.t, b[i].first.t) ||
+            !Geom::are_near(a[i].second.t, b[i].second.t)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+double elapsed_ms(gint64 start)
+{
+    return (g_get_monotonic_time() - start) / 1000.0;
+}
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+    std::size_t max_all_pairs = argc > 1 ? atoi(argv[1]) : 30000;
+    bool identical = true;
+
+    printf("%-10s %10s %14s %14s %14s %9s\n", "test", "segments", "intersections",
+           "sweep ms", "all-pairs ms", "speedup");
+    for (std::size_t s = 0; s < G_N_ELEMENTS(sizes); ++s) {
+        Geom::PathVector a(random_polyline(sizes[s], 1));
+        Geom::PathVector b(random_polyline(sizes[s], 2));
+
+        for (int self = 1; self >= 0; --self) {
+            gint64 start = g_get_monotonic_time();
+            std::vector<Geom::PVIntersection> sweep = self ? a.intersectSelf() : a.intersect(b);
+            double sweep_ms = elapsed_ms(start);
+
+            char reference[32] = "-";
+            char speedup[32] = "-";
+            if (sizes[s] <= max_all_pairs) {
+                start = g_get_monotonic_time();
+                std::vector<Geom::PVIntersection> naive = all_pairs(a, self ? a : b, self);
+                double naive_ms = elapsed_ms(start);
+                g_snprintf(reference, sizeof(reference), "%.1f", naive_ms);
+                g_snprintf(speedup, sizeof(speedup), "%.1fx", naive_ms / std::max(sweep_ms, 0.001));
+                if (!same_intersections(sweep, naive)) {
+                    fprintf(stderr, "%s %zu: %zu intersections found by the sweep, %zu by all pairs\n",
+                            self ? "self" : "pairwise", sizes[s], sweep.size(), naive.size());
+                    identical = false;
+                }
+            }
+            printf("%-10s %10zu %14zu %14.1f %14s %9s\n", self ? "self" : "pairwise", sizes[s],
+                   sweep.size(), sweep_ms, reference, speedup);
+        }
+    }
+    return identical ? 0 : 1;
+}
+
+/*
+  Local Variables:
+  mode:c++
+  c-file-style:"stroustrup"
+  c-file-offsets:((innamespace . 0)(inline-open . 0)(case-label . +))
+  indent-tabs-mode:nil
+  fill-column:99
+  End:
+*/
+// vim: filetype=cpp:expandtab:shiftwidth=4:tabstop=8:softtabstop=4:fileencoding=utf-8:textwidth=99 :
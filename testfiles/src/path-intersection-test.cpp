@@ -0,0 +1,59 @@
+/*
+ * Intersections of paths
+ *
+ * Copyright (C) 2018 Authors
+ *
+ * Released under GNU GPL, read the file 'COPYING' for more information
+ */
+#include <gtest/gtest.h>
+#include <2geom/bezier-curve.h>
+#include <2geom/elliptical-arc.h>
+#include <2geom/path.h>
+#include <2geom/pathvector.h>
+
+// the two arcs of a circle meet at both of their nodes, which are no crossings
+TEST(PathIntersectionTest, TwoArcCircleHasNoSelfIntersection) {
+    Geom::Path circle(Geom::Point(1, 0));
+    circle.appendNew<Geom::EllipticalArc>(1, 1, 0, false, true, Geom::Point(-1, 0));
+    circle.appendNew<Geom::EllipticalArc>(1, 1, 0, false, true, Geom::Point(1, 0));
+    circle.close();
+    ASSERT_EQ(2u, circle.size());
+
+    EXPECT_TRUE(circle.intersectSelf().empty());
+    EXPECT_TRUE(Geom::PathVector(circle).intersectSelf().empty());
+}
+
+// the same for two curves that do not lie on one circle
+TEST(PathIntersectionTest, LensHasNoSelfIntersection) {
+    Geom::Path lens(Geom::Point(0, 0));
+    lens.appendNew<Geom::CubicBezier>(Geom::Point(1, 1), Geom::Point(2, 1), Geom::Point(3, 0));
+    lens.appendNew<Geom::CubicBezier>(Geom::Point(2, -1), Geom::Point(1, -1), Geom::Point(0, 0));
+    lens.close();
+    ASSERT_EQ(2u, lens.size());
+
+    EXPECT_TRUE(lens.intersectSelf().empty());
+    EXPECT_TRUE(Geom::PathVector(lens).intersectSelf().empty());
+}
+
+TEST(PathIntersectionTest, CrossingPolylineIntersectsItself) {
+    Geom::Path bowtie(Geom::Point(0, 0));
+    bowtie.appendNew<Geom::LineSegment>(Geom::Point(2, 2));
+    bowtie.appendNew<Geom::LineSegment>(Geom::Point(2, 0));
+    bowtie.appendNew<Geom::LineSegment>(Geom::Point(0, 2));
+    bowtie.close();
+
+    std::vector<Geom::PathIntersection> xs = bowtie.intersectSelf();
+    ASSERT_EQ(1u, xs.size());
+    EXPECT_TRUE(Geom::are_near(xs[0].point(), Geom::Point(1, 1)));
+}
+
+/*
+  Local Variables:
+  mode:c++
+  c-file-style:"stroustrup"
+  c-file-offsets:((innamespace . 0)(inline-open . 0)(case-label . +))
+  indent-tabs-mode:nil
+  fill-column:99
+  End:
+*/
+// vim: filetype=cpp:expandtab:shiftwidth=4:tabstop=8:softtabstop=4:fileencoding=utf-8:textwidth=99 :
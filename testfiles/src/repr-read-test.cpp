@@ -0,0 +1,64 @@
+/*
+ * Reading XML documents
+ *
+ * Copyright (C) 2018 Authors
+ *
+ * Released under GNU GPL, read the file 'COPYING' for more information
+ */
+#include <cstring>
+#include <gtest/gtest.h>
+
+#include "xml/repr.h"
+
+namespace {
+
+Inkscape::XML::Document *read(char const *svg)
+{
+    return sp_repr_read_mem(svg, strlen(svg), SP_SVG_NS_URI);
+}
+
+} // namespace
+
+// the space between the tspans is text of its own, which must not be lost
+TEST(ReprReadTest, KeepsWhitespaceUnderPreserve) {
+    Inkscape::XML::Document *doc = read("<svg xmlns=\"http://www.w3.org/2000/svg\">"
+                                        "<text xml:space=\"preserve\"><tspan>a</tspan> <tspan>b</tspan></text>"
+                                        "</svg>");
+    ASSERT_TRUE(doc != NULL);
+    Inkscape::XML::Node *text = doc->root()->firstChild();
+    ASSERT_TRUE(text != NULL);
+    ASSERT_EQ(3u, text->childCount());
+    Inkscape::XML::Node *space = text->nthChild(1);
+    EXPECT_EQ(Inkscape::XML::TEXT_NODE, space->type());
+    EXPECT_STREQ(" ", space->content());
+    Inkscape::GC::release(doc);
+}
+
+TEST(ReprReadTest, DropsWhitespaceOtherwise) {
+    Inkscape::XML::Document *doc = read("<svg xmlns=\"http://www.w3.org/2000/svg\">\n"
+                                        "  <text><tspan>a</tspan> <tspan>b</tspan></text>\n"
+                                        "  <g xml:space=\"preserve\"> <text xml:space=\"default\">"
+                                        "<tspan>a</tspan> <tspan>b</tspan></text></g>\n"
+                                        "</svg>");
+    ASSERT_TRUE(doc != NULL);
+    Inkscape::XML::Node *root = doc->root();
+    ASSERT_EQ(2u, root->childCount());
+    EXPECT_EQ(2u, root->firstChild()->childCount());
+    Inkscape::XML::Node *group = root->nthChild(1);
+    // the group keeps its space, the text inside it does not
+    ASSERT_EQ(2u, group->childCount());
+    EXPECT_STREQ(" ", group->firstChild()->content());
+    EXPECT_EQ(2u, group->nthChild(1)->childCount());
+    Inkscape::GC::release(doc);
+}
+
+/*
+  Local Variables:
+  mode:c++
+  c-file-style:"stroustrup"
+  c-file-offsets:((innamespace . 0)(inline-open . 0)(case-label . +))
+  indent-tabs-mode:nil
+  fill-column:99
+  End:
+*/
+// vim: filetype=cpp:expandtab:shiftwidth=4:tabstop=8:softtabstop=4:fileencoding=utf-8:textwidth=99 :
@@ -0,0 +1,90 @@
+/*
+ * Saving XML documents to files
+ *
+ * Copyright (C) 2018 Authors
+ *
+ * Released under GNU GPL, read the file 'COPYING' for more information
+ */
+#include <cstdio>
+#include <string>
+#include <gtest/gtest.h>
+#include <glib.h>
+
+#include "io/gzipstream.h"
+#include "io/uristream.h"
+#include "xml/repr.h"
+
+namespace {
+
+/// A drawing with enough children of the root to be serialized in parallel
+Inkscape::XML::Document *make_document()
+{
+    std::string svg = "<svg xmlns=\"http://www.w3.org/2000/svg\" xmlns:xlink=\"http://www.w3.org/1999/xlink\">\n"
+                      "  <!-- groups -->\n"
+                      "  <defs><linearGradient id=\"grad\"/></defs>\n";
+    for (int i = 0; i < 500; ++i) {
+        gchar *group = g_strdup_printf("  <g id=\"g%d\"><rect width=\"%d\" style=\"fill:url(#grad)\"/>"
+                                       "<text xml:space=\"preserve\"> a &amp; &lt;%d&gt; </text>"
+                                       "<![CDATA[x < y]]><?pi data?></g>\n", i, i, i);
+        svg += group;
+        g_free(group);
+    }
+    svg += "</svg>\n";
+    return sp_repr_read_mem(svg.c_str(), svg.size(), SP_SVG_NS_URI);
+}
+
+std::string read_file(FILE *fp)
+{
+    std::string bytes;
+    char buf[4096];
+    size_t len;
+    rewind(fp);
+    while ((len = fread(buf, 1, sizeof(buf), fp)) > 0) {
+        bytes.append(buf, len);
+    }
+    return bytes;
+}
+
+} // namespace
+
+// the bytes are those the stream writer of sp_repr_save_buf() would write
+TEST(ReprSaveTest, SameBytesAsWriter) {
+    Inkscape::XML::Document *doc = make_document();
+    ASSERT_TRUE(doc != NULL);
+    std::string expected = sp_repr_save_buf(doc).raw();
+
+    FILE *fp = tmpfile();
+    ASSERT_TRUE(fp != NULL);
+    sp_repr_save_stream(doc, fp, SP_INKSCAPE_NS_URI);
+    EXPECT_EQ(expected, read_file(fp));
+    fclose(fp);
+
+    FILE *expected_fp = tmpfile();
+    ASSERT_TRUE(expected_fp != NULL);
+    {
+        Inkscape::URI dummy("x");
+        Inkscape::IO::UriOutputStream bout(expected_fp, dummy);
+        Inkscape::IO::GzipOutputStream gout(bout);
+        Inkscape::IO::OutputStreamWriter out(gout);
+        out.writeString(expected.c_str());
+    }
+    fp = tmpfile();
+    ASSERT_TRUE(fp != NULL);
+    sp_repr_save_stream(doc, fp, SP_INKSCAPE_NS_URI, true);
+    EXPECT_EQ(read_file(expected_fp), read_file(fp));
+    fclose(fp);
+    fclose(expected_fp);
+
+    Inkscape::GC::release(doc);
+}
+
+/*
+  Local Variables:
+  mode:c++
+  c-file-style:"stroustrup"
+  c-file-offsets:((innamespace . 0)(inline-open . 0)(case-label . +))
+  indent-tabs-mode:nil
+  fill-column:99
+  End:
+*/
+// vim: filetype=cpp:expandtab:shiftwidth=4:tabstop=8:softtabstop=4:fileencoding=utf-8:textwidth=99 :
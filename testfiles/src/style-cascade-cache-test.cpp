@@ -0,0 +1,142 @@
+/*
+ * Matching style sheet selectors through the style cascade cache
+ *
+ * Copyright (C) 2018 Authors
+ *
+ * Released under GNU GPL, read the file 'COPYING' for more information
+ */
+#include <string>
+#include <utility>
+#include <vector>
+#include <gtest/gtest.h>
+#include <doc-per-case-test.h>
+
+#include "attributes.h"
+#include "libcroco/cr-sel-eng.h"
+#include "style-cascade-cache.h"
+#include "svg/css-ostringstream.h"
+#include "xml/croco-node-iface.h"
+#include "xml/node.h"
+
+using namespace Inkscape;
+using namespace Inkscape::XML;
+
+namespace {
+
+typedef std::vector<std::pair<unsigned, std::string> > Declarations;
+
+/// Rules of all kinds of selectors, cascading into each other
+char const *const RULES =
+    "rect { fill: red; stroke: blue }\n"
+    ".a { fill: green }\n"
+    ".a.b, #r2 { stroke-width: 2 !important; fill: yellow }\n"
+    "g > rect.b { stroke-width: 3 }\n"
+    "svg g .c { opacity: 0.5 }\n"
+    "rect:first-child { stroke: black }\n"
+    "rect + rect { font-size: 20px }\n"
+    "[id=r3] { fill: navy !important }\n"
+    "* { stroke-linecap: round }\n";
+
+} // namespace
+
+class StyleCascadeCacheTest : public DocPerCaseTest {
+public:
+    StyleCascadeCacheTest()
+        : _sel_eng(cr_sel_eng_new())
+    {
+        cr_sel_eng_set_node_iface(_sel_eng, &croco_node_iface);
+    }
+    ~StyleCascadeCacheTest()
+    {
+        cr_sel_eng_destroy(_sel_eng);
+    }
+
+    /// What SPStyle read from cr_sel_eng_get_matched_properties_from_cascade()
+    Declarations expected(SPDocument *doc, Node *node) {
+        Declarations decls;
+        CRPropList *props = NULL;
+        cr_sel_eng_get_matched_properties_from_cascade(_sel_eng, doc->style_cascade, node, &props);
+        std::vector<CRDeclaration *> list;
+        for (CRPropList *p = props; p; p = cr_prop_list_get_next(p)) {
+            CRDeclaration *decl = NULL;
+            cr_prop_list_get_decl(p, &decl);
+            list.push_back(decl);
+        }
+        for (std::vector<CRDeclaration *>::reverse_iterator i = list.rbegin(); i != list.rend(); ++i) {
+            unsigned prop_idx = sp_attribute_lookup((*i)->property->stryng->str);
+            if (prop_idx != SP_ATTR_INVALID) {
+                gchar *value = reinterpret_cast<gchar *>(cr_term_to_string((*i)->value));
+                CSSOStringStream os;
+                os << value << ((*i)->important ? " !important" : "");
+                decls.push_back(std::make_pair(prop_idx, os.str()));
+                g_free(value);
+            }
+        }
+        if (props) {
+            cr_prop_list_destroy(props);
+        }
+        return decls;
+    }
+
+    Declarations matched(SPDocument *doc, Node *node) {
+        Declarations decls;
+        std::vector<StyleCascadeCache::Declaration const *> const &found =
+            doc->getStyleCascadeCache().match(_sel_eng, node);
+        for (std::vector<StyleCascadeCache::Declaration const *>::const_iterator i = found.begin();
+             i != found.end(); ++i) {
+            decls.push_back(std::make_pair((*i)->prop_idx, (*i)->value));
+        }
+        return decls;
+    }
+
+    /// Compares the declarations of all elements below node, and returns how many had any
+    unsigned compare(SPDocument *doc, Node *node) {
+        unsigned styled = 0;
+        for (Node *child = node->firstChild(); child; child = child->next()) {
+            if (child->type() == ELEMENT_NODE) {
+                Declarations decls = expected(doc, child);
+                EXPECT_EQ(decls, matched(doc, child)) << child->name() << " " << (child->attribute("id") ? child->attribute("id") : "");
+                styled += !decls.empty();
+            }
+            styled += compare(doc, child);
+        }
+        return styled;
+    }
+
+protected:
+    CRSelEng *_sel_eng;
+};
+
+TEST_F(StyleCascadeCacheTest, SameDeclarationsAsLibcroco) {
+    std::string svg = std::string("<svg xmlns=\"http://www.w3.org/2000/svg\"><style id=\"style\">") + RULES + "</style>";
+    for (int i = 0; i < 20; ++i) {
+        svg += "<g class=\"c\"><rect id=\"r1\" class=\"a\"/><rect id=\"r2\" class=\"a b\"/>"
+               "<rect id=\"r3\" class=\"b\"/><g><circle class=\"c\"/><rect class=\"aab\"/></g></g>";
+    }
+    svg += "</svg>";
+    SPDocument *doc = SPDocument::createNewDocFromMem(svg.c_str(), svg.size(), false);
+    ASSERT_TRUE(doc != NULL);
+
+    // twice, to compare matches computed and taken from the cache
+    EXPECT_LT(0u, compare(doc, doc->getReprRoot()));
+    EXPECT_LT(0u, compare(doc, doc->getReprRoot()));
+
+    // changing the style sheet invalidates the cache
+    Node *style = doc->getObjectById("style")->getRepr();
+    ASSERT_TRUE(style->firstChild() != NULL);
+    style->firstChild()->setContent(".b { fill: purple } rect .c, g > .c { opacity: 0.25 }");
+    EXPECT_LT(0u, compare(doc, doc->getReprRoot()));
+
+    doc->doUnref();
+}
+
+/*
+  Local Variables:
+  mode:c++
+  c-file-style:"stroustrup"
+  c-file-offsets:((innamespace . 0)(inline-open . 0)(case-label . +))
+  indent-tabs-mode:nil
+  fill-column:99
+  End:
+*/
+// vim: filetype=cpp:expandtab:shiftwidth=4:tabstop=8:softtabstop=4:fileencoding=utf-8:textwidth=99 :
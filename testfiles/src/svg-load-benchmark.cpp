@@ -0,0 +1,150 @@
+/*
+ * Benchmark of reading SVG files into Inkscape::XML documents.
+ *
+ * Writes a generated drawing of the given number of groups (default 100000) to a
+ * temporary file, and reads it in separate processes with sp_repr_read_file(), which
+ * builds the nodes from SAX events, and with the libxml2 tree copied by
+ * sp_repr_do_read(). Reports the time and the peak resident set size of each.
+ * Exits with a non-zero status if the documents differ.
+ *
+ * Copyright (C) 2018 Authors
+ *
+ * Released under GNU GPL, read the file 'COPYING' for more information
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <libxml/parser.h>
+#ifndef G_OS_WIN32
+#include <sys/resource.h>
+#endif
+
+#include "inkgc/gc-core.h"
+#include "xml/repr.h"
+
+Inkscape::XML::Document *sp_repr_do_read(xmlDocPtr doc, const gchar *default_ns);
+
+namespace {
+
+/// Groups of a path, a rectangle with a gradient reference, and a line of text
+void write_drawing(FILE *fp, unsigned groups)
+{
+    srand(1);
+    fprintf(fp, "<?xml version=\"1.0\" encoding=\"UTF-8\" standalone=\"no\"?>\n"
+                "<svg xmlns=\"http://www.w3.org/2000/svg\" xmlns:xlink=\"http://www.w3.org/1999/xlink\"\n"
+                "   xmlns:inkscape=\"http://www.inkscape.org/namespaces/inkscape\"\n"
+                "   width=\"1000\" height=\"1000\" version=\"1.1\">\n"
+                "  <!-- generated by svg-load-benchmark -->\n"
+                "  <defs><linearGradient id=\"grad\"><stop offset=\"0\" style=\"stop-color:#000\"/></linearGradient></defs>\n");
+    for (unsigned i = 0; i < groups; ++i) {
+        int x = rand() % 1000, y = rand() % 1000;
+        fprintf(fp, "  <g id=\"g%u\" inkscape:label=\"Group %u\" transform=\"translate(%d,%d)\">\n"
+                    "    <path d=\"M 0,0 C %d,%d %d,%d 10,10 Z\" style=\"fill:#%06x;stroke:none\"/>\n"
+                    "    <rect x=\"0\" y=\"0\" width=\"%d\" height=\"%d\" style=\"fill:url(#grad)\"/>\n"
+                    "    <text xml:space=\"preserve\" x=\"0\" y=\"12\"><tspan>Label &amp; %u</tspan></text>\n"
+                    "  </g>\n",
+                i, i, x, y, rand() % 20, rand() % 20, rand() % 20, rand() % 20, rand() % 0x1000000,
+                rand() % 50 + 1, rand() % 50 + 1, i);
+    }
+    fprintf(fp, "</svg>\n");
+}
+
+long peak_rss_kb()
+{
+#ifndef G_OS_WIN32
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) == 0) {
+        return usage.ru_maxrss;
+    }
+#endif
+    return -1;
+}
+
+/// Reads the file and prints the time, the peak RSS and a hash of the saved document
+int load(char const *mode, char const *filename)
+{
+    Inkscape::GC::init();
+    long base_kb = peak_rss_kb();
+    gint64 start = g_get_monotonic_time();
+
+    Inkscape::XML::Document *doc = NULL;
+    if (!strcmp(mode, "sax")) {
+        doc = sp_repr_read_file(filename, SP_SVG_NS_URI);
+    } else {
+        xmlSubstituteEntitiesDefault(1);
+        xmlDocPtr xml = xmlReadFile(filename, NULL, XML_PARSE_HUGE | XML_PARSE_RECOVER | XML_PARSE_NONET);
+        doc = sp_repr_do_read(xml, SP_SVG_NS_URI);
+        if (xml) {
+            xmlFreeDoc(xml);
+        }
+    }
+
+    double ms = (g_get_monotonic_time() - start) / 1000.0;
+    long peak_kb = peak_rss_kb();
+    if (!doc) {
+        return 1;
+    }
+    printf("%.1f %ld %ld %u\n", ms, base_kb, peak_kb, g_str_hash(sp_repr_save_buf(doc).c_str()));
+    return 0;
+}
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+    if (argc == 4 && !strcmp(argv[1], "--load")) {
+        return load(argv[2], argv[3]);
+    }
+    unsigned groups = argc > 1 ? atoi(argv[1]) : 100000;
+
+    gchar *filename = NULL;
+    gint fd = g_file_open_tmp("svg-load-benchmark-XXXXXX.svg", &filename, NULL);
+    if (fd < 0) {
+        fprintf(stderr, "cannot create a temporary file\n");
+        return 1;
+    }
+    FILE *fp = fdopen(fd, "w");
+    write_drawing(fp, groups);
+    fclose(fp);
+
+    printf("%-18s %10s %12s %12s\n", "loader", "ms", "peak KiB", "+KiB");
+    char const *modes[] = { "dom", "sax" };
+    unsigned hashes[2] = { 0, 1 };
+    for (unsigned m = 0; m < G_N_ELEMENTS(modes); ++m) {
+        char *child_argv[] = { argv[0], const_cast<char *>("--load"), const_cast<char *>(modes[m]), filename, NULL };
+        gchar *out = NULL;
+        gint status = 0;
+        double ms = 0;
+        long base_kb = 0, peak_kb = 0;
+        if (!g_spawn_sync(NULL, child_argv, NULL, G_SPAWN_DEFAULT, NULL, NULL, &out, NULL, &status, NULL) ||
+            status != 0 || sscanf(out, "%lf %ld %ld %u", &ms, &base_kb, &peak_kb, &hashes[m]) != 4) {
+            fprintf(stderr, "%s: loading failed\n", modes[m]);
+            hashes[m] = m;
+        }
+        g_free(out);
+        printf("%-18s %10.1f %12ld %12ld\n", m ? "SAX (Inkscape)" : "libxml2 tree", ms, peak_kb, peak_kb - base_kb);
+    }
+
+    g_unlink(filename);
+    g_free(filename);
+    if (hashes[0] != hashes[1]) {
+        fprintf(stderr, "the documents differ\n");
+        return 1;
+    }
+    return 0;
+}
+
+/*
+  Local Variables:
+  mode:c++
+  c-file-style:"stroustrup"
+  c-file-offsets:((innamespace . 0)(inline-open . 0)(case-label . +))
+  indent-tabs-mode:nil
+  fill-column:99
+  End:
+*/
+// vim: filetype=cpp:expandtab:shiftwidth=4:tabstop=8:softtabstop=4:fileencoding=utf-8:textwidth=99 :